@@ -598,6 +598,48 @@ _finished:
     return success;
 }
 
+static gboolean
+_handle_stats ()
+{
+    GError *error = NULL;
+    GDBusConnection *connection = NULL;
+    TlmDbusLogin *login_object = NULL;
+    gchar *metrics = NULL;
+    gboolean success = FALSE;
+
+    connection = _get_root_socket_bus_connection (&error);
+    if (connection == NULL) {
+        WARN("failed to get bus connection : error %s",
+            error ? error->message : "(null)");
+        goto _finished;
+    }
+
+    login_object = _get_login_object (connection, &error);
+    if (login_object == NULL) {
+        WARN("failed to get login object : error %s",
+            error ? error->message : "(null)");
+        goto _finished;
+    }
+
+    tlm_dbus_login_call_get_metrics_sync (login_object, &metrics, NULL,
+            &error);
+    if (error) {
+        WARN ("get metrics failed with error: %d:%s", error->code,
+                error->message);
+    } else {
+        g_print ("%s", metrics);
+        success = TRUE;
+    }
+    g_free (metrics);
+
+_finished:
+    if (error) g_error_free (error);
+    if (login_object) g_object_unref (login_object);
+    if (connection) g_object_unref (connection);
+
+    return success;
+}
+
 int main (int argc, char *argv[])
 {
     GError *error = NULL;
@@ -610,6 +652,7 @@ int main (int argc, char *argv[])
     gboolean run_tlm_daemon = FALSE;
     gboolean is_launch_proc_op = FALSE;
     gboolean is_stop_proc_op = FALSE;
+    gboolean is_stats_op = FALSE;
     GOptionGroup* user_option = NULL;
     GOptionGroup* launcher_option = NULL;
     TlmLoginManager *login_mgr = NULL;
@@ -633,6 +676,9 @@ int main (int argc, char *argv[])
         { "stop-proc", 'p', 0, G_OPTION_ARG_NONE, &is_stop_proc_op,
                 "stop process -- sessionid and pid are mandatory",
                 NULL },
+        { "stats", 'm', 0, G_OPTION_ARG_NONE, &is_stats_op,
+                "print the daemon metrics in the Prometheus text format",
+                NULL },
         { "run-daemon", 'r', 0, G_OPTION_ARG_NONE, &run_tlm_daemon,
                 "run tlm daemon (by default tlm daemon is not run)",
                 NULL },
@@ -716,6 +762,8 @@ int main (int argc, char *argv[])
         rval = _handle_launch_process (launcher);
     } else if (is_stop_proc_op) {
         rval = _handle_stop_process (launcher);
+    } else if (is_stats_op) {
+        rval = _handle_stats ();
     } else {
         WARN ("No option specified");
         rval = FALSE;
@@ -192,4 +192,91 @@
  */
 #define TLM_CONFIG_GENERAL_SESSION_TYPE     "SESSION_TYPE"
 
+/**
+ * TLM_CONFIG_GENERAL_SESSIOND_POOL_SIZE
+ *
+ * Number of tlm-sessiond instances to keep spawned and connected per seat,
+ * ready to be used for the next login. Default value: 0 (disabled)
+ *
+ * Can be overridden in seat specific group. Pooled instances read their own
+ * configuration when they are spawned.
+ */
+#define TLM_CONFIG_GENERAL_SESSIOND_POOL_SIZE "SESSIOND_POOL_SIZE"
+
+/**
+ * TLM_CONFIG_GENERAL_SESSION_CGROUP
+ *
+ * Path of a cgroup v2 directory delegated to tlm. When set, every user
+ * session is placed in its own cgroup below it and torn down with
+ * cgroup.kill, so processes escaping the session's process group don't
+ * survive logout. Requires Linux 5.14 or newer; sessions fall back to
+ * process group signalling when the cgroup cannot be used.
+ */
+#define TLM_CONFIG_GENERAL_SESSION_CGROUP   "SESSION_CGROUP"
+
+/**
+ * TLM_CONFIG_GENERAL_CGROUP_KILL_TIMEOUT
+ *
+ * Time in milliseconds a session in a cgroup is given to exit after SIGHUP
+ * before the whole cgroup is killed. Default value: TERMINATE_TIMEOUT
+ */
+#define TLM_CONFIG_GENERAL_CGROUP_KILL_TIMEOUT "CGROUP_KILL_TIMEOUT"
+
+/**
+ * TLM_CONFIG_GENERAL_UTMP_HOST_ADDRESS
+ *
+ * Numeric IPv4 or IPv6 address recorded in utmp/wtmp login entries. When
+ * set, the local host name is not resolved at all; a value that is not an
+ * address leaves the field empty. Default: address of the host name,
+ * resolved in the background when tlm-sessiond starts
+ */
+#define TLM_CONFIG_GENERAL_UTMP_HOST_ADDRESS "UTMP_HOST_ADDRESS"
+
+/**
+ * TLM_CONFIG_GENERAL_WATCH_CONFIG
+ *
+ * Reload the configuration when the configuration file changes, in addition
+ * to on SIGHUP. Value type: boolean. Default value: FALSE
+ */
+#define TLM_CONFIG_GENERAL_WATCH_CONFIG     "WATCH_CONFIG"
+
+/**
+ * TLM_CONFIG_GENERAL_RELOAD_RELOGIN
+ *
+ * When the configuration is reloaded, terminate the sessions of seats whose
+ * settings changed so that they log in again with the new settings. When
+ * unset, running sessions keep the settings they were started with.
+ * Value type: boolean. Default value: FALSE
+ */
+#define TLM_CONFIG_GENERAL_RELOAD_RELOGIN   "RELOAD_RELOGIN"
+
+/**
+ * TLM_CONFIG_GENERAL_WATCHDOG_THRESHOLD
+ *
+ * Time in milliseconds a single main loop dispatch of the daemon may take
+ * before it is logged as a stall and counted in the
+ * tlm_mainloop_stalls_total metric. Default value: 0 (disabled)
+ */
+#define TLM_CONFIG_GENERAL_WATCHDOG_THRESHOLD "WATCHDOG_THRESHOLD"
+
+/**
+ * TLM_CONFIG_GENERAL_THROTTLE_RELOGIN
+ *
+ * Delay logins on a seat by 10 seconds when more than three follow each
+ * other within a second, to keep a failing session from respawning in a
+ * tight loop. Load tests turn this off. Value type: boolean.
+ * Default value: TRUE
+ */
+#define TLM_CONFIG_GENERAL_THROTTLE_RELOGIN "THROTTLE_RELOGIN"
+
+/**
+ * TLM_CONFIG_GENERAL_REQUEST_TRACE
+ *
+ * File to record the D-Bus login, logout and switch requests to, with
+ * their timing and outcome and the user names anonymized, for replaying
+ * them with tlm-bench --replay. The file is truncated when tlm starts or
+ * the path changes on reload. Default value: unset (not recorded)
+ */
+#define TLM_CONFIG_GENERAL_REQUEST_TRACE    "REQUEST_TRACE"
+
 #endif /* __TLM_GENERAL_CONFIG_H_ */
@@ -0,0 +1,607 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "tlm-config-image.h"
+#include "tlm-log.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC         0x0001U
+#define MFD_ALLOW_SEALING   0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS         (1024 + 9)
+#define F_GET_SEALS         (1024 + 10)
+#define F_SEAL_SEAL         0x0001
+#define F_SEAL_SHRINK       0x0002
+#define F_SEAL_GROW         0x0004
+#define F_SEAL_WRITE        0x0008
+#endif
+
+#define TLM_CONFIG_IMAGE_MAGIC      "TLMCIMG"
+#define TLM_CONFIG_IMAGE_VERSION    1
+#define TLM_CONFIG_IMAGE_SEALS \
+        (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)
+
+/* A read-only snapshot of all configuration groups, laid out so that it can
+ * be used straight from a mapping: a header, the groups sorted by name, the
+ * key/value entries of each group sorted by key and a pool of NUL terminated
+ * strings. All references are offsets from the start of the image, 0 stands
+ * for a NULL value. The image always lives in a sealed memfd, so it can be
+ * handed to child processes which map it without parsing anything and
+ * without having to trust the sender not to change it underneath them. */
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 size;
+    guint32 n_groups;
+    guint32 groups_offset;
+    /* identity of the file the image was built from, for the disk cache */
+    guint64 source_dev;
+    guint64 source_ino;
+    guint64 source_size;
+    gint64 source_mtime_sec;
+    gint64 source_mtime_nsec;
+} TlmConfigImageHeader;
+
+typedef struct {
+    guint32 name;
+    guint32 n_entries;
+    guint32 entries_offset;
+} TlmConfigImageGroup;
+
+typedef struct {
+    guint32 key;
+    guint32 value;
+} TlmConfigImageEntry;
+
+struct _TlmConfigImage
+{
+    gint fd;
+    const guint8 *data;
+    gsize size;
+};
+
+static int
+_memfd_create (const char *name, unsigned int flags)
+{
+#ifdef SYS_memfd_create
+    return syscall (SYS_memfd_create, name, flags);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static const TlmConfigImageHeader *
+_header (TlmConfigImage *image)
+{
+    return (const TlmConfigImageHeader *) image->data;
+}
+
+static const TlmConfigImageGroup *
+_groups (TlmConfigImage *image)
+{
+    return (const TlmConfigImageGroup *) (image->data +
+            _header (image)->groups_offset);
+}
+
+static const TlmConfigImageEntry *
+_entries (TlmConfigImage *image, const TlmConfigImageGroup *group)
+{
+    return (const TlmConfigImageEntry *) (image->data +
+            group->entries_offset);
+}
+
+static const gchar *
+_string (TlmConfigImage *image, guint32 offset)
+{
+    return offset ? (const gchar *) (image->data + offset) : NULL;
+}
+
+static void
+_set_source (TlmConfigImageHeader *header, const struct stat *source)
+{
+    if (!source)
+        return;
+    header->source_dev = source->st_dev;
+    header->source_ino = source->st_ino;
+    header->source_size = source->st_size;
+    header->source_mtime_sec = source->st_mtim.tv_sec;
+    header->source_mtime_nsec = source->st_mtim.tv_nsec;
+}
+
+static gboolean
+_is_source_same (const TlmConfigImageHeader *header, const struct stat *source)
+{
+    return header->source_dev == (guint64) source->st_dev &&
+           header->source_ino == (guint64) source->st_ino &&
+           header->source_size == (guint64) source->st_size &&
+           header->source_mtime_sec == (gint64) source->st_mtim.tv_sec &&
+           header->source_mtime_nsec == (gint64) source->st_mtim.tv_nsec;
+}
+
+/* Checks that every reference points inside the image and that the image
+ * ends in a NUL, so no lookup can read past the end whatever the content. */
+static gboolean
+_validate (const guint8 *data, gsize size)
+{
+    const TlmConfigImageHeader *header = (const TlmConfigImageHeader *) data;
+    const TlmConfigImageGroup *groups;
+    guint32 i, j;
+
+    if (size < sizeof (*header) || size > G_MAXUINT32 ||
+        data[size - 1] != '\0')
+        return FALSE;
+    if (memcmp (header->magic, TLM_CONFIG_IMAGE_MAGIC,
+                sizeof (header->magic)) != 0 ||
+        header->version != TLM_CONFIG_IMAGE_VERSION ||
+        header->size != size)
+        return FALSE;
+    if (header->groups_offset % sizeof (guint32) != 0 ||
+        (guint64) header->groups_offset +
+        (guint64) header->n_groups * sizeof (TlmConfigImageGroup) > size)
+        return FALSE;
+
+    groups = (const TlmConfigImageGroup *) (data + header->groups_offset);
+    for (i = 0; i < header->n_groups; i++) {
+        const TlmConfigImageEntry *entries;
+
+        if (groups[i].name == 0 || groups[i].name >= size ||
+            groups[i].entries_offset % sizeof (guint32) != 0 ||
+            (guint64) groups[i].entries_offset +
+            (guint64) groups[i].n_entries * sizeof (TlmConfigImageEntry) >
+            size)
+            return FALSE;
+
+        entries = (const TlmConfigImageEntry *) (data +
+                groups[i].entries_offset);
+        for (j = 0; j < groups[i].n_entries; j++) {
+            if (entries[j].key == 0 || entries[j].key >= size ||
+                entries[j].value >= size)
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static gboolean
+_write_all (gint fd, const guint8 *data, gsize size)
+{
+    while (size > 0) {
+        ssize_t n = write (fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        data += n;
+        size -= n;
+    }
+    return TRUE;
+}
+
+static TlmConfigImage *
+_map (gint fd)
+{
+    TlmConfigImage *image = NULL;
+    struct stat st;
+    void *data;
+
+    if (fstat (fd, &st) < 0 || st.st_size <= 0) {
+        WARN ("invalid config image descriptor %d", fd);
+        return NULL;
+    }
+
+    data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        WARN ("mmap(config image): %s", strerror (errno));
+        return NULL;
+    }
+
+    if (!_validate (data, st.st_size)) {
+        WARN ("corrupted config image");
+        munmap (data, st.st_size);
+        return NULL;
+    }
+
+    image = g_slice_new0 (TlmConfigImage);
+    image->fd = fd;
+    image->data = data;
+    image->size = st.st_size;
+    return image;
+}
+
+static TlmConfigImage *
+_new_from_data (const guint8 *data, gsize size)
+{
+    TlmConfigImage *image = NULL;
+    gint fd;
+
+    fd = _memfd_create ("tlm-config", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        DBG ("memfd_create(): %s", strerror (errno));
+        return NULL;
+    }
+
+    if (!_write_all (fd, data, size) ||
+        fcntl (fd, F_ADD_SEALS, TLM_CONFIG_IMAGE_SEALS) < 0) {
+        WARN ("failed to write config image: %s", strerror (errno));
+        close (fd);
+        return NULL;
+    }
+
+    image = _map (fd);
+    if (!image)
+        close (fd);
+    return image;
+}
+
+static gint
+_compare_strings (gconstpointer a, gconstpointer b)
+{
+    return strcmp (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+static GPtrArray *
+_sorted_keys (GHashTable *table)
+{
+    GPtrArray *keys = g_ptr_array_sized_new (g_hash_table_size (table));
+    GHashTableIter iter;
+    gpointer key;
+
+    g_hash_table_iter_init (&iter, table);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+        g_ptr_array_add (keys, key);
+    g_ptr_array_sort (keys, _compare_strings);
+
+    return keys;
+}
+
+static guint32
+_add_string (GString *pool, gsize pool_offset, const gchar *str)
+{
+    guint32 offset;
+
+    if (!str)
+        return 0;
+    offset = pool_offset + pool->len;
+    g_string_append_len (pool, str, strlen (str) + 1);
+    return offset;
+}
+
+/* Serializes @config_table, a table of group tables as kept by #TlmConfig.
+ * @source is recorded so that a cached copy can be matched against the
+ * configuration file it was built from. */
+TlmConfigImage *
+tlm_config_image_new_from_table (
+        GHashTable *config_table,
+        const struct stat *source)
+{
+    TlmConfigImage *image = NULL;
+    TlmConfigImageHeader header;
+    TlmConfigImageGroup *groups = NULL;
+    TlmConfigImageEntry *entries = NULL;
+    GPtrArray *group_names = NULL;
+    GString *pool = NULL;
+    GByteArray *data = NULL;
+    gsize n_entries = 0, entry = 0, pool_offset;
+    guint i, j;
+
+    g_return_val_if_fail (config_table != NULL, NULL);
+
+    group_names = _sorted_keys (config_table);
+    for (i = 0; i < group_names->len; i++)
+        n_entries += g_hash_table_size (g_hash_table_lookup (config_table,
+                    g_ptr_array_index (group_names, i)));
+
+    pool_offset = sizeof (header) +
+        group_names->len * sizeof (TlmConfigImageGroup) +
+        n_entries * sizeof (TlmConfigImageEntry);
+    groups = g_new0 (TlmConfigImageGroup, group_names->len);
+    entries = g_new0 (TlmConfigImageEntry, n_entries);
+    pool = g_string_new (NULL);
+
+    for (i = 0; i < group_names->len; i++) {
+        const gchar *name = g_ptr_array_index (group_names, i);
+        GHashTable *group_table = g_hash_table_lookup (config_table, name);
+        GPtrArray *keys = _sorted_keys (group_table);
+
+        groups[i].name = _add_string (pool, pool_offset, name);
+        groups[i].n_entries = keys->len;
+        groups[i].entries_offset = sizeof (header) +
+            group_names->len * sizeof (TlmConfigImageGroup) +
+            entry * sizeof (TlmConfigImageEntry);
+        for (j = 0; j < keys->len; j++, entry++) {
+            const gchar *key = g_ptr_array_index (keys, j);
+            entries[entry].key = _add_string (pool, pool_offset, key);
+            entries[entry].value = _add_string (pool, pool_offset,
+                    g_hash_table_lookup (group_table, key));
+        }
+        g_ptr_array_unref (keys);
+    }
+    /* an image always ends in a NUL, even without any strings */
+    g_string_append_c (pool, '\0');
+
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, TLM_CONFIG_IMAGE_MAGIC, sizeof (header.magic));
+    header.version = TLM_CONFIG_IMAGE_VERSION;
+    header.size = pool_offset + pool->len;
+    header.n_groups = group_names->len;
+    header.groups_offset = sizeof (header);
+    _set_source (&header, source);
+
+    if (pool_offset + pool->len <= G_MAXUINT32) {
+        data = g_byte_array_sized_new (header.size);
+        g_byte_array_append (data, (const guint8 *) &header, sizeof (header));
+        g_byte_array_append (data, (const guint8 *) groups,
+                group_names->len * sizeof (TlmConfigImageGroup));
+        g_byte_array_append (data, (const guint8 *) entries,
+                n_entries * sizeof (TlmConfigImageEntry));
+        g_byte_array_append (data, (const guint8 *) pool->str, pool->len);
+
+        image = _new_from_data (data->data, data->len);
+        g_byte_array_unref (data);
+    }
+
+    g_string_free (pool, TRUE);
+    g_free (entries);
+    g_free (groups);
+    g_ptr_array_unref (group_names);
+
+    return image;
+}
+
+/* Maps an image received from the parent process. Only sealed memfds are
+ * accepted; the image takes ownership of @fd. */
+TlmConfigImage *
+tlm_config_image_new_from_fd (
+        gint fd)
+{
+    TlmConfigImage *image = NULL;
+    gint seals;
+
+    seals = fcntl (fd, F_GET_SEALS);
+    if (seals < 0 || (seals & TLM_CONFIG_IMAGE_SEALS) !=
+            TLM_CONFIG_IMAGE_SEALS) {
+        WARN ("config image descriptor %d is not sealed", fd);
+        return NULL;
+    }
+
+    if (fcntl (fd, F_SETFD, FD_CLOEXEC) < 0)
+        WARN ("fcntl(%d): %s", fd, strerror (errno));
+
+    image = _map (fd);
+    if (image)
+        DBG ("mapped %" G_GSIZE_FORMAT " byte config image", image->size);
+    return image;
+}
+
+TlmConfigImage *
+tlm_config_image_load_cache (
+        const gchar *cache_path,
+        const struct stat *source)
+{
+    TlmConfigImage *image = NULL;
+    gchar *contents = NULL;
+    gsize length = 0;
+
+    g_return_val_if_fail (cache_path != NULL, NULL);
+    g_return_val_if_fail (source != NULL, NULL);
+
+    if (!g_file_get_contents (cache_path, &contents, &length, NULL))
+        return NULL;
+
+    if (!_validate ((const guint8 *) contents, length) ||
+        !_is_source_same ((const TlmConfigImageHeader *) contents, source)) {
+        DBG ("config cache %s is stale", cache_path);
+        g_free (contents);
+        return NULL;
+    }
+
+    image = _new_from_data ((const guint8 *) contents, length);
+    g_free (contents);
+    if (image)
+        DBG ("loaded config from cache %s", cache_path);
+    return image;
+}
+
+gboolean
+tlm_config_image_save_cache (
+        TlmConfigImage *image,
+        const gchar *cache_path)
+{
+    GError *error = NULL;
+    gchar *dir = NULL;
+
+    g_return_val_if_fail (image != NULL, FALSE);
+    g_return_val_if_fail (cache_path != NULL, FALSE);
+
+    dir = g_path_get_dirname (cache_path);
+    g_mkdir_with_parents (dir, 0755);
+    g_free (dir);
+
+    if (!g_file_set_contents (cache_path, (const gchar *) image->data,
+                              image->size, &error)) {
+        DBG ("failed to write config cache: %s", error->message);
+        g_error_free (error);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void
+tlm_config_image_free (
+        TlmConfigImage *image)
+{
+    if (!image)
+        return;
+
+    munmap ((void *) image->data, image->size);
+    close (image->fd);
+    g_slice_free (TlmConfigImage, image);
+}
+
+gint
+tlm_config_image_get_fd (
+        TlmConfigImage *image)
+{
+    g_return_val_if_fail (image != NULL, -1);
+
+    return image->fd;
+}
+
+gsize
+tlm_config_image_get_size (
+        TlmConfigImage *image)
+{
+    g_return_val_if_fail (image != NULL, 0);
+
+    return image->size;
+}
+
+guint
+tlm_config_image_get_n_groups (
+        TlmConfigImage *image)
+{
+    g_return_val_if_fail (image != NULL, 0);
+
+    return _header (image)->n_groups;
+}
+
+const gchar *
+tlm_config_image_get_group_name (
+        TlmConfigImage *image,
+        guint index)
+{
+    g_return_val_if_fail (image != NULL, NULL);
+    g_return_val_if_fail (index < _header (image)->n_groups, NULL);
+
+    return _string (image, _groups (image)[index].name);
+}
+
+static const TlmConfigImageGroup *
+_find_group (TlmConfigImage *image, const gchar *group)
+{
+    const TlmConfigImageGroup *groups = _groups (image);
+    guint lo = 0, hi = _header (image)->n_groups;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        gint cmp = strcmp (group, _string (image, groups[mid].name));
+        if (cmp == 0)
+            return &groups[mid];
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return NULL;
+}
+
+gboolean
+tlm_config_image_has_group (
+        TlmConfigImage *image,
+        const gchar *group)
+{
+    g_return_val_if_fail (image != NULL, FALSE);
+    g_return_val_if_fail (group != NULL, FALSE);
+
+    return _find_group (image, group) != NULL;
+}
+
+/* Returns FALSE if @key is not in @group; @value points into the image and
+ * may be NULL for keys set without a value. */
+gboolean
+tlm_config_image_lookup (
+        TlmConfigImage *image,
+        const gchar *group,
+        const gchar *key,
+        const gchar **value)
+{
+    const TlmConfigImageGroup *image_group = NULL;
+    const TlmConfigImageEntry *entries = NULL;
+    guint lo = 0, hi;
+
+    g_return_val_if_fail (image != NULL, FALSE);
+    g_return_val_if_fail (group != NULL && key != NULL, FALSE);
+
+    image_group = _find_group (image, group);
+    if (!image_group)
+        return FALSE;
+
+    entries = _entries (image, image_group);
+    hi = image_group->n_entries;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        gint cmp = strcmp (key, _string (image, entries[mid].key));
+        if (cmp == 0) {
+            if (value)
+                *value = _string (image, entries[mid].value);
+            return TRUE;
+        }
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return FALSE;
+}
+
+/* Copies @group into a table as used by #TlmConfig, NULL if there is no
+ * such group. */
+GHashTable *
+tlm_config_image_get_group_table (
+        TlmConfigImage *image,
+        const gchar *group)
+{
+    const TlmConfigImageGroup *image_group = NULL;
+    const TlmConfigImageEntry *entries = NULL;
+    GHashTable *group_table = NULL;
+    guint i;
+
+    g_return_val_if_fail (image != NULL, NULL);
+    g_return_val_if_fail (group != NULL, NULL);
+
+    image_group = _find_group (image, group);
+    if (!image_group)
+        return NULL;
+
+    group_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+            g_free);
+    entries = _entries (image, image_group);
+    for (i = 0; i < image_group->n_entries; i++)
+        g_hash_table_insert (group_table,
+                g_strdup (_string (image, entries[i].key)),
+                g_strdup (_string (image, entries[i].value)));
+
+    return group_table;
+}
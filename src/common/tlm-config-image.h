@@ -0,0 +1,96 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TLM_CONFIG_IMAGE_H
+#define _TLM_CONFIG_IMAGE_H
+
+#include <sys/stat.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* environment variable carrying the image descriptor to child processes */
+#define TLM_CONFIG_IMAGE_FD_ENV "TLM_CONFIG_FD"
+
+typedef struct _TlmConfigImage TlmConfigImage;
+
+TlmConfigImage *
+tlm_config_image_new_from_table (
+        GHashTable *config_table,
+        const struct stat *source);
+
+TlmConfigImage *
+tlm_config_image_new_from_fd (
+        gint fd);
+
+TlmConfigImage *
+tlm_config_image_load_cache (
+        const gchar *cache_path,
+        const struct stat *source);
+
+gboolean
+tlm_config_image_save_cache (
+        TlmConfigImage *image,
+        const gchar *cache_path);
+
+void
+tlm_config_image_free (
+        TlmConfigImage *image);
+
+gint
+tlm_config_image_get_fd (
+        TlmConfigImage *image);
+
+gsize
+tlm_config_image_get_size (
+        TlmConfigImage *image);
+
+guint
+tlm_config_image_get_n_groups (
+        TlmConfigImage *image);
+
+const gchar *
+tlm_config_image_get_group_name (
+        TlmConfigImage *image,
+        guint index);
+
+gboolean
+tlm_config_image_has_group (
+        TlmConfigImage *image,
+        const gchar *group);
+
+gboolean
+tlm_config_image_lookup (
+        TlmConfigImage *image,
+        const gchar *group,
+        const gchar *key,
+        const gchar **value);
+
+GHashTable *
+tlm_config_image_get_group_table (
+        TlmConfigImage *image,
+        const gchar *group);
+
+G_END_DECLS
+
+#endif /* _TLM_CONFIG_IMAGE_H */
@@ -24,13 +24,19 @@
  * 02110-1301 USA
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <glib/gstdio.h>
 
 #include "config.h"
 #include "tlm-config.h"
 #include "tlm-config-general.h"
+#include "tlm-seat-config.h"
+#include "tlm-config-image.h"
 #include "tlm-log.h"
 
 /**
@@ -70,6 +76,12 @@
  * Otherwise, the config file location is determined at compilation time as
  * $(sysconfdir) + "tlm.conf"
  *
+ * Processes started by tlm get the configuration of their parent as
+ * a read-only binary image instead, see tlm_config_get_image_fd(), and skip
+ * the file altogether. When tlm is configured with --enable-config-cache,
+ * the image built from the file is also stored on disk and reused for as
+ * long as the file does not change.
+ *
  * <refsect1><title>Example configuration file</title></refsect1>
  *
  * See example configuration file here:
@@ -94,7 +106,11 @@
 struct _TlmConfigPrivate
 {
     gchar *config_file_path;
-    GHashTable *config_table;
+    GHashTable *config_table; /* groups changed or copied from the image */
+    GHashTable *seat_configs;
+    TlmConfigImage *image;
+    TlmConfigImage *export_image;
+    gboolean is_modified;
 };
 
 #define TLM_CONFIG_PRIV(obj) G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
@@ -113,6 +129,37 @@ _check_config_file (const gchar *path)
     return NULL;
 }
 
+/* The parent's image descriptor is marked close-on-exec here and every
+ * TlmConfig maps a duplicate of it, so reloading keeps working and the
+ * descriptor is only passed further on purpose. */
+static TlmConfigImage *
+_load_inherited_image ()
+{
+    TlmConfigImage *image = NULL;
+    const gchar *fd_env = g_getenv (TLM_CONFIG_IMAGE_FD_ENV);
+    gint fd, image_fd;
+
+    if (!fd_env)
+        return NULL;
+
+    fd = atoi (fd_env);
+    if (fd < 3 || fcntl (fd, F_SETFD, FD_CLOEXEC) < 0) {
+        DBG ("no config image at descriptor '%s'", fd_env);
+        return NULL;
+    }
+
+    image_fd = fcntl (fd, F_DUPFD_CLOEXEC, 3);
+    if (image_fd < 0) {
+        WARN ("fcntl(%d, F_DUPFD_CLOEXEC): %s", fd, strerror (errno));
+        return NULL;
+    }
+
+    image = tlm_config_image_new_from_fd (image_fd);
+    if (!image)
+        close (image_fd);
+    return image;
+}
+
 static gboolean
 _load_config (TlmConfig *self)
 {
@@ -121,10 +168,17 @@ _load_config (TlmConfig *self)
     gchar **groups = NULL;
     gsize n_groups = 0;
     int i,j;
-    GKeyFile *settings = g_key_file_new ();
+    GKeyFile *settings = NULL;
+    struct stat source;
 
     const gchar * const *sysconfdirs;
 
+    priv->image = _load_inherited_image ();
+    if (priv->image) {
+        DBG ("using config image of the parent process");
+        return TRUE;
+    }
+
     if (!priv->config_file_path) {
         const gchar *cfg_env = g_getenv ("TLM_CONF_FILE");
         if (cfg_env) {
@@ -148,7 +202,18 @@ _load_config (TlmConfig *self)
     }
 
     if (priv->config_file_path) {
+        /* before reading, so that a change while loading makes the
+         * cache stale */
+        if (g_stat (priv->config_file_path, &source) < 0)
+            memset (&source, 0, sizeof (source));
+#ifdef TLM_CONFIG_CACHE_PATH
+        priv->image = tlm_config_image_load_cache (TLM_CONFIG_CACHE_PATH,
+                                                   &source);
+        if (priv->image)
+            return TRUE;
+#endif
         DBG ("loading TLM config from %s", priv->config_file_path);
+        settings = g_key_file_new ();
         if (!g_key_file_load_from_file (settings,
                                         priv->config_file_path,
                                         G_KEY_FILE_NONE, &err)) {
@@ -220,9 +285,54 @@ _load_config (TlmConfig *self)
 
     g_key_file_free (settings);
 
+    /* serve lookups from the image from now on, it is needed for the
+     * child processes anyway */
+    priv->image = tlm_config_image_new_from_table (priv->config_table,
+                                                   &source);
+    if (priv->image) {
+#ifdef TLM_CONFIG_CACHE_PATH
+        tlm_config_image_save_cache (priv->image, TLM_CONFIG_CACHE_PATH);
+#endif
+        g_hash_table_remove_all (priv->config_table);
+    }
+
     return TRUE;
 }
 
+static GHashTable *
+_copy_group_from_image (
+        TlmConfig *self,
+        const gchar *group)
+{
+    GHashTable *group_table = NULL;
+
+    if (!self->priv->image)
+        return NULL;
+
+    group_table = tlm_config_image_get_group_table (self->priv->image, group);
+    if (group_table)
+        g_hash_table_insert (self->priv->config_table, g_strdup (group),
+                             group_table);
+    return group_table;
+}
+
+static gboolean
+_lookup_value (
+        TlmConfig *self,
+        const gchar *group,
+        const gchar *key,
+        const gchar **value)
+{
+    GHashTable *group_table = g_hash_table_lookup (self->priv->config_table,
+                                                   group);
+    if (group_table)
+        return g_hash_table_lookup_extended (group_table, key, NULL,
+                                             (gpointer *) value);
+    if (self->priv->image)
+        return tlm_config_image_lookup (self->priv->image, group, key, value);
+    return FALSE;
+}
+
 #ifdef ENABLE_DEBUG
 static void
 _load_environment (
@@ -253,11 +363,16 @@ tlm_config_get_group (
         TlmConfig *self,
         const gchar *group)
 {
+    GHashTable *group_table = NULL;
+
     g_return_val_if_fail (self && TLM_IS_CONFIG(self), NULL);
     g_return_val_if_fail (group && group[0], NULL);
 
-    return (GHashTable *) g_hash_table_lookup (self->priv->config_table,
-                                                  group);
+    group_table = (GHashTable *) g_hash_table_lookup (
+            self->priv->config_table, group);
+    if (!group_table)
+        group_table = _copy_group_from_image (self, group);
+    return group_table;
 }
 
 /**
@@ -277,13 +392,15 @@ tlm_config_get_string (
         const gchar *group,
         const gchar *key)
 {
+    const gchar *value = NULL;
+
     g_return_val_if_fail (self && TLM_IS_CONFIG (self), NULL);
     g_return_val_if_fail (key && key[0], NULL);
+    g_return_val_if_fail (group && group[0], NULL);
 
-    GHashTable *group_table = tlm_config_get_group (self, group);
-    if (!group_table) return NULL;
-
-    return (const gchar *) g_hash_table_lookup (group_table, key);
+    if (!_lookup_value (self, group, key, &value))
+        return NULL;
+    return value;
 }
 
 /**
@@ -305,15 +422,14 @@ tlm_config_get_string_default (
         const gchar *key,
         const gchar *value)
 {
-    const gchar *res;
+    const gchar *res = NULL;
     g_return_val_if_fail (self && TLM_IS_CONFIG (self), NULL);
     g_return_val_if_fail (key && key[0], NULL);
+    g_return_val_if_fail (group && group[0], NULL);
 
-    GHashTable *group_table = tlm_config_get_group (self, group);
-    if (!group_table) return NULL;
+    if (!tlm_config_has_group (self, group)) return NULL;
 
-    res = g_hash_table_lookup (group_table, key);
-    if (!res)
+    if (!_lookup_value (self, group, key, &res) || !res)
         return value;
     return res;
 }
@@ -354,6 +470,10 @@ tlm_config_set_string (
                          (gpointer) g_strdup (key),
                          (gpointer) g_strdup (value));
 
+    self->priv->is_modified = TRUE;
+    g_clear_pointer (&self->priv->export_image, tlm_config_image_free);
+    if (self->priv->seat_configs)
+        g_hash_table_remove_all (self->priv->seat_configs);
 }
 /**
  * tlm_config_get_int:
@@ -535,8 +655,11 @@ tlm_config_has_group (
     g_return_val_if_fail (self && TLM_IS_CONFIG (self), FALSE);
     g_return_val_if_fail (group, FALSE);
 
-    return g_hash_table_contains (self->priv->config_table,
-                                  (gconstpointer)group);
+    if (g_hash_table_contains (self->priv->config_table,
+                               (gconstpointer)group))
+        return TRUE;
+    return self->priv->image &&
+        tlm_config_image_has_group (self->priv->image, group);
 }
 
 /**
@@ -556,26 +679,61 @@ tlm_config_has_key (
     const gchar *group,
     const gchar *key)
 {
-    GHashTable *group_table = NULL;
     g_return_val_if_fail (self && TLM_IS_CONFIG (self), FALSE);
     g_return_val_if_fail (key, FALSE);
 
     if (!group) group = TLM_CONFIG_GENERAL;
 
-    group_table = tlm_config_get_group (self, group);
-    if (!group_table) return FALSE;
+    return _lookup_value (self, group, key, NULL);
+}
+
+/**
+ * tlm_config_get_seat_config:
+ * @config: (transfer none): an instance of #TlmConfig
+ * @seat_id: (allow-none): the seat id, %NULL for General values only
+ *
+ * Gets the compiled configuration of @seat_id. Snapshots are built on first
+ * use and shared until the configuration is reloaded or changed.
+ *
+ * Returns: (transfer full): a #TlmSeatConfig, release with
+ * tlm_seat_config_unref()
+ */
+TlmSeatConfig *
+tlm_config_get_seat_config (
+        TlmConfig *config,
+        const gchar *seat_id)
+{
+    TlmSeatConfig *seat_config = NULL;
+    const gchar *key = seat_id ? seat_id : TLM_CONFIG_GENERAL;
+
+    g_return_val_if_fail (config && TLM_IS_CONFIG (config), NULL);
+
+    seat_config = g_hash_table_lookup (config->priv->seat_configs, key);
+    if (!seat_config) {
+        seat_config = tlm_seat_config_new (config, seat_id);
+        g_hash_table_insert (config->priv->seat_configs, g_strdup (key),
+                             seat_config);
+    }
 
-    return g_hash_table_contains (group_table, (gconstpointer)key);
+    return tlm_seat_config_ref (seat_config);
 }
 
 static void
 _cleanup (TlmConfig *self)
 {
+    if (self->priv->seat_configs) {
+        g_hash_table_unref (self->priv->seat_configs);
+        self->priv->seat_configs = NULL;
+    }
+
     if (self->priv->config_table) {
         g_hash_table_unref (self->priv->config_table);
         self->priv->config_table = NULL;
     }
 
+    g_clear_pointer (&self->priv->export_image, tlm_config_image_free);
+    g_clear_pointer (&self->priv->image, tlm_config_image_free);
+
     if (self->priv->config_file_path) {
         g_free (self->priv->config_file_path);
         self->priv->config_file_path = NULL;
@@ -621,11 +779,17 @@ static void
 _initialize (TlmConfig *self)
 {
     self->priv->config_file_path = NULL;
+    self->priv->is_modified = FALSE;
     self->priv->config_table = g_hash_table_new_full (
                                     g_str_hash,
                                     g_str_equal,
                                     g_free,
                                     (GDestroyNotify)g_hash_table_unref);
+    self->priv->seat_configs = g_hash_table_new_full (
+                                    g_str_hash,
+                                    g_str_equal,
+                                    g_free,
+                                    (GDestroyNotify)tlm_seat_config_unref);
 
 
     if (!_load_config (self))
@@ -644,6 +808,47 @@ tlm_config_init (
     _initialize (self);
 }
 
+/**
+ * tlm_config_get_image_fd:
+ * @self: (transfer none): an instance of #TlmConfig
+ *
+ * Gets a sealed memfd holding the current configuration as a read-only
+ * binary image. A process started with the descriptor and its number in
+ * the TLM_CONFIG_FD environment variable maps the image instead of parsing
+ * the configuration file. The descriptor is owned by @self and is replaced
+ * when the configuration changes.
+ *
+ * Returns: the descriptor, or -1 if no image could be created.
+ */
+gint
+tlm_config_get_image_fd (
+        TlmConfig *self)
+{
+    TlmConfigPrivate *priv = NULL;
+    guint i;
+
+    g_return_val_if_fail (self && TLM_IS_CONFIG (self), -1);
+    priv = self->priv;
+
+    if (priv->image && !priv->is_modified)
+        return tlm_config_image_get_fd (priv->image);
+
+    if (!priv->export_image) {
+        /* the changed groups are in config_table already, bring over the
+         * rest as well */
+        if (priv->image) {
+            for (i = 0; i < tlm_config_image_get_n_groups (priv->image); i++)
+                tlm_config_get_group (self,
+                        tlm_config_image_get_group_name (priv->image, i));
+        }
+        priv->export_image = tlm_config_image_new_from_table (
+                priv->config_table, NULL);
+    }
+
+    return priv->export_image ?
+        tlm_config_image_get_fd (priv->export_image) : -1;
+}
+
 /**
  * tlm_config_reload:
  * @self: (transfer none): an instance of #TlmConfig
@@ -662,6 +867,123 @@ tlm_config_reload (
     _initialize (self);
 }
 
+static void
+_collect_groups (
+        TlmConfig *self,
+        GHashTable *groups)
+{
+    GHashTableIter iter;
+    gpointer group;
+    guint i;
+
+    g_hash_table_iter_init (&iter, self->priv->config_table);
+    while (g_hash_table_iter_next (&iter, &group, NULL))
+        g_hash_table_add (groups, group);
+
+    if (!self->priv->image)
+        return;
+    for (i = 0; i < tlm_config_image_get_n_groups (self->priv->image); i++)
+        g_hash_table_add (groups, (gpointer)
+                tlm_config_image_get_group_name (self->priv->image, i));
+}
+
+static void
+_diff_group (
+        GHashTable *old_group,
+        GHashTable *new_group,
+        GHashTable *changed_keys)
+{
+    GHashTableIter iter;
+    gpointer key, value, other_value;
+
+    if (old_group) {
+        g_hash_table_iter_init (&iter, old_group);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+            if (!new_group ||
+                !g_hash_table_lookup_extended (new_group, key, NULL,
+                                               &other_value) ||
+                g_strcmp0 (value, other_value) != 0)
+                g_hash_table_add (changed_keys, g_strdup (key));
+        }
+    }
+
+    if (new_group) {
+        g_hash_table_iter_init (&iter, new_group);
+        while (g_hash_table_iter_next (&iter, &key, NULL)) {
+            if (!old_group || !g_hash_table_contains (old_group, key))
+                g_hash_table_add (changed_keys, g_strdup (key));
+        }
+    }
+}
+
+/**
+ * tlm_config_diff:
+ * @self: (transfer none): an instance of #TlmConfig
+ * @other: (transfer none): the #TlmConfig to compare against
+ *
+ * Compares two configurations key by key, typically the running one and
+ * a freshly loaded one.
+ *
+ * Returns: (transfer full): a #GHashTable mapping the name of each group
+ * that differs to a set (#GHashTable) of the keys that were added, removed
+ * or changed in it. The table is empty if the configurations are equal.
+ * Release with g_hash_table_unref().
+ */
+GHashTable *
+tlm_config_diff (
+        TlmConfig *self,
+        TlmConfig *other)
+{
+    GHashTable *diff = NULL;
+    GHashTable *groups = NULL;
+    GHashTableIter iter;
+    gpointer group;
+
+    g_return_val_if_fail (self && TLM_IS_CONFIG (self), NULL);
+    g_return_val_if_fail (other && TLM_IS_CONFIG (other), NULL);
+
+    diff = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                  (GDestroyNotify)g_hash_table_unref);
+    groups = g_hash_table_new (g_str_hash, g_str_equal);
+    _collect_groups (self, groups);
+    _collect_groups (other, groups);
+
+    g_hash_table_iter_init (&iter, groups);
+    while (g_hash_table_iter_next (&iter, &group, NULL)) {
+        GHashTable *changed_keys = g_hash_table_new_full (g_str_hash,
+                g_str_equal, g_free, NULL);
+
+        _diff_group (tlm_config_get_group (self, group),
+                     tlm_config_get_group (other, group),
+                     changed_keys);
+        if (g_hash_table_size (changed_keys) > 0)
+            g_hash_table_insert (diff, g_strdup (group), changed_keys);
+        else
+            g_hash_table_unref (changed_keys);
+    }
+    g_hash_table_unref (groups);
+
+    return diff;
+}
+
+/**
+ * tlm_config_get_file_path:
+ * @self: (transfer none): an instance of #TlmConfig
+ *
+ * Gets the path of the configuration file @self was loaded from.
+ *
+ * Returns: the path, or %NULL if no file was found or the configuration was
+ * inherited from the parent process.
+ */
+const gchar *
+tlm_config_get_file_path (
+        TlmConfig *self)
+{
+    g_return_val_if_fail (self && TLM_IS_CONFIG (self), NULL);
+
+    return self->priv->config_file_path;
+}
+
 /**
  * tlm_config_new:
  *
@@ -146,10 +146,23 @@ tlm_config_get_group (
         TlmConfig *self,
         const gchar *group);
 
+gint
+tlm_config_get_image_fd (
+        TlmConfig *self);
+
 void
 tlm_config_reload (
         TlmConfig *self);
 
+GHashTable *
+tlm_config_diff (
+        TlmConfig *self,
+        TlmConfig *other);
+
+const gchar *
+tlm_config_get_file_path (
+        TlmConfig *self);
+
 G_END_DECLS
 
 #endif /* __TLM_CONFIG_H_ */
@@ -0,0 +1,526 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tlm-home-cleanup.h"
+#include "tlm-log.h"
+
+/* The home directory is renamed to a hidden sibling and an empty home is
+ * created in its place before tlm_home_cleanup_start() returns, so the next
+ * login never waits for the old tree to be deleted. The deletion runs in a
+ * worker thread with openat()/unlinkat() relative to directory descriptors,
+ * which neither forks a shell nor resolves full paths for every entry, and
+ * does not follow symlinks or cross into other file systems. Homes that
+ * cannot be renamed are emptied in place before returning, blocking. */
+
+#define TLM_HOME_CLEANUP_MAX_THREADS 2
+#define TLM_HOME_CLEANUP_SUFFIX ".tlm-cleanup-"
+#define TLM_HOME_CLEANUP_RENAME_ATTEMPTS 16
+
+typedef struct {
+    gchar *home_dir;
+    gchar *trash_dir;
+    gboolean success;
+    GMainContext *context;
+    TlmHomeCleanupFunc func;
+    gpointer user_data;
+} TlmHomeCleanupJob;
+
+static GThreadPool *cleanup_pool = NULL;
+static GHashTable *swept_homes = NULL;
+
+/* walks @names down from @root_fd, one descriptor open at a time */
+static gint
+_open_path (
+        gint root_fd,
+        GPtrArray *names,
+        dev_t dev)
+{
+    struct stat st;
+    gint fd, next;
+    guint i;
+
+    fd = fcntl (root_fd, F_DUPFD_CLOEXEC, 0);
+    for (i = 0; fd >= 0 && i < names->len; i++) {
+        next = openat (fd, g_ptr_array_index (names, i),
+                O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        close (fd);
+        fd = next;
+        if (fd >= 0 && (fstat (fd, &st) != 0 || st.st_dev != dev)) {
+            close (fd);
+            fd = -1;
+        }
+    }
+    return fd;
+}
+
+static void
+_add_failed (
+        GHashTable *failed,
+        gint dir_fd,
+        const gchar *name)
+{
+    struct stat st;
+    gint64 *ino;
+
+    if (fstatat (dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        return;
+    ino = g_new (gint64, 1);
+    *ino = st.st_ino;
+    g_hash_table_add (failed, ino);
+}
+
+/* Deletes everything below @root_fd with at most two directories open
+ * however deep the tree is: the path below the root is kept as names and
+ * walked again from the root to go back up. Directories that could not be
+ * emptied are remembered so they are not descended into again. */
+static gboolean
+_delete_contents (
+        gint root_fd,
+        dev_t dev)
+{
+    GPtrArray *names = g_ptr_array_new_with_free_func (g_free);
+    GHashTable *failed = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+            g_free, NULL);
+    gboolean success = TRUE;
+    gint fd = _open_path (root_fd, names, dev);
+
+    for (;;) {
+        DIR *dir;
+        struct dirent *entry;
+        gint child_fd = -1;
+        gchar *done;
+
+        if (fd < 0 || !(dir = fdopendir (fd))) {
+            if (fd >= 0) close (fd);
+            success = FALSE;
+            break;
+        }
+
+        while (child_fd < 0 && (entry = readdir (dir)) != NULL) {
+            const gchar *name = entry->d_name;
+            struct stat st;
+            gint64 ino;
+
+            if (strcmp (name, ".") == 0 || strcmp (name, "..") == 0)
+                continue;
+
+            if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN) {
+                if (unlinkat (dirfd (dir), name, 0) != 0 && errno != ENOENT)
+                    success = FALSE;
+                continue;
+            }
+
+            if (fstatat (dirfd (dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                if (errno != ENOENT) success = FALSE;
+                continue;
+            }
+            if (!S_ISDIR (st.st_mode)) {
+                if (unlinkat (dirfd (dir), name, 0) != 0 && errno != ENOENT)
+                    success = FALSE;
+                continue;
+            }
+            if (st.st_dev != dev) {
+                WARN ("not descending into mount point '%s'", name);
+                success = FALSE;
+                continue;
+            }
+            ino = st.st_ino;
+            if (g_hash_table_contains (failed, &ino) ||
+                unlinkat (dirfd (dir), name, AT_REMOVEDIR) == 0)
+                continue;
+
+            child_fd = openat (dirfd (dir), name,
+                    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (child_fd < 0) {
+                _add_failed (failed, dirfd (dir), name);
+                success = FALSE;
+                continue;
+            }
+            g_ptr_array_add (names, g_strdup (name));
+        }
+        closedir (dir);
+
+        if (child_fd >= 0) {
+            fd = child_fd;
+            continue;
+        }
+        if (names->len == 0)
+            break;
+
+        /* the directory is as empty as it gets, remove it from its parent */
+        done = g_strdup (g_ptr_array_index (names, names->len - 1));
+        g_ptr_array_remove_index (names, names->len - 1);
+        fd = _open_path (root_fd, names, dev);
+        if (fd >= 0 && unlinkat (fd, done, AT_REMOVEDIR) != 0 &&
+            errno != ENOENT) {
+            _add_failed (failed, fd, done);
+            success = FALSE;
+        }
+        g_free (done);
+    }
+
+    g_hash_table_unref (failed);
+    g_ptr_array_unref (names);
+    return success;
+}
+
+static gboolean
+_empty_dir (
+        const gchar *path)
+{
+    struct stat st;
+    gboolean success;
+    gint fd;
+
+    fd = open (path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return FALSE;
+
+    success = fstat (fd, &st) == 0 && _delete_contents (fd, st.st_dev);
+    close (fd);
+    return success;
+}
+
+/**
+ * tlm_home_cleanup_delete_tree:
+ * @path: directory to delete
+ *
+ * Deletes @path and everything below it without following symlinks or
+ * crossing mount points. Blocks until done; tlm_home_cleanup_start() runs
+ * this in a worker thread.
+ *
+ * Returns: %TRUE if the whole tree was removed.
+ */
+gboolean
+tlm_home_cleanup_delete_tree (
+        const gchar *path)
+{
+    g_return_val_if_fail (path != NULL, FALSE);
+
+    if (!_empty_dir (path))
+        return FALSE;
+
+    return rmdir (path) == 0;
+}
+
+static void
+_job_free (
+        TlmHomeCleanupJob *job)
+{
+    g_free (job->home_dir);
+    g_free (job->trash_dir);
+    if (job->context) g_main_context_unref (job->context);
+    g_slice_free (TlmHomeCleanupJob, job);
+}
+
+static gboolean
+_job_complete (
+        gpointer data)
+{
+    TlmHomeCleanupJob *job = (TlmHomeCleanupJob *) data;
+
+    if (job->func)
+        job->func (job->home_dir, job->success, job->user_data);
+
+    _job_free (job);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_dispatch_job (
+        TlmHomeCleanupJob *job)
+{
+    GSource *source;
+
+    if (!job->context) {
+        _job_free (job);
+        return;
+    }
+
+    source = g_idle_source_new ();
+    g_source_set_callback (source, _job_complete, job, NULL);
+    g_source_attach (source, job->context);
+    g_source_unref (source);
+}
+
+static void
+_cleanup_worker (
+        gpointer data,
+        gpointer unused)
+{
+    TlmHomeCleanupJob *job = (TlmHomeCleanupJob *) data;
+    gint64 start = g_get_monotonic_time ();
+
+    (void) unused;
+
+    job->success = tlm_home_cleanup_delete_tree (job->trash_dir);
+
+    DBG ("deleted old contents of '%s' in %" G_GINT64_FORMAT " us",
+         job->home_dir, g_get_monotonic_time () - start);
+
+    _dispatch_job (job);
+}
+
+static void
+_queue_job (
+        TlmHomeCleanupJob *job)
+{
+    GError *error = NULL;
+
+    if (!cleanup_pool) {
+        cleanup_pool = g_thread_pool_new (_cleanup_worker, NULL,
+                TLM_HOME_CLEANUP_MAX_THREADS, FALSE, &error);
+        if (!cleanup_pool) {
+            WARN ("Failed to create home cleanup pool: %s",
+                  error ? error->message : "");
+            g_clear_error (&error);
+            _cleanup_worker (job, NULL);
+            return;
+        }
+    }
+
+    g_thread_pool_push (cleanup_pool, job, NULL);
+}
+
+/**
+ * tlm_home_cleanup_discard:
+ * @path: directory to delete
+ *
+ * Deletes @path and everything below it in the background.
+ */
+void
+tlm_home_cleanup_discard (
+        const gchar *path)
+{
+    TlmHomeCleanupJob *job;
+
+    g_return_if_fail (path != NULL);
+
+    job = g_slice_new0 (TlmHomeCleanupJob);
+    job->home_dir = g_strdup (path);
+    job->trash_dir = g_strdup (path);
+    _queue_job (job);
+}
+
+/* trees left behind when the daemon stopped in the middle of a cleanup */
+static void
+_sweep_leftovers (
+        const gchar *home_dir)
+{
+    gchar *parent, *base, *prefix;
+    const gchar *name;
+    GDir *dir;
+
+    if (!swept_homes)
+        swept_homes = g_hash_table_new_full (g_str_hash, g_str_equal,
+                g_free, NULL);
+    if (g_hash_table_contains (swept_homes, home_dir))
+        return;
+    g_hash_table_add (swept_homes, g_strdup (home_dir));
+
+    parent = g_path_get_dirname (home_dir);
+    base = g_path_get_basename (home_dir);
+    prefix = g_strconcat (".", base, TLM_HOME_CLEANUP_SUFFIX, NULL);
+
+    if ((dir = g_dir_open (parent, 0, NULL)) != NULL) {
+        while ((name = g_dir_read_name (dir)) != NULL) {
+            gchar *path;
+
+            if (!g_str_has_prefix (name, prefix))
+                continue;
+
+            DBG ("deleting leftover '%s/%s'", parent, name);
+            path = g_build_filename (parent, name, NULL);
+            tlm_home_cleanup_discard (path);
+            g_free (path);
+        }
+        g_dir_close (dir);
+    }
+
+    g_free (prefix);
+    g_free (base);
+    g_free (parent);
+}
+
+static gchar *
+_move_aside (
+        const gchar *home_dir)
+{
+    gchar *parent = g_path_get_dirname (home_dir);
+    gchar *base = g_path_get_basename (home_dir);
+    gchar *trash_dir = NULL;
+    gint i;
+
+    for (i = 0; i < TLM_HOME_CLEANUP_RENAME_ATTEMPTS; i++) {
+        trash_dir = g_strdup_printf ("%s/.%s" TLM_HOME_CLEANUP_SUFFIX "%08x",
+                parent, base, g_random_int ());
+        if (rename (home_dir, trash_dir) == 0)
+            break;
+        g_free (trash_dir);
+        trash_dir = NULL;
+        if (errno != EEXIST && errno != ENOTEMPTY) {
+            DBG ("cannot move '%s' aside: %s", home_dir, strerror (errno));
+            break;
+        }
+    }
+
+    g_free (base);
+    g_free (parent);
+    return trash_dir;
+}
+
+static gboolean
+_recreate_home (
+        const gchar *home_dir,
+        const gchar *replacement,
+        const struct stat *st)
+{
+    if (replacement) {
+        if (rename (replacement, home_dir) != 0)
+            return FALSE;
+    } else if (mkdir (home_dir, 0700) != 0) {
+        return FALSE;
+    }
+
+    if (chown (home_dir, st->st_uid, st->st_gid) != 0 ||
+        chmod (home_dir, st->st_mode & 07777) != 0) {
+        if (replacement) rename (home_dir, replacement);
+        else rmdir (home_dir);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+_start (
+        const gchar *home_dir,
+        const gchar *replacement,
+        TlmHomeCleanupFunc func,
+        gpointer user_data)
+{
+    TlmHomeCleanupJob *job;
+    struct stat st;
+
+    if (lstat (home_dir, &st) != 0 || !S_ISDIR (st.st_mode)) {
+        WARN ("'%s' is not a directory", home_dir);
+        return FALSE;
+    }
+
+    _sweep_leftovers (home_dir);
+
+    job = g_slice_new0 (TlmHomeCleanupJob);
+    job->home_dir = g_strdup (home_dir);
+    job->context = g_main_context_ref_thread_default ();
+    job->func = func;
+    job->user_data = user_data;
+
+    job->trash_dir = _move_aside (home_dir);
+    if (job->trash_dir && !_recreate_home (home_dir, replacement, &st)) {
+        WARN ("cannot recreate '%s': %s", home_dir, strerror (errno));
+        if (rename (job->trash_dir, home_dir) != 0) {
+            WARN ("cannot restore '%s': %s", home_dir, strerror (errno));
+            _job_free (job);
+            return FALSE;
+        }
+        g_free (job->trash_dir);
+        job->trash_dir = NULL;
+    }
+    if (!job->trash_dir) {
+        gboolean success;
+
+        if (replacement) {
+            _job_free (job);
+            return FALSE;
+        }
+        /* the next login writes into this very directory, so it cannot be
+         * emptied behind its back */
+        WARN ("cannot move '%s' aside, emptying it in place", home_dir);
+        success = job->success = _empty_dir (home_dir);
+        _dispatch_job (job);
+        return success;
+    }
+
+    _queue_job (job);
+    return TRUE;
+}
+
+/**
+ * tlm_home_cleanup_start:
+ * @home_dir: home directory to clean up
+ * @func: (allow-none): called when the old contents are gone
+ * @user_data: data passed to @func
+ *
+ * Replaces @home_dir with an empty directory of the same owner and mode and
+ * deletes the old contents in the background. @home_dir is empty when this
+ * returns. If it cannot be renamed (e.g. it is a mount point), it is
+ * emptied in place before returning instead. @func is called from the
+ * thread default main context of the caller.
+ *
+ * Returns: %TRUE if the cleanup was started, or the home emptied in place.
+ */
+gboolean
+tlm_home_cleanup_start (
+        const gchar *home_dir,
+        TlmHomeCleanupFunc func,
+        gpointer user_data)
+{
+    g_return_val_if_fail (home_dir && home_dir[0] == '/', FALSE);
+
+    return _start (home_dir, NULL, func, user_data);
+}
+
+/**
+ * tlm_home_cleanup_replace:
+ * @home_dir: home directory to clean up
+ * @replacement: prepared directory on the same file system as @home_dir
+ * @func: (allow-none): called when the old contents are gone
+ * @user_data: data passed to @func
+ *
+ * Like tlm_home_cleanup_start(), but moves @replacement into place instead of
+ * creating an empty directory. Nothing is changed if either rename fails.
+ *
+ * Returns: %TRUE if @replacement is now @home_dir.
+ */
+gboolean
+tlm_home_cleanup_replace (
+        const gchar *home_dir,
+        const gchar *replacement,
+        TlmHomeCleanupFunc func,
+        gpointer user_data)
+{
+    g_return_val_if_fail (home_dir && home_dir[0] == '/', FALSE);
+    g_return_val_if_fail (replacement != NULL, FALSE);
+
+    return _start (home_dir, replacement, func, user_data);
+}
@@ -0,0 +1,60 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef _TLM_HOME_CLEANUP_H
+#define _TLM_HOME_CLEANUP_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef void (*TlmHomeCleanupFunc) (
+        const gchar *home_dir,
+        gboolean success,
+        gpointer user_data);
+
+gboolean
+tlm_home_cleanup_start (
+        const gchar *home_dir,
+        TlmHomeCleanupFunc func,
+        gpointer user_data);
+
+gboolean
+tlm_home_cleanup_replace (
+        const gchar *home_dir,
+        const gchar *replacement,
+        TlmHomeCleanupFunc func,
+        gpointer user_data);
+
+void
+tlm_home_cleanup_discard (
+        const gchar *path);
+
+gboolean
+tlm_home_cleanup_delete_tree (
+        const gchar *path);
+
+G_END_DECLS
+
+#endif /* _TLM_HOME_CLEANUP_H */
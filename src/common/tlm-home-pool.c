@@ -0,0 +1,842 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tlm-home-pool.h"
+#include "tlm-log.h"
+
+/* A pool keeps guest homes filled from a template ready as hidden siblings
+ * of the home they are for, so swapping one in at logout is a pair of
+ * renames on the same file system. Homes are built in a worker thread,
+ * cloning file data with FICLONE where the file system shares extents,
+ * copy_file_range() where it can copy in kernel, and read()/write()
+ * otherwise. A home is renamed from its building name to its ready name only
+ * once complete, so ready homes left by a previous run are reused and
+ * partial ones deleted. The ready name carries a stamp of the template
+ * contents it was copied from; homes with a different stamp than the
+ * template's latest are deleted instead of swapped in. Nothing is ever
+ * copied on the caller's thread: with no home ready, the home is emptied. */
+
+#define TLM_HOME_POOL_BUILDING ".tlm-building-"
+#define TLM_HOME_POOL_READY ".tlm-ready-"
+#define TLM_HOME_POOL_COPY_BUFFER (64 * 1024)
+
+struct _TlmHomePool {
+    gint ref_count;
+    gint closed;
+    gchar *template_dir;
+    guint size;
+    guint64 stamp;
+    guint stamp_sequence;
+    guint next_sequence;
+    GHashTable *homes;
+    GThreadPool *workers;
+    GMainContext *context;
+};
+
+typedef struct {
+    gchar *home_dir;
+    uid_t uid;
+    gid_t gid;
+    GQueue ready;
+    guint pending;
+} TlmHomePoolHome;
+
+typedef struct {
+    TlmHomePool *pool;
+    TlmHomePoolHome *home;
+    uid_t uid;
+    gid_t gid;
+    guint64 stamp;
+    guint sequence;
+    gchar *path;
+} TlmHomePoolFill;
+
+static gboolean
+_copy_data (
+        gint src_fd,
+        gint dst_fd)
+{
+    gchar *buffer;
+    ssize_t n;
+    gboolean success = TRUE;
+
+#ifdef FICLONE
+    if (ioctl (dst_fd, FICLONE, src_fd) == 0)
+        return TRUE;
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+    /* advances both offsets, read()/write() carry on from where it failed */
+    while ((n = copy_file_range (src_fd, NULL, dst_fd, NULL, G_MAXINT32, 0))
+            > 0)
+        ;
+    if (n == 0)
+        return TRUE;
+#endif
+
+    buffer = g_malloc (TLM_HOME_POOL_COPY_BUFFER);
+    while ((n = read (src_fd, buffer, TLM_HOME_POOL_COPY_BUFFER)) != 0) {
+        gchar *p = buffer;
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            success = FALSE;
+            break;
+        }
+        while (n > 0) {
+            ssize_t written = write (dst_fd, p, n);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                success = FALSE;
+                break;
+            }
+            p += written;
+            n -= written;
+        }
+        if (!success)
+            break;
+    }
+    g_free (buffer);
+
+    return success;
+}
+
+static gboolean
+_copy_file (
+        gint src_dir_fd,
+        gint dst_dir_fd,
+        const gchar *name)
+{
+    gint src_fd, dst_fd;
+    gboolean success;
+
+    src_fd = openat (src_dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (src_fd < 0)
+        return FALSE;
+
+    dst_fd = openat (dst_dir_fd, name,
+            O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (dst_fd < 0) {
+        close (src_fd);
+        return FALSE;
+    }
+
+    success = _copy_data (src_fd, dst_fd);
+
+    close (src_fd);
+    if (close (dst_fd) != 0)
+        success = FALSE;
+    return success;
+}
+
+static gboolean
+_copy_symlink (
+        gint src_dir_fd,
+        gint dst_dir_fd,
+        const gchar *name)
+{
+    gchar target[PATH_MAX];
+    ssize_t len;
+
+    len = readlinkat (src_dir_fd, name, target, sizeof (target) - 1);
+    if (len < 0)
+        return FALSE;
+    target[len] = '\0';
+
+    return symlinkat (target, dst_dir_fd, name) == 0;
+}
+
+/* takes ownership of both descriptors */
+static gboolean
+_copy_contents (
+        gint src_fd,
+        gint dst_fd,
+        uid_t uid,
+        gid_t gid)
+{
+    DIR *dir;
+    struct dirent *entry;
+    gboolean success = TRUE;
+
+    if (!(dir = fdopendir (src_fd))) {
+        close (src_fd);
+        close (dst_fd);
+        return FALSE;
+    }
+
+    while ((entry = readdir (dir)) != NULL) {
+        const gchar *name = entry->d_name;
+        struct stat st;
+        gboolean copied;
+
+        if (strcmp (name, ".") == 0 || strcmp (name, "..") == 0)
+            continue;
+
+        if (fstatat (dirfd (dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            success = FALSE;
+            continue;
+        }
+
+        if (S_ISDIR (st.st_mode)) {
+            gint child_src, child_dst = -1;
+
+            copied = FALSE;
+            if (mkdirat (dst_fd, name, 0700) == 0 &&
+                (child_src = openat (dirfd (dir), name,
+                        O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) >= 0) {
+                child_dst = openat (dst_fd, name,
+                        O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                if (child_dst >= 0)
+                    copied = _copy_contents (child_src, child_dst, uid, gid);
+                else
+                    close (child_src);
+            }
+        } else if (S_ISREG (st.st_mode)) {
+            copied = _copy_file (dirfd (dir), dst_fd, name);
+        } else if (S_ISLNK (st.st_mode)) {
+            copied = _copy_symlink (dirfd (dir), dst_fd, name);
+        } else {
+            DBG ("skipping special file '%s' in template", name);
+            continue;
+        }
+
+        /* the mode goes last, a read-only directory is filled by now */
+        if (!copied ||
+            fchownat (dst_fd, name, uid, gid, AT_SYMLINK_NOFOLLOW) != 0 ||
+            (!S_ISLNK (st.st_mode) &&
+             fchmodat (dst_fd, name, st.st_mode & 07777, 0) != 0))
+            success = FALSE;
+    }
+
+    closedir (dir);
+    close (dst_fd);
+    return success;
+}
+
+static guint64
+_mix (guint64 value)
+{
+    value ^= value >> 33;
+    value *= G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+    value ^= value >> 33;
+    value *= G_GUINT64_CONSTANT (0xc4ceb9fe1a85ec53);
+    value ^= value >> 33;
+    return value;
+}
+
+static guint64
+_hash_string (const gchar *str)
+{
+    guint64 hash = G_GUINT64_CONSTANT (0xcbf29ce484222325);
+
+    for (; *str; str++) {
+        hash ^= (guchar) *str;
+        hash *= G_GUINT64_CONSTANT (0x100000001b3);
+    }
+    return hash;
+}
+
+/* sums a hash of every entry, so the order entries are read in is
+ * irrelevant */
+static void
+_stamp_tree (
+        const gchar *path,
+        const gchar *relative,
+        guint64 *stamp)
+{
+    const gchar *name;
+    GDir *dir;
+
+    if (!(dir = g_dir_open (path, 0, NULL))) {
+        *stamp += 1;
+        return;
+    }
+
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        gchar *child = g_build_filename (path, name, NULL);
+        gchar *child_relative = g_build_filename (relative, name, NULL);
+        struct stat st;
+
+        if (lstat (child, &st) == 0) {
+            guint64 hash = _hash_string (child_relative);
+
+            hash = _mix (hash ^ st.st_mode);
+            hash = _mix (hash ^ (guint64) st.st_size);
+            hash = _mix (hash ^ (guint64) st.st_mtim.tv_sec);
+            hash = _mix (hash ^ (guint64) st.st_mtim.tv_nsec);
+            *stamp += hash;
+            if (S_ISDIR (st.st_mode))
+                _stamp_tree (child, child_relative, stamp);
+        }
+        g_free (child_relative);
+        g_free (child);
+    }
+    g_dir_close (dir);
+}
+
+static guint64
+_template_stamp (
+        const gchar *template_dir)
+{
+    guint64 stamp = 0;
+
+    _stamp_tree (template_dir, "", &stamp);
+    return stamp;
+}
+
+/* the stamp of a ready home's directory name, FALSE if it has none */
+static gboolean
+_parse_stamp (
+        const gchar *name,
+        const gchar *prefix,
+        guint64 *stamp)
+{
+    gchar *end = NULL;
+
+    if (!g_str_has_prefix (name, prefix))
+        return FALSE;
+    name += strlen (prefix);
+    *stamp = g_ascii_strtoull (name, &end, 16);
+    return end == name + 16 && *end == '-';
+}
+
+static gchar *
+_ready_prefix (
+        const gchar *home_dir)
+{
+    gchar *base = g_path_get_basename (home_dir);
+    gchar *prefix = g_strconcat (".", base, TLM_HOME_POOL_READY, NULL);
+
+    g_free (base);
+    return prefix;
+}
+
+static gboolean
+_is_current (
+        TlmHomePool *pool,
+        TlmHomePoolHome *home,
+        const gchar *path)
+{
+    gchar *name = g_path_get_basename (path);
+    gchar *prefix = _ready_prefix (home->home_dir);
+    guint64 stamp = 0;
+    gboolean current;
+
+    current = _parse_stamp (name, prefix, &stamp) && stamp == pool->stamp;
+
+    g_free (prefix);
+    g_free (name);
+    return current;
+}
+
+static gchar *
+_sibling_path (
+        const gchar *home_dir,
+        const gchar *suffix)
+{
+    gchar *parent = g_path_get_dirname (home_dir);
+    gchar *base = g_path_get_basename (home_dir);
+    gchar *path;
+
+    path = g_strdup_printf ("%s/.%s%s%08x", parent, base, suffix,
+            g_random_int ());
+
+    g_free (base);
+    g_free (parent);
+    return path;
+}
+
+static gchar *
+_build_home (
+        const gchar *template_dir,
+        const gchar *home_dir,
+        uid_t uid,
+        gid_t gid,
+        guint64 stamp)
+{
+    gchar *building, *ready = NULL;
+    gint src_fd, dst_fd;
+    gboolean success = FALSE;
+    gint64 start = g_get_monotonic_time ();
+
+    building = _sibling_path (home_dir, TLM_HOME_POOL_BUILDING);
+    if (mkdir (building, 0700) != 0) {
+        WARN ("cannot create '%s': %s", building, strerror (errno));
+        g_free (building);
+        return NULL;
+    }
+
+    src_fd = open (template_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    dst_fd = open (building, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (src_fd >= 0 && dst_fd >= 0) {
+        success = _copy_contents (src_fd, dst_fd, uid, gid) &&
+                  chown (building, uid, gid) == 0;
+    } else {
+        if (src_fd >= 0) close (src_fd);
+        if (dst_fd >= 0) close (dst_fd);
+    }
+
+    if (success) {
+        gchar *suffix = g_strdup_printf ("%s%016" G_GINT64_MODIFIER "x-",
+                TLM_HOME_POOL_READY, stamp);
+        ready = _sibling_path (home_dir, suffix);
+        g_free (suffix);
+        if (rename (building, ready) != 0) {
+            g_free (ready);
+            ready = NULL;
+        }
+    }
+
+    if (ready) {
+        DBG ("built '%s' from '%s' in %" G_GINT64_FORMAT " us", ready,
+             template_dir, g_get_monotonic_time () - start);
+    } else {
+        WARN ("failed to copy '%s' for '%s'", template_dir, home_dir);
+        tlm_home_cleanup_delete_tree (building);
+    }
+
+    g_free (building);
+    return ready;
+}
+
+static TlmHomePool *
+_pool_ref (
+        TlmHomePool *pool)
+{
+    g_atomic_int_inc (&pool->ref_count);
+    return pool;
+}
+
+static void
+_home_free (
+        gpointer data)
+{
+    TlmHomePoolHome *home = (TlmHomePoolHome *) data;
+    gchar *path;
+
+    /* ready homes stay on disk for the next run */
+    while ((path = g_queue_pop_head (&home->ready)) != NULL)
+        g_free (path);
+    g_free (home->home_dir);
+    g_slice_free (TlmHomePoolHome, home);
+}
+
+static void
+_pool_unref (
+        TlmHomePool *pool)
+{
+    if (!g_atomic_int_dec_and_test (&pool->ref_count))
+        return;
+
+    g_thread_pool_free (pool->workers, TRUE, TRUE);
+    g_hash_table_unref (pool->homes);
+    g_main_context_unref (pool->context);
+    g_free (pool->template_dir);
+    g_slice_free (TlmHomePool, pool);
+}
+
+static void _refill (TlmHomePool *pool, TlmHomePoolHome *home);
+
+/* the template changed since the ready homes were copied from it */
+static void
+_discard_stale (
+        TlmHomePool *pool)
+{
+    GHashTableIter iter;
+    TlmHomePoolHome *home;
+    GList *paths, *l;
+
+    g_hash_table_iter_init (&iter, pool->homes);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &home)) {
+        paths = home->ready.head;
+        g_queue_init (&home->ready);
+        for (l = paths; l; l = l->next) {
+            if (_is_current (pool, home, l->data)) {
+                g_queue_push_tail (&home->ready, l->data);
+            } else {
+                DBG ("discarding '%s', the template changed", (gchar *) l->data);
+                tlm_home_cleanup_discard (l->data);
+                g_free (l->data);
+            }
+        }
+        g_list_free (paths);
+        _refill (pool, home);
+    }
+}
+
+static gboolean
+_fill_complete (
+        gpointer data)
+{
+    TlmHomePoolFill *fill = (TlmHomePoolFill *) data;
+    TlmHomePoolHome *home = fill->home;
+    TlmHomePool *pool = fill->pool;
+
+    home->pending--;
+    if (fill->path && !g_atomic_int_get (&pool->closed)) {
+        /* a fill queued later has seen the template more recently */
+        gboolean newer = fill->sequence > pool->stamp_sequence;
+
+        if (fill->uid == home->uid && fill->gid == home->gid &&
+            (newer || fill->stamp == pool->stamp)) {
+            g_queue_push_tail (&home->ready, fill->path);
+            fill->path = NULL;
+        } else {
+            tlm_home_cleanup_discard (fill->path);
+        }
+        if (newer) {
+            pool->stamp_sequence = fill->sequence;
+            if (fill->stamp != pool->stamp) {
+                pool->stamp = fill->stamp;
+                _discard_stale (pool);
+            }
+        }
+    }
+
+    g_free (fill->path);
+    _pool_unref (fill->pool);
+    g_slice_free (TlmHomePoolFill, fill);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_fill_worker (
+        gpointer data,
+        gpointer unused)
+{
+    TlmHomePoolFill *fill = (TlmHomePoolFill *) data;
+    GSource *source;
+
+    (void) unused;
+
+    if (!g_atomic_int_get (&fill->pool->closed)) {
+        fill->stamp = _template_stamp (fill->pool->template_dir);
+        fill->path = _build_home (fill->pool->template_dir,
+                fill->home->home_dir, fill->uid, fill->gid, fill->stamp);
+    }
+
+    source = g_idle_source_new ();
+    g_source_set_callback (source, _fill_complete, fill, NULL);
+    g_source_attach (source, fill->pool->context);
+    g_source_unref (source);
+}
+
+static void
+_refill (
+        TlmHomePool *pool,
+        TlmHomePoolHome *home)
+{
+    while (g_queue_get_length (&home->ready) + home->pending < pool->size) {
+        TlmHomePoolFill *fill = g_slice_new0 (TlmHomePoolFill);
+
+        fill->pool = _pool_ref (pool);
+        fill->home = home;
+        fill->uid = home->uid;
+        fill->gid = home->gid;
+        fill->sequence = ++pool->next_sequence;
+        home->pending++;
+        g_thread_pool_push (pool->workers, fill, NULL);
+    }
+}
+
+/* picks up what a previous run left next to the home */
+static void
+_adopt_leftovers (
+        TlmHomePool *pool,
+        TlmHomePoolHome *home)
+{
+    gchar *parent, *base, *ready_prefix, *building_prefix;
+    const gchar *name;
+    GDir *dir;
+
+    parent = g_path_get_dirname (home->home_dir);
+    base = g_path_get_basename (home->home_dir);
+    ready_prefix = g_strconcat (".", base, TLM_HOME_POOL_READY, NULL);
+    building_prefix = g_strconcat (".", base, TLM_HOME_POOL_BUILDING, NULL);
+
+    if ((dir = g_dir_open (parent, 0, NULL)) != NULL) {
+        while ((name = g_dir_read_name (dir)) != NULL) {
+            gchar *path;
+            struct stat st;
+            guint64 stamp = 0;
+
+            if (!g_str_has_prefix (name, ready_prefix) &&
+                !g_str_has_prefix (name, building_prefix))
+                continue;
+
+            path = g_build_filename (parent, name, NULL);
+            if (_parse_stamp (name, ready_prefix, &stamp) &&
+                stamp == pool->stamp &&
+                lstat (path, &st) == 0 && S_ISDIR (st.st_mode) &&
+                st.st_uid == home->uid && st.st_gid == home->gid) {
+                DBG ("reusing prepared home '%s'", path);
+                g_queue_push_tail (&home->ready, path);
+                continue;
+            }
+
+            tlm_home_cleanup_discard (path);
+            g_free (path);
+        }
+        g_dir_close (dir);
+    }
+
+    g_free (building_prefix);
+    g_free (ready_prefix);
+    g_free (base);
+    g_free (parent);
+}
+
+static TlmHomePoolHome *
+_get_home (
+        TlmHomePool *pool,
+        const gchar *home_dir,
+        uid_t uid,
+        gid_t gid)
+{
+    TlmHomePoolHome *home;
+    gchar *path;
+
+    home = g_hash_table_lookup (pool->homes, home_dir);
+    if (!home) {
+        home = g_slice_new0 (TlmHomePoolHome);
+        home->home_dir = g_strdup (home_dir);
+        home->uid = uid;
+        home->gid = gid;
+        g_queue_init (&home->ready);
+        g_hash_table_insert (pool->homes, home->home_dir, home);
+        _adopt_leftovers (pool, home);
+    } else if (home->uid != uid || home->gid != gid) {
+        /* the account was recreated, prepared homes have the old owner */
+        while ((path = g_queue_pop_head (&home->ready)) != NULL) {
+            tlm_home_cleanup_discard (path);
+            g_free (path);
+        }
+        home->uid = uid;
+        home->gid = gid;
+    }
+
+    return home;
+}
+
+/**
+ * tlm_home_pool_new:
+ * @template_dir: directory the homes are copied from
+ * @size: number of homes to keep ready per home directory
+ *
+ * Creates a pool of guest homes prepared from @template_dir. Completions
+ * are dispatched in the thread default main context of the caller. The
+ * template is stamped here to tell which ready homes left by a previous run
+ * are still current; changes made later are noticed by the next refill.
+ *
+ * Returns: (transfer full): a new #TlmHomePool, or %NULL on error.
+ */
+TlmHomePool *
+tlm_home_pool_new (
+        const gchar *template_dir,
+        guint size)
+{
+    TlmHomePool *pool;
+    GError *error = NULL;
+
+    g_return_val_if_fail (template_dir && template_dir[0] == '/', NULL);
+    g_return_val_if_fail (size > 0, NULL);
+
+    if (!g_file_test (template_dir, G_FILE_TEST_IS_DIR)) {
+        WARN ("home template '%s' is not a directory", template_dir);
+        return NULL;
+    }
+
+    pool = g_slice_new0 (TlmHomePool);
+    pool->ref_count = 1;
+    pool->template_dir = g_strdup (template_dir);
+    pool->size = size;
+    pool->stamp = _template_stamp (template_dir);
+    pool->homes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+            _home_free);
+    pool->context = g_main_context_ref_thread_default ();
+    pool->workers = g_thread_pool_new (_fill_worker, NULL, 1, FALSE, &error);
+    if (!pool->workers) {
+        WARN ("Failed to create home pool worker: %s",
+              error ? error->message : "");
+        g_clear_error (&error);
+        g_hash_table_unref (pool->homes);
+        g_main_context_unref (pool->context);
+        g_free (pool->template_dir);
+        g_slice_free (TlmHomePool, pool);
+        return NULL;
+    }
+
+    DBG ("keeping %u homes from '%s' ready", size, template_dir);
+    return pool;
+}
+
+/**
+ * tlm_home_pool_new_from_config:
+ * @config: (allow-none): configuration of an account plugin
+ *
+ * Creates a pool as configured by #TLM_HOME_POOL_TEMPLATE and
+ * #TLM_HOME_POOL_SIZE in @config.
+ *
+ * Returns: (transfer full): a new #TlmHomePool, or %NULL if the pool is not
+ * configured or cannot be created.
+ */
+TlmHomePool *
+tlm_home_pool_new_from_config (
+        GHashTable *config)
+{
+    const gchar *template_dir, *size;
+    guint64 value = 1;
+
+    if (!config)
+        return NULL;
+
+    template_dir = g_hash_table_lookup (config, TLM_HOME_POOL_TEMPLATE);
+    if (!template_dir || !template_dir[0])
+        return NULL;
+
+    size = g_hash_table_lookup (config, TLM_HOME_POOL_SIZE);
+    if (size) {
+        value = g_ascii_strtoull (size, NULL, 10);
+        if (value == 0)
+            return NULL;
+        value = MIN (value, G_MAXUINT);
+    }
+
+    return tlm_home_pool_new (template_dir, (guint) value);
+}
+
+/**
+ * tlm_home_pool_free:
+ * @pool: (transfer full): a #TlmHomePool
+ *
+ * Stops preparing homes. Homes already prepared are left in place and
+ * reused by the next pool for the same home directories.
+ */
+void
+tlm_home_pool_free (
+        TlmHomePool *pool)
+{
+    if (!pool)
+        return;
+
+    g_atomic_int_set (&pool->closed, TRUE);
+    _pool_unref (pool);
+}
+
+/**
+ * tlm_home_pool_prepare:
+ * @pool: a #TlmHomePool
+ * @home_dir: home directory of a guest account
+ * @uid: owner of the home
+ * @gid: group of the home
+ *
+ * Starts preparing homes for @home_dir in the background, without waiting
+ * for its first cleanup.
+ */
+void
+tlm_home_pool_prepare (
+        TlmHomePool *pool,
+        const gchar *home_dir,
+        uid_t uid,
+        gid_t gid)
+{
+    g_return_if_fail (pool != NULL);
+    g_return_if_fail (home_dir && home_dir[0] == '/');
+
+    _refill (pool, _get_home (pool, home_dir, uid, gid));
+}
+
+/**
+ * tlm_home_pool_swap:
+ * @pool: a #TlmHomePool
+ * @home_dir: home directory of a guest account
+ * @uid: owner of the home
+ * @gid: group of the home
+ * @func: (allow-none): called when the old contents are gone
+ * @user_data: data passed to @func
+ *
+ * Replaces @home_dir with a prepared home and starts preparing the next one.
+ * When none is ready yet, @home_dir is emptied instead, see
+ * tlm_home_cleanup_start(); the template is never copied on the caller's
+ * thread. The old home is deleted in the background.
+ *
+ * Returns: %TRUE if @home_dir was replaced or, failing that, emptied.
+ */
+gboolean
+tlm_home_pool_swap (
+        TlmHomePool *pool,
+        const gchar *home_dir,
+        uid_t uid,
+        gid_t gid,
+        TlmHomeCleanupFunc func,
+        gpointer user_data)
+{
+    TlmHomePoolHome *home;
+    gchar *ready;
+    gboolean ret = FALSE;
+
+    g_return_val_if_fail (pool != NULL, FALSE);
+    g_return_val_if_fail (home_dir && home_dir[0] == '/', FALSE);
+
+    if (!g_file_test (home_dir, G_FILE_TEST_IS_DIR)) {
+        WARN ("'%s' is not a directory", home_dir);
+        return FALSE;
+    }
+
+    home = _get_home (pool, home_dir, uid, gid);
+
+    while (!ret && (ready = g_queue_pop_head (&home->ready)) != NULL) {
+        ret = tlm_home_cleanup_replace (home_dir, ready, func, user_data);
+        if (ret) {
+            DBG ("swapped '%s' in as '%s'", ready, home_dir);
+        } else {
+            WARN ("cannot swap '%s' in as '%s'", ready, home_dir);
+            tlm_home_cleanup_discard (ready);
+        }
+        g_free (ready);
+    }
+
+    if (!ret) {
+        DBG ("no prepared home for '%s' yet, emptying it", home_dir);
+        ret = tlm_home_cleanup_start (home_dir, func, user_data);
+    }
+
+    _refill (pool, home);
+    return ret;
+}
@@ -0,0 +1,85 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef _TLM_HOME_POOL_H
+#define _TLM_HOME_POOL_H
+
+#include <sys/types.h>
+#include <glib.h>
+
+#include "tlm-home-cleanup.h"
+
+G_BEGIN_DECLS
+
+/**
+ * TLM_HOME_POOL_TEMPLATE:
+ *
+ * Key of the account plugin's group: directory whose contents every fresh
+ * guest home gets a copy of. Setting it enables keeping prepared guest homes
+ * ready. Default value: unset (homes are emptied).
+ */
+#define TLM_HOME_POOL_TEMPLATE              "GUEST_HOME_TEMPLATE"
+
+/**
+ * TLM_HOME_POOL_SIZE:
+ *
+ * Key of the account plugin's group: number of prepared homes kept ready
+ * per guest user when #TLM_HOME_POOL_TEMPLATE is set. Default value: 1.
+ */
+#define TLM_HOME_POOL_SIZE                  "GUEST_HOME_POOL_SIZE"
+
+typedef struct _TlmHomePool TlmHomePool;
+
+TlmHomePool *
+tlm_home_pool_new (
+        const gchar *template_dir,
+        guint size);
+
+TlmHomePool *
+tlm_home_pool_new_from_config (
+        GHashTable *config);
+
+void
+tlm_home_pool_free (
+        TlmHomePool *pool);
+
+void
+tlm_home_pool_prepare (
+        TlmHomePool *pool,
+        const gchar *home_dir,
+        uid_t uid,
+        gid_t gid);
+
+gboolean
+tlm_home_pool_swap (
+        TlmHomePool *pool,
+        const gchar *home_dir,
+        uid_t uid,
+        gid_t gid,
+        TlmHomeCleanupFunc func,
+        gpointer user_data);
+
+G_END_DECLS
+
+#endif /* _TLM_HOME_POOL_H */
@@ -26,7 +26,11 @@
 
 #include "tlm-log.h"
 
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
+#include <unistd.h>
 
 
 /**
@@ -35,6 +39,17 @@
  * @include: tlm-log.h
  *
  * This section describes various logging utilities that TLM plugins can use.
+ *
+ * Messages are copied into a per-process ring buffer and written to syslog
+ * by a background thread, so logging doesn't block the caller. When the
+ * ring is full, messages are dropped. The writer thread reports how many
+ * were dropped. Errors and critical messages are written right away. A
+ * forked child logs to stderr only until it execs: another thread of the
+ * parent may have held the syslog lock at fork time.
+ *
+ * Debug messages can be switched on and off at runtime with
+ * tlm_log_set_debug(); the initial state is taken from the TLM_DEBUG
+ * environment variable and defaults to on in debug builds.
  */
 
 /**
@@ -51,7 +66,8 @@
  * @frmt: log message format
  * @...: arguments
  *
- * Logs a debugging message
+ * Logs a debugging message. Nothing is evaluated or formatted while debug
+ * messages are disabled, see tlm_log_set_debug().
  */
 
 /**
@@ -87,13 +103,44 @@
  */
 
 
+/* must be a power of two */
+#define TLM_LOG_RING_SIZE   512
+#define TLM_LOG_ENTRY_SIZE  512
+
+typedef struct {
+    gint sequence;
+    gint priority;
+    gchar text[TLM_LOG_ENTRY_SIZE];
+} TlmLogEntry;
+
+gint tlm_log_debug_enabled = 1;
+
 static gboolean _initialized = FALSE;
 static int _log_levels_enabled = (G_LOG_LEVEL_ERROR |
                                  G_LOG_LEVEL_CRITICAL |
                                  G_LOG_LEVEL_WARNING |
+                                 G_LOG_LEVEL_MESSAGE |
                                  G_LOG_LEVEL_DEBUG);
 GHashTable *_log_handlers = NULL; /* log_domain:handler_id */
 
+/* bounded multi-producer ring: an entry's sequence equals the write
+ * position when it is free and the position + 1 once it holds a message */
+static TlmLogEntry *_ring = NULL;
+static gint _ring_head = 0;
+static guint _ring_tail = 0; /* writer thread only */
+static gint _ring_dropped = 0; /* since the writer last reported */
+static gint _ring_dropped_total = 0; /* never reset */
+
+static GThread *_writer = NULL;
+static GMutex _writer_lock;
+static GCond _writer_cond;
+static gint _writer_sleeping = 0;
+static gint _writer_stop = 0;
+static gboolean _async = FALSE;
+static gboolean _atfork_installed = FALSE;
+static gboolean _forked = FALSE;
+static gchar *_ident = NULL;
+
 static int
 _log_level_to_priority (GLogLevelFlags log_level)
 {
@@ -108,6 +155,166 @@ _log_level_to_priority (GLogLevelFlags log_level)
     }
 }
 
+static gboolean
+_ring_push (int priority, const gchar *log_domain, const gchar *message)
+{
+    TlmLogEntry *entry;
+    gint pos, seq;
+
+    for (;;) {
+        pos = g_atomic_int_get (&_ring_head);
+        entry = &_ring[(guint) pos % TLM_LOG_RING_SIZE];
+        seq = g_atomic_int_get (&entry->sequence);
+        if (seq == pos) {
+            if (g_atomic_int_compare_and_exchange (&_ring_head, pos,
+                        (gint) ((guint) pos + 1)))
+                break;
+        } else if ((gint) ((guint) seq - (guint) pos) < 0) {
+            /* the writer hasn't caught up with a full ring */
+            g_atomic_int_inc (&_ring_dropped);
+            g_atomic_int_inc (&_ring_dropped_total);
+            return FALSE;
+        }
+    }
+
+    entry->priority = priority;
+    g_snprintf (entry->text, sizeof (entry->text), "[%s] %s", log_domain,
+                message);
+    g_atomic_int_set (&entry->sequence, (gint) ((guint) pos + 1));
+
+    if (g_atomic_int_get (&_writer_sleeping)) {
+        g_mutex_lock (&_writer_lock);
+        g_cond_signal (&_writer_cond);
+        g_mutex_unlock (&_writer_lock);
+    }
+    return TRUE;
+}
+
+static TlmLogEntry *
+_ring_peek (void)
+{
+    TlmLogEntry *entry = &_ring[_ring_tail % TLM_LOG_RING_SIZE];
+
+    if (g_atomic_int_get (&entry->sequence) != (gint) (_ring_tail + 1))
+        return NULL;
+    return entry;
+}
+
+static void
+_ring_release (TlmLogEntry *entry)
+{
+    g_atomic_int_set (&entry->sequence,
+                      (gint) (_ring_tail + TLM_LOG_RING_SIZE));
+    _ring_tail++;
+}
+
+static void
+_drain_ring (void)
+{
+    TlmLogEntry *entry;
+    guint dropped;
+
+    while ((entry = _ring_peek ())) {
+        syslog (entry->priority, "%s", entry->text);
+        _ring_release (entry);
+    }
+
+    dropped = (guint) g_atomic_int_and ((guint *) &_ring_dropped, 0);
+    if (dropped)
+        syslog (LOG_WARNING, "[%s] %u log message(s) dropped", G_LOG_DOMAIN,
+                dropped);
+}
+
+static gpointer
+_log_writer (gpointer data)
+{
+    for (;;) {
+        _drain_ring ();
+        if (g_atomic_int_get (&_writer_stop))
+            break;
+
+        g_mutex_lock (&_writer_lock);
+        g_atomic_int_set (&_writer_sleeping, 1);
+        /* producers signal whenever _writer_sleeping is set */
+        if (!_ring_peek () && !g_atomic_int_get (&_writer_stop))
+            g_cond_wait (&_writer_cond, &_writer_lock);
+        g_atomic_int_set (&_writer_sleeping, 0);
+        g_mutex_unlock (&_writer_lock);
+    }
+
+    _drain_ring ();
+    return NULL;
+}
+
+/* the writer thread doesn't exist in a forked child, and syslog() or NSS
+ * may be locked there by a thread of the parent */
+static void
+_log_after_fork (void)
+{
+    _async = FALSE;
+    _writer = NULL;
+    _forked = TRUE;
+}
+
+/* same format as LOG_PERROR, without taking any lock */
+static void
+_log_to_stderr (const gchar *log_domain, const gchar *message)
+{
+    gchar line[TLM_LOG_ENTRY_SIZE];
+    gint len;
+
+    len = g_snprintf (line, sizeof (line) - 1, "%s[%d]: [%s] %s",
+            _ident ? _ident : "", (gint) getpid (), log_domain, message);
+    len = MIN (len, (gint) sizeof (line) - 2);
+    line[len++] = '\n';
+    if (write (STDERR_FILENO, line, len) < 0) {
+        /* nowhere left to report it */
+    }
+}
+
+static void
+_start_writer (void)
+{
+    guint i;
+    GError *error = NULL;
+
+    if (!_ring) {
+        _ring = g_new0 (TlmLogEntry, TLM_LOG_RING_SIZE);
+        for (i = 0; i < TLM_LOG_RING_SIZE; i++)
+            _ring[i].sequence = i;
+    }
+
+    if (!_atfork_installed) {
+        pthread_atfork (NULL, NULL, _log_after_fork);
+        _atfork_installed = TRUE;
+    }
+
+    g_atomic_int_set (&_writer_stop, 0);
+    _writer = g_thread_try_new ("tlm-log", _log_writer, NULL, &error);
+    if (!_writer) {
+        syslog (LOG_WARNING, "[%s] logging synchronously: %s", G_LOG_DOMAIN,
+                error->message);
+        g_error_free (error);
+        return;
+    }
+    _async = TRUE;
+}
+
+static void
+_stop_writer (void)
+{
+    if (!_async)
+        return;
+
+    _async = FALSE;
+    g_mutex_lock (&_writer_lock);
+    g_atomic_int_set (&_writer_stop, 1);
+    g_cond_signal (&_writer_cond);
+    g_mutex_unlock (&_writer_lock);
+    g_thread_join (_writer);
+    _writer = NULL;
+}
+
 static void
 _log_handler (const gchar *log_domain,
               GLogLevelFlags log_level,
@@ -115,23 +322,62 @@ _log_handler (const gchar *log_domain,
               gpointer userdata)
 {
     int priority ;
-    gboolean unint = FALSE;
 
     if (! (log_level & _log_levels_enabled))
         return; 
+    if ((log_level & G_LOG_LEVEL_DEBUG) &&
+        !g_atomic_int_get (&tlm_log_debug_enabled))
+        return;
 
-    if (!_initialized) {
-        tlm_log_init (log_domain);
-        unint = TRUE;
+    if (_forked) {
+        _log_to_stderr (log_domain, message);
+        return;
     }
 
     priority = _log_level_to_priority (log_level);
 
+    /* fatal messages may be the last thing the process does */
+    if (_initialized && _async &&
+        !(log_level & (G_LOG_FLAG_FATAL | G_LOG_LEVEL_ERROR |
+                       G_LOG_LEVEL_CRITICAL))) {
+        _ring_push (priority, log_domain, message);
+        return;
+    }
+
     syslog (priority, "[%s] %s", log_domain, message);
+}
 
-    if (unint) {
-        tlm_log_close (log_domain);
-    }
+/**
+ * tlm_log_set_debug:
+ * @enable: whether debug messages are logged
+ *
+ * Switches debug messages on or off at runtime. Has no effect on builds
+ * without --enable-debug, where debug messages are compiled out.
+ */
+void tlm_log_set_debug (gboolean enable)
+{
+    g_atomic_int_set (&tlm_log_debug_enabled, enable ? 1 : 0);
+}
+
+/**
+ * tlm_log_get_debug:
+ *
+ * Returns: whether debug messages are logged.
+ */
+gboolean tlm_log_get_debug (void)
+{
+    return g_atomic_int_get (&tlm_log_debug_enabled) != 0;
+}
+
+/**
+ * tlm_log_get_dropped_total:
+ *
+ * Returns: the number of messages dropped because the ring buffer was full,
+ * since the process started.
+ */
+guint tlm_log_get_dropped_total (void)
+{
+    return (guint) g_atomic_int_get (&_ring_dropped_total);
 }
 
 /**
@@ -142,6 +388,7 @@ _log_handler (const gchar *log_domain,
  */
 void tlm_log_init (const gchar *domain)
 {
+    const gchar *e_val = NULL;
 
     if (!_log_handlers) {
          _log_handlers = g_hash_table_new_full (
@@ -161,7 +408,13 @@ void tlm_log_init (const gchar *domain)
 
     if (_initialized) return ;
 
-    openlog (g_get_prgname(), LOG_PID | LOG_PERROR, LOG_DAEMON);
+    e_val = g_getenv ("TLM_DEBUG");
+    if (e_val)
+        tlm_log_set_debug (atoi (e_val) != 0);
+
+    _ident = g_strdup (g_get_prgname ());
+    openlog (_ident, LOG_PID | LOG_PERROR, LOG_DAEMON);
+    _start_writer ();
 
     _initialized = TRUE;
 }
@@ -192,7 +445,10 @@ void tlm_log_close (const gchar *domain)
     }
 
     if (_initialized) {
+        _stop_writer ();
         closelog();
+        g_free (_ident);
+        _ident = NULL;
         _initialized = FALSE;
     }
 }
@@ -35,6 +35,12 @@ G_BEGIN_DECLS
 
 void tlm_log_init (const gchar *domain);
 void tlm_log_close (const gchar *domain);
+void tlm_log_set_debug (gboolean enable);
+gboolean tlm_log_get_debug (void);
+guint tlm_log_get_dropped_total (void);
+
+/* read by DBG, use tlm_log_set_debug() to change */
+extern gint tlm_log_debug_enabled;
 
 #define EXPAND_LOG_MSG(frmt, args...) "%f %s +%d %s :" frmt, \
     g_get_monotonic_time()*1.0e-6, __FILE__, __LINE__, __PRETTY_FUNCTION__, \
@@ -42,12 +48,17 @@ void tlm_log_close (const gchar *domain);
 
 #ifdef ENABLE_DEBUG
 # define INFO(frmt, args...)     g_print(EXPAND_LOG_MSG(frmt, ##args))
-# define DBG(frmt, args...)      g_debug("debug:"EXPAND_LOG_MSG(frmt, ##args))
+# define DBG(frmt, args...)      G_STMT_START { \
+    if (G_UNLIKELY (tlm_log_debug_enabled)) \
+        g_debug("debug:"EXPAND_LOG_MSG(frmt, ##args)); \
+    } G_STMT_END
 #else
 # define INFO(frmt, args...)
 # define DBG(frmt, args...)
 #endif
 
+/* operational records kept in release builds, without source location */
+#define NOTICE(frmt, args...)   g_message(frmt, ##args)
 #define WARN(frmt, args...)     g_warning("warning:"EXPAND_LOG_MSG(frmt, ##args))
 #define CRITICAL(frmt, args...) g_critical(EXPAND_LOG_MSG(frmt, ##args))
 #define ERR(frmt, args...)      g_error(EXPAND_LOG_MSG(frmt, ##args))
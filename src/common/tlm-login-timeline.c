@@ -0,0 +1,227 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "tlm-login-timeline.h"
+
+/**
+ * SECTION:tlm-login-timeline
+ * @short_description: per-login phase timestamps
+ * @include: tlm-login-timeline.h
+ *
+ * #TlmLoginTimeline records when each phase of a login completed. tlm
+ * stamps the phases it drives, tlm-sessiond sends the stamps of the PAM
+ * and session start phases over D-Bus as an a{sx} dictionary keyed by
+ * phase name, and the merged timeline is logged once per login and
+ * returned with the session info.
+ */
+
+static const gchar *_phase_names[TLM_LOGIN_PHASE_COUNT] = {
+    "queued",
+    "sessiond-spawned",
+    "sessiond-connected",
+    "pam-start",
+    "pam-authenticate",
+    "pam-open-session",
+    "runtime-dir",
+    "terminal",
+    "fork",
+    "exec",
+};
+
+/**
+ * tlm_login_phase_get_name:
+ * @phase: a #TlmLoginPhase
+ *
+ * Returns: (transfer none): the name of @phase as used in the D-Bus
+ * dictionaries and the log, %NULL if @phase is invalid.
+ */
+const gchar *
+tlm_login_phase_get_name (
+        TlmLoginPhase phase)
+{
+    g_return_val_if_fail (phase < TLM_LOGIN_PHASE_COUNT, NULL);
+
+    return _phase_names[phase];
+}
+
+/**
+ * tlm_login_timeline_reset:
+ * @timeline: a #TlmLoginTimeline
+ *
+ * Clears all stamps of @timeline.
+ */
+void
+tlm_login_timeline_reset (
+        TlmLoginTimeline *timeline)
+{
+    g_return_if_fail (timeline != NULL);
+
+    memset (timeline->stamps, 0, sizeof (timeline->stamps));
+}
+
+/**
+ * tlm_login_timeline_mark:
+ * @timeline: a #TlmLoginTimeline
+ * @phase: the phase that just completed
+ *
+ * Stamps @phase with the current monotonic time.
+ */
+void
+tlm_login_timeline_mark (
+        TlmLoginTimeline *timeline,
+        TlmLoginPhase phase)
+{
+    g_return_if_fail (timeline != NULL && phase < TLM_LOGIN_PHASE_COUNT);
+
+    timeline->stamps[phase] = g_get_monotonic_time ();
+}
+
+/**
+ * tlm_login_timeline_to_variant:
+ * @timeline: a #TlmLoginTimeline
+ *
+ * Returns: (transfer floating): the stamped phases of @timeline as an a{sx}
+ * dictionary of phase name to monotonic time in microseconds.
+ */
+GVariant *
+tlm_login_timeline_to_variant (
+        const TlmLoginTimeline *timeline)
+{
+    GVariantBuilder builder;
+    guint i;
+
+    g_return_val_if_fail (timeline != NULL, NULL);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sx}"));
+    for (i = 0; i < TLM_LOGIN_PHASE_COUNT; i++) {
+        if (timeline->stamps[i])
+            g_variant_builder_add (&builder, "{sx}", _phase_names[i],
+                                   timeline->stamps[i]);
+    }
+    return g_variant_builder_end (&builder);
+}
+
+/**
+ * tlm_login_timeline_merge_variant:
+ * @timeline: a #TlmLoginTimeline
+ * @variant: an a{sx} dictionary as built by tlm_login_timeline_to_variant()
+ *
+ * Copies the stamps found in @variant into @timeline, unknown phase names
+ * are ignored.
+ */
+void
+tlm_login_timeline_merge_variant (
+        TlmLoginTimeline *timeline,
+        GVariant *variant)
+{
+    GVariantIter iter;
+    const gchar *name;
+    gint64 stamp;
+    guint i;
+
+    g_return_if_fail (timeline != NULL);
+
+    if (!variant ||
+        !g_variant_is_of_type (variant, G_VARIANT_TYPE ("a{sx}")))
+        return;
+
+    g_variant_iter_init (&iter, variant);
+    while (g_variant_iter_next (&iter, "{&sx}", &name, &stamp)) {
+        for (i = 0; i < TLM_LOGIN_PHASE_COUNT; i++) {
+            if (g_strcmp0 (name, _phase_names[i]) == 0) {
+                timeline->stamps[i] = stamp;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * tlm_login_timeline_to_string:
+ * @timeline: a #TlmLoginTimeline
+ *
+ * Formats the time spent in each phase since the previous stamped one, the
+ * total and the slowest phase, e.g. "total 412.3 ms, slowest
+ * pam-authenticate 300.2 ms: queued, pam-start 2.1 ms, ...". Phases
+ * stamped before the login was queued, like the spawn of a pooled
+ * tlm-sessiond, are shown as "pooled".
+ *
+ * Returns: (transfer full): the breakdown, free with g_free()
+ */
+gchar *
+tlm_login_timeline_to_string (
+        const TlmLoginTimeline *timeline)
+{
+    GString *phases;
+    gint64 base = 0, prev, last = 0, slowest = -1;
+    gint slowest_phase = -1;
+    gchar *str;
+    guint i;
+
+    g_return_val_if_fail (timeline != NULL, NULL);
+
+    /* durations are counted from the request, or from the first stamp when
+     * the request time is not known */
+    base = timeline->stamps[TLM_LOGIN_PHASE_QUEUED];
+    for (i = 0; !base && i < TLM_LOGIN_PHASE_COUNT; i++)
+        base = timeline->stamps[i];
+
+    phases = g_string_new (NULL);
+    prev = base;
+    for (i = 0; i < TLM_LOGIN_PHASE_COUNT; i++) {
+        gint64 stamp = timeline->stamps[i];
+
+        if (!stamp)
+            continue;
+        if (phases->len)
+            g_string_append (phases, ", ");
+        g_string_append (phases, _phase_names[i]);
+        if (stamp < base) {
+            g_string_append (phases, " pooled");
+            continue;
+        }
+        if (stamp == base && i == TLM_LOGIN_PHASE_QUEUED)
+            continue;
+        if (stamp < prev)
+            stamp = prev;
+        g_string_append_printf (phases, " %.1f ms", (stamp - prev) / 1000.0);
+        if (stamp - prev > slowest) {
+            slowest = stamp - prev;
+            slowest_phase = i;
+        }
+        prev = last = stamp;
+    }
+
+    if (slowest_phase < 0) {
+        str = g_strdup_printf ("no phases: %s", phases->str);
+    } else {
+        str = g_strdup_printf ("total %.1f ms, slowest %s %.1f ms: %s",
+                               (last - base) / 1000.0,
+                               _phase_names[slowest_phase],
+                               slowest / 1000.0, phases->str);
+    }
+    g_string_free (phases, TRUE);
+    return str;
+}
@@ -0,0 +1,103 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TLM_LOGIN_TIMELINE_H
+#define _TLM_LOGIN_TIMELINE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * TlmLoginPhase:
+ * @TLM_LOGIN_PHASE_QUEUED: login request queued by the D-Bus observer
+ * @TLM_LOGIN_PHASE_SESSIOND_SPAWNED: tlm-sessiond process spawned
+ * @TLM_LOGIN_PHASE_SESSIOND_CONNECTED: D-Bus handshake with tlm-sessiond done
+ * @TLM_LOGIN_PHASE_PAM_START: pam_start() returned
+ * @TLM_LOGIN_PHASE_PAM_AUTHENTICATE: pam_authenticate() returned
+ * @TLM_LOGIN_PHASE_PAM_OPEN_SESSION: pam_setcred() and pam_open_session()
+ * returned
+ * @TLM_LOGIN_PHASE_RUNTIME_DIR: XDG_RUNTIME_DIR set up
+ * @TLM_LOGIN_PHASE_TERMINAL: terminal prepared
+ * @TLM_LOGIN_PHASE_FORK: session process forked
+ * @TLM_LOGIN_PHASE_EXEC: session command about to be executed
+ * @TLM_LOGIN_PHASE_COUNT: number of phases
+ *
+ * Phases of a login in the order they complete.
+ */
+typedef enum {
+    TLM_LOGIN_PHASE_QUEUED = 0,
+    TLM_LOGIN_PHASE_SESSIOND_SPAWNED,
+    TLM_LOGIN_PHASE_SESSIOND_CONNECTED,
+    TLM_LOGIN_PHASE_PAM_START,
+    TLM_LOGIN_PHASE_PAM_AUTHENTICATE,
+    TLM_LOGIN_PHASE_PAM_OPEN_SESSION,
+    TLM_LOGIN_PHASE_RUNTIME_DIR,
+    TLM_LOGIN_PHASE_TERMINAL,
+    TLM_LOGIN_PHASE_FORK,
+    TLM_LOGIN_PHASE_EXEC,
+    TLM_LOGIN_PHASE_COUNT
+} TlmLoginPhase;
+
+/**
+ * TlmLoginTimeline:
+ * @stamps: g_get_monotonic_time() at which each phase completed, 0 for
+ * phases not reached
+ *
+ * Timestamps of one login. The monotonic clock is shared by all processes
+ * on the host, so stamps taken by tlm and tlm-sessiond can be merged.
+ */
+typedef struct _TlmLoginTimeline
+{
+    gint64 stamps[TLM_LOGIN_PHASE_COUNT];
+} TlmLoginTimeline;
+
+const gchar *
+tlm_login_phase_get_name (
+        TlmLoginPhase phase);
+
+void
+tlm_login_timeline_reset (
+        TlmLoginTimeline *timeline);
+
+void
+tlm_login_timeline_mark (
+        TlmLoginTimeline *timeline,
+        TlmLoginPhase phase);
+
+GVariant *
+tlm_login_timeline_to_variant (
+        const TlmLoginTimeline *timeline);
+
+void
+tlm_login_timeline_merge_variant (
+        TlmLoginTimeline *timeline,
+        GVariant *variant);
+
+gchar *
+tlm_login_timeline_to_string (
+        const TlmLoginTimeline *timeline);
+
+G_END_DECLS
+
+#endif /* _TLM_LOGIN_TIMELINE_H */
@@ -0,0 +1,278 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <glib-unix.h>
+
+#include "tlm-process-watch.h"
+#include "tlm-log.h"
+
+/* idtype for waitid() on a pidfd, Linux >= 5.4 */
+#define TLM_P_PIDFD 3
+
+/* Each watched child gets a pidfd and its own fd source in the default main
+ * context: an exit wakes up exactly the source of that child and the child
+ * is reaped with waitid(P_PIDFD). Signals go through the pidfd, so they can
+ * never hit a recycled pid. Kernels without pidfd support, or without
+ * waitid(P_PIDFD) like 5.3, fall back to a GLib child watch. */
+struct _TlmProcessWatch
+{
+    GPid pid;
+    gint pidfd;
+    guint source_id;
+    gboolean is_reaped;
+    TlmProcessWatchFunc func;
+    gpointer user_data;
+};
+
+static int
+_pidfd_open (pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall (SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int
+_pidfd_send_signal (int pidfd, int sig)
+{
+#ifdef SYS_pidfd_send_signal
+    return syscall (SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* probed once on the first pidfd, -1 until then */
+static gint _pidfd_wait_supported = -1;
+
+static gboolean
+_pidfd_wait_check (int pidfd)
+{
+    siginfo_t info;
+
+    if (_pidfd_wait_supported < 0) {
+        /* WNOWAIT leaves an already exited child to the real wait */
+        memset (&info, 0, sizeof (info));
+        _pidfd_wait_supported = waitid ((idtype_t) TLM_P_PIDFD, pidfd, &info,
+                WEXITED | WNOHANG | WNOWAIT) == 0 || errno != EINVAL;
+        if (!_pidfd_wait_supported)
+            DBG ("waitid(P_PIDFD) not supported, using child watches");
+    }
+    return _pidfd_wait_supported;
+}
+
+static gint
+_siginfo_to_status (const siginfo_t *info)
+{
+    switch (info->si_code) {
+        case CLD_EXITED:
+            return (info->si_status & 0xff) << 8;
+        case CLD_KILLED:
+            return info->si_status & 0x7f;
+        case CLD_DUMPED:
+            return (info->si_status & 0x7f) | 0x80;
+        default:
+            return 0;
+    }
+}
+
+static void
+_process_exited (
+        TlmProcessWatch *watch,
+        gint status)
+{
+    watch->is_reaped = TRUE;
+    watch->source_id = 0;
+
+    /* the callback is allowed to free the watch */
+    if (watch->func)
+        watch->func (watch->pid, status, watch->user_data);
+}
+
+static gboolean
+_on_pidfd_ready (
+        gint fd,
+        GIOCondition condition,
+        gpointer user_data)
+{
+    TlmProcessWatch *watch = (TlmProcessWatch *) user_data;
+    siginfo_t info;
+    gint status = 0;
+    pid_t ret;
+
+    memset (&info, 0, sizeof (info));
+    if (waitid ((idtype_t) TLM_P_PIDFD, fd, &info, WEXITED | WNOHANG) < 0) {
+        if (errno == EINTR)
+            return G_SOURCE_CONTINUE;
+        WARN ("waitid(%d): %s", watch->pid, strerror (errno));
+
+        /* still our child until it is reaped, so the pid is safe to use */
+        do {
+            ret = waitpid (watch->pid, &status, WNOHANG);
+        } while (ret < 0 && errno == EINTR);
+        if (ret == 0)
+            return G_SOURCE_CONTINUE;
+        if (ret < 0)
+            WARN ("waitpid(%d): %s", watch->pid, strerror (errno));
+        _process_exited (watch, ret > 0 ? status : 0);
+        return G_SOURCE_REMOVE;
+    }
+
+    if (info.si_pid == 0)
+        return G_SOURCE_CONTINUE;
+
+    _process_exited (watch, _siginfo_to_status (&info));
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_on_child_watch (
+        GPid pid,
+        gint status,
+        gpointer user_data)
+{
+    g_spawn_close_pid (pid);
+    _process_exited ((TlmProcessWatch *) user_data, status);
+}
+
+TlmProcessWatch *
+tlm_process_watch_new (
+        GPid pid,
+        TlmProcessWatchFunc func,
+        gpointer user_data)
+{
+    TlmProcessWatch *watch = NULL;
+
+    g_return_val_if_fail (pid > 0, NULL);
+
+    watch = g_slice_new0 (TlmProcessWatch);
+    watch->pid = pid;
+    watch->func = func;
+    watch->user_data = user_data;
+
+    /* a pidfd without waitid(P_PIDFD) is still used to send signals */
+    watch->pidfd = _pidfd_open (pid);
+    if (watch->pidfd >= 0 && _pidfd_wait_check (watch->pidfd)) {
+        watch->source_id = g_unix_fd_add_full (G_PRIORITY_DEFAULT,
+                watch->pidfd, G_IO_IN, _on_pidfd_ready, watch, NULL);
+    } else {
+        if (watch->pidfd < 0)
+            DBG ("pidfd_open(%d): %s, using child watch", pid,
+                    strerror (errno));
+        watch->source_id = g_child_watch_add (pid, _on_child_watch, watch);
+    }
+
+    return watch;
+}
+
+void
+tlm_process_watch_free (
+        TlmProcessWatch *watch)
+{
+    if (!watch)
+        return;
+
+    if (watch->source_id) {
+        g_source_remove (watch->source_id);
+        watch->source_id = 0;
+    }
+    if (watch->pidfd >= 0) {
+        close (watch->pidfd);
+        watch->pidfd = -1;
+    }
+    g_slice_free (TlmProcessWatch, watch);
+}
+
+GPid
+tlm_process_watch_get_pid (
+        TlmProcessWatch *watch)
+{
+    g_return_val_if_fail (watch != NULL, 0);
+
+    return watch->pid;
+}
+
+gboolean
+tlm_process_watch_is_alive (
+        TlmProcessWatch *watch)
+{
+    g_return_val_if_fail (watch != NULL, FALSE);
+
+    return !watch->is_reaped;
+}
+
+gboolean
+tlm_process_watch_signal (
+        TlmProcessWatch *watch,
+        int sig)
+{
+    g_return_val_if_fail (watch != NULL, FALSE);
+
+    if (watch->is_reaped) {
+        errno = ESRCH;
+        return FALSE;
+    }
+
+    if (watch->pidfd >= 0) {
+        if (_pidfd_send_signal (watch->pidfd, sig) == 0)
+            return TRUE;
+        if (errno != ENOSYS)
+            return FALSE;
+    }
+
+    /* not reaped yet, so the pid still refers to our child */
+    return kill (watch->pid, sig) == 0;
+}
+
+gboolean
+tlm_process_watch_signal_group (
+        TlmProcessWatch *watch,
+        int sig)
+{
+    g_return_val_if_fail (watch != NULL, FALSE);
+
+    if (watch->is_reaped) {
+        errno = ESRCH;
+        return FALSE;
+    }
+
+    /* the watched process leads its own group; as long as it has not been
+     * reaped neither its pid nor the group id can be reused */
+    if (killpg (watch->pid, sig) == 0)
+        return TRUE;
+    if (errno != ESRCH)
+        return FALSE;
+
+    /* not a group leader (yet) */
+    return tlm_process_watch_signal (watch, sig);
+}
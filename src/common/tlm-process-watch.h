@@ -0,0 +1,70 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TLM_PROCESS_WATCH_H
+#define _TLM_PROCESS_WATCH_H
+
+#include <sys/types.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TlmProcessWatch TlmProcessWatch;
+
+/* status is in waitpid() format */
+typedef void (*TlmProcessWatchFunc) (
+        GPid pid,
+        gint status,
+        gpointer user_data);
+
+TlmProcessWatch *
+tlm_process_watch_new (
+        GPid pid,
+        TlmProcessWatchFunc func,
+        gpointer user_data);
+
+void
+tlm_process_watch_free (
+        TlmProcessWatch *watch);
+
+GPid
+tlm_process_watch_get_pid (
+        TlmProcessWatch *watch);
+
+gboolean
+tlm_process_watch_is_alive (
+        TlmProcessWatch *watch);
+
+gboolean
+tlm_process_watch_signal (
+        TlmProcessWatch *watch,
+        int sig);
+
+gboolean
+tlm_process_watch_signal_group (
+        TlmProcessWatch *watch,
+        int sig);
+
+G_END_DECLS
+
+#endif /* _TLM_PROCESS_WATCH_H */
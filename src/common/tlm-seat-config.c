@@ -0,0 +1,283 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tlm-seat-config.h"
+#include "tlm-config-general.h"
+#include "tlm-config-seat.h"
+#include "tlm-log.h"
+
+/**
+ * SECTION:tlm-seat-config
+ * @short_description: compiled per-seat configuration
+ * @include: tlm-seat-config.h
+ *
+ * #TlmSeatConfig holds the values of the keys tlm reads on every login,
+ * looked up and parsed once when the snapshot is built. Code on the login
+ * path reads the struct fields instead of going through the string based
+ * #TlmConfig getters and the seat group to General group fallback.
+ *
+ * |[
+ *
+ * TlmSeatConfig *seat_config = tlm_config_get_seat_config (config, "seat0");
+ * if (seat_config->setup_terminal)
+ *     ...
+ * tlm_seat_config_unref (seat_config);
+ *
+ * ]|
+ */
+
+typedef enum {
+    TLM_SEAT_CONFIG_BOOLEAN,
+    TLM_SEAT_CONFIG_UINT,
+    TLM_SEAT_CONFIG_MODE,
+    TLM_SEAT_CONFIG_STRING,
+    TLM_SEAT_CONFIG_PRESENT
+} TlmSeatConfigType;
+
+/* groups a key is looked up in, the seat group takes precedence */
+#define TLM_SEAT_CONFIG_SCOPE_SEAT      (1 << 0)
+#define TLM_SEAT_CONFIG_SCOPE_GENERAL   (1 << 1)
+#define TLM_SEAT_CONFIG_SCOPE_BOTH \
+        (TLM_SEAT_CONFIG_SCOPE_SEAT | TLM_SEAT_CONFIG_SCOPE_GENERAL)
+
+typedef struct {
+    const gchar *key;
+    TlmSeatConfigType type;
+    guint scope;
+    gsize offset;
+    guint default_value;
+    const gchar *default_string;
+} TlmSeatConfigField;
+
+#define FIELD(key, type, scope, member, def, def_str) \
+    { key, TLM_SEAT_CONFIG_##type, TLM_SEAT_CONFIG_SCOPE_##scope, \
+      G_STRUCT_OFFSET (TlmSeatConfig, member), def, def_str }
+
+static const TlmSeatConfigField _fields[] = {
+    FIELD (TLM_CONFIG_SEAT_ACTIVE, BOOLEAN, SEAT, active, TRUE, NULL),
+    FIELD (TLM_CONFIG_SEAT_VTNR, UINT, SEAT, vtnr, 0, NULL),
+    FIELD (TLM_CONFIG_GENERAL_NSEATS, PRESENT, GENERAL, has_nseats, 0, NULL),
+    FIELD (TLM_CONFIG_GENERAL_AUTO_LOGIN, BOOLEAN, GENERAL, auto_login,
+           TRUE, NULL),
+    FIELD (TLM_CONFIG_GENERAL_X11_SESSION, BOOLEAN, GENERAL, x11_session,
+           FALSE, NULL),
+    FIELD (TLM_CONFIG_GENERAL_PAUSE_SESSION, BOOLEAN, GENERAL, pause_session,
+           FALSE, NULL),
+    FIELD (TLM_CONFIG_GENERAL_THROTTLE_RELOGIN, BOOLEAN, GENERAL,
+           throttle_relogin, TRUE, NULL),
+    FIELD (TLM_CONFIG_GENERAL_SETUP_TERMINAL, BOOLEAN, BOTH, setup_terminal,
+           FALSE, NULL),
+    FIELD (TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR, BOOLEAN, BOTH,
+           setup_runtime_dir, FALSE, NULL),
+    FIELD (TLM_CONFIG_GENERAL_RUNTIME_MODE, MODE, BOTH, runtime_mode,
+           0700, NULL),
+    FIELD (TLM_CONFIG_GENERAL_SESSIOND_POOL_SIZE, UINT, BOTH,
+           sessiond_pool_size, 0, NULL),
+    FIELD (TLM_CONFIG_GENERAL_SESSION_PATH, STRING, GENERAL, session_path,
+           0, "/usr/local/bin:/usr/bin:/bin"),
+    FIELD (TLM_CONFIG_GENERAL_DATA_DIRS, STRING, GENERAL, data_dirs,
+           0, "/usr/share:/usr/local/share"),
+    FIELD (TLM_CONFIG_GENERAL_SESSION_CMD, STRING, BOTH, session_cmd,
+           0, NULL),
+    FIELD (TLM_CONFIG_GENERAL_SESSION_TYPE, STRING, BOTH, session_type,
+           0, NULL),
+    FIELD (TLM_CONFIG_GENERAL_PAM_SERVICE, STRING, BOTH, pam_service,
+           0, "tlm-login"),
+    FIELD (TLM_CONFIG_GENERAL_DEFAULT_PAM_SERVICE, STRING, BOTH,
+           default_pam_service, 0, "tlm-default-login"),
+    FIELD (TLM_CONFIG_GENERAL_DEFAULT_USER, STRING, BOTH, default_user,
+           0, "guest"),
+};
+
+#undef FIELD
+
+static const gchar *
+_resolve_group (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const TlmSeatConfigField *field)
+{
+    if ((field->scope & TLM_SEAT_CONFIG_SCOPE_SEAT) && seat_id &&
+        tlm_config_has_key (config, seat_id, field->key))
+        return seat_id;
+    if ((field->scope & TLM_SEAT_CONFIG_SCOPE_GENERAL) &&
+        tlm_config_has_key (config, TLM_CONFIG_GENERAL, field->key))
+        return TLM_CONFIG_GENERAL;
+    return NULL;
+}
+
+static void
+_compile_field (
+        TlmSeatConfig *seat_config,
+        TlmConfig *config,
+        const TlmSeatConfigField *field)
+{
+    gpointer member = G_STRUCT_MEMBER_P (seat_config, field->offset);
+    const gchar *group = _resolve_group (config, seat_config->seat_id, field);
+    const gchar *str_value = NULL;
+
+    switch (field->type) {
+        case TLM_SEAT_CONFIG_BOOLEAN:
+            *(gboolean *) member = group ?
+                tlm_config_get_boolean (config, group, field->key,
+                        field->default_value) :
+                (gboolean) field->default_value;
+            break;
+        case TLM_SEAT_CONFIG_UINT:
+            *(guint *) member = group ?
+                tlm_config_get_uint (config, group, field->key,
+                        field->default_value) :
+                field->default_value;
+            break;
+        case TLM_SEAT_CONFIG_MODE:
+            *(guint *) member = field->default_value;
+            if (group)
+                str_value = tlm_config_get_string (config, group, field->key);
+            if (str_value && sscanf (str_value, "%o", (guint *) member) <= 0) {
+                WARN ("Invalid %s '%s'", field->key, str_value);
+                *(guint *) member = field->default_value;
+            }
+            break;
+        case TLM_SEAT_CONFIG_STRING:
+            if (group)
+                str_value = tlm_config_get_string (config, group, field->key);
+            *(gchar **) member = g_strdup (str_value ? str_value :
+                    field->default_string);
+            break;
+        case TLM_SEAT_CONFIG_PRESENT:
+            *(gboolean *) member = group != NULL;
+            break;
+    }
+}
+
+/**
+ * tlm_seat_config_new:
+ * @config: (transfer none): an instance of #TlmConfig
+ * @seat_id: (allow-none): the seat id, %NULL for General values only
+ *
+ * Builds a snapshot of @config for @seat_id. Most callers want the cached
+ * snapshot returned by tlm_config_get_seat_config() instead.
+ *
+ * Returns: (transfer full): a new #TlmSeatConfig
+ */
+TlmSeatConfig *
+tlm_seat_config_new (
+        TlmConfig *config,
+        const gchar *seat_id)
+{
+    TlmSeatConfig *seat_config = NULL;
+    guint i;
+
+    g_return_val_if_fail (config && TLM_IS_CONFIG (config), NULL);
+
+    seat_config = g_slice_new0 (TlmSeatConfig);
+    seat_config->ref_count = 1;
+    seat_config->seat_id = g_strdup (seat_id);
+
+    for (i = 0; i < G_N_ELEMENTS (_fields); i++)
+        _compile_field (seat_config, config, &_fields[i]);
+
+    DBG ("compiled configuration of seat %s", seat_id ? seat_id : "(none)");
+    return seat_config;
+}
+
+/**
+ * tlm_seat_config_ref:
+ * @seat_config: (transfer none): a #TlmSeatConfig
+ *
+ * Increments the reference count of @seat_config.
+ *
+ * Returns: (transfer full): @seat_config
+ */
+TlmSeatConfig *
+tlm_seat_config_ref (
+        TlmSeatConfig *seat_config)
+{
+    g_return_val_if_fail (seat_config != NULL, NULL);
+
+    g_atomic_int_inc (&seat_config->ref_count);
+    return seat_config;
+}
+
+/**
+ * tlm_seat_config_unref:
+ * @seat_config: (transfer full): a #TlmSeatConfig
+ *
+ * Decrements the reference count of @seat_config and frees it when the
+ * count drops to zero.
+ */
+void
+tlm_seat_config_unref (
+        TlmSeatConfig *seat_config)
+{
+    guint i;
+
+    if (!seat_config ||
+        !g_atomic_int_dec_and_test (&seat_config->ref_count))
+        return;
+
+    for (i = 0; i < G_N_ELEMENTS (_fields); i++) {
+        if (_fields[i].type == TLM_SEAT_CONFIG_STRING)
+            g_free (G_STRUCT_MEMBER (gchar *, seat_config, _fields[i].offset));
+    }
+    g_free (seat_config->seat_id);
+    g_slice_free (TlmSeatConfig, seat_config);
+}
+
+/**
+ * tlm_seat_config_equal:
+ * @a: (transfer none): a #TlmSeatConfig
+ * @b: (transfer none): a #TlmSeatConfig
+ *
+ * Compares the values of two snapshots, for example of the same seat before
+ * and after the configuration was reloaded.
+ *
+ * Returns: %TRUE if all values are equal, %FALSE otherwise.
+ */
+gboolean
+tlm_seat_config_equal (
+        const TlmSeatConfig *a,
+        const TlmSeatConfig *b)
+{
+    guint i;
+
+    g_return_val_if_fail (a != NULL && b != NULL, FALSE);
+
+    for (i = 0; i < G_N_ELEMENTS (_fields); i++) {
+        gsize offset = _fields[i].offset;
+
+        if (_fields[i].type == TLM_SEAT_CONFIG_STRING) {
+            if (g_strcmp0 (G_STRUCT_MEMBER (gchar *, a, offset),
+                           G_STRUCT_MEMBER (gchar *, b, offset)) != 0)
+                return FALSE;
+        } else if (G_STRUCT_MEMBER (guint, a, offset) !=
+                   G_STRUCT_MEMBER (guint, b, offset)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
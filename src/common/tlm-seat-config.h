@@ -0,0 +1,114 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __TLM_SEAT_CONFIG_H_
+#define __TLM_SEAT_CONFIG_H_
+
+#include <glib.h>
+
+#include "tlm-config.h"
+
+G_BEGIN_DECLS
+
+/**
+ * TlmSeatConfig:
+ * @ref_count: reference count
+ * @seat_id: the seat the values were resolved for
+ * @active: #TLM_CONFIG_SEAT_ACTIVE
+ * @vtnr: #TLM_CONFIG_SEAT_VTNR
+ * @has_nseats: whether #TLM_CONFIG_GENERAL_NSEATS is configured
+ * @auto_login: #TLM_CONFIG_GENERAL_AUTO_LOGIN
+ * @x11_session: #TLM_CONFIG_GENERAL_X11_SESSION
+ * @pause_session: #TLM_CONFIG_GENERAL_PAUSE_SESSION
+ * @throttle_relogin: #TLM_CONFIG_GENERAL_THROTTLE_RELOGIN
+ * @setup_terminal: #TLM_CONFIG_GENERAL_SETUP_TERMINAL
+ * @setup_runtime_dir: #TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR
+ * @runtime_mode: #TLM_CONFIG_GENERAL_RUNTIME_MODE, parsed
+ * @sessiond_pool_size: #TLM_CONFIG_GENERAL_SESSIOND_POOL_SIZE
+ * @session_path: #TLM_CONFIG_GENERAL_SESSION_PATH
+ * @data_dirs: #TLM_CONFIG_GENERAL_DATA_DIRS
+ * @session_cmd: #TLM_CONFIG_GENERAL_SESSION_CMD
+ * @session_type: #TLM_CONFIG_GENERAL_SESSION_TYPE
+ * @pam_service: #TLM_CONFIG_GENERAL_PAM_SERVICE
+ * @default_pam_service: #TLM_CONFIG_GENERAL_DEFAULT_PAM_SERVICE
+ * @default_user: #TLM_CONFIG_GENERAL_DEFAULT_USER
+ *
+ * Immutable snapshot of the configuration of one seat, with values of the
+ * seat's group already merged over the General group and parsed into their
+ * types. Keys missing from both groups hold their documented defaults,
+ * strings without a default are %NULL. Obtained with
+ * tlm_config_get_seat_config(); the snapshot stays valid after the
+ * configuration is reloaded or changed.
+ */
+typedef struct _TlmSeatConfig
+{
+    gint ref_count;
+    gchar *seat_id;
+
+    gboolean active;
+    guint vtnr;
+    gboolean has_nseats;
+    gboolean auto_login;
+    gboolean x11_session;
+    gboolean pause_session;
+    gboolean throttle_relogin;
+    gboolean setup_terminal;
+    gboolean setup_runtime_dir;
+    guint runtime_mode;
+    guint sessiond_pool_size;
+
+    gchar *session_path;
+    gchar *data_dirs;
+    gchar *session_cmd;
+    gchar *session_type;
+    gchar *pam_service;
+    gchar *default_pam_service;
+    gchar *default_user;
+} TlmSeatConfig;
+
+TlmSeatConfig *
+tlm_config_get_seat_config (
+        TlmConfig *config,
+        const gchar *seat_id);
+
+TlmSeatConfig *
+tlm_seat_config_new (
+        TlmConfig *config,
+        const gchar *seat_id);
+
+TlmSeatConfig *
+tlm_seat_config_ref (
+        TlmSeatConfig *seat_config);
+
+void
+tlm_seat_config_unref (
+        TlmSeatConfig *seat_config);
+
+gboolean
+tlm_seat_config_equal (
+        const TlmSeatConfig *a,
+        const TlmSeatConfig *b);
+
+G_END_DECLS
+
+#endif /* __TLM_SEAT_CONFIG_H_ */
@@ -0,0 +1,173 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "tlm-spawn.h"
+#include "tlm-error.h"
+#include "tlm-log.h"
+
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+extern char **environ;
+
+struct _tlm_dirent64
+{
+    guint64 d_ino;
+    gint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static int
+_parse_fd (const char *name)
+{
+    int fd = 0;
+
+    if (!*name)
+        return -1;
+    for (; *name; name++) {
+        if (*name < '0' || *name > '9')
+            return -1;
+        fd = fd * 10 + (*name - '0');
+    }
+    return fd;
+}
+
+/* only async-signal-safe calls, this runs in forked children */
+static int
+_set_cloexec_from_proc (int first_fd)
+{
+    char buf[4096] __attribute__ ((aligned (8)));
+    int dir_fd;
+    long n;
+
+    dir_fd = open ("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0)
+        return -1;
+
+    while ((n = syscall (SYS_getdents64, dir_fd, buf, sizeof (buf))) > 0) {
+        long off = 0;
+        while (off < n) {
+            struct _tlm_dirent64 *de = (struct _tlm_dirent64 *) (buf + off);
+            int fd = _parse_fd (de->d_name);
+            if (fd >= first_fd && fd != dir_fd)
+                fcntl (fd, F_SETFD, FD_CLOEXEC);
+            off += de->d_reclen;
+        }
+    }
+
+    close (dir_fd);
+    return n < 0 ? -1 : 0;
+}
+
+/* Marks every descriptor from first_fd up as close-on-exec: a single
+ * close_range() call where available, otherwise only the descriptors listed
+ * in /proc/self/fd instead of the whole RLIMIT_NOFILE range. */
+void
+tlm_spawn_set_cloexec_from (int first_fd)
+{
+    long open_max;
+    int fd;
+
+#ifdef SYS_close_range
+    if (syscall (SYS_close_range, first_fd, ~0U, CLOSE_RANGE_CLOEXEC) == 0)
+        return;
+#endif
+
+    if (_set_cloexec_from_proc (first_fd) == 0)
+        return;
+
+    open_max = sysconf (_SC_OPEN_MAX);
+    for (fd = first_fd; fd < open_max; fd++)
+        fcntl (fd, F_SETFD, FD_CLOEXEC);
+}
+
+/* Spawns argv[0] from PATH with posix_spawn(), which shares the address
+ * space with the parent until exec (clone with CLONE_VM | CLONE_VFORK in
+ * glibc) instead of copying the page tables of a large process. The child
+ * starts with default signal handlers, an empty signal mask and, on
+ * request, in a process group of its own. Exec failures are reported. */
+gboolean
+tlm_spawn_async (
+        gchar **argv,
+        gboolean new_process_group,
+        GPid *child_pid,
+        GError **error)
+{
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t mask;
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    pid_t pid = 0;
+    int ret;
+
+    g_return_val_if_fail (argv && argv[0], FALSE);
+
+    posix_spawnattr_init (&attr);
+    posix_spawn_file_actions_init (&actions);
+
+    sigfillset (&mask);
+    posix_spawnattr_setsigdefault (&attr, &mask);
+    sigemptyset (&mask);
+    posix_spawnattr_setsigmask (&attr, &mask);
+
+    if (new_process_group) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup (&attr, 0);
+    }
+    posix_spawnattr_setflags (&attr, flags);
+
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+    posix_spawn_file_actions_addclosefrom_np (&actions, 3);
+#endif
+
+    ret = posix_spawnp (&pid, argv[0], &actions, &attr, argv, environ);
+
+    posix_spawn_file_actions_destroy (&actions);
+    posix_spawnattr_destroy (&attr);
+
+    if (ret != 0) {
+        WARN ("failed to spawn '%s': %s", argv[0], strerror (ret));
+        if (error)
+            *error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_INTERNAL_SERVER,
+                    "Failed to spawn '%s': %s", argv[0], strerror (ret));
+        return FALSE;
+    }
+
+    DBG ("spawned '%s' with pid %d", argv[0], pid);
+    if (child_pid)
+        *child_pid = pid;
+    return TRUE;
+}
@@ -0,0 +1,84 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef _TLM_TRACE_H
+#define _TLM_TRACE_H
+
+#include <glib.h>
+
+#include "config.h"
+
+/* USDT probes of the "tlm" provider, for bpftrace, perf and systemtap on
+ * hosts running a stock build:
+ *
+ *   bpftrace -e 'usdt:/usr/bin/tlm:tlm:session__created
+ *                { printf ("%s %s\n", str (arg0), str (arg1)); }'
+ *
+ * Every probe takes the seat id and session id, NULL while not known, and
+ * the uid, -1 while not known, followed by the probe specific arguments:
+ *
+ *   tlm:       session__create__request  username
+ *              session__create           username
+ *              session__created
+ *              sessiond__spawn           pid
+ *              sessiond__signal          pid, signal
+ *              request__enqueue          request type, queue length
+ *              request__dequeue          request type, usec waited
+ *   tlm-sessiond:
+ *              pam__enter                phase
+ *              pam__exit                 phase, PAM return code
+ *              session__fork             pid
+ *              session__exec             command
+ *              session__signal           pid, signal
+ *   tlm-launcher:
+ *              launcher__spawn           pid, command
+ *              launcher__exit            pid, wait status
+ *
+ * A probe is a single nop in the code; its arguments are evaluated in
+ * place, so only pass values that are already at hand. Builds without
+ * sys/sdt.h, or configured with --disable-usdt, have no probes at all. */
+
+#ifdef ENABLE_USDT
+
+#include <sys/sdt.h>
+
+#define TLM_TRACE(probe, seat_id, session_id, uid) \
+    DTRACE_PROBE3 (tlm, probe, seat_id, session_id, (gint) (uid))
+#define TLM_TRACE1(probe, seat_id, session_id, uid, arg1) \
+    DTRACE_PROBE4 (tlm, probe, seat_id, session_id, (gint) (uid), arg1)
+#define TLM_TRACE2(probe, seat_id, session_id, uid, arg1, arg2) \
+    DTRACE_PROBE5 (tlm, probe, seat_id, session_id, (gint) (uid), arg1, arg2)
+
+#else
+
+#define TLM_TRACE(probe, seat_id, session_id, uid) \
+    do { } while (0)
+#define TLM_TRACE1(probe, seat_id, session_id, uid, arg1) \
+    do { } while (0)
+#define TLM_TRACE2(probe, seat_id, session_id, uid, arg1, arg2) \
+    do { } while (0)
+
+#endif
+
+#endif /* _TLM_TRACE_H */
@@ -26,6 +26,7 @@
 
 #include <sys/types.h>
 #include <pwd.h>
+#include <grp.h>
 #include <sys/stat.h>
 #include <glib/gstdio.h>
 #include <utmp.h>
@@ -33,8 +34,10 @@
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <arpa/inet.h>
 #include <sys/inotify.h>
 #include <netdb.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <glib/gstdio.h>
@@ -44,6 +47,7 @@
 
 #include "tlm-utils.h"
 #include "tlm-log.h"
+#include "tlm-error.h"
 #include "tlm-config.h"
 #include "tlm-config-general.h"
 
@@ -70,52 +74,259 @@ tlm_user_get_name (uid_t user_id)
     return pwent->pw_name;
 }
 
+/* Resolved passwd entry and group list of a user. Entries are kept until
+ * /etc/passwd or /etc/group changes or they get older than
+ * TLM_USER_INFO_TTL, which covers network NSS sources and systems where
+ * /etc cannot be watched. */
+#define TLM_USER_INFO_TTL (60 * G_USEC_PER_SEC)
+
+G_LOCK_DEFINE_STATIC (user_info_cache);
+static GHashTable *user_info_cache = NULL;
+static guint user_info_watch_id = 0;
+static gboolean user_info_watch_failed = FALSE;
+static guint user_info_nss_calls = 0;
+
+static void
+_user_info_free (TlmUserInfo *info)
+{
+    g_free (info->name);
+    g_free (info->home_dir);
+    g_free (info->shell);
+    g_free (info->groups);
+    g_slice_free (TlmUserInfo, info);
+}
+
+TlmUserInfo *
+tlm_user_info_ref (TlmUserInfo *info)
+{
+    g_return_val_if_fail (info != NULL, NULL);
+
+    g_atomic_int_inc (&info->ref_count);
+    return info;
+}
+
+void
+tlm_user_info_unref (TlmUserInfo *info)
+{
+    if (info && g_atomic_int_dec_and_test (&info->ref_count))
+        _user_info_free (info);
+}
+
+void
+tlm_user_info_invalidate_cache (void)
+{
+    G_LOCK (user_info_cache);
+    if (user_info_cache)
+        g_hash_table_remove_all (user_info_cache);
+    G_UNLOCK (user_info_cache);
+}
+
+guint
+tlm_user_info_get_nss_calls (void)
+{
+    return g_atomic_int_get (&user_info_nss_calls);
+}
+
+static gboolean
+_on_user_db_changed (
+        gint fd,
+        GIOCondition condition,
+        gpointer user_data)
+{
+    gchar buf[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    gboolean changed = FALSE;
+    ssize_t len;
+
+    while ((len = read (fd, buf, sizeof (buf))) > 0) {
+        gchar *ptr = buf;
+        while (ptr < buf + len) {
+            struct inotify_event *ie = (struct inotify_event *) ptr;
+            if (ie->len && (g_strcmp0 (ie->name, "passwd") == 0 ||
+                            g_strcmp0 (ie->name, "group") == 0))
+                changed = TRUE;
+            ptr += sizeof (struct inotify_event) + ie->len;
+        }
+    }
+
+    if (changed) {
+        DBG ("user database changed, dropping cached user info");
+        tlm_user_info_invalidate_cache ();
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/* must be called with the cache lock held */
+static void
+_user_info_setup_watch (void)
+{
+    int ifd;
+
+    if (user_info_watch_id || user_info_watch_failed)
+        return;
+
+    /* the files are usually replaced by rename, so watch the directory */
+    ifd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (ifd < 0 || inotify_add_watch (ifd, "/etc", IN_CLOSE_WRITE |
+                IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0) {
+        WARN ("Failed to watch user database: %s", strerror (errno));
+        if (ifd >= 0) close (ifd);
+        user_info_watch_failed = TRUE;
+        return;
+    }
+
+    user_info_watch_id = g_unix_fd_add_full (G_PRIORITY_DEFAULT, ifd, G_IO_IN,
+            _on_user_db_changed, NULL, NULL);
+}
+
+static TlmUserInfo *
+_user_info_resolve (const gchar *username)
+{
+    TlmUserInfo *info = NULL;
+    struct passwd pwent, *result = NULL;
+    gchar *buf = NULL;
+    long buf_len;
+    int ngroups = 32;
+    int ret;
+
+    buf_len = sysconf (_SC_GETPW_R_SIZE_MAX);
+    if (buf_len <= 0)
+        buf_len = 16384;
+
+    do {
+        buf = g_realloc (buf, buf_len);
+        g_atomic_int_inc (&user_info_nss_calls);
+        ret = getpwnam_r (username, &pwent, buf, buf_len, &result);
+        buf_len *= 2;
+    } while (ret == ERANGE);
+
+    if (ret != 0 || !result) {
+        g_free (buf);
+        return NULL;
+    }
+
+    info = g_slice_new0 (TlmUserInfo);
+    info->ref_count = 1;
+    info->name = g_strdup (pwent.pw_name);
+    info->uid = pwent.pw_uid;
+    info->gid = pwent.pw_gid;
+    info->home_dir = g_strdup (pwent.pw_dir);
+    info->shell = g_strdup (pwent.pw_shell);
+    info->resolve_time = g_get_monotonic_time ();
+    g_free (buf);
+
+    info->groups = g_new (gid_t, ngroups);
+    g_atomic_int_inc (&user_info_nss_calls);
+    if (getgrouplist (username, info->gid, info->groups, &ngroups) < 0) {
+        /* ngroups holds the needed size now */
+        info->groups = g_renew (gid_t, info->groups, ngroups);
+        g_atomic_int_inc (&user_info_nss_calls);
+        if (getgrouplist (username, info->gid, info->groups, &ngroups) < 0) {
+            WARN ("getgrouplist(%s) failed", username);
+            info->groups[0] = info->gid;
+            ngroups = 1;
+        }
+    }
+    info->n_groups = ngroups;
+
+    return info;
+}
+
+TlmUserInfo *
+tlm_user_info_lookup (const gchar *username)
+{
+    TlmUserInfo *info = NULL;
+
+    if (!username)
+        return NULL;
+
+    G_LOCK (user_info_cache);
+    if (!user_info_cache)
+        user_info_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                g_free, (GDestroyNotify) tlm_user_info_unref);
+    _user_info_setup_watch ();
+
+    info = g_hash_table_lookup (user_info_cache, username);
+    if (info && g_get_monotonic_time () - info->resolve_time >
+            TLM_USER_INFO_TTL) {
+        g_hash_table_remove (user_info_cache, username);
+        info = NULL;
+    }
+    if (info) {
+        tlm_user_info_ref (info);
+        G_UNLOCK (user_info_cache);
+        return info;
+    }
+    G_UNLOCK (user_info_cache);
+
+    info = _user_info_resolve (username);
+    if (!info)
+        return NULL;
+
+    G_LOCK (user_info_cache);
+    g_hash_table_replace (user_info_cache, g_strdup (username),
+            tlm_user_info_ref (info));
+    G_UNLOCK (user_info_cache);
+
+    return info;
+}
+
+/* The tlm_user_get_* accessors hold a reference only while reading: a
+ * cache entry may expire or be invalidated at any time, so strings are
+ * returned as copies that the caller frees. */
 uid_t
 tlm_user_get_uid (const gchar *username)
 {
-    struct passwd *pwent;
+    TlmUserInfo *info = tlm_user_info_lookup (username);
+    uid_t uid;
 
-    pwent = getpwnam (username);
-    if (!pwent)
+    if (!info)
         return -1;
 
-    return pwent->pw_uid;
+    uid = info->uid;
+    tlm_user_info_unref (info);
+    return uid;
 }
 
 gid_t
 tlm_user_get_gid (const gchar *username)
 {
-    struct passwd *pwent;
+    TlmUserInfo *info = tlm_user_info_lookup (username);
+    gid_t gid;
 
-    pwent = getpwnam (username);
-    if (!pwent)
+    if (!info)
         return -1;
 
-    return pwent->pw_gid;
+    gid = info->gid;
+    tlm_user_info_unref (info);
+    return gid;
 }
 
-const gchar *
+gchar *
 tlm_user_get_home_dir (const gchar *username)
 {
-    struct passwd *pwent;
+    TlmUserInfo *info = tlm_user_info_lookup (username);
+    gchar *home_dir;
 
-    pwent = getpwnam (username);
-    if (!pwent)
+    if (!info)
         return NULL;
 
-    return pwent->pw_dir;
+    home_dir = g_strdup (info->home_dir);
+    tlm_user_info_unref (info);
+    return home_dir;
 }
 
-const gchar *
+gchar *
 tlm_user_get_shell (const gchar *username)
 {
-    struct passwd *pwent;
+    TlmUserInfo *info = tlm_user_info_lookup (username);
+    gchar *shell;
 
-    pwent = getpwnam (username);
-    if (!pwent)
+    if (!info)
         return NULL;
 
-    return pwent->pw_shell;
+    shell = g_strdup (info->shell);
+    tlm_user_info_unref (info);
+    return shell;
 }
 
 gboolean
@@ -187,14 +398,40 @@ _get_tty_id (
         memcpy (tty_id, tty_name, len);
 }
 
-static gchar *
+/* Host name and address recorded in utmp. Looked up once when sessiond
+ * starts, in a thread of its own so that a slow resolver delays neither the
+ * startup nor a login; entries written before the lookup finished go
+ * without an address. */
+typedef struct {
+    gchar name[HOST_NAME_SIZE];
+    guint32 address[4];
+    gboolean has_address;
+} TlmUtmpHost;
+
+/* A utmp/wtmp record captured on the login path, written by the utmp
+ * writer thread. */
+typedef struct {
+    gchar *username;
+    gchar *tty_name;
+    pid_t pid;
+    pid_t session;
+    struct timeval tv;
+} TlmUtmpRequest;
+
+G_LOCK_DEFINE_STATIC (utmp_host);
+static TlmUtmpHost utmp_host;
+static gboolean utmp_host_initialized = FALSE;
+static GThreadPool *utmp_pool = NULL;
+
+static gboolean
 _get_host_address (
-        const gchar *hostname)
+        const gchar *hostname,
+        guint32 *address)
 {
-    gchar *hostaddress = NULL;
     struct addrinfo hints, *info = NULL;
+    gboolean res = FALSE;
 
-    if (!hostname) return NULL;
+    if (!hostname || !*hostname) return FALSE;
 
     memset (&hints, 0, sizeof (hints));
     hints.ai_flags = AI_ADDRCONFIG;
@@ -203,18 +440,38 @@ _get_host_address (
         if (info) {
             if (info->ai_family == AF_INET) {
                 struct sockaddr_in *sa = (struct sockaddr_in *) info->ai_addr;
-                hostaddress = g_malloc0 (sizeof(struct in_addr));
-                memcpy (hostaddress, &(sa->sin_addr), sizeof (struct in_addr));
+                memcpy (address, &(sa->sin_addr), sizeof (struct in_addr));
+                res = TRUE;
             } else if (info->ai_family == AF_INET6) {
                 struct sockaddr_in6 *sa = (struct sockaddr_in6 *) info->ai_addr;
-                hostaddress = g_malloc0 (sizeof(struct in6_addr));
-                memcpy (hostaddress, &(sa->sin6_addr),
-                        sizeof (struct in6_addr));
+                memcpy (address, &(sa->sin6_addr), sizeof (struct in6_addr));
+                res = TRUE;
             }
             freeaddrinfo (info);
         }
     }
-    return hostaddress;
+    return res;
+}
+
+static gpointer
+_resolve_host_thread (
+        gpointer data)
+{
+    gchar *hostname = (gchar *) data;
+    guint32 address[4] = { 0, 0, 0, 0 };
+    gint64 start = g_get_monotonic_time ();
+
+    if (_get_host_address (hostname, address)) {
+        G_LOCK (utmp_host);
+        memcpy (utmp_host.address, address, sizeof (utmp_host.address));
+        utmp_host.has_address = TRUE;
+        G_UNLOCK (utmp_host);
+    }
+    DBG ("resolved host '%s' in %" G_GINT64_FORMAT " us", hostname,
+         g_get_monotonic_time () - start);
+
+    g_free (hostname);
+    return NULL;
 }
 
 static gboolean
@@ -240,47 +497,80 @@ _is_tty_same (
     return res;
 }
 
-static gchar *
-_get_host_name ()
+/* A configured address is used as is, anything not parsing as one leaves
+ * the address empty; without one the host name is resolved in the
+ * background. Only the first call has an effect. */
+void
+tlm_utils_init_utmp (const gchar *hostaddress)
 {
-    gchar *name = g_malloc0 (HOST_NAME_SIZE);
-    if (gethostname (name, HOST_NAME_SIZE) != 0) {
-        g_free (name);
-        return NULL;
+    gchar name[HOST_NAME_SIZE];
+    GThread *thread = NULL;
+    GError *error = NULL;
+
+    G_LOCK (utmp_host);
+    if (utmp_host_initialized) {
+        G_UNLOCK (utmp_host);
+        return;
+    }
+    utmp_host_initialized = TRUE;
+    memset (&utmp_host, 0, sizeof (utmp_host));
+    if (gethostname (name, sizeof (name)) == 0) {
+        name[sizeof (name) - 1] = '\0';
+        g_strlcpy (utmp_host.name, name, sizeof (utmp_host.name));
     }
-    return name;
+    if (hostaddress) {
+        if (inet_pton (AF_INET, hostaddress, utmp_host.address) == 1 ||
+            inet_pton (AF_INET6, hostaddress, utmp_host.address) == 1)
+            utmp_host.has_address = TRUE;
+        else if (*hostaddress)
+            WARN ("Invalid utmp host address '%s'", hostaddress);
+    }
+    G_UNLOCK (utmp_host);
+
+    if (hostaddress || !utmp_host.name[0])
+        return;
+
+    thread = g_thread_try_new ("tlm-resolver", _resolve_host_thread,
+            g_strdup (utmp_host.name), &error);
+    if (!thread) {
+        WARN ("Failed to start host lookup: %s", error ? error->message : "");
+        g_clear_error (&error);
+        return;
+    }
+    g_thread_unref (thread);
 }
 
-void
-tlm_utils_log_utmp_entry (const gchar *username)
+static void
+_utmp_request_free (
+        TlmUtmpRequest *req)
+{
+    g_free (req->username);
+    g_free (req->tty_name);
+    g_slice_free (TlmUtmpRequest, req);
+}
+
+static void
+_write_utmp_entry (
+        TlmUtmpRequest *req)
 {
-    struct timeval tv;
-    pid_t pid;
     struct utmp ut_ent;
     struct utmp *ut_tmp = NULL;
-    gchar *hostname = NULL, *hostaddress = NULL;
-    const gchar *tty_name = NULL;
     gchar *tty_no_dev_name = NULL;
 
-    DBG ("Log session entry to utmp/wtmp");
-
-    hostname = _get_host_name ();
-    hostaddress = _get_host_address (hostname);
-    tty_name = ttyname (0);
-    if (tty_name) {
+    if (req->tty_name) {
         tty_no_dev_name = g_strdup (
-            (strncmp (tty_name, "/dev/", 5) == 0) ? tty_name + 5 : tty_name);
+            (strncmp (req->tty_name, "/dev/", 5) == 0) ?
+            req->tty_name + 5 : req->tty_name);
     }
-    pid = getpid ();
     utmpname (_PATH_UTMP);
 
     setutent ();
     while ((ut_tmp = getutent())) {
-        if ( (ut_tmp->ut_pid == pid) &&
+        if ( (ut_tmp->ut_pid == req->pid) &&
              (ut_tmp->ut_id[0] != '\0') &&
              (ut_tmp->ut_type == LOGIN_PROCESS ||
                      ut_tmp->ut_type == USER_PROCESS) &&
-             (_is_tty_same (ut_tmp->ut_line, tty_name))) {
+             (_is_tty_same (ut_tmp->ut_line, req->tty_name))) {
             break;
         }
     }
@@ -289,25 +579,28 @@ tlm_utils_log_utmp_entry (const gchar *username)
     else        memset (&ut_ent, 0, sizeof (ut_ent));
 
     ut_ent.ut_type = USER_PROCESS;
-    ut_ent.ut_pid = pid;
+    ut_ent.ut_pid = req->pid;
     if (tty_no_dev_name)
         _get_tty_id (ut_ent.ut_id, tty_no_dev_name);
-    if (username)
-        strncpy (ut_ent.ut_user, username, sizeof (ut_ent.ut_user));
+    if (req->username)
+        strncpy (ut_ent.ut_user, req->username, sizeof (ut_ent.ut_user));
     if (tty_no_dev_name)
         strncpy (ut_ent.ut_line, tty_no_dev_name, sizeof (ut_ent.ut_line));
-    if (hostname)
-        strncpy (ut_ent.ut_host, hostname, sizeof (ut_ent.ut_host));
-    if (hostaddress)
-        memcpy (&ut_ent.ut_addr_v6, hostaddress, sizeof (ut_ent.ut_addr_v6));
 
-    ut_ent.ut_session = getsid (0);
-    gettimeofday (&tv, NULL);
+    G_LOCK (utmp_host);
+    if (utmp_host.name[0])
+        strncpy (ut_ent.ut_host, utmp_host.name, sizeof (ut_ent.ut_host));
+    if (utmp_host.has_address)
+        memcpy (&ut_ent.ut_addr_v6, utmp_host.address,
+                sizeof (ut_ent.ut_addr_v6));
+    G_UNLOCK (utmp_host);
+
+    ut_ent.ut_session = req->session;
 #ifdef _HAVE_UT_TV
-    ut_ent.ut_tv.tv_sec = tv.tv_sec;
-    ut_ent.ut_tv.tv_usec = tv.tv_usec;
+    ut_ent.ut_tv.tv_sec = req->tv.tv_sec;
+    ut_ent.ut_tv.tv_usec = req->tv.tv_usec;
 #else
-    ut_ent.ut_time = tv.tv_sec;
+    ut_ent.ut_time = req->tv.tv_sec;
 #endif
 
     pututline (&ut_ent);
@@ -315,11 +608,66 @@ tlm_utils_log_utmp_entry (const gchar *username)
 
     updwtmp (_PATH_WTMP, &ut_ent);
 
-    g_free (hostaddress);
-    g_free (hostname);
     g_free (tty_no_dev_name);
 }
 
+static void
+_utmp_worker (
+        gpointer data,
+        gpointer unused)
+{
+    TlmUtmpRequest *req = (TlmUtmpRequest *) data;
+
+    _write_utmp_entry (req);
+    _utmp_request_free (req);
+}
+
+/* The entry is captured right away and written to utmp and wtmp by
+ * a writer thread, so logins never block on the files. */
+void
+tlm_utils_log_utmp_entry (const gchar *username)
+{
+    TlmUtmpRequest *req = NULL;
+    const gchar *tty_name = NULL;
+    GError *error = NULL;
+
+    DBG ("Log session entry to utmp/wtmp");
+
+    tlm_utils_init_utmp (NULL);
+
+    req = g_slice_new0 (TlmUtmpRequest);
+    req->username = g_strdup (username);
+    tty_name = ttyname (0);
+    req->tty_name = g_strdup (tty_name);
+    req->pid = getpid ();
+    req->session = getsid (0);
+    gettimeofday (&req->tv, NULL);
+
+    if (!utmp_pool) {
+        /* one thread keeps the writes ordered */
+        utmp_pool = g_thread_pool_new (_utmp_worker, NULL, 1, FALSE, &error);
+        if (!utmp_pool) {
+            WARN ("Failed to create utmp writer: %s",
+                    error ? error->message : "");
+            g_clear_error (&error);
+            _utmp_worker (req, NULL);
+            return;
+        }
+    }
+
+    g_thread_pool_push (utmp_pool, req, NULL);
+}
+
+void
+tlm_utils_flush_utmp (void)
+{
+    if (!utmp_pool)
+        return;
+
+    g_thread_pool_free (utmp_pool, FALSE, TRUE);
+    utmp_pool = NULL;
+}
+
 static gchar **
 _split_command_line_with_regex(const char *command, GRegex *regex) {
   gchar **temp_strv = NULL;
@@ -408,6 +756,74 @@ tlm_utils_split_command_lines (const GList const *commands_list) {
   return argv_list;
 }
 
+/* expands %s in a session command template to the session id */
+gchar *
+tlm_utils_build_session_command (const gchar *template,
+                                 const gchar *session_id)
+{
+    const char *pptr;
+    gchar *out;
+    GString *str;
+
+    pptr = template;
+    str = g_string_sized_new (strlen(template) + strlen(session_id));
+    while (*pptr != '\0') {
+        if (*pptr == '%') {
+            pptr++;
+            switch (*pptr) {
+                case 's':
+                    g_string_append (str, session_id);
+                    break;
+                default:
+                    ;
+            }
+        } else {
+            g_string_append_c (str, *pptr);
+        }
+        pptr++;
+    }
+    out = g_string_free (str, FALSE);
+    return out;
+}
+
+/* expands %S to the seat number and %I to the seat id in a user name
+ * template */
+gchar *
+tlm_utils_build_user_name (const gchar *template, const gchar *seat_id)
+{
+    int seat_num = 0;
+    const char *pptr;
+    gchar *out;
+    GString *str;
+
+    if (strncmp (seat_id, "seat", 4) == 0)
+        seat_num = atoi (seat_id + 4);
+    else
+        WARN ("Unrecognized seat id format");
+    pptr = template;
+    str = g_string_sized_new (16);
+    while (*pptr != '\0') {
+        if (*pptr == '%') {
+            pptr++;
+            switch (*pptr) {
+                case 'S':
+                    g_string_append_printf (str, "%d", seat_num);
+                    break;
+                case 'I':
+                    g_string_append (str, seat_id);
+                    break;
+                default:
+                    ;
+            }
+        } else {
+            g_string_append_c (str, *pptr);
+        }
+        pptr++;
+    }
+    out = g_string_free (str, FALSE);
+    return out;
+}
+
 typedef struct {
   int ifd;
   GHashTable *dir_table; /* { gchar*: GList* } */
@@ -727,22 +1143,11 @@ static int func_conv(
     return PAM_SUCCESS;
 }
 
-gboolean
-tlm_authenticate_user (
-    TlmConfig *config,
-    const gchar *username,
-    const gchar *password)
+static const gchar *
+_get_auth_service (
+    TlmConfig *config)
 {
-    pam_handle_t *pam_h = NULL;
-    gboolean ret_auth = FALSE;
-    int ret;
     const gchar *service = NULL;
-    TlmLoginInfo *info = NULL;
-
-    if (!password || !username) {
-        WARN("username or password would be NULL");
-        return FALSE;
-    }
 
     // If TLM_CONFIG_PAM_AUTHENTICATION_SERVICE is not specified in tlm.conf
     // use "system-auth" as defult.
@@ -751,6 +1156,19 @@ tlm_authenticate_user (
                                     TLM_CONFIG_GENERAL_PAM_SERVICE);
     if (!service)
         service = "system-auth";
+    return service;
+}
+
+static gboolean
+_pam_authenticate (
+    const gchar *service,
+    const gchar *username,
+    const gchar *password)
+{
+    pam_handle_t *pam_h = NULL;
+    gboolean ret_auth = FALSE;
+    int ret;
+    TlmLoginInfo *info = NULL;
 
     info = g_malloc0 (sizeof (*info));
     info->username = strndup (username, PAM_MAX_RESP_SIZE - 1);
@@ -760,7 +1178,7 @@ tlm_authenticate_user (
     ret = pam_start (service, username, &conv, &pam_h);
     if (ret != PAM_SUCCESS) {
         WARN("Failed to pam_start: %d", ret);
-        return FALSE;
+        goto _out;
     }
 
     ret = pam_authenticate (pam_h, PAM_SILENT);
@@ -773,8 +1191,150 @@ tlm_authenticate_user (
 
     pam_end(pam_h, ret);
 
+_out:
     free(info->username);
     free(info->password);
     g_free(info);
     return ret_auth;
 }
+
+gboolean
+tlm_authenticate_user (
+    TlmConfig *config,
+    const gchar *username,
+    const gchar *password)
+{
+    if (!password || !username) {
+        WARN("username or password would be NULL");
+        return FALSE;
+    }
+
+    return _pam_authenticate (_get_auth_service (config), username, password);
+}
+
+/* PAM stacks can block for a long time (slow hashes, network backends),
+ * so asynchronous authentication runs in a small pool of worker threads
+ * and the result is delivered back in the caller's main context. */
+#define TLM_AUTH_MAX_THREADS 4
+
+typedef struct _TlmAuthRequest
+{
+    gchar *service;
+    gchar *username;
+    gchar *password;
+    gboolean authenticated;
+    GCancellable *cancellable;
+    GMainContext *context;
+    TlmAuthenticateCb cb;
+    gpointer userdata;
+} TlmAuthRequest;
+
+static GThreadPool *auth_pool = NULL;
+
+static void
+_auth_request_free (
+    TlmAuthRequest *req)
+{
+    g_free (req->service);
+    g_free (req->username);
+    if (req->password) {
+        memset (req->password, 0, strlen (req->password));
+        g_free (req->password);
+    }
+    if (req->cancellable) g_object_unref (req->cancellable);
+    g_main_context_unref (req->context);
+    g_slice_free (TlmAuthRequest, req);
+}
+
+static gboolean
+_auth_request_complete (
+    gpointer data)
+{
+    TlmAuthRequest *req = (TlmAuthRequest *) data;
+
+    GError *error = NULL;
+
+    /* cancellation happens in the caller's context, so a request cancelled
+     * before this point always reports G_IO_ERROR_CANCELLED */
+    if (g_cancellable_set_error_if_cancelled (req->cancellable, &error))
+        DBG ("authentication of '%s' cancelled", req->username);
+    else if (!req->authenticated)
+        error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_PAM_AUTH_FAILURE,
+                "Authentication failed");
+
+    if (req->cb) req->cb (error, req->userdata);
+
+    if (error) g_error_free (error);
+    _auth_request_free (req);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_auth_request_dispatch (
+    TlmAuthRequest *req)
+{
+    GSource *source = g_idle_source_new ();
+
+    g_source_set_callback (source, _auth_request_complete, req, NULL);
+    g_source_attach (source, req->context);
+    g_source_unref (source);
+}
+
+static void
+_auth_worker (
+    gpointer data,
+    gpointer unused)
+{
+    TlmAuthRequest *req = (TlmAuthRequest *) data;
+
+    if (!g_cancellable_is_cancelled (req->cancellable))
+        req->authenticated = _pam_authenticate (req->service, req->username,
+                req->password);
+
+    _auth_request_dispatch (req);
+}
+
+void
+tlm_authenticate_user_async (
+    TlmConfig *config,
+    const gchar *username,
+    const gchar *password,
+    GCancellable *cancellable,
+    TlmAuthenticateCb cb,
+    gpointer userdata)
+{
+    GError *error = NULL;
+    TlmAuthRequest *req = NULL;
+
+    req = g_slice_new0 (TlmAuthRequest);
+    req->service = g_strdup (_get_auth_service (config));
+    req->username = g_strdup (username);
+    req->password = g_strdup (password);
+    req->cancellable = cancellable ? g_object_ref (cancellable) :
+            g_cancellable_new ();
+    req->context = g_main_context_ref_thread_default ();
+    req->cb = cb;
+    req->userdata = userdata;
+
+    if (!password || !username) {
+        WARN("username or password would be NULL");
+        _auth_request_dispatch (req);
+        return;
+    }
+
+    if (!auth_pool) {
+        auth_pool = g_thread_pool_new (_auth_worker, NULL,
+                TLM_AUTH_MAX_THREADS, FALSE, &error);
+        if (!auth_pool) {
+            WARN ("Failed to create authentication pool: %s",
+                    error ? error->message : "");
+            g_clear_error (&error);
+            req->authenticated = _pam_authenticate (req->service,
+                    req->username, req->password);
+            _auth_request_dispatch (req);
+            return;
+        }
+    }
+
+    g_thread_pool_push (auth_pool, req, NULL);
+}
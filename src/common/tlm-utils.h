@@ -29,6 +29,7 @@
 
 #include <sys/types.h>
 #include <glib.h>
+#include <gio/gio.h>
 
 #include "tlm-config.h"
 
@@ -37,6 +38,34 @@ G_BEGIN_DECLS
 void
 g_clear_string (gchar **);
 
+typedef struct _TlmUserInfo
+{
+    gint ref_count;
+    gchar *name;
+    uid_t uid;
+    gid_t gid;
+    gchar *home_dir;
+    gchar *shell;
+    gid_t *groups;
+    gint n_groups;
+    gint64 resolve_time;
+} TlmUserInfo;
+
+TlmUserInfo *
+tlm_user_info_lookup (const gchar *username);
+
+TlmUserInfo *
+tlm_user_info_ref (TlmUserInfo *info);
+
+void
+tlm_user_info_unref (TlmUserInfo *info);
+
+void
+tlm_user_info_invalidate_cache (void);
+
+guint
+tlm_user_info_get_nss_calls (void);
+
 const gchar *
 tlm_user_get_name (uid_t user_id);
 
@@ -46,24 +75,37 @@ tlm_user_get_uid (const gchar *username);
 gid_t
 tlm_user_get_gid (const gchar *username);
 
-const gchar *
+gchar *
 tlm_user_get_home_dir (const gchar *username);
 
-const gchar *
+gchar *
 tlm_user_get_shell (const gchar *username);
 
 gboolean
 tlm_utils_delete_dir (const gchar *dir);
 
+void
+tlm_utils_init_utmp (const gchar *hostaddress);
+
 void
 tlm_utils_log_utmp_entry (const gchar *username);
 
+void
+tlm_utils_flush_utmp (void);
+
 gchar **
 tlm_utils_split_command_line (const gchar *command);
 
 GList *
 tlm_utils_split_command_lines (const GList const *commands_list);
 
+gchar *
+tlm_utils_build_session_command (const gchar *template,
+                                 const gchar *session_id);
+
+gchar *
+tlm_utils_build_user_name (const gchar *template, const gchar *seat_id);
+
 typedef void (*WatchCb) (const gchar *found_item, gboolean is_final, GError *error, gpointer userdata);
 
 guint
@@ -72,6 +114,13 @@ tlm_utils_watch_for_files (const gchar **watch_list, WatchCb cb, gpointer userda
 gboolean
 tlm_authenticate_user (TlmConfig *config, const gchar *username, const gchar *password);
 
+typedef void (*TlmAuthenticateCb) (GError *error, gpointer userdata);
+
+void
+tlm_authenticate_user_async (TlmConfig *config, const gchar *username,
+        const gchar *password, GCancellable *cancellable,
+        TlmAuthenticateCb cb, gpointer userdata);
+
 G_END_DECLS
 
 #endif /* _TLM_UTILS_H */
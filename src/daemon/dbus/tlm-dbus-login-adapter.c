@@ -60,6 +60,7 @@ enum {
     SIG_LOGOUT_USER,
     SIG_SWITCH_USER,
     SIG_GET_SESSION_INFO,
+    SIG_GET_METRICS,
 
     SIG_MAX
 };
@@ -250,6 +251,17 @@ tlm_dbus_login_adapter_class_init (
             2,
             G_TYPE_STRING,
             G_TYPE_DBUS_METHOD_INVOCATION);
+
+    signals[SIG_GET_METRICS] = g_signal_new ("get-metrics",
+            TLM_TYPE_LOGIN_ADAPTER,
+            G_SIGNAL_RUN_LAST,
+            0,
+            NULL,
+            NULL,
+            NULL,
+            G_TYPE_NONE,
+            1,
+            G_TYPE_DBUS_METHOD_INVOCATION);
 }
 
 static void
@@ -376,6 +388,32 @@ _handle_get_session_info (
     return TRUE;
 }
 
+static gboolean
+_handle_get_metrics (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        gpointer emitter)
+{
+    GError *error = NULL;
+
+    g_return_val_if_fail (self && TLM_IS_DBUS_LOGIN_ADAPTER(self),
+            FALSE);
+
+    /* only the root login object serves metrics */
+    if (!g_signal_has_handler_pending (self, signals[SIG_GET_METRICS], 0,
+            FALSE)) {
+        error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_DBUS_REQ_NOT_SUPPORTED,
+                "Dbus request not supported");
+        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_error_free (error);
+        return TRUE;
+    }
+
+    g_signal_emit (self, signals[SIG_GET_METRICS], 0, invocation);
+
+    return TRUE;
+}
+
 TlmDbusLoginAdapter *
 tlm_dbus_login_adapter_new_with_connection (
         GDBusConnection *bus_connection)
@@ -405,6 +443,8 @@ tlm_dbus_login_adapter_new_with_connection (
     g_signal_connect_swapped (adapter->priv->dbus_obj,
         "handle-get-session-info", G_CALLBACK(_handle_get_session_info),
         adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_obj,
+        "handle-get-metrics", G_CALLBACK(_handle_get_metrics), adapter);
 
     return adapter;
 }
@@ -472,3 +512,15 @@ tlm_dbus_login_adapter_request_completed (
         break;
     }
 }
+
+void
+tlm_dbus_login_adapter_complete_get_metrics (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *metrics)
+{
+    g_return_if_fail (self && TLM_IS_DBUS_LOGIN_ADAPTER(self));
+
+    tlm_dbus_login_complete_get_metrics (self->priv->dbus_obj, invocation,
+            metrics);
+}
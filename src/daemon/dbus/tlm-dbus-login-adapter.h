@@ -86,6 +86,12 @@ tlm_dbus_login_adapter_request_completed (
         TlmDbusResponse *response,
         GError *error);
 
+void
+tlm_dbus_login_adapter_complete_get_metrics (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *metrics);
+
 G_END_DECLS
 
 #endif /* __TLM_DBUS_LOGIN_ADAPTER_H_ */
@@ -43,6 +43,10 @@
 #include "dbus/tlm-dbus-utils.h"
 #include "tlm-seat.h"
 #include "tlm-manager.h"
+#include "tlm-metrics.h"
+#include "tlm-watchdog.h"
+#include "tlm-request-trace.h"
+#include "tlm-trace.h"
 #include "common/tlm-error.h"
 
 G_DEFINE_TYPE (TlmDbusObserver, tlm_dbus_observer, G_TYPE_OBJECT);
@@ -54,16 +58,27 @@ typedef struct
 {
     TlmDbusRequest *dbus_request;
     TlmSeat *seat;
+    gint64 enqueue_time;
+    gint64 start_time;
 } TlmRequest;
 
+/* Requests are serialized per seat; requests for different seats are
+ * processed independently of each other */
+typedef struct
+{
+    TlmDbusObserver *observer;
+    gchar *seat_id;
+    GQueue *request_queue;
+    guint request_id;
+    TlmRequest *active_request;
+} TlmSeatQueue;
+
 struct _TlmDbusObserverPrivate
 {
     TlmManager *manager;
     TlmSeat *seat;
     TlmDbusServer *dbus_server;
-    GQueue *request_queue;
-    guint request_id;
-    TlmRequest *active_request;
+    GHashTable *seat_queues; /* (seat_id, TlmSeatQueue) */
     DbusObserverEnableFlags enable_flags;
 };
 
@@ -120,6 +135,12 @@ _handle_dbus_get_session_info (
         GDBusMethodInvocation *invocation,
         GObject *dbus_adapter);
 
+static void
+_handle_dbus_get_metrics (
+        TlmDbusObserver *self,
+        GDBusMethodInvocation *invocation,
+        GObject *dbus_adapter);
+
 static void
 _disconnect_dbus_adapter (
         TlmDbusObserver *self,
@@ -162,20 +183,29 @@ _connect_seat (
 
 static void
 _process_next_request_in_idle (
-        TlmDbusObserver *self);
+        TlmSeatQueue *seat_queue);
 
 static void
 _on_seat_dispose (
         TlmDbusObserver *self,
         GObject *dead)
 {
+    GHashTableIter iter;
+    TlmSeatQueue *seat_queue = NULL;
+
     g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self) && dead &&
                 TLM_IS_SEAT(dead));
     g_object_weak_unref (dead, (GWeakNotify)_on_seat_dispose, self);
     _disconnect_seat (self, TLM_SEAT (dead));
-    if (self->priv->active_request &&
-        G_OBJECT(self->priv->active_request->seat) == dead) {
-        self->priv->active_request->seat = NULL;
+
+    if (self->priv->seat_queues) {
+        g_hash_table_iter_init (&iter, self->priv->seat_queues);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer)&seat_queue)) {
+            if (seat_queue->active_request &&
+                G_OBJECT(seat_queue->active_request->seat) == dead) {
+                seat_queue->active_request->seat = NULL;
+            }
+        }
     }
     if (G_OBJECT(self->priv->seat) == dead)
         self->priv->seat = NULL;
@@ -270,43 +300,67 @@ _connect_seat (
 }
 
 static void
-_on_dbus_adapter_dispose (
-        TlmDbusObserver *self,
+_remove_adapter_requests (
+        TlmSeatQueue *seat_queue,
         GObject *dead)
 {
-    GList *head=NULL, *elem=NULL, *next;
+    TlmDbusObserver *self = seat_queue->observer;
+    GList *elem = NULL, *next = NULL;
 
-    g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self) && dead &&
-                TLM_IS_DBUS_LOGIN_ADAPTER(dead));
-    _disconnect_dbus_adapter (self, TLM_DBUS_LOGIN_ADAPTER(dead));
-
-    if (self->priv->request_queue)
-        head = elem = g_queue_peek_head_link (self->priv->request_queue);
+    elem = g_queue_peek_head_link (seat_queue->request_queue);
     while (elem) {
         TlmRequest *request = elem->data;
         TlmDbusRequest *dbus_req = request->dbus_request;
         next = g_list_next (elem);
         if (dbus_req && G_OBJECT (dbus_req->dbus_adapter) == dead) {
             DBG ("removing the request for dead dbus adapter");
-            head = g_list_delete_link (head, elem);
+            g_queue_delete_link (seat_queue->request_queue, elem);
+            tlm_metrics_add (TLM_METRIC_REQUESTS_QUEUED, "seat",
+                    seat_queue->seat_id, -1);
             _dispose_request (self, request);
         }
         elem = next;
     }
 
     /* check for active request */
-    if (self->priv->active_request &&
-        G_OBJECT (self->priv->active_request->dbus_request->dbus_adapter) ==
+    if (seat_queue->active_request &&
+        G_OBJECT (seat_queue->active_request->dbus_request->dbus_adapter) ==
                 dead) {
         DBG ("removing the request for dead dbus adapter");
-        _dispose_request (self, self->priv->active_request);
-        self->priv->active_request = NULL;
-        if (self->priv->request_id) {
-            g_source_remove (self->priv->request_id);
-            self->priv->request_id = 0;
+        if (seat_queue->active_request->seat &&
+            seat_queue->active_request->dbus_request->type ==
+                TLM_DBUS_REQUEST_TYPE_SWITCH_USER)
+            tlm_seat_cancel_switch_user (seat_queue->active_request->seat);
+        _dispose_request (self, seat_queue->active_request);
+        seat_queue->active_request = NULL;
+        if (seat_queue->request_id) {
+            g_source_remove (seat_queue->request_id);
+            seat_queue->request_id = 0;
         }
-        _process_next_request_in_idle (self);
     }
+
+    /* also drops the queue if nothing is left in it */
+    if (!seat_queue->active_request)
+        _process_next_request_in_idle (seat_queue);
+}
+
+static void
+_on_dbus_adapter_dispose (
+        TlmDbusObserver *self,
+        GObject *dead)
+{
+    GHashTableIter iter;
+    TlmSeatQueue *seat_queue = NULL;
+
+    g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self) && dead &&
+                TLM_IS_DBUS_LOGIN_ADAPTER(dead));
+    _disconnect_dbus_adapter (self, TLM_DBUS_LOGIN_ADAPTER(dead));
+
+    if (!self->priv->seat_queues) return;
+
+    g_hash_table_iter_init (&iter, self->priv->seat_queues);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer)&seat_queue))
+        _remove_adapter_requests (seat_queue, dead);
 }
 
 static void
@@ -327,6 +381,9 @@ _connect_dbus_adapter (
         g_signal_connect_swapped (G_OBJECT (adapter),
                 "get-session-info", G_CALLBACK(_handle_dbus_get_session_info),
                 self);
+    if (self->priv->enable_flags & DBUS_OBSERVER_ENABLE_GET_METRICS)
+        g_signal_connect_swapped (G_OBJECT (adapter),
+                "get-metrics", G_CALLBACK(_handle_dbus_get_metrics), self);
 }
 
 static void
@@ -346,6 +403,9 @@ _disconnect_dbus_adapter (
     if (self->priv->enable_flags & DBUS_OBSERVER_ENABLE_GET_SESSION_INFO)
         g_signal_handlers_disconnect_by_func (G_OBJECT(adapter),
                 _handle_dbus_get_session_info, self);
+    if (self->priv->enable_flags & DBUS_OBSERVER_ENABLE_GET_METRICS)
+        g_signal_handlers_disconnect_by_func (G_OBJECT(adapter),
+                _handle_dbus_get_metrics, self);
 }
 
 static void
@@ -414,6 +474,21 @@ _abort_dbus_request (
     _complete_dbus_request (request, NULL, error);
 }
 
+static void
+_record_request (
+        TlmRequest *request,
+        guint status)
+{
+    TlmDbusRequest *dbus_req = NULL;
+
+    if (!request || !(dbus_req = request->dbus_request)) return;
+
+    tlm_request_trace_record (dbus_req->type, request->seat ?
+            tlm_seat_get_id (request->seat) : dbus_req->seat_id,
+            dbus_req->username, request->enqueue_time, request->start_time,
+            status);
+}
+
 static void
 _complete_request (
 		TlmDbusObserver *self,
@@ -421,6 +496,7 @@ _complete_request (
         TlmDbusResponse *response,
         GError *error)
 {
+    _record_request (request, error ? error->code : TLM_ERROR_NONE);
     _complete_dbus_request (request->dbus_request, response, error);
 	request->dbus_request = NULL;
     _dispose_request (self, request);
@@ -433,6 +509,7 @@ _clear_request (
 {
 	if (!request) return;
 
+	_record_request (request, TLM_ERROR_DBUS_REQ_ABORTED);
 	_abort_dbus_request (request->dbus_request);
 	request->dbus_request = NULL;
 	_dispose_request (self, request);
@@ -457,26 +534,58 @@ _is_request_supported (
     return FALSE;
 }
 
+static void
+_update_wait_stats (
+        TlmSeatQueue *seat_queue,
+        TlmRequest *req)
+{
+    gint64 wait_time;
+
+    req->start_time = g_get_monotonic_time ();
+    wait_time = req->start_time - req->enqueue_time;
+
+    tlm_metrics_add (TLM_METRIC_REQUESTS_QUEUED, "seat", seat_queue->seat_id,
+            -1);
+    tlm_metrics_add (TLM_METRIC_REQUESTS_PROCESSED, "seat", seat_queue->seat_id,
+            1);
+    tlm_metrics_observe (TLM_METRIC_REQUEST_WAIT, "seat", seat_queue->seat_id,
+            wait_time);
+    TLM_TRACE2 (request__dequeue, seat_queue->seat_id,
+            req->dbus_request->sessionid, -1, req->dbus_request->type,
+            wait_time);
+
+    DBG ("seat %s: request waited %" G_GINT64_FORMAT " usec, %u more queued",
+            seat_queue->seat_id, wait_time,
+            g_queue_get_length (seat_queue->request_queue));
+}
+
 static gboolean
 _process_request (
-        TlmDbusObserver *self)
+        TlmSeatQueue *seat_queue)
 {
-    g_return_val_if_fail (self && TLM_IS_DBUS_OBSERVER(self), FALSE);
+    g_return_val_if_fail (seat_queue, FALSE);
+    TlmDbusObserver *self = seat_queue->observer;
     GError *err = NULL;
     TlmRequest* req = NULL;
     TlmDbusRequest* dbus_req = NULL;
     TlmSeat *seat = NULL;
-    gboolean retval = NULL;
-    self->priv->request_id = 0;
+    seat_queue->request_id = 0;
 
-    if (!self->priv->active_request) {
+    /* queues are created for incoming requests, do not keep idle ones */
+    if (!seat_queue->active_request &&
+        g_queue_is_empty (seat_queue->request_queue)) {
+        DBG ("request queue is empty for seat %s", seat_queue->seat_id);
+        g_hash_table_remove (self->priv->seat_queues, seat_queue->seat_id);
+        return FALSE;
+    }
+
+    if (!seat_queue->active_request) {
         gboolean ret = FALSE;
 
-        req = g_queue_pop_head (self->priv->request_queue);
-        if (!req) {
-            DBG ("request queue is empty");
-            goto _finished;
-        }
+        req = g_queue_pop_head (seat_queue->request_queue);
+        _update_wait_stats (seat_queue, req);
+        tlm_watchdog_mark ("D-Bus request", seat_queue->seat_id);
+
         dbus_req = req->dbus_request;
         if (!_is_request_supported (self, dbus_req->type)) {
             WARN ("Request not supported -- req-type %d flags %d",
@@ -514,9 +623,10 @@ _process_request (
             goto _finished;
         }
 
-        self->priv->active_request = req;
+        seat_queue->active_request = req;
         switch(dbus_req->type) {
         case TLM_DBUS_REQUEST_TYPE_LOGIN_USER:
+            tlm_seat_set_request_time (seat, req->enqueue_time);
             ret = tlm_seat_create_session (seat, NULL, dbus_req->username,
                     dbus_req->password, dbus_req->environment);
             break;
@@ -524,6 +634,7 @@ _process_request (
             ret = tlm_seat_terminate_session (seat);
             break;
         case TLM_DBUS_REQUEST_TYPE_SWITCH_USER:
+            tlm_seat_set_request_time (seat, req->enqueue_time);
             ret = tlm_seat_switch_user (seat, NULL, dbus_req->username,
                     dbus_req->password, dbus_req->environment);
             break;
@@ -531,9 +642,12 @@ _process_request (
             ret = tlm_seat_get_session_info (seat, dbus_req->sessionid);
             break;
         }
-        if (!ret) {
-            _dispose_request (self, self->priv->active_request);
-            self->priv->active_request = NULL;
+        /* a failing seat call may have emitted session-error already,
+         * which completes the request and clears active_request */
+        if (!ret && seat_queue->active_request == req) {
+            _record_request (seat_queue->active_request, TLM_ERROR_UNKNOWN);
+            _dispose_request (self, seat_queue->active_request);
+            seat_queue->active_request = NULL;
         }
     }
 
@@ -542,26 +656,102 @@ _finished:
         _complete_request (self, req, NULL, err);
     }
 
-    if (self->priv->active_request != NULL)
-        retval = FALSE;
-    else if (g_queue_is_empty(self->priv->request_queue))
-        retval = FALSE;
-    else
-        retval = TRUE;
+    if (!seat_queue->active_request)
+        _process_next_request_in_idle (seat_queue);
 
-    return retval;
+    return FALSE;
 }
 
 static void
 _process_next_request_in_idle (
-        TlmDbusObserver *self)
+        TlmSeatQueue *seat_queue)
 {
-    if (!self->priv->request_id &&
-        !g_queue_is_empty (self->priv->request_queue)) {
-        DBG ("request queue has request(s) to be processed");
-        self->priv->request_id = g_idle_add ((GSourceFunc)_process_request,
-                self);
+    if (seat_queue->request_id) return;
+
+    /* an empty queue is freed from the idle, not under the caller that may
+     * still be using it */
+    if (!g_queue_is_empty (seat_queue->request_queue))
+        DBG ("request queue of seat %s has request(s) to be processed",
+                seat_queue->seat_id);
+    seat_queue->request_id = g_idle_add ((GSourceFunc)_process_request,
+            seat_queue);
+}
+
+static void
+_free_seat_queue (
+        TlmSeatQueue *seat_queue)
+{
+    TlmDbusObserver *self = seat_queue->observer;
+
+    if (seat_queue->request_id) {
+        g_source_remove (seat_queue->request_id);
+        seat_queue->request_id = 0;
+    }
+    _clear_request (seat_queue->active_request, self);
+    seat_queue->active_request = NULL;
+
+    tlm_metrics_add (TLM_METRIC_REQUESTS_QUEUED, "seat", seat_queue->seat_id,
+            -(gint64) g_queue_get_length (seat_queue->request_queue));
+    g_queue_foreach (seat_queue->request_queue, (GFunc) _clear_request, self);
+    g_queue_free (seat_queue->request_queue);
+    g_free (seat_queue->seat_id);
+    g_free (seat_queue);
+}
+
+static TlmSeatQueue *
+_get_seat_queue (
+        TlmDbusObserver *self,
+        const gchar *seat_id)
+{
+    TlmSeatQueue *seat_queue = NULL;
+
+    if (!seat_id || !self->priv->seat_queues) return NULL;
+
+    seat_queue = g_hash_table_lookup (self->priv->seat_queues, seat_id);
+    if (!seat_queue) {
+        seat_queue = g_malloc0 (sizeof (TlmSeatQueue));
+        seat_queue->observer = self;
+        seat_queue->seat_id = g_strdup (seat_id);
+        seat_queue->request_queue = g_queue_new ();
+        g_hash_table_insert (self->priv->seat_queues, seat_queue->seat_id,
+                seat_queue);
     }
+    return seat_queue;
+}
+
+static TlmSeatQueue *
+_find_seat_queue (
+        TlmDbusObserver *self,
+        GObject *seat)
+{
+    const gchar *seat_id = tlm_seat_get_id (TLM_SEAT (seat));
+
+    if (!seat_id || !self->priv->seat_queues) return NULL;
+    return g_hash_table_lookup (self->priv->seat_queues, seat_id);
+}
+
+static const gchar *
+_resolve_request_seat_id (
+        TlmDbusObserver *self,
+        TlmDbusRequest *dbus_req)
+{
+    TlmSeat *seat = NULL;
+
+    if (self->priv->seat)
+        return tlm_seat_get_id (self->priv->seat);
+    if (dbus_req->seat_id) {
+        /* a queue is only created for a seat that exists */
+        if (self->priv->manager &&
+            !tlm_manager_get_seat (self->priv->manager, dbus_req->seat_id))
+            return NULL;
+        return dbus_req->seat_id;
+    }
+    if (dbus_req->sessionid && self->priv->manager) {
+        seat = tlm_manager_get_seat_by_sessionid (self->priv->manager,
+                dbus_req->sessionid);
+        if (seat) return tlm_seat_get_id (seat);
+    }
+    return NULL;
 }
 
 static void
@@ -569,8 +759,25 @@ _add_request (
         TlmDbusObserver *self,
         TlmRequest *request)
 {
-    g_queue_push_tail (self->priv->request_queue, request);
-    _process_next_request_in_idle (self);
+    TlmSeatQueue *seat_queue = _get_seat_queue (self,
+            _resolve_request_seat_id (self, request->dbus_request));
+
+    if (!seat_queue) {
+        WARN ("Cannot find the seat");
+        _complete_request (self, request, NULL, TLM_GET_ERROR_FOR_ID (
+                TLM_ERROR_SEAT_NOT_FOUND, "Seat not found"));
+        return;
+    }
+
+    request->enqueue_time = g_get_monotonic_time ();
+    g_queue_push_tail (seat_queue->request_queue, request);
+    tlm_metrics_add (TLM_METRIC_REQUESTS_QUEUED, "seat", seat_queue->seat_id,
+            1);
+    TLM_TRACE2 (request__enqueue, seat_queue->seat_id,
+            request->dbus_request->sessionid, -1, request->dbus_request->type,
+            g_queue_get_length (seat_queue->request_queue));
+
+    _process_next_request_in_idle (seat_queue);
 }
 
 static void
@@ -580,27 +787,30 @@ _handle_seat_session_created (
         GObject *seat)
 {
     TlmDbusResponse *resp = NULL;
+    TlmSeatQueue *seat_queue = NULL;
     DBG ("self %p seat %p", self, seat);
 
     g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self));
     g_return_if_fail (seat && TLM_IS_SEAT(seat));
 
+    seat_queue = _find_seat_queue (self, seat);
+
     /* Login/switch request should only be completed on session created
      * signal from seat */
-    if (!self->priv->active_request ||
-        G_OBJECT (self->priv->active_request->seat) != seat ||
-        !self->priv->active_request->dbus_request ||
-        (self->priv->active_request->dbus_request->type !=
+    if (!seat_queue || !seat_queue->active_request ||
+        G_OBJECT (seat_queue->active_request->seat) != seat ||
+        !seat_queue->active_request->dbus_request ||
+        (seat_queue->active_request->dbus_request->type !=
                 TLM_DBUS_REQUEST_TYPE_LOGIN_USER &&
-         self->priv->active_request->dbus_request->type !=
+         seat_queue->active_request->dbus_request->type !=
                 TLM_DBUS_REQUEST_TYPE_SWITCH_USER))
         return;
 
     resp = tlm_dbus_utils_create_response (sessionid, NULL);
-    _complete_request (self, self->priv->active_request, resp, NULL);
-    self->priv->active_request = NULL;
+    _complete_request (self, seat_queue->active_request, resp, NULL);
+    seat_queue->active_request = NULL;
 
-    _process_next_request_in_idle (self);
+    _process_next_request_in_idle (seat_queue);
 }
 
 void
@@ -640,17 +850,20 @@ _handle_seat_session_terminated (
         const gchar *sessionid,
         GObject *seat)
 {
+    TlmSeatQueue *seat_queue = NULL;
     DBG ("self %p seat %p sessionid %s", self, seat, sessionid);
 
     g_return_val_if_fail (self && TLM_IS_DBUS_OBSERVER(self), FALSE);
     g_return_val_if_fail (seat && TLM_IS_SEAT(seat), FALSE);
 
+    seat_queue = _find_seat_queue (self, seat);
+
     /* Logout request should only be completed on session terminated signal
      * from seat */
-    if (!self->priv->active_request ||
-        G_OBJECT (self->priv->active_request->seat) != seat ||
-        !self->priv->active_request->dbus_request ||
-        self->priv->active_request->dbus_request->type !=
+    if (!seat_queue || !seat_queue->active_request ||
+        G_OBJECT (seat_queue->active_request->seat) != seat ||
+        !seat_queue->active_request->dbus_request ||
+        seat_queue->active_request->dbus_request->type !=
                 TLM_DBUS_REQUEST_TYPE_LOGOUT_USER) {
         /* Check if there is any dbus connection still alive and close it */
         _remove_adaptor_object_by_sessionid (
@@ -659,12 +872,12 @@ _handle_seat_session_terminated (
     }
 
     _disconnect_dbus_adapter (self, TLM_DBUS_LOGIN_ADAPTER (
-            self->priv->active_request->dbus_request->dbus_adapter));
+            seat_queue->active_request->dbus_request->dbus_adapter));
 
-    _complete_request (self, self->priv->active_request, NULL, NULL);
-    self->priv->active_request = NULL;
+    _complete_request (self, seat_queue->active_request, NULL, NULL);
+    seat_queue->active_request = NULL;
 
-    _process_next_request_in_idle (self);
+    _process_next_request_in_idle (seat_queue);
 
     return FALSE;
 }
@@ -677,23 +890,26 @@ _handle_seat_session_info (
         GObject *seat)
 {
     TlmDbusResponse *resp = NULL;
+    TlmSeatQueue *seat_queue = NULL;
     DBG ("self %p seat %p", self, seat);
 
     g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self));
     g_return_if_fail (seat && TLM_IS_SEAT(seat));
 
-    if (!self->priv->active_request ||
-        G_OBJECT (self->priv->active_request->seat) != seat ||
-        !self->priv->active_request->dbus_request ||
-        self->priv->active_request->dbus_request->type !=
+    seat_queue = _find_seat_queue (self, seat);
+
+    if (!seat_queue || !seat_queue->active_request ||
+        G_OBJECT (seat_queue->active_request->seat) != seat ||
+        !seat_queue->active_request->dbus_request ||
+        seat_queue->active_request->dbus_request->type !=
                 TLM_DBUS_REQUEST_TYPE_GET_SESSION_INFO)
         return;
 
     resp = tlm_dbus_utils_create_response (sessionid, sessioninfo);
-    _complete_request (self, self->priv->active_request, resp, NULL);
-    self->priv->active_request = NULL;
+    _complete_request (self, seat_queue->active_request, resp, NULL);
+    seat_queue->active_request = NULL;
 
-    _process_next_request_in_idle (self);
+    _process_next_request_in_idle (seat_queue);
 }
 
 static void
@@ -704,19 +920,22 @@ _handle_seat_session_error (
 {
     DBG ("self %p seat %p", self, seat);
     GError *error = NULL;
+    TlmSeatQueue *seat_queue = NULL;
 
     g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self));
     g_return_if_fail (seat && TLM_IS_SEAT(seat));
 
-    if (!self->priv->active_request ||
-        G_OBJECT (self->priv->active_request->seat) != seat)
+    seat_queue = _find_seat_queue (self, seat);
+
+    if (!seat_queue || !seat_queue->active_request ||
+        G_OBJECT (seat_queue->active_request->seat) != seat)
         return;
 
     error = TLM_GET_ERROR_FOR_ID (error_code, "Dbus request failed");
-    _complete_request (self, self->priv->active_request, NULL, error);
-    self->priv->active_request = NULL;
+    _complete_request (self, seat_queue->active_request, NULL, error);
+    seat_queue->active_request = NULL;
 
-    _process_next_request_in_idle (self);
+    _process_next_request_in_idle (seat_queue);
 }
 
 static void
@@ -798,19 +1017,31 @@ _handle_dbus_get_session_info (
     _add_request (self, _create_request (self, request, NULL));
 }
 
+/* answered right away, metrics do not wait in the seat queues */
+static void
+_handle_dbus_get_metrics (
+        TlmDbusObserver *self,
+        GDBusMethodInvocation *invocation,
+        GObject *dbus_adapter)
+{
+    gchar *metrics;
+
+    g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self));
+
+    metrics = tlm_metrics_to_text ();
+    tlm_dbus_login_adapter_complete_get_metrics (
+            TLM_DBUS_LOGIN_ADAPTER (dbus_adapter), invocation, metrics);
+    g_free (metrics);
+}
+
 static void
 _stop_dbus_server (TlmDbusObserver *self)
 {
+    GHashTable *seat_queues = self->priv->seat_queues;
+
     DBG("self %p", self);
-    _clear_request (self->priv->active_request, self);
-    self->priv->active_request = NULL;
-
-    if (self->priv->request_queue) {
-        g_queue_foreach (self->priv->request_queue,
-                           (GFunc) _clear_request, self);
-        g_queue_free (self->priv->request_queue);
-        self->priv->request_queue = NULL;
-    }
+    self->priv->seat_queues = NULL;
+    if (seat_queues) g_hash_table_unref (seat_queues);
 
     if (self->priv->dbus_server) {
         tlm_dbus_server_stop (self->priv->dbus_server);
@@ -837,11 +1068,6 @@ tlm_dbus_observer_dispose (GObject *object)
     TlmDbusObserver *self = TLM_DBUS_OBSERVER(object);
     DBG("disposing dbus_observer: %p", self);
 
-    if (self->priv->request_id) {
-        g_source_remove (self->priv->request_id);
-        self->priv->request_id = 0;
-    }
-
     _stop_dbus_server (self);
     if (self->priv->manager) {
         g_object_weak_unref (G_OBJECT (self->priv->manager),
@@ -886,9 +1112,8 @@ tlm_dbus_observer_init (TlmDbusObserver *dbus_observer)
     priv->manager = NULL;
     priv->seat = NULL;
     priv->enable_flags = DBUS_OBSERVER_ENABLE_ALL;
-    priv->request_queue = g_queue_new ();
-    priv->request_id = 0;
-    priv->active_request = NULL;
+    priv->seat_queues = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+            (GDestroyNotify)_free_seat_queue);
     dbus_observer->priv = priv;
 }
 
@@ -63,7 +63,8 @@ typedef enum {
     DBUS_OBSERVER_ENABLE_LOGOUT_USER = 0x02,
     DBUS_OBSERVER_ENABLE_SWITCH_USER = 0x04,
     DBUS_OBSERVER_ENABLE_GET_SESSION_INFO = 0x08,
-    DBUS_OBSERVER_ENABLE_ALL = 0x0F,
+    DBUS_OBSERVER_ENABLE_GET_METRICS = 0x10,
+    DBUS_OBSERVER_ENABLE_ALL = 0x1F,
 } DbusObserverEnableFlags;
 
 GType tlm_dbus_observer_get_type(void);
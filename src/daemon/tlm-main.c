@@ -39,6 +39,8 @@
 #include "tlm-log.h"
 #include "tlm-manager.h"
 #include "tlm-seat.h"
+#include "tlm-session-remote.h"
+#include "tlm-metrics.h"
 #include "tlm-config.h"
 #include "tlm-config-general.h"
 
@@ -80,6 +82,16 @@ _on_sighup_cb (gpointer data)
     return FALSE;
 }
 
+static gboolean
+_on_sigusr2_cb (gpointer data)
+{
+    tlm_log_set_debug (!tlm_log_get_debug ());
+    NOTICE ("debug logging %s",
+            tlm_log_get_debug () ? "enabled" : "disabled");
+
+    return G_SOURCE_CONTINUE;
+}
+
 static void
 _setup_unix_signal_handlers (TlmManager *manager)
 {
@@ -88,6 +100,7 @@ _setup_unix_signal_handlers (TlmManager *manager)
 
     g_unix_signal_add (SIGTERM, _on_sigterm_cb, (gpointer) manager);
     g_unix_signal_add (SIGHUP, _on_sighup_cb, (gpointer) manager);
+    g_unix_signal_add (SIGUSR2, _on_sigusr2_cb, NULL);
 }
 
 int main(int argc, char *argv[])
@@ -190,8 +203,14 @@ int main(int argc, char *argv[])
     g_object_unref (G_OBJECT(manager));
     g_free (username);
 
+    /* sessiond processes still going down were detached from their
+     * sessions, wait for them to be reaped before exiting */
+    if (tlm_session_remote_drain_detached (main_loop))
+        g_main_loop_run (main_loop);
+
     DBG ("clean shutdown");
 
+    tlm_metrics_clear ();
     tlm_log_close (NULL);
 
     return 0;
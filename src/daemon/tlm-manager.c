@@ -32,7 +32,10 @@
 #include "tlm-config.h"
 #include "tlm-config-general.h"
 #include "tlm-config-seat.h"
+#include "tlm-seat-config.h"
 #include "tlm-dbus-observer.h"
+#include "tlm-watchdog.h"
+#include "tlm-request-trace.h"
 #include "tlm-utils.h"
 #include "config.h"
 
@@ -45,6 +48,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <sys/inotify.h>
+#include <unistd.h>
 
 G_DEFINE_TYPE (TlmManager, tlm_manager, G_TYPE_OBJECT);
 
@@ -55,6 +59,9 @@ G_DEFINE_TYPE (TlmManager, tlm_manager, G_TYPE_OBJECT);
 #define LOGIND_OBJECT_PATH 	"/org/freedesktop/login1"
 #define LOGIND_MANAGER_IFACE 	LOGIND_BUS_NAME".Manager"
 
+/* editors write the configuration file in several steps */
+#define TLM_CONFIG_RELOAD_DELAY 200 /* ms */
+
 struct _TlmManagerPrivate
 {
     GDBusConnection *connection;
@@ -68,6 +75,13 @@ struct _TlmManagerPrivate
 
     guint seat_added_id;
     guint seat_removed_id;
+
+    GHashTable *retired_seats; /* removed by reload, session still running */
+    GHashTable *relogin_seats; /* to log in again with the new config */
+    gchar *config_watch_path;
+    gint config_watch_fd;
+    guint config_watch_id;
+    guint config_reload_id;
 };
 
 enum {
@@ -101,6 +115,18 @@ _unref_auth_plugins (gpointer data)
 	g_object_unref (plugin);
 }
 
+static void
+_unwatch_config (TlmManager *manager);
+
+static void
+_update_config_watch (TlmManager *manager);
+
+static void
+_update_watchdog (TlmManager *manager);
+
+static void
+_update_request_trace (TlmManager *manager);
+
 static void
 tlm_manager_dispose (GObject *self)
 {
@@ -117,10 +143,16 @@ tlm_manager_dispose (GObject *self)
         tlm_manager_stop (manager);
     }
 
+    _unwatch_config (manager);
+    tlm_watchdog_stop ();
+    tlm_request_trace_close ();
+
     if (manager->priv->seats) {
         g_hash_table_unref (manager->priv->seats);
         manager->priv->seats = NULL;
     }
+    g_clear_pointer (&manager->priv->retired_seats, g_hash_table_unref);
+    g_clear_pointer (&manager->priv->relogin_seats, g_hash_table_unref);
 
     g_clear_object (&manager->priv->account_plugin);
     g_clear_object (&manager->priv->config);
@@ -417,9 +449,16 @@ tlm_manager_init (TlmManager *manager)
     priv->config = tlm_config_new ();
     priv->connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
     if (!priv->connection) {
-        CRITICAL ("error getting system bus: %s", error->message);
+        /* virtual seats do not need logind */
+        if (!tlm_config_has_key (priv->config, TLM_CONFIG_GENERAL,
+                                 TLM_CONFIG_GENERAL_NSEATS)) {
+            CRITICAL ("error getting system bus: %s", error->message);
+            g_error_free (error);
+            return;
+        }
+        WARN ("no system bus, running with virtual seats only: %s",
+              error->message);
         g_error_free (error);
-        return;
     }
 
     priv->seats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
@@ -427,6 +466,14 @@ tlm_manager_init (TlmManager *manager)
 
     priv->account_plugin = NULL;
     priv->auth_plugins = NULL;
+    priv->retired_seats = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, NULL);
+    priv->relogin_seats = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, NULL);
+    priv->config_watch_path = NULL;
+    priv->config_watch_fd = -1;
+    priv->config_watch_id = 0;
+    priv->config_reload_id = 0;
 
     manager->priv = priv;
 
@@ -456,6 +503,7 @@ _prepare_user_login_cb (TlmSeat *seat, const gchar *user_name, gpointer user_dat
                                 TLM_CONFIG_GENERAL_PREPARE_DEFAULT,
                                 FALSE)) {
         DBG ("prepare for login for '%s'", user_name);
+        tlm_watchdog_mark ("guest account setup", tlm_seat_get_id (seat));
         if (!tlm_manager_setup_guest_user (manager, user_name)) {
             WARN ("failed to prepare for '%s'", user_name);
         }
@@ -474,6 +522,7 @@ _prepare_user_logout_cb (TlmSeat *seat, const gchar *user_name, gpointer user_da
                                 TLM_CONFIG_GENERAL_PREPARE_DEFAULT,
                                 FALSE)) {
         DBG ("prepare for logout for '%s'", user_name);
+        tlm_watchdog_mark ("guest account cleanup", tlm_seat_get_id (seat));
         if (!tlm_account_plugin_cleanup_guest_user (
                 manager->priv->account_plugin, user_name, FALSE)) {
             WARN ("failed to prepare for '%s'", user_name);
@@ -481,6 +530,17 @@ _prepare_user_logout_cb (TlmSeat *seat, const gchar *user_name, gpointer user_da
     }
 }
 
+static void
+_remove_seat (TlmManager *manager, const gchar *seat_id)
+{
+    gchar *id = g_strdup (seat_id);
+
+    DBG ("removing seat '%s'", id);
+    g_hash_table_remove (manager->priv->seats, id);
+    g_signal_emit (manager, signals[SIG_SEAT_REMOVED], 0, id, NULL);
+    g_free (id);
+}
+
 static gboolean
 _session_terminated_cb (GObject *emitter, const gchar *session_id,
         TlmManager *manager)
@@ -499,6 +559,17 @@ _session_terminated_cb (GObject *emitter, const gchar *session_id,
                 DBG ("signalling stopped");
                 g_signal_emit (manager, signals[SIG_MANAGER_STOPPED], 0);
             }
+        } else if (g_hash_table_remove (manager->priv->retired_seats,
+                                        tlm_seat_get_id (seat))) {
+            _remove_seat (manager, tlm_seat_get_id (seat));
+        } else if (g_hash_table_remove (manager->priv->relogin_seats,
+                                        tlm_seat_get_id (seat))) {
+            DBG ("seat '%s' logs in with the new configuration",
+                 tlm_seat_get_id (seat));
+            return FALSE;
+        } else if (tlm_seat_has_pending_switch (seat)) {
+            /* the prepared session is opened once the seat is free */
+            return FALSE;
         }
     }
     return TRUE;
@@ -633,7 +704,8 @@ _manager_hashify_seats (TlmManager *manager, GVariant *hash_map)
     g_variant_iter_init (&iter, hash_map);
     while (g_variant_iter_next (&iter, "(so)", &id, &path)) {
         DBG("found seat %s:%s", id, path);
-        _add_seat (manager, id, path);
+        if (!g_hash_table_contains (manager->priv->seats, id))
+            _add_seat (manager, id, path);
         g_free (id);
         g_free (path);
     }
@@ -682,22 +754,19 @@ _manager_on_seat_added (GDBusConnection *connection,
                         GVariant *params,
                         gpointer userdata)
 {
-    gchar *id = NULL, *path = NULL;
+    const gchar *id = NULL, *path = NULL;
     TlmManager *manager = TLM_MANAGER (userdata);
 
     g_return_if_fail (manager);
     g_return_if_fail (params);
 
     g_variant_get (params, "(&s&o)", &id, &path);
-    g_variant_unref (params);
 
     DBG("Seat added: %s:%s", id, path);
 
     if (!g_hash_table_contains (manager->priv->seats, id)) {
         _add_seat (manager, id, path);
     }
-    g_free (id);
-    g_free (path);
 }
 
 static void
@@ -709,24 +778,18 @@ _manager_on_seat_removed (GDBusConnection *connection,
                         GVariant *params,
                         gpointer userdata)
 {
-    gchar *id = NULL, *path = NULL;
+    const gchar *id = NULL, *path = NULL;
     TlmManager *manager = TLM_MANAGER (userdata);
 
     g_return_if_fail (manager);
     g_return_if_fail (params);
 
-    g_variant_get (params, "(&s&o)", &id, path);
-    g_variant_unref (params);
+    g_variant_get (params, "(&s&o)", &id, &path);
 
     DBG("Seat removed: %s:%s", id, path);
 
-    if (!g_hash_table_contains (manager->priv->seats, id)) {
-        g_hash_table_remove (manager->priv->seats, id);
-        g_signal_emit (manager, signals[SIG_SEAT_REMOVED], 0, id, NULL);
-
-    } 
-    g_free (id);
-    g_free (path);
+    if (g_hash_table_contains (manager->priv->seats, id))
+        _remove_seat (manager, id);
 }
 
 static void
@@ -773,6 +836,301 @@ _manager_unsubsribe_seat_changes (TlmManager *manager)
     }
 }
 
+static void
+_reload_accounts_plugin (TlmManager *manager, TlmConfig *old_config,
+                         GHashTable *diff)
+{
+    const gchar *old_name = tlm_config_get_string_default (old_config,
+            TLM_CONFIG_GENERAL, TLM_CONFIG_GENERAL_ACCOUNTS_PLUGIN, "default");
+    const gchar *name = tlm_config_get_string_default (manager->priv->config,
+            TLM_CONFIG_GENERAL, TLM_CONFIG_GENERAL_ACCOUNTS_PLUGIN, "default");
+
+    if (g_strcmp0 (old_name, name) == 0 &&
+        !g_hash_table_contains (diff, name)) {
+        DBG ("account plugin configuration unchanged");
+        return;
+    }
+
+    DBG ("reloading account plugin '%s'", name);
+    g_clear_object (&manager->priv->account_plugin);
+    _load_accounts_plugin (manager, name);
+}
+
+static gboolean
+_is_seat_wanted (TlmManager *manager, const gchar *seat_id,
+                 GHashTable *virtual_seats)
+{
+    if (virtual_seats && !g_hash_table_contains (virtual_seats, seat_id))
+        return FALSE;
+    return tlm_config_get_boolean (manager->priv->config, seat_id,
+                                   TLM_CONFIG_SEAT_ACTIVE, TRUE);
+}
+
+static GHashTable *
+_get_virtual_seats (TlmConfig *config)
+{
+    GHashTable *seat_ids = NULL;
+    guint i, nseats;
+
+    if (!tlm_config_has_key (config, TLM_CONFIG_GENERAL,
+                             TLM_CONFIG_GENERAL_NSEATS))
+        return NULL;
+
+    seat_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    nseats = tlm_config_get_uint (config, TLM_CONFIG_GENERAL,
+                                  TLM_CONFIG_GENERAL_NSEATS, 0);
+    for (i = 0; i < nseats; i++)
+        g_hash_table_add (seat_ids, g_strdup_printf ("seat%u", i));
+    return seat_ids;
+}
+
+static void
+_update_seat (TlmManager *manager, TlmSeat *seat, TlmConfig *old_config,
+              GHashTable *diff, gboolean relogin)
+{
+    const gchar *seat_id = tlm_seat_get_id (seat);
+    TlmSeatConfig *old_seat_config = NULL;
+    TlmSeatConfig *seat_config = NULL;
+    gboolean changed;
+
+    old_seat_config = tlm_config_get_seat_config (old_config, seat_id);
+    seat_config = tlm_config_get_seat_config (manager->priv->config, seat_id);
+    changed = g_hash_table_contains (diff, seat_id) ||
+        !tlm_seat_config_equal (old_seat_config, seat_config);
+    tlm_seat_config_unref (old_seat_config);
+    tlm_seat_config_unref (seat_config);
+
+    g_hash_table_remove (manager->priv->retired_seats, seat_id);
+    tlm_seat_set_config (seat, manager->priv->config);
+    if (!changed)
+        return;
+
+    DBG ("configuration of seat '%s' changed", seat_id);
+    if (relogin && tlm_seat_get_session_id (seat) &&
+        tlm_seat_terminate_session (seat))
+        g_hash_table_add (manager->priv->relogin_seats, g_strdup (seat_id));
+}
+
+static void
+_update_seats (TlmManager *manager, TlmConfig *old_config, GHashTable *diff)
+{
+    TlmManagerPrivate *priv = manager->priv;
+    GHashTable *virtual_seats = NULL;
+    GHashTableIter iter;
+    gpointer key, value;
+    GList *seat_ids = NULL, *l;
+    gboolean relogin;
+    gboolean sync_seats = FALSE;
+
+    if (tlm_config_has_key (old_config, TLM_CONFIG_GENERAL,
+                            TLM_CONFIG_GENERAL_NSEATS) !=
+        tlm_config_has_key (priv->config, TLM_CONFIG_GENERAL,
+                            TLM_CONFIG_GENERAL_NSEATS))
+        WARN ("switching between virtual and logind seats needs a restart");
+
+    relogin = tlm_config_get_boolean (priv->config, TLM_CONFIG_GENERAL,
+                                      TLM_CONFIG_GENERAL_RELOAD_RELOGIN,
+                                      FALSE);
+    if (priv->seat_added_id == 0)
+        virtual_seats = _get_virtual_seats (priv->config);
+
+    g_hash_table_iter_init (&iter, priv->seats);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+        seat_ids = g_list_prepend (seat_ids, g_strdup (key));
+
+    for (l = seat_ids; l; l = l->next) {
+        TlmSeat *seat = g_hash_table_lookup (priv->seats, l->data);
+
+        if (_is_seat_wanted (manager, l->data, virtual_seats)) {
+            _update_seat (manager, seat, old_config, diff, relogin);
+        } else if (!g_hash_table_contains (priv->retired_seats, l->data)) {
+            g_hash_table_remove (priv->relogin_seats, l->data);
+            if (tlm_seat_get_session_id (seat) &&
+                tlm_seat_terminate_session (seat))
+                g_hash_table_add (priv->retired_seats, g_strdup (l->data));
+            else
+                _remove_seat (manager, l->data);
+        }
+    }
+    g_list_free_full (seat_ids, g_free);
+
+    if (virtual_seats) {
+        g_hash_table_iter_init (&iter, virtual_seats);
+        while (g_hash_table_iter_next (&iter, &key, NULL)) {
+            if (!g_hash_table_contains (priv->seats, key)) {
+                DBG ("adding virtual seat '%s'", (const gchar *) key);
+                _add_seat (manager, key, NULL);
+            }
+        }
+        g_hash_table_unref (virtual_seats);
+        return;
+    }
+
+    /* seats activated by the new configuration come from logind */
+    g_hash_table_iter_init (&iter, diff);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        if (g_hash_table_contains (value, TLM_CONFIG_SEAT_ACTIVE) &&
+            !g_hash_table_contains (priv->seats, key))
+            sync_seats = TRUE;
+    }
+    if (sync_seats)
+        _manager_sync_seats (manager);
+}
+
+static void
+_reload_config (TlmManager *manager)
+{
+    TlmManagerPrivate *priv = manager->priv;
+    TlmConfig *old_config = NULL;
+    TlmConfig *config = NULL;
+    GHashTable *diff = NULL;
+    GHashTableIter iter;
+    gpointer group, keys;
+
+    config = tlm_config_new ();
+    diff = tlm_config_diff (priv->config, config);
+    if (g_hash_table_size (diff) == 0) {
+        DBG ("configuration unchanged");
+        g_hash_table_unref (diff);
+        g_object_unref (config);
+        return;
+    }
+
+    g_hash_table_iter_init (&iter, diff);
+    while (g_hash_table_iter_next (&iter, &group, &keys))
+        DBG ("group '%s': %u key(s) changed", (const gchar *) group,
+             g_hash_table_size (keys));
+
+    /* seats and sessions hold their own references, running sessions keep
+     * using the old configuration */
+    old_config = priv->config;
+    priv->config = config;
+
+    _reload_accounts_plugin (manager, old_config, diff);
+    if (priv->is_started) {
+        _update_seats (manager, old_config, diff);
+        _update_config_watch (manager);
+        _update_watchdog (manager);
+        _update_request_trace (manager);
+    }
+
+    g_hash_table_unref (diff);
+    g_object_unref (old_config);
+}
+
+static gboolean
+_on_config_reload_timeout (gpointer user_data)
+{
+    TlmManager *manager = TLM_MANAGER (user_data);
+
+    manager->priv->config_reload_id = 0;
+    DBG ("configuration file changed");
+    _reload_config (manager);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+_on_config_dir_changed (gint fd, GIOCondition condition, gpointer user_data)
+{
+    TlmManager *manager = TLM_MANAGER (user_data);
+    TlmManagerPrivate *priv = manager->priv;
+    gchar buf[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    gchar *name = g_path_get_basename (priv->config_watch_path);
+    gboolean changed = FALSE;
+    ssize_t len;
+
+    while ((len = read (fd, buf, sizeof (buf))) > 0) {
+        gchar *ptr = buf;
+        while (ptr < buf + len) {
+            struct inotify_event *ie = (struct inotify_event *) ptr;
+            if (ie->len && g_strcmp0 (ie->name, name) == 0)
+                changed = TRUE;
+            ptr += sizeof (struct inotify_event) + ie->len;
+        }
+    }
+    g_free (name);
+
+    if (changed) {
+        if (priv->config_reload_id)
+            g_source_remove (priv->config_reload_id);
+        priv->config_reload_id = g_timeout_add (TLM_CONFIG_RELOAD_DELAY,
+                _on_config_reload_timeout, manager);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+_unwatch_config (TlmManager *manager)
+{
+    TlmManagerPrivate *priv = manager->priv;
+
+    if (priv->config_reload_id) {
+        g_source_remove (priv->config_reload_id);
+        priv->config_reload_id = 0;
+    }
+    if (priv->config_watch_id) {
+        g_source_remove (priv->config_watch_id);
+        priv->config_watch_id = 0;
+    }
+    if (priv->config_watch_fd >= 0) {
+        close (priv->config_watch_fd);
+        priv->config_watch_fd = -1;
+    }
+    g_clear_string (&priv->config_watch_path);
+}
+
+static void
+_update_config_watch (TlmManager *manager)
+{
+    TlmManagerPrivate *priv = manager->priv;
+    const gchar *path = tlm_config_get_file_path (priv->config);
+    gchar *dir = NULL;
+    int ifd;
+
+    if (!path || !tlm_config_get_boolean (priv->config, TLM_CONFIG_GENERAL,
+                                          TLM_CONFIG_GENERAL_WATCH_CONFIG,
+                                          FALSE)) {
+        _unwatch_config (manager);
+        return;
+    }
+    if (g_strcmp0 (path, priv->config_watch_path) == 0)
+        return;
+    _unwatch_config (manager);
+
+    /* the file is usually replaced by rename, so watch the directory */
+    dir = g_path_get_dirname (path);
+    ifd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (ifd < 0 || inotify_add_watch (ifd, dir, IN_CLOSE_WRITE |
+                IN_MOVED_TO | IN_CREATE) < 0) {
+        WARN ("Failed to watch configuration file '%s': %s", path,
+              strerror (errno));
+        if (ifd >= 0) close (ifd);
+        g_free (dir);
+        return;
+    }
+    g_free (dir);
+
+    DBG ("watching configuration file '%s'", path);
+    priv->config_watch_fd = ifd;
+    priv->config_watch_path = g_strdup (path);
+    priv->config_watch_id = g_unix_fd_add (ifd, G_IO_IN,
+            _on_config_dir_changed, manager);
+}
+
+static void
+_update_watchdog (TlmManager *manager)
+{
+    tlm_watchdog_start (NULL, tlm_config_get_uint (manager->priv->config,
+                TLM_CONFIG_GENERAL, TLM_CONFIG_GENERAL_WATCHDOG_THRESHOLD, 0));
+}
+
+static void
+_update_request_trace (TlmManager *manager)
+{
+    tlm_request_trace_open (tlm_config_get_string (manager->priv->config,
+                TLM_CONFIG_GENERAL, TLM_CONFIG_GENERAL_REQUEST_TRACE));
+}
+
 gboolean
 tlm_manager_start (TlmManager *manager)
 {
@@ -798,6 +1156,9 @@ tlm_manager_start (TlmManager *manager)
     }
 
     manager->priv->is_started = TRUE;
+    _update_config_watch (manager);
+    _update_watchdog (manager);
+    _update_request_trace (manager);
 
     return TRUE;
 }
@@ -808,6 +1169,7 @@ tlm_manager_stop (TlmManager *manager)
     g_return_val_if_fail (manager && TLM_IS_MANAGER (manager), FALSE);
 
     _manager_unsubsribe_seat_changes (manager);
+    _unwatch_config (manager);
 
     GHashTableIter iter;
     gpointer key, value;
@@ -890,13 +1252,7 @@ tlm_manager_sighup_received (TlmManager *manager)
 {
     g_return_if_fail (manager && TLM_IS_MANAGER (manager));
 
-    DBG ("sighup recvd. reload configuration and account plugin");
-    tlm_config_reload (manager->priv->config);
-    g_clear_object (&manager->priv->account_plugin);
-    _load_accounts_plugin (manager,
-                           tlm_config_get_string_default (manager->priv->config,
-                                                          TLM_CONFIG_GENERAL,
-                                                          TLM_CONFIG_GENERAL_ACCOUNTS_PLUGIN,
-                                                          "default"));
+    DBG ("sighup recvd. reload configuration");
+    _reload_config (manager);
 }
 
@@ -0,0 +1,321 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Counters, gauges and latency histograms of the daemon, exported in the
+ * Prometheus text format through the getMetrics method of the root login
+ * object. Series are identified by the metric name and an optional single
+ * label. Only the main loop updates them, no locking is done. */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "tlm-metrics.h"
+#include "common/tlm-log.h"
+
+typedef enum {
+    TLM_METRIC_COUNTER,
+    TLM_METRIC_GAUGE,
+    TLM_METRIC_HISTOGRAM
+} TlmMetricType;
+
+typedef struct {
+    const gchar *name;
+    TlmMetricType type;
+    const gchar *help;
+} TlmMetricDefinition;
+
+static const TlmMetricDefinition _definitions[] = {
+    { TLM_METRIC_LOGINS, TLM_METRIC_COUNTER,
+      "Sessions created by login requests and automatic logins" },
+    { TLM_METRIC_LOGIN_LATENCY, TLM_METRIC_HISTOGRAM,
+      "Time from login request to session created" },
+    { TLM_METRIC_SWITCHES, TLM_METRIC_COUNTER,
+      "Sessions created by switch user requests" },
+    { TLM_METRIC_SWITCH_LATENCY, TLM_METRIC_HISTOGRAM,
+      "Time from switch user request to the new session created" },
+    { TLM_METRIC_LOGOUTS, TLM_METRIC_COUNTER,
+      "Sessions terminated by logout requests" },
+    { TLM_METRIC_LOGOUT_LATENCY, TLM_METRIC_HISTOGRAM,
+      "Time from logout request to session terminated" },
+    { TLM_METRIC_SESSION_ERRORS, TLM_METRIC_COUNTER,
+      "Session errors by TlmError code, PAM failures included" },
+    { TLM_METRIC_RELOGIN_THROTTLED, TLM_METRIC_COUNTER,
+      "Logins delayed because relogins were spinning too fast" },
+    { TLM_METRIC_ACTIVE_SESSIONS, TLM_METRIC_GAUGE,
+      "Sessions currently running" },
+    { TLM_METRIC_SEATS, TLM_METRIC_GAUGE,
+      "Seats held by the daemon, retired ones included" },
+    { TLM_METRIC_SESSIOND_SPAWN, TLM_METRIC_HISTOGRAM,
+      "Time to spawn tlm-sessiond and connect to it" },
+    { TLM_METRIC_SESSIOND_POOL_HITS, TLM_METRIC_COUNTER,
+      "Logins served by a pre-spawned tlm-sessiond" },
+    { TLM_METRIC_SESSIOND_POOL_MISSES, TLM_METRIC_COUNTER,
+      "Logins that had to spawn tlm-sessiond" },
+    { TLM_METRIC_TERMINATE_ESCALATIONS, TLM_METRIC_COUNTER,
+      "tlm-sessiond processes that ignored the previous signal" },
+    { TLM_METRIC_REQUESTS_QUEUED, TLM_METRIC_GAUGE,
+      "D-Bus requests waiting in the seat queues, by seat" },
+    { TLM_METRIC_REQUESTS_PROCESSED, TLM_METRIC_COUNTER,
+      "D-Bus requests taken from the seat queues, by seat" },
+    { TLM_METRIC_REQUEST_WAIT, TLM_METRIC_HISTOGRAM,
+      "Time D-Bus requests waited in the seat queues" },
+    { TLM_METRIC_LOG_DROPPED, TLM_METRIC_COUNTER,
+      "Log messages dropped because the log ring was full" },
+    { TLM_METRIC_MAINLOOP_STALLS, TLM_METRIC_COUNTER,
+      "Main loop dispatches over the watchdog threshold, by callback" },
+    { TLM_METRIC_MAINLOOP_STALL, TLM_METRIC_HISTOGRAM,
+      "Duration of the main loop dispatches over the watchdog threshold" },
+};
+
+/* upper bounds of the histogram buckets, usec */
+static const gint64 _buckets[] = {
+    1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000
+};
+
+#define TLM_METRIC_N_BUCKETS G_N_ELEMENTS (_buckets)
+
+typedef struct {
+    const TlmMetricDefinition *definition;
+    gchar *labels; /* 'label="value"' or NULL */
+    gint64 value;  /* counters and gauges, sum in usec for histograms */
+    guint64 count;
+    guint64 buckets[TLM_METRIC_N_BUCKETS]; /* not cumulative */
+} TlmMetric;
+
+static GHashTable *_metrics = NULL; /* (series, TlmMetric) */
+
+static void
+_free_metric (TlmMetric *metric)
+{
+    g_free (metric->labels);
+    g_slice_free (TlmMetric, metric);
+}
+
+static const TlmMetricDefinition *
+_find_definition (const gchar *name)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (_definitions); i++) {
+        if (g_strcmp0 (_definitions[i].name, name) == 0)
+            return &_definitions[i];
+    }
+    return NULL;
+}
+
+static TlmMetric *
+_get_metric (
+        const gchar *name,
+        const gchar *label,
+        const gchar *value)
+{
+    const TlmMetricDefinition *definition;
+    TlmMetric *metric;
+    gchar *labels = NULL;
+    gchar *series;
+
+    definition = _find_definition (name);
+    if (!definition) {
+        WARN ("unknown metric %s", name);
+        return NULL;
+    }
+
+    if (label) {
+        gchar *escaped = g_strescape (value ? value : "", NULL);
+        labels = g_strdup_printf ("%s=\"%s\"", label, escaped);
+        g_free (escaped);
+    }
+    series = g_strconcat (name, "{", labels ? labels : "", "}", NULL);
+
+    if (!_metrics)
+        _metrics = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                (GDestroyNotify) _free_metric);
+
+    metric = g_hash_table_lookup (_metrics, series);
+    if (metric) {
+        g_free (series);
+        g_free (labels);
+        return metric;
+    }
+
+    metric = g_slice_new0 (TlmMetric);
+    metric->definition = definition;
+    metric->labels = labels;
+    g_hash_table_insert (_metrics, series, metric);
+    return metric;
+}
+
+void
+tlm_metrics_add (
+        const gchar *name,
+        const gchar *label,
+        const gchar *value,
+        gint64 delta)
+{
+    TlmMetric *metric = _get_metric (name, label, value);
+
+    g_return_if_fail (metric &&
+            metric->definition->type != TLM_METRIC_HISTOGRAM);
+    metric->value += delta;
+}
+
+void
+tlm_metrics_set (
+        const gchar *name,
+        const gchar *label,
+        const gchar *value,
+        gint64 amount)
+{
+    TlmMetric *metric = _get_metric (name, label, value);
+
+    g_return_if_fail (metric &&
+            metric->definition->type != TLM_METRIC_HISTOGRAM);
+    metric->value = amount;
+}
+
+void
+tlm_metrics_observe (
+        const gchar *name,
+        const gchar *label,
+        const gchar *value,
+        gint64 usec)
+{
+    TlmMetric *metric = _get_metric (name, label, value);
+    guint i;
+
+    g_return_if_fail (metric &&
+            metric->definition->type == TLM_METRIC_HISTOGRAM);
+
+    if (usec < 0)
+        usec = 0;
+    metric->value += usec;
+    metric->count++;
+    for (i = 0; i < TLM_METRIC_N_BUCKETS; i++) {
+        if (usec <= _buckets[i]) {
+            metric->buckets[i]++;
+            break;
+        }
+    }
+}
+
+static void
+_append_sample (
+        GString *text,
+        const gchar *name,
+        const gchar *labels,
+        const gchar *format,
+        ...) G_GNUC_PRINTF (4, 5);
+
+static void
+_append_sample (
+        GString *text,
+        const gchar *name,
+        const gchar *labels,
+        const gchar *format,
+        ...)
+{
+    va_list args;
+
+    g_string_append (text, name);
+    if (labels)
+        g_string_append_printf (text, "{%s}", labels);
+    g_string_append_c (text, ' ');
+    va_start (args, format);
+    g_string_append_vprintf (text, format, args);
+    va_end (args);
+    g_string_append_c (text, '\n');
+}
+
+static void
+_append_histogram (
+        GString *text,
+        const gchar *name,
+        TlmMetric *metric)
+{
+    const gchar *sep = metric->labels ? "," : "";
+    const gchar *labels = metric->labels ? metric->labels : "";
+    guint64 cumulative = 0;
+    guint i;
+
+    for (i = 0; i < TLM_METRIC_N_BUCKETS; i++) {
+        cumulative += metric->buckets[i];
+        g_string_append_printf (text,
+                "%s_bucket{%s%sle=\"%g\"} %" G_GUINT64_FORMAT "\n",
+                name, labels, sep, _buckets[i] / 1e6, cumulative);
+    }
+    g_string_append_printf (text,
+            "%s_bucket{%s%sle=\"+Inf\"} %" G_GUINT64_FORMAT "\n",
+            name, labels, sep, metric->count);
+    g_string_append (text, name);
+    _append_sample (text, "_sum", metric->labels, "%.6f",
+            metric->value / 1e6);
+    g_string_append (text, name);
+    _append_sample (text, "_count", metric->labels, "%" G_GUINT64_FORMAT,
+            metric->count);
+}
+
+gchar *
+tlm_metrics_to_text (void)
+{
+    static const gchar *type_names[] = { "counter", "gauge", "histogram" };
+    GString *text = g_string_new (NULL);
+    GList *series, *item;
+    guint i;
+
+    /* sampled from modules that keep their own count */
+    tlm_metrics_set (TLM_METRIC_LOG_DROPPED, NULL, NULL,
+            tlm_log_get_dropped_total ());
+
+    series = g_hash_table_get_keys (_metrics);
+    series = g_list_sort (series, (GCompareFunc) g_strcmp0);
+
+    for (i = 0; i < G_N_ELEMENTS (_definitions); i++) {
+        const TlmMetricDefinition *definition = &_definitions[i];
+
+        g_string_append_printf (text, "# HELP %s %s\n# TYPE %s %s\n",
+                definition->name, definition->help, definition->name,
+                type_names[definition->type]);
+
+        for (item = series; item; item = g_list_next (item)) {
+            TlmMetric *metric = g_hash_table_lookup (_metrics, item->data);
+
+            if (metric->definition != definition)
+                continue;
+            if (definition->type == TLM_METRIC_HISTOGRAM)
+                _append_histogram (text, definition->name, metric);
+            else
+                _append_sample (text, definition->name, metric->labels,
+                        "%" G_GINT64_FORMAT, metric->value);
+        }
+    }
+
+    g_list_free (series);
+    return g_string_free (text, FALSE);
+}
+
+void
+tlm_metrics_clear (void)
+{
+    g_clear_pointer (&_metrics, g_hash_table_unref);
+}
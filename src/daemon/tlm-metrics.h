@@ -0,0 +1,82 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TLM_METRICS_H
+#define _TLM_METRICS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* metric names, see _definitions in tlm-metrics.c for types and help */
+#define TLM_METRIC_LOGINS               "tlm_logins_total"
+#define TLM_METRIC_LOGIN_LATENCY        "tlm_login_latency_seconds"
+#define TLM_METRIC_SWITCHES             "tlm_switches_total"
+#define TLM_METRIC_SWITCH_LATENCY       "tlm_switch_latency_seconds"
+#define TLM_METRIC_LOGOUTS              "tlm_logouts_total"
+#define TLM_METRIC_LOGOUT_LATENCY       "tlm_logout_latency_seconds"
+#define TLM_METRIC_SESSION_ERRORS       "tlm_session_errors_total"
+#define TLM_METRIC_RELOGIN_THROTTLED    "tlm_relogin_throttled_total"
+#define TLM_METRIC_ACTIVE_SESSIONS      "tlm_active_sessions"
+#define TLM_METRIC_SEATS                "tlm_seats"
+#define TLM_METRIC_SESSIOND_SPAWN       "tlm_sessiond_spawn_seconds"
+#define TLM_METRIC_SESSIOND_POOL_HITS   "tlm_sessiond_pool_hits_total"
+#define TLM_METRIC_SESSIOND_POOL_MISSES "tlm_sessiond_pool_misses_total"
+#define TLM_METRIC_TERMINATE_ESCALATIONS "tlm_terminate_escalations_total"
+#define TLM_METRIC_REQUESTS_QUEUED      "tlm_requests_queued"
+#define TLM_METRIC_REQUESTS_PROCESSED   "tlm_requests_processed_total"
+#define TLM_METRIC_REQUEST_WAIT         "tlm_request_wait_seconds"
+#define TLM_METRIC_LOG_DROPPED          "tlm_log_dropped_total"
+#define TLM_METRIC_MAINLOOP_STALLS      "tlm_mainloop_stalls_total"
+#define TLM_METRIC_MAINLOOP_STALL       "tlm_mainloop_stall_seconds"
+
+void
+tlm_metrics_add (
+        const gchar *name,
+        const gchar *label,
+        const gchar *value,
+        gint64 delta);
+
+void
+tlm_metrics_set (
+        const gchar *name,
+        const gchar *label,
+        const gchar *value,
+        gint64 amount);
+
+void
+tlm_metrics_observe (
+        const gchar *name,
+        const gchar *label,
+        const gchar *value,
+        gint64 usec);
+
+gchar *
+tlm_metrics_to_text (void);
+
+void
+tlm_metrics_clear (void);
+
+G_END_DECLS
+
+#endif /* _TLM_METRICS_H */
@@ -0,0 +1,183 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Records the D-Bus requests that went through the seat queues, for
+ * tlm-bench --replay. User names are replaced by an HMAC under a key that
+ * is drawn per trace and never written, so a trace tells users apart
+ * without naming them. Every record is flushed as soon as its request
+ * completes, so a trace survives the daemon crashing. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tlm-request-trace.h"
+#include "common/tlm-log.h"
+#include "common/tlm-utils.h"
+
+#define TLM_REQUEST_TRACE_KEY_SIZE 32
+
+static FILE *_trace = NULL;
+static gchar *_path = NULL;
+static gint64 _start = 0;
+static GHmac *_hmac = NULL;
+
+gboolean
+tlm_request_trace_open (
+        const gchar *path)
+{
+    TlmRequestTraceHeader header;
+    guchar key[TLM_REQUEST_TRACE_KEY_SIZE];
+    guint i;
+    int fd;
+
+    if (path && !*path)
+        path = NULL;
+    if (g_strcmp0 (path, _path) == 0)
+        return TRUE;
+
+    tlm_request_trace_close ();
+    if (!path)
+        return TRUE;
+
+    fd = open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0 || !(_trace = fdopen (fd, "w"))) {
+        WARN ("cannot open request trace '%s': %s", path, strerror (errno));
+        if (fd >= 0)
+            close (fd);
+        return FALSE;
+    }
+
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, TLM_REQUEST_TRACE_MAGIC, sizeof (header.magic));
+    header.start_time = g_get_real_time ();
+    fwrite (&header, sizeof (header), 1, _trace);
+    fflush (_trace);
+
+    for (i = 0; i < sizeof (key); i += sizeof (guint32)) {
+        guint32 value = g_random_int ();
+        memcpy (key + i, &value, sizeof (value));
+    }
+    _hmac = g_hmac_new (G_CHECKSUM_SHA256, key, sizeof (key));
+    memset (key, 0, sizeof (key));
+
+    _path = g_strdup (path);
+    _start = g_get_monotonic_time ();
+    DBG ("recording requests to '%s'", path);
+    return TRUE;
+}
+
+void
+tlm_request_trace_close (void)
+{
+    if (!_trace)
+        return;
+
+    if (fclose (_trace) != 0)
+        WARN ("failed to write request trace '%s': %s", _path,
+              strerror (errno));
+    _trace = NULL;
+    g_hmac_unref (_hmac);
+    _hmac = NULL;
+    g_clear_string (&_path);
+}
+
+static guint32
+_hash_user (const gchar *username)
+{
+    GHmac *hmac;
+    guint8 digest[32];
+    gsize len = sizeof (digest);
+    guint32 user;
+
+    if (!username || !*username)
+        return 0;
+
+    hmac = g_hmac_copy (_hmac);
+    g_hmac_update (hmac, (const guchar *) username, -1);
+    g_hmac_get_digest (hmac, digest, &len);
+    g_hmac_unref (hmac);
+    memcpy (&user, digest, sizeof (user));
+
+    /* 0 stands for no user */
+    return user ? user : 1;
+}
+
+static guint16
+_seat_number (const gchar *seat_id)
+{
+    gchar *end = NULL;
+    guint64 number;
+
+    if (!seat_id || !g_str_has_prefix (seat_id, "seat"))
+        return TLM_REQUEST_TRACE_SEAT_OTHER;
+    number = g_ascii_strtoull (seat_id + 4, &end, 10);
+    if (end == seat_id + 4 || *end || number >= TLM_REQUEST_TRACE_SEAT_OTHER)
+        return TLM_REQUEST_TRACE_SEAT_OTHER;
+    return (guint16) number;
+}
+
+/* times are monotonic, enqueue_time and start_time are 0 for requests that
+ * never made it into or out of a seat queue */
+void
+tlm_request_trace_record (
+        guint type,
+        const gchar *seat_id,
+        const gchar *username,
+        gint64 enqueue_time,
+        gint64 start_time,
+        guint status)
+{
+    TlmRequestTraceRecord record;
+    gint64 now;
+
+    if (!_trace)
+        return;
+
+    now = g_get_monotonic_time ();
+    if (!enqueue_time || enqueue_time < _start)
+        enqueue_time = now;
+    if (!start_time)
+        start_time = now;
+    if (start_time < enqueue_time)
+        start_time = enqueue_time;
+
+    memset (&record, 0, sizeof (record));
+    record.arrival = enqueue_time - _start;
+    record.wait = MIN (start_time - enqueue_time, G_MAXUINT32);
+    record.latency = MIN (now - enqueue_time, G_MAXUINT32);
+    record.user = _hash_user (username);
+    record.seat = _seat_number (seat_id);
+    record.type = type;
+    record.status = MIN (status, G_MAXUINT8);
+
+    if (fwrite (&record, sizeof (record), 1, _trace) != 1 ||
+        fflush (_trace) != 0) {
+        WARN ("failed to write request trace '%s', stopping: %s", _path,
+              strerror (errno));
+        tlm_request_trace_close ();
+    }
+}
@@ -0,0 +1,71 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TLM_REQUEST_TRACE_H
+#define _TLM_REQUEST_TRACE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A trace is a TlmRequestTraceHeader followed by one record per completed
+ * request, in completion order and host byte order. */
+#define TLM_REQUEST_TRACE_MAGIC     "TLMRQTR1"
+
+/* seat ids that are not seat<N> */
+#define TLM_REQUEST_TRACE_SEAT_OTHER G_MAXUINT16
+
+typedef struct {
+    gchar magic[8];
+    gint64 start_time;  /* wall clock, usec since the epoch */
+} TlmRequestTraceHeader;
+
+typedef struct {
+    guint64 arrival;    /* usec from the start of the trace */
+    guint32 wait;       /* usec queued behind other requests of the seat */
+    guint32 latency;    /* usec from arrival to completion */
+    guint32 user;       /* keyed hash of the user name, 0 if none */
+    guint16 seat;       /* N of seat<N> */
+    guint8 type;        /* TlmDbusRequestType */
+    guint8 status;      /* TlmError code, 0 on success */
+} TlmRequestTraceRecord;
+
+gboolean
+tlm_request_trace_open (
+        const gchar *path);
+
+void
+tlm_request_trace_close (void);
+
+void
+tlm_request_trace_record (
+        guint type,
+        const gchar *seat_id,
+        const gchar *username,
+        gint64 enqueue_time,
+        gint64 start_time,
+        guint status);
+
+G_END_DECLS
+
+#endif /* _TLM_REQUEST_TRACE_H */
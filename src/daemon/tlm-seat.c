@@ -24,6 +24,7 @@
  * 02110-1301 USA
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -33,10 +34,14 @@
 
 #include "tlm-seat.h"
 #include "tlm-session-remote.h"
+#include "tlm-metrics.h"
+#include "tlm-watchdog.h"
+#include "tlm-trace.h"
 #include "tlm-log.h"
 #include "tlm-error.h"
 #include "tlm-utils.h"
 #include "tlm-config-general.h"
+#include "tlm-seat-config.h"
 #include "tlm-dbus-observer.h"
 
 G_DEFINE_TYPE (TlmSeat, tlm_seat, G_TYPE_OBJECT);
@@ -67,6 +72,7 @@ static guint signals[SIG_MAX];
 struct _TlmSeatPrivate
 {
     TlmConfig *config;
+    TlmSeatConfig *seat_config; /* refreshed at each login */
     gchar *id;
     gchar *default_user;
     gchar *path;
@@ -74,6 +80,8 @@ struct _TlmSeatPrivate
     gchar *next_user;
     gchar *next_password;
     GHashTable *next_environment;
+    gint64 next_request_time;
+    gint64 request_time; /* when the pending login was requested */
     gint64 prev_time;
     gint32 prev_count;
     gboolean default_active;
@@ -81,6 +89,19 @@ struct _TlmSeatPrivate
     TlmDbusObserver *dbus_observer; /* dbus server accessed only by user who has
     active session */
     TlmDbusObserver *prev_dbus_observer;
+    GCancellable *auth_cancellable; /* pending switch-user authentication */
+    GQueue *session_pool; /* pre-spawned, connected sessiond instances */
+    guint pool_refill_id;
+    GCancellable *pool_spawn; /* set while a pooled sessiond connects */
+    guint pool_hits;
+    guint pool_misses;
+    TlmSessionRemote *next_session; /* session prepared for switch user */
+    GCancellable *next_spawn; /* set while next_session's sessiond connects */
+    gboolean next_authenticated;
+    gboolean session_active; /* counted in the active sessions metric */
+    gint64 login_time; /* request times of the pending operations */
+    gint64 switch_time;
+    gint64 logout_time;
 };
 
 typedef struct _DelayClosure
@@ -90,12 +111,22 @@ typedef struct _DelayClosure
     gchar *username;
     gchar *password;
     GHashTable *environment;
+    gint64 request_time;
 } DelayClosure;
 
 static void
 _disconnect_session_signals (
         TlmSeat *seat);
 
+static void
+_connect_session_signals (
+        TlmSeat *seat);
+
+static gboolean
+_create_dbus_observer (
+        TlmSeat *seat,
+        const gchar *username);
+
 static void
 _reset_next (TlmSeatPrivate *priv)
 {
@@ -106,6 +137,16 @@ _reset_next (TlmSeatPrivate *priv)
         g_hash_table_unref (priv->next_environment);
         priv->next_environment = NULL;
     }
+    priv->next_request_time = 0;
+}
+
+static gint64
+_take_request_time (TlmSeatPrivate *priv)
+{
+    gint64 request_time = priv->request_time;
+
+    priv->request_time = 0;
+    return request_time ? request_time : g_get_monotonic_time ();
 }
 
 static void
@@ -116,7 +157,25 @@ _handle_session_created (
 {
     g_return_if_fail (self && TLM_IS_SEAT (self));
 
+    TlmSeatPrivate *priv = self->priv;
+    gint64 now = g_get_monotonic_time ();
+
     DBG ("sessionid: %s", sessionid);
+    TLM_TRACE (session__created, priv->id, sessionid, -1);
+
+    priv->session_active = TRUE;
+    tlm_metrics_add (TLM_METRIC_ACTIVE_SESSIONS, NULL, NULL, 1);
+    if (priv->switch_time) {
+        tlm_metrics_add (TLM_METRIC_SWITCHES, "seat", priv->id, 1);
+        tlm_metrics_observe (TLM_METRIC_SWITCH_LATENCY, "seat", priv->id,
+                now - priv->switch_time);
+    } else {
+        tlm_metrics_add (TLM_METRIC_LOGINS, "seat", priv->id, 1);
+        if (priv->login_time)
+            tlm_metrics_observe (TLM_METRIC_LOGIN_LATENCY, "seat", priv->id,
+                    now - priv->login_time);
+    }
+    priv->switch_time = priv->login_time = 0;
 
     g_signal_emit (self, signals[SIG_SESSION_CREATED], 0, sessionid);
 
@@ -130,6 +189,154 @@ _close_active_session (TlmSeat *self)
     _disconnect_session_signals (self);
     if (priv->session)
         g_clear_object (&priv->session);
+    if (priv->session_active) {
+        priv->session_active = FALSE;
+        tlm_metrics_add (TLM_METRIC_ACTIVE_SESSIONS, NULL, NULL, -1);
+    }
+}
+
+static void
+_handle_next_session_authenticated (
+        TlmSeat *self,
+        gpointer user_data);
+
+static void
+_handle_next_session_error (
+        TlmSeat *self,
+        GError *error,
+        gpointer user_data);
+
+static void
+_disconnect_next_session_signals (TlmSeat *seat)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+
+    if (!priv->next_session) return;
+    g_signal_handlers_disconnect_by_func (G_OBJECT (priv->next_session),
+            _handle_next_session_authenticated, seat);
+    g_signal_handlers_disconnect_by_func (G_OBJECT (priv->next_session),
+            _handle_next_session_error, seat);
+}
+
+static void
+_discard_next_session (TlmSeat *seat)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+
+    if (priv->next_spawn) {
+        g_cancellable_cancel (priv->next_spawn);
+        g_clear_object (&priv->next_spawn);
+    }
+    if (!priv->next_session) return;
+    DBG ("discarding prepared session on seat %s", priv->id);
+    _disconnect_next_session_signals (seat);
+    g_clear_object (&priv->next_session);
+    priv->next_authenticated = FALSE;
+}
+
+static void
+_activate_next_session (TlmSeat *seat)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+
+    DBG ("opening prepared session for '%s' on seat %s", priv->next_user,
+            priv->id);
+    _disconnect_next_session_signals (seat);
+    priv->session = priv->next_session;
+    priv->next_session = NULL;
+    priv->next_authenticated = FALSE;
+
+    priv->prev_dbus_observer = priv->dbus_observer;
+    priv->dbus_observer = NULL;
+    if (!_create_dbus_observer (seat, priv->next_user)) {
+        g_clear_object (&priv->session);
+        _reset_next (priv);
+        g_signal_emit (seat, signals[SIG_SESSION_ERROR],  0,
+                TLM_ERROR_DBUS_SERVER_START_FAILURE);
+        return;
+    }
+
+    _connect_session_signals (seat);
+    tlm_session_remote_open (priv->session);
+    _reset_next (priv);
+}
+
+/* the previous session is gone, returns FALSE if no switch user waits for
+ * the seat */
+static gboolean
+_continue_switch_user (TlmSeat *seat)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+
+    if (priv->next_session) {
+        if (priv->next_authenticated)
+            _activate_next_session (seat);
+        else
+            DBG ("waiting for next session to be authenticated");
+        return TRUE;
+    }
+    if (priv->next_spawn) {
+        DBG ("waiting for next session to be spawned");
+        return TRUE;
+    }
+    if (!priv->next_user)
+        return FALSE;
+
+    /* nothing prepared, create the session from scratch */
+    DBG ("login of '%s' after termination", priv->next_user);
+    priv->request_time = priv->next_request_time;
+    tlm_seat_create_session (seat,
+            priv->next_service,
+            priv->next_user,
+            priv->next_password,
+            priv->next_environment);
+    _reset_next (priv);
+    return TRUE;
+}
+
+static void
+_handle_next_session_authenticated (
+        TlmSeat *self,
+        gpointer user_data)
+{
+    g_return_if_fail (self && TLM_IS_SEAT (self));
+
+    DBG ("next session authenticated on seat %s", self->priv->id);
+    self->priv->next_authenticated = TRUE;
+
+    /* previous session is already gone, open the new one right away */
+    if (!self->priv->session)
+        _activate_next_session (self);
+}
+
+static void
+_handle_next_session_error (
+        TlmSeat *self,
+        GError *error,
+        gpointer user_data)
+{
+    g_return_if_fail (self && TLM_IS_SEAT (self));
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (self);
+
+    WARN ("preparing next session failed: %d:%s", error->code,
+            error->message);
+    _discard_next_session (self);
+
+    /* fall back to creating the session from scratch, either now or once
+     * the previous session has terminated */
+    if (!priv->session)
+        _continue_switch_user (self);
+}
+
+static TlmSeatConfig *
+_get_seat_config (TlmSeat *seat)
+{
+    TlmSeatPrivate *priv = seat->priv;
+
+    if (!priv->seat_config)
+        priv->seat_config = tlm_config_get_seat_config (priv->config,
+                                                        priv->id);
+    return priv->seat_config;
 }
 
 static void
@@ -146,6 +353,12 @@ _handle_session_terminated (
 
     DBG ("seat %p session %p", self, priv->session);
     _close_active_session (seat);
+    if (priv->logout_time) {
+        tlm_metrics_add (TLM_METRIC_LOGOUTS, "seat", priv->id, 1);
+        tlm_metrics_observe (TLM_METRIC_LOGOUT_LATENCY, "seat", priv->id,
+                g_get_monotonic_time () - priv->logout_time);
+        priv->logout_time = 0;
+    }
 
     g_signal_emit (seat,
             signals[SIG_SESSION_TERMINATED],
@@ -154,32 +367,25 @@ _handle_session_terminated (
             &stop);
     if (stop) {
         DBG ("no relogin or switch user");
+        _discard_next_session (seat);
         return;
     }
     g_clear_object (&priv->dbus_observer);
 
-    if (tlm_config_get_boolean (priv->config,
-                                TLM_CONFIG_GENERAL,
-                                TLM_CONFIG_GENERAL_X11_SESSION,
-                                FALSE)) {
+    if (_get_seat_config (seat)->x11_session) {
         DBG ("X11 session termination");
+        _discard_next_session (seat);
         if (kill (0, SIGTERM))
             WARN ("Failed to send TERM signal to process tree");
         return;
     }
 
-    if (tlm_config_get_boolean (priv->config,
-                                TLM_CONFIG_GENERAL,
-                                TLM_CONFIG_GENERAL_AUTO_LOGIN,
-                                TRUE) ||
-                                seat->priv->next_user) {
-        DBG ("auto re-login with '%s'", seat->priv->next_user);
-        tlm_seat_create_session (seat,
-                seat->priv->next_service,
-                seat->priv->next_user,
-                seat->priv->next_password,
-                seat->priv->next_environment);
-        _reset_next (priv);
+    if (_continue_switch_user (seat))
+        return;
+
+    if (_get_seat_config (seat)->auto_login) {
+        DBG ("auto re-login");
+        tlm_seat_create_session (seat, NULL, NULL, NULL, NULL);
     }
 }
 
@@ -191,7 +397,19 @@ _handle_error (
 {
     g_return_if_fail (self && TLM_IS_SEAT (self));
 
+    gint code = error->code;
+    gchar *code_str;
+
     DBG ("Error : %d:%s", error->code, error->message);
+
+    /* sessiond reports PAM failures as creation failures, with the code of
+     * the original error in front of the message */
+    if (code == TLM_ERROR_SESSION_CREATION_FAILURE && error->message)
+        sscanf (error->message, "%d:", &code);
+    code_str = g_strdup_printf ("%d", code);
+    tlm_metrics_add (TLM_METRIC_SESSION_ERRORS, "code", code_str, 1);
+    g_free (code_str);
+
     g_signal_emit (self, signals[SIG_SESSION_ERROR],  0, error->code);
 
     if (error->code == TLM_ERROR_PAM_AUTH_FAILURE ||
@@ -199,7 +417,14 @@ _handle_error (
         error->code == TLM_ERROR_SESSION_TERMINATION_FAILURE) {
         DBG ("Destroy the session in case of creation/termination failure");
         _close_active_session (self);
+        self->priv->login_time = self->priv->switch_time = 0;
+        self->priv->logout_time = 0;
         g_clear_object (&self->priv->dbus_observer);
+
+        /* the seat is free, a switch user must not wait for a
+         * session-terminated that will not come */
+        if (error->code == TLM_ERROR_SESSION_TERMINATION_FAILURE)
+            _continue_switch_user (self);
     }
 }
 
@@ -275,19 +500,127 @@ _create_dbus_observer (
     return (seat->priv->dbus_observer != NULL);
 }
 
+static guint
+_get_session_pool_size (TlmSeat *seat)
+{
+    if (!seat->priv->config) return 0;
+    return _get_seat_config (seat)->sessiond_pool_size;
+}
+
+static void _schedule_session_pool_refill (TlmSeat *seat);
+
+static void
+_on_pooled_session_spawned (TlmSessionRemote *session, gpointer user_data)
+{
+    TlmSeat *seat = TLM_SEAT (user_data);
+    TlmSeatPrivate *priv = seat->priv;
+
+    g_clear_object (&priv->pool_spawn);
+    if (!session) {
+        WARN ("Failed to connect to pre-spawned sessiond for seat %s",
+                priv->id);
+        return;
+    }
+    g_queue_push_tail (priv->session_pool, session);
+    DBG ("seat %s: %u sessiond(s) in pool", priv->id,
+            g_queue_get_length (priv->session_pool));
+
+    _schedule_session_pool_refill (seat);
+}
+
+static gboolean
+_refill_session_pool (gpointer user_data)
+{
+    TlmSeat *seat = TLM_SEAT (user_data);
+    TlmSeatPrivate *priv = seat->priv;
+
+    priv->pool_refill_id = 0;
+    if (priv->pool_spawn || g_queue_get_length (priv->session_pool) >=
+            _get_session_pool_size (seat))
+        return G_SOURCE_REMOVE;
+
+    /* one sessiond at a time, connecting to it is left to the main loop */
+    priv->pool_spawn = g_cancellable_new ();
+    if (!tlm_session_remote_spawn_async (priv->config, priv->pool_spawn,
+                _on_pooled_session_spawned, seat)) {
+        WARN ("Failed to pre-spawn sessiond for seat %s", priv->id);
+        g_clear_object (&priv->pool_spawn);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_schedule_session_pool_refill (TlmSeat *seat)
+{
+    if (!seat->priv->pool_refill_id && !seat->priv->pool_spawn &&
+            _get_session_pool_size (seat) > 0)
+        seat->priv->pool_refill_id = g_idle_add_full (G_PRIORITY_LOW,
+                _refill_session_pool, seat, NULL);
+}
+
+static void
+_cancel_session_pool_refill (TlmSeat *seat)
+{
+    if (seat->priv->pool_refill_id) {
+        g_source_remove (seat->priv->pool_refill_id);
+        seat->priv->pool_refill_id = 0;
+    }
+    if (seat->priv->pool_spawn) {
+        g_cancellable_cancel (seat->priv->pool_spawn);
+        g_clear_object (&seat->priv->pool_spawn);
+    }
+}
+
+static TlmSessionRemote *
+_take_pooled_session (TlmSeat *seat)
+{
+    TlmSeatPrivate *priv = seat->priv;
+    TlmSessionRemote *session = NULL;
+
+    if (_get_session_pool_size (seat) == 0) return NULL;
+
+    while ((session = g_queue_pop_head (priv->session_pool))) {
+        if (tlm_session_remote_is_alive (session)) break;
+        DBG ("dropping dead sessiond from pool");
+        g_object_unref (session);
+    }
+
+    if (session) {
+        priv->pool_hits++;
+        tlm_metrics_add (TLM_METRIC_SESSIOND_POOL_HITS, "seat", priv->id, 1);
+    } else {
+        priv->pool_misses++;
+        tlm_metrics_add (TLM_METRIC_SESSIOND_POOL_MISSES, "seat", priv->id,
+                1);
+    }
+    DBG ("seat %s: sessiond pool hits %u misses %u", priv->id,
+            priv->pool_hits, priv->pool_misses);
+
+    _schedule_session_pool_refill (seat);
+    return session;
+}
+
 static void
 tlm_seat_dispose (GObject *self)
 {
     TlmSeat *seat = TLM_SEAT(self);
 
     DBG("disposing seat: %s", seat->priv->id);
-
+    tlm_watchdog_mark ("seat dispose", seat->priv->id);
+
+    tlm_seat_cancel_switch_user (seat);
+    _discard_next_session (seat);
+    _cancel_session_pool_refill (seat);
+    if (seat->priv->session_pool) {
+        g_queue_free_full (seat->priv->session_pool, g_object_unref);
+        seat->priv->session_pool = NULL;
+    }
     g_clear_object (&seat->priv->dbus_observer);
     g_clear_object (&seat->priv->prev_dbus_observer);
 
-    _disconnect_session_signals (seat);
-    if (seat->priv->session)
-        g_clear_object (&seat->priv->session);
+    _close_active_session (seat);
+    g_clear_pointer (&seat->priv->seat_config, tlm_seat_config_unref);
     if (seat->priv->config) {
         g_object_unref (seat->priv->config);
         seat->priv->config = NULL;
@@ -308,6 +641,8 @@ tlm_seat_finalize (GObject *self)
 
     _reset_next (priv);
 
+    tlm_metrics_add (TLM_METRIC_SEATS, NULL, NULL, -1);
+
     G_OBJECT_CLASS (tlm_seat_parent_class)->finalize (self);
 }
 
@@ -465,7 +800,16 @@ tlm_seat_init (TlmSeat *seat)
     priv->id = priv->path = priv->default_user = NULL;
     priv->dbus_observer = priv->prev_dbus_observer = NULL;
     priv->default_active = FALSE;
+    priv->session_pool = g_queue_new ();
+    priv->pool_refill_id = 0;
+    priv->pool_spawn = NULL;
+    priv->pool_hits = priv->pool_misses = 0;
+    priv->next_session = NULL;
+    priv->next_spawn = NULL;
+    priv->next_authenticated = FALSE;
     seat->priv = priv;
+
+    tlm_metrics_add (TLM_METRIC_SEATS, NULL, NULL, 1);
 }
 
 const gchar *
@@ -485,23 +829,107 @@ tlm_seat_get_session_id (TlmSeat *seat)
     return tlm_session_remote_get_sessionid (seat->priv->session);
 }
 
-gboolean
-tlm_seat_switch_user (TlmSeat *seat,
-                      const gchar *service,
-                      const gchar *username,
-                      const gchar *password,
-                      GHashTable *environment)
+typedef struct _SwitchUserClosure
 {
-    g_return_val_if_fail (seat && TLM_IS_SEAT(seat), FALSE);
+    TlmSeat *seat; /* not owned, the request is cancelled on seat dispose */
+    gchar *service;
+    gchar *username;
+    gchar *password;
+    GHashTable *environment;
+    gint64 request_time;
+} SwitchUserClosure;
+
+static void
+_switch_user_closure_free (SwitchUserClosure *closure)
+{
+    g_free (closure->service);
+    g_free (closure->username);
+    g_free (closure->password);
+    if (closure->environment)
+        g_hash_table_unref (closure->environment);
+    g_slice_free (SwitchUserClosure, closure);
+}
+
+static const gchar *
+_get_pam_service (TlmSeat *seat, const gchar *username)
+{
+    TlmSeatConfig *seat_config = _get_seat_config (seat);
 
+    DBG ("PAM service not defined, looking up configuration");
+    return username ? seat_config->pam_service :
+        seat_config->default_pam_service;
+}
+
+static void
+_authenticate_next_session (TlmSeat *seat)
+{
     TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+    const gchar *service = priv->next_service;
+
+    if (!service)
+        service = _get_pam_service (seat, priv->next_user);
+
+    /* authenticate the incoming user while the current session is being
+     * torn down, the session is opened once the seat is free */
+    tlm_session_remote_setup (priv->next_session, priv->id, service,
+            priv->next_user);
+    tlm_session_remote_set_request_time (priv->next_session,
+            priv->next_request_time);
+    g_signal_connect_swapped (priv->next_session, "authenticated",
+            G_CALLBACK (_handle_next_session_authenticated), seat);
+    g_signal_connect_swapped (priv->next_session, "session-error",
+            G_CALLBACK (_handle_next_session_error), seat);
+    tlm_session_remote_authenticate (priv->next_session, priv->next_password,
+            priv->next_environment);
+}
 
-    // If username & its password is not authenticated, immediately return FALSE
-    // so that current session is not terminated.
-    if (!tlm_authenticate_user (priv->config, username, password)) {
-        WARN("fail to tlm_authenticate_user");
-        return FALSE;
+static void
+_on_next_session_spawned (TlmSessionRemote *session, gpointer user_data)
+{
+    TlmSeat *seat = TLM_SEAT (user_data);
+    TlmSeatPrivate *priv = seat->priv;
+
+    g_clear_object (&priv->next_spawn);
+    if (!session) {
+        WARN ("Failed to prepare next session, login after termination");
+        if (!priv->session)
+            _continue_switch_user (seat);
+        return;
     }
+    priv->next_session = session;
+    _authenticate_next_session (seat);
+}
+
+static void
+_prepare_next_session (TlmSeat *seat)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+
+    _discard_next_session (seat);
+
+    priv->next_session = _take_pooled_session (seat);
+    if (priv->next_session) {
+        _authenticate_next_session (seat);
+        return;
+    }
+
+    /* never connect to a new sessiond synchronously from the main loop */
+    priv->next_spawn = g_cancellable_new ();
+    if (!tlm_session_remote_spawn_async (priv->config, priv->next_spawn,
+                _on_next_session_spawned, seat)) {
+        WARN ("Failed to prepare next session, login after termination");
+        g_clear_object (&priv->next_spawn);
+    }
+}
+
+static gboolean
+_switch_user (TlmSeat *seat,
+              const gchar *service,
+              const gchar *username,
+              const gchar *password,
+              GHashTable *environment)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
 
     if (!priv->session) {
         return tlm_seat_create_session (seat, service, username, password,
@@ -512,45 +940,102 @@ tlm_seat_switch_user (TlmSeat *seat,
     priv->next_service = g_strdup (service);
     priv->next_user = g_strdup (username);
     priv->next_password = g_strdup (password);
-    priv->next_environment = g_hash_table_ref (environment);
+    if (environment)
+        priv->next_environment = g_hash_table_ref (environment);
+    priv->next_request_time = _take_request_time (priv);
 
-    return tlm_seat_terminate_session (seat);
+    if (!tlm_seat_terminate_session (seat))
+        return FALSE;
+    /* counted as a switch, not as a logout */
+    priv->logout_time = 0;
+
+    _prepare_next_session (seat);
+    return TRUE;
 }
 
-static gchar *
-_build_user_name (const gchar *template, const gchar *seat_id)
+static void
+_switch_user_authenticated (GError *error, gpointer user_data)
 {
-    int seat_num = 0;
-    const char *pptr;
-    gchar *out;
-    GString *str;
+    SwitchUserClosure *closure = (SwitchUserClosure *) user_data;
+    TlmSeat *seat = closure->seat;
 
-    if (strncmp (seat_id, "seat", 4) == 0)
-        seat_num = atoi (seat_id + 4);
-    else
-        WARN ("Unrecognized seat id format");
-    pptr = template;
-    str = g_string_sized_new (16);
-    while (*pptr != '\0') {
-        if (*pptr == '%') {
-            pptr++;
-            switch (*pptr) {
-                case 'S':
-                    g_string_append_printf (str, "%d", seat_num);
-                    break;
-                case 'I':
-                    g_string_append (str, seat_id);
-                    break;
-                default:
-                    ;
-            }
-        } else {
-            g_string_append_c (str, *pptr);
-        }
-        pptr++;
+    if (error && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        DBG ("switch user to '%s' cancelled", closure->username);
+        _switch_user_closure_free (closure);
+        return;
+    }
+
+    g_clear_object (&seat->priv->auth_cancellable);
+
+    // If username & its password is not authenticated, fail the request
+    // so that current session is not terminated.
+    if (error) {
+        WARN("fail to tlm_authenticate_user: %s", error->message);
+        g_signal_emit (seat, signals[SIG_SESSION_ERROR], 0,
+                TLM_ERROR_PAM_AUTH_FAILURE);
+    } else {
+        seat->priv->request_time = closure->request_time;
+        seat->priv->switch_time = closure->request_time;
+        if (!_switch_user (seat, closure->service, closure->username,
+                    closure->password, closure->environment))
+            WARN ("fail to switch user to '%s'", closure->username);
+    }
+
+    _switch_user_closure_free (closure);
+}
+
+gboolean
+tlm_seat_switch_user (TlmSeat *seat,
+                      const gchar *service,
+                      const gchar *username,
+                      const gchar *password,
+                      GHashTable *environment)
+{
+    g_return_val_if_fail (seat && TLM_IS_SEAT(seat), FALSE);
+
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+    SwitchUserClosure *closure = NULL;
+
+    /* password check runs in a worker thread, the switch continues once
+     * it has succeeded; a newer request supersedes a pending one */
+    tlm_seat_cancel_switch_user (seat);
+
+    closure = g_slice_new0 (SwitchUserClosure);
+    closure->seat = seat;
+    closure->service = g_strdup (service);
+    closure->username = g_strdup (username);
+    closure->password = g_strdup (password);
+    if (environment)
+        closure->environment = g_hash_table_ref (environment);
+    closure->request_time = _take_request_time (priv);
+
+    priv->auth_cancellable = g_cancellable_new ();
+    tlm_authenticate_user_async (priv->config, username, password,
+            priv->auth_cancellable, _switch_user_authenticated, closure);
+
+    return TRUE;
+}
+
+gboolean
+tlm_seat_has_pending_switch (TlmSeat *seat)
+{
+    g_return_val_if_fail (seat && TLM_IS_SEAT(seat), FALSE);
+
+    return seat->priv->next_user != NULL ||
+           seat->priv->next_session != NULL ||
+           seat->priv->next_spawn != NULL;
+}
+
+void
+tlm_seat_cancel_switch_user (TlmSeat *seat)
+{
+    g_return_if_fail (seat && TLM_IS_SEAT(seat));
+
+    if (seat->priv->auth_cancellable) {
+        DBG ("cancel pending switch user on seat %s", seat->priv->id);
+        g_cancellable_cancel (seat->priv->auth_cancellable);
+        g_clear_object (&seat->priv->auth_cancellable);
     }
-    out = g_string_free (str, FALSE);
-    return out;
 }
 
 static gboolean
@@ -565,6 +1050,7 @@ _delayed_session (gpointer user_data)
          delay_closure->seat->priv->id,
          delay_closure->service,
          delay_closure->username);
+    delay_closure->seat->priv->request_time = delay_closure->request_time;
     tlm_seat_create_session (delay_closure->seat,
                              delay_closure->service,
                              delay_closure->username,
@@ -589,19 +1075,27 @@ tlm_seat_create_session (TlmSeat *seat,
 {
     g_return_val_if_fail (seat && TLM_IS_SEAT(seat), FALSE);
     TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+    gint64 request_time = _take_request_time (priv);
 
+    TLM_TRACE1 (session__create__request, priv->id, NULL, -1, username);
     if (priv->session != NULL) {
         g_signal_emit (seat, signals[SIG_SESSION_ERROR],  0,
                 TLM_ERROR_SESSION_ALREADY_EXISTS);
         return FALSE;
     }
+    _discard_next_session (seat);
+    g_clear_pointer (&priv->seat_config, tlm_seat_config_unref);
 
-    if (g_get_monotonic_time () - priv->prev_time < 1000000) {
+    if (!_get_seat_config (seat)->throttle_relogin) {
+        priv->prev_count = 0;
+    } else if (g_get_monotonic_time () - priv->prev_time < 1000000) {
         DBG ("short time relogin");
         priv->prev_time = g_get_monotonic_time ();
         priv->prev_count++;
         if (priv->prev_count > 3) {
             WARN ("relogins spinning too fast, delay...");
+            tlm_metrics_add (TLM_METRIC_RELOGIN_THROTTLED, "seat", priv->id,
+                    1);
             DelayClosure *delay_closure = g_slice_new0 (DelayClosure);
             delay_closure->seat = g_object_ref (seat);
             delay_closure->service = g_strdup (service);
@@ -609,6 +1103,7 @@ tlm_seat_create_session (TlmSeat *seat,
             delay_closure->password = g_strdup (password);
             if (environment)
                 delay_closure->environment = g_hash_table_ref (environment);
+            delay_closure->request_time = request_time;
             g_timeout_add_seconds (10, _delayed_session, delay_closure);
             return TRUE;
         }
@@ -617,35 +1112,14 @@ tlm_seat_create_session (TlmSeat *seat,
         priv->prev_count = 1;
     }
 
-    if (!service) {
-        DBG ("PAM service not defined, looking up configuration");
-        service = tlm_config_get_string (priv->config,
-                                         priv->id,
-                                         username ? TLM_CONFIG_GENERAL_PAM_SERVICE : TLM_CONFIG_GENERAL_DEFAULT_PAM_SERVICE);
-        if (!service)
-            service = tlm_config_get_string (priv->config,
-                                             TLM_CONFIG_GENERAL,
-                                             username ? TLM_CONFIG_GENERAL_PAM_SERVICE : TLM_CONFIG_GENERAL_DEFAULT_PAM_SERVICE);
-        if (!service)
-            service = username ? "tlm-login" : "tlm-default-login";
-    }
+    if (!service)
+        service = _get_pam_service (seat, username);
     DBG ("using PAM service %s for seat %s", service, priv->id);
 
     if (!username) {
-        if (!priv->default_user) {
-            const gchar *name_tmpl =
-                    tlm_config_get_string_default (priv->config,
-                            priv->id,
-                            TLM_CONFIG_GENERAL_DEFAULT_USER,
-                            "guest");
-            if (!name_tmpl)
-                name_tmpl = tlm_config_get_string_default (priv->config,
-                        TLM_CONFIG_GENERAL,
-                        TLM_CONFIG_GENERAL_DEFAULT_USER,
-                        "guest");
-            if (name_tmpl)
-                priv->default_user = _build_user_name (name_tmpl, priv->id);
-        }
+        if (!priv->default_user)
+            priv->default_user = tlm_utils_build_user_name (
+                    _get_seat_config (seat)->default_user, priv->id);
         if (priv->default_user) {
             priv->default_active = TRUE;
             g_signal_emit (seat,
@@ -655,15 +1129,24 @@ tlm_seat_create_session (TlmSeat *seat,
         }
     }
 
-    priv->session = tlm_session_remote_new (priv->config,
-            priv->id,
-            service,
-            priv->default_active ? priv->default_user : username);
+    priv->session = _take_pooled_session (seat);
+    if (priv->session)
+        tlm_session_remote_setup (priv->session,
+                priv->id,
+                service,
+                priv->default_active ? priv->default_user : username);
+    else
+        priv->session = tlm_session_remote_new (priv->config,
+                priv->id,
+                service,
+                priv->default_active ? priv->default_user : username);
     if (!priv->session) {
         g_signal_emit (seat, signals[SIG_SESSION_ERROR], 0,
                 TLM_ERROR_SESSION_CREATION_FAILURE);
         return FALSE;
     }
+    tlm_session_remote_set_request_time (priv->session, request_time);
+    priv->login_time = request_time;
 
     /*It is needed to handle switch user case which completes after new session
      *is created */
@@ -678,10 +1161,20 @@ tlm_seat_create_session (TlmSeat *seat,
     }
 
     _connect_session_signals (seat);
+    TLM_TRACE1 (session__create, priv->id, NULL, -1,
+            priv->default_active ? priv->default_user : username);
     tlm_session_remote_create (priv->session, password, environment);
     return TRUE;
 }
 
+void
+tlm_seat_set_request_time (TlmSeat *seat, gint64 request_time)
+{
+    g_return_if_fail (seat && TLM_IS_SEAT(seat));
+
+    seat->priv->request_time = request_time;
+}
+
 gboolean
 tlm_seat_terminate_session (TlmSeat *seat)
 {
@@ -703,6 +1196,8 @@ tlm_seat_terminate_session (TlmSeat *seat)
                 TLM_ERROR_SESSION_NOT_VALID);
         return FALSE;
     }
+    if (!seat->priv->logout_time)
+        seat->priv->logout_time = g_get_monotonic_time ();
 
     return TRUE;
 }
@@ -736,6 +1231,34 @@ tlm_seat_new (TlmConfig *config,
                          "id", id,
                          "path", path,
                          NULL);
+    _schedule_session_pool_refill (seat);
     return seat;
 }
 
+void
+tlm_seat_set_config (TlmSeat *seat, TlmConfig *config)
+{
+    g_return_if_fail (seat && TLM_IS_SEAT (seat));
+    g_return_if_fail (config && TLM_IS_CONFIG (config));
+    TlmSeatPrivate *priv = seat->priv;
+
+    if (priv->config == config) return;
+
+    /* the running session keeps the configuration it was started with, the
+     * new one is used from the next login on */
+    g_object_ref (config);
+    g_clear_object (&priv->config);
+    priv->config = config;
+    g_clear_pointer (&priv->seat_config, tlm_seat_config_unref);
+    if (!priv->default_active)
+        g_clear_string (&priv->default_user);
+
+    /* pooled sessiond instances were started with the old configuration */
+    _cancel_session_pool_refill (seat);
+    while (!g_queue_is_empty (priv->session_pool))
+        g_object_unref (g_queue_pop_head (priv->session_pool));
+    _schedule_session_pool_refill (seat);
+
+    DBG ("seat %s: configuration replaced", priv->id);
+}
+
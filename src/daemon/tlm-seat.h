@@ -77,6 +77,12 @@ tlm_seat_switch_user (TlmSeat *seat,
                       const gchar *password,
                       GHashTable *environment);
 
+gboolean
+tlm_seat_has_pending_switch (TlmSeat *seat);
+
+void
+tlm_seat_cancel_switch_user (TlmSeat *seat);
+
 gboolean
 tlm_seat_create_session (TlmSeat *seat,
                          const gchar *service, 
@@ -84,12 +90,18 @@ tlm_seat_create_session (TlmSeat *seat,
                          const gchar *password,
                          GHashTable *environment);
 
+void
+tlm_seat_set_request_time (TlmSeat *seat, gint64 request_time);
+
 gboolean
 tlm_seat_terminate_session (TlmSeat *seat);
 
 gboolean
 tlm_seat_get_session_info (TlmSeat *seat, const gchar *sessionid);
 
+void
+tlm_seat_set_config (TlmSeat *seat, TlmConfig *config);
+
 G_END_DECLS
 
 #endif /* _TLM_SEAT_H */
@@ -27,16 +27,23 @@
 
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include "common/tlm-log.h"
 #include "common/tlm-error.h"
 #include "common/tlm-config.h"
 #include "common/tlm-config-general.h"
+#include "common/tlm-config-image.h"
+#include "common/tlm-login-timeline.h"
 #include "common/tlm-pipe-stream.h"
+#include "common/tlm-process-watch.h"
+#include "common/tlm-trace.h"
 #include "common/dbus/tlm-dbus.h"
 #include "common/dbus/tlm-dbus-utils.h"
 #include "common/dbus/tlm-dbus-session-gen.h"
 #include "tlm-session-remote.h"
+#include "tlm-metrics.h"
+#include "tlm-watchdog.h"
 
 #define TLM_SESSIOND_NAME "tlm-sessiond"
 
@@ -53,16 +60,29 @@ enum
 
 static GParamSpec *properties[N_PROPERTIES];
 
+/* Running sessiond process. Termination is driven from the main loop: the
+ * child is signalled with SIGHUP, SIGTERM and SIGKILL in turn until the
+ * child watch reaps it. If the remote object is disposed first the child is
+ * detached and finishes terminating on its own. */
+typedef struct _TlmSessiondChild
+{
+    TlmSessionRemote *session; /* not owned, NULL when detached */
+    GPid pid;
+    TlmProcessWatch *watch;
+    int last_sig;
+    guint timer_id;
+    guint timeout;
+} TlmSessiondChild;
+
+static guint detached_children = 0;
+static GMainLoop *drain_loop = NULL;
+
 struct _TlmSessionRemotePrivate
 {
 	TlmConfig *config;
     GDBusConnection *connection;
     TlmDbusSession *dbus_session_proxy;
-    GPid cpid;
-    guint child_watch_id;
-    gboolean is_sessiond_up;
-    int last_sig;
-    guint timer_id;
+    TlmSessiondChild *child;
     gboolean can_emit_signal;
 
     /* Signals */
@@ -70,8 +90,10 @@ struct _TlmSessionRemotePrivate
     gulong signal_session_terminated;
     gulong signal_authenticated;
     gulong signal_error;
+    gulong signal_login_timeline;
 
     gchar *sessionid;
+    TlmLoginTimeline timeline;
 };
 
 G_DEFINE_TYPE (TlmSessionRemote, tlm_session_remote, G_TYPE_OBJECT);
@@ -90,25 +112,47 @@ enum {
 
 static guint signals[SIG_MAX];
 
+static void
+_free_sessiond_child (TlmSessiondChild *child)
+{
+    if (child->timer_id) {
+        g_source_remove (child->timer_id);
+        child->timer_id = 0;
+    }
+    tlm_process_watch_free (child->watch);
+    g_slice_free (TlmSessiondChild, child);
+}
+
+static void
+_release_detached_child (TlmSessiondChild *child)
+{
+    _free_sessiond_child (child);
+    if (--detached_children == 0 && drain_loop) {
+        g_main_loop_quit (drain_loop);
+        g_main_loop_unref (drain_loop);
+        drain_loop = NULL;
+    }
+}
+
 static void
 _on_child_down_cb (
         GPid  pid,
         gint  status,
         gpointer data)
 {
-    g_spawn_close_pid (pid);
-
-    TlmSessionRemote *session = TLM_SESSION_REMOTE (data);
+    TlmSessiondChild *child = (TlmSessiondChild *) data;
+    TlmSessionRemote *session = child->session;
 
     DBG ("sessiond(%p) with pid (%d) closed with status %d", session, pid,
             status);
 
-    session->priv->is_sessiond_up = FALSE;
-    session->priv->child_watch_id = 0;
-    if (session->priv->timer_id) {
-        g_source_remove (session->priv->timer_id);
-        session->priv->timer_id = 0;
+    if (!session) {
+        _release_detached_child (child);
+        return;
     }
+    _free_sessiond_child (child);
+
+    session->priv->child = NULL;
     if (session->priv->can_emit_signal)
         g_signal_emit (session, signals[SIG_SESSION_TERMINATED], 0,
                 session->priv->sessionid);
@@ -172,33 +216,48 @@ tlm_session_remote_get_property (
 static gboolean
 _terminate_timeout (gpointer user_data)
 {
-    TlmSessionRemote *self = TLM_SESSION_REMOTE(user_data);
-    TlmSessionRemotePrivate *priv = TLM_SESSION_REMOTE_PRIV(self);
+    TlmSessiondChild *child = (TlmSessiondChild *) user_data;
+    TlmSessionRemote *self = child->session;
 
-    switch (priv->last_sig)
+    switch (child->last_sig)
     {
         case SIGHUP:
             DBG ("child %u didn't respond to SIGHUP, sending SIGTERM",
-                 priv->cpid);
-            if (kill (priv->cpid, SIGTERM))
+                 child->pid);
+            if (!tlm_process_watch_signal (child->watch, SIGTERM))
                 WARN ("kill(%u, SIGTERM): %s",
-                      priv->cpid,
+                      child->pid,
                       strerror(errno));
-            priv->last_sig = SIGTERM;
+            child->last_sig = SIGTERM;
+            TLM_TRACE2 (sessiond__signal, NULL,
+                    self ? self->priv->sessionid : NULL, -1, child->pid,
+                    SIGTERM);
+            tlm_metrics_add (TLM_METRIC_TERMINATE_ESCALATIONS, "signal",
+                    "SIGTERM", 1);
             return G_SOURCE_CONTINUE;
         case SIGTERM:
             DBG ("child %u didn't respond to SIGTERM, sending SIGKILL",
-                 priv->cpid);
-            if (kill (priv->cpid, SIGKILL))
+                 child->pid);
+            if (!tlm_process_watch_signal (child->watch, SIGKILL))
                 WARN ("kill(%u, SIGKILL): %s",
-                      priv->cpid,
+                      child->pid,
                       strerror(errno));
-            priv->last_sig = SIGKILL;
+            child->last_sig = SIGKILL;
+            TLM_TRACE2 (sessiond__signal, NULL,
+                    self ? self->priv->sessionid : NULL, -1, child->pid,
+                    SIGKILL);
+            tlm_metrics_add (TLM_METRIC_TERMINATE_ESCALATIONS, "signal",
+                    "SIGKILL", 1);
             return G_SOURCE_CONTINUE;
         case SIGKILL:
             DBG ("child %u didn't respond to SIGKILL, "
-                    "process is stuck in kernel",  priv->cpid);
-            priv->timer_id = 0;
+                    "process is stuck in kernel",  child->pid);
+            child->timer_id = 0;
+            if (!self) {
+                /* nobody is interested in this one anymore */
+                _release_detached_child (child);
+                return G_SOURCE_REMOVE;
+            }
             if (self->priv->can_emit_signal) {
                 GError *error = TLM_GET_ERROR_FOR_ID (
                         TLM_ERROR_SESSION_TERMINATION_FAILURE,
@@ -210,12 +269,32 @@ _terminate_timeout (gpointer user_data)
             return G_SOURCE_REMOVE;
         default:
             WARN ("%d has unknown signaling state %d",
-                  priv->cpid,
-                  priv->last_sig);
+                  child->pid,
+                  child->last_sig);
     }
+    child->timer_id = 0;
     return G_SOURCE_REMOVE;
 }
 
+static void
+_terminate_sessiond_child (TlmSessiondChild *child)
+{
+    if (child->last_sig) {
+        DBG ("sessiond %u is already terminating", child->pid);
+        return;
+    }
+
+    DBG ("Terminate child session process");
+    if (!tlm_process_watch_signal (child->watch, SIGHUP))
+        WARN ("kill(%u, SIGHUP): %s", child->pid, strerror(errno));
+    child->last_sig = SIGHUP;
+    TLM_TRACE2 (sessiond__signal, NULL,
+            child->session ? child->session->priv->sessionid : NULL, -1,
+            child->pid, SIGHUP);
+    child->timer_id = g_timeout_add_seconds (child->timeout,
+            _terminate_timeout, child);
+}
+
 static void
 tlm_session_remote_dispose (GObject *object)
 {
@@ -223,24 +302,14 @@ tlm_session_remote_dispose (GObject *object)
     self->priv->can_emit_signal = FALSE;
 
     DBG("self %p", self);
-    if (self->priv->is_sessiond_up) {
-        tlm_session_remote_terminate (self);
-        while (self->priv->is_sessiond_up)
-            g_main_context_iteration(NULL, TRUE);
-        DBG ("Sessiond DESTROYED");
-    }
-
-    if (self->priv->timer_id) {
-        g_source_remove (self->priv->timer_id);
-        self->priv->timer_id = 0;
-    }
-
-    self->priv->cpid = 0;
-    self->priv->last_sig = 0;
-
-    if (self->priv->child_watch_id > 0) {
-        g_source_remove (self->priv->child_watch_id);
-        self->priv->child_watch_id = 0;
+    if (self->priv->child) {
+        /* do not wait for the child here, it is reaped from the main loop
+         * once it has gone down */
+        _terminate_sessiond_child (self->priv->child);
+        self->priv->child->session = NULL;
+        self->priv->child = NULL;
+        detached_children++;
+        DBG ("Sessiond detached");
     }
 
     g_clear_object (&self->priv->config);
@@ -254,6 +323,8 @@ tlm_session_remote_dispose (GObject *object)
                 self->priv->signal_error);
         g_signal_handler_disconnect (self->priv->dbus_session_proxy,
                 self->priv->signal_authenticated);
+        g_signal_handler_disconnect (self->priv->dbus_session_proxy,
+                self->priv->signal_login_timeline);
         g_object_unref (self->priv->dbus_session_proxy);
         self->priv->dbus_session_proxy = NULL;
     }
@@ -362,11 +433,7 @@ tlm_session_remote_init (TlmSessionRemote *self)
 
     self->priv->connection = NULL;
     self->priv->dbus_session_proxy = NULL;
-    self->priv->cpid = 0;
-    self->priv->child_watch_id = 0;
-    self->priv->is_sessiond_up = FALSE;
-    self->priv->last_sig = 0;
-    self->priv->timer_id = 0;
+    self->priv->child = NULL;
     self->priv->sessionid = 0;
 }
 
@@ -407,6 +474,69 @@ tlm_session_remote_create (
     g_free (pass);
 }
 
+static void
+_session_authenticate_async_cb (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GError *error = NULL;
+    TlmDbusSession *proxy = TLM_DBUS_SESSION (object);
+    TlmSessionRemote *self = TLM_SESSION_REMOTE (user_data);
+
+    tlm_dbus_session_call_session_authenticate_finish (proxy, res, &error);
+    if (error) {
+        WARN("session authentication request failed");
+        g_signal_emit (self, signals[SIG_SESSION_ERROR],  0, error);
+        g_error_free (error);
+    }
+}
+
+void
+tlm_session_remote_authenticate (
+    TlmSessionRemote *session,
+    const gchar *password,
+    GHashTable *environment)
+{
+    GVariant *data = NULL;
+    gchar *pass = g_strdup (password);
+    if (environment) data = tlm_dbus_utils_hash_table_to_variant (environment);
+    if (!data) data = g_variant_new ("a{ss}", NULL);
+
+    if (!pass) pass = g_strdup ("");
+    tlm_dbus_session_call_session_authenticate (
+            session->priv->dbus_session_proxy, pass, data, NULL,
+            _session_authenticate_async_cb, session);
+    g_free (pass);
+}
+
+static void
+_session_open_async_cb (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GError *error = NULL;
+    TlmDbusSession *proxy = TLM_DBUS_SESSION (object);
+    TlmSessionRemote *self = TLM_SESSION_REMOTE (user_data);
+
+    tlm_dbus_session_call_session_open_finish (proxy, res, &error);
+    if (error) {
+        WARN("session open request failed");
+        g_signal_emit (self, signals[SIG_SESSION_ERROR],  0, error);
+        g_error_free (error);
+    }
+}
+
+void
+tlm_session_remote_open (
+    TlmSessionRemote *session)
+{
+    tlm_dbus_session_call_session_open (
+            session->priv->dbus_session_proxy, NULL,
+            _session_open_async_cb, session);
+}
+
 /* signals */
 static void
 _on_session_created_cb (
@@ -456,19 +586,53 @@ _on_error_cb (
     g_error_free (gerror);
 }
 
-TlmSessionRemote *
-tlm_session_remote_new (
+static void
+_on_login_timeline_cb (
+        TlmSessionRemote *self,
+        GVariant *timeline,
+        gpointer user_data)
+{
+    gchar *seat_id = NULL, *username = NULL, *breakdown;
+
+    g_return_if_fail (self && TLM_IS_SESSION_REMOTE (self));
+
+    tlm_login_timeline_merge_variant (&self->priv->timeline, timeline);
+
+    g_object_get (G_OBJECT (self), "seatid", &seat_id, "username", &username,
+            NULL);
+    breakdown = tlm_login_timeline_to_string (&self->priv->timeline);
+    NOTICE ("login of '%s' on %s: %s", username ? username : "",
+            seat_id ? seat_id : "", breakdown);
+    g_free (breakdown);
+    g_free (username);
+    g_free (seat_id);
+}
+
+static void
+_sessiond_child_setup (gpointer user_data)
+{
+    gint config_fd = GPOINTER_TO_INT (user_data);
+
+    /* the only descriptor kept besides the stdio pipes */
+    if (config_fd >= 0)
+        fcntl (config_fd, F_SETFD, 0);
+}
+
+/* starts sessiond and returns the remote object owning it, the pipe stream
+ * to talk to it is returned in stream */
+static TlmSessionRemote *
+_spawn_sessiond (
         TlmConfig *config,
-        const gchar *seat_id,
-        const gchar *service,
-        const gchar *username)
+        TlmPipeStream **stream)
 {
     GError *error = NULL;
     GPid cpid = 0;
     gchar **argv;
+    gchar **envp = NULL;
+    gint config_fd;
     gint cin_fd, cout_fd;
     TlmSessionRemote *session = NULL;
-    TlmPipeStream *stream = NULL;
+    TlmSessiondChild *child = NULL;
     gboolean ret = FALSE;
     const gchar *bin_path = TLM_BIN_DIR;
 
@@ -483,19 +647,37 @@ tlm_session_remote_new (
         return NULL;
     }
 
+    tlm_watchdog_mark ("sessiond spawn", NULL);
+
     /* This guarantees that writes to a pipe will never cause
      * a process termination via SIGPIPE, and instead a proper
      * error will be returned */
     signal(SIGPIPE, SIG_IGN);
 
+    /* sessiond maps our configuration instead of parsing the file again */
+    envp = g_get_environ ();
+    config_fd = tlm_config_get_image_fd (config);
+    if (config_fd >= 0) {
+        gchar *fd_str = g_strdup_printf ("%d", config_fd);
+        envp = g_environ_setenv (envp, TLM_CONFIG_IMAGE_FD_ENV, fd_str, TRUE);
+        g_free (fd_str);
+    } else {
+        envp = g_environ_unsetenv (envp, TLM_CONFIG_IMAGE_FD_ENV);
+    }
+    /* follow debug logging switched at runtime */
+    envp = g_environ_setenv (envp, "TLM_DEBUG",
+                             tlm_log_get_debug () ? "1" : "0", TRUE);
+
     /* Spawn child process */
     argv = g_new0 (gchar *, 1 + 1);
     argv[0] = g_build_filename (bin_path, TLM_SESSIOND_NAME, NULL);
-    ret = g_spawn_async_with_pipes (NULL, argv, NULL,
-            G_SPAWN_DO_NOT_REAP_CHILD, NULL,
-            NULL, &cpid, &cin_fd, &cout_fd, NULL, &error);
+    ret = g_spawn_async_with_pipes (NULL, argv, envp,
+            G_SPAWN_DO_NOT_REAP_CHILD, _sessiond_child_setup,
+            GINT_TO_POINTER (config_fd), &cpid, &cin_fd, &cout_fd, NULL,
+            &error);
     g_strfreev (argv);
-    if (ret == FALSE || (kill(cpid, 0) != 0)) {
+    g_strfreev (envp);
+    if (ret == FALSE) {
         DBG ("failed to start sessiond: error %s(%d)",
             error ? error->message : "(null)", ret);
         if (error) g_error_free (error);
@@ -505,14 +687,67 @@ tlm_session_remote_new (
     /* Create dbus session object */
     session = TLM_SESSION_REMOTE (g_object_new (TLM_TYPE_SESSION_REMOTE,
             "config", config, NULL));
+    tlm_login_timeline_mark (&session->priv->timeline,
+            TLM_LOGIN_PHASE_SESSIOND_SPAWNED);
+
+    child = g_slice_new0 (TlmSessiondChild);
+    child->session = session;
+    child->pid = cpid;
+    TLM_TRACE1 (sessiond__spawn, NULL, NULL, -1, cpid);
+    child->timeout = tlm_config_get_uint (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT, 3);
+    child->watch = tlm_process_watch_new (cpid, _on_child_down_cb, child);
+    session->priv->child = child;
+
+    *stream = tlm_pipe_stream_new (cout_fd, cin_fd, TRUE);
+    return session;
+}
+
+static void
+_sessiond_connected (
+        TlmSessionRemote *session,
+        gint64 start_time)
+{
+    DBG("'%s' object exported(%p)", TLM_SESSION_OBJECTPATH, session);
+    tlm_login_timeline_mark (&session->priv->timeline,
+            TLM_LOGIN_PHASE_SESSIOND_CONNECTED);
+    tlm_metrics_observe (TLM_METRIC_SESSIOND_SPAWN, NULL, NULL,
+            session->priv->timeline.stamps[TLM_LOGIN_PHASE_SESSIOND_CONNECTED]
+            - start_time);
+
+    session->priv->signal_session_created = g_signal_connect_swapped (
+            session->priv->dbus_session_proxy, "session-created",
+            G_CALLBACK (_on_session_created_cb), session);
+    session->priv->signal_session_terminated = g_signal_connect_swapped (
+            session->priv->dbus_session_proxy, "session-terminated",
+            G_CALLBACK(_on_session_terminated_cb), session);
+    session->priv->signal_authenticated = g_signal_connect_swapped (
+            session->priv->dbus_session_proxy, "authenticated",
+            G_CALLBACK(_on_authenticated_cb), session);
+    session->priv->signal_error = g_signal_connect_swapped (
+            session->priv->dbus_session_proxy, "error",
+            G_CALLBACK(_on_error_cb), session);
+    session->priv->signal_login_timeline = g_signal_connect_swapped (
+            session->priv->dbus_session_proxy, "login-timeline",
+            G_CALLBACK(_on_login_timeline_cb), session);
+
+    session->priv->can_emit_signal = TRUE;
+}
+
+TlmSessionRemote *
+tlm_session_remote_spawn (
+        TlmConfig *config)
+{
+    GError *error = NULL;
+    TlmSessionRemote *session = NULL;
+    TlmPipeStream *stream = NULL;
+    gint64 start_time = g_get_monotonic_time ();
 
-    session->priv->child_watch_id = g_child_watch_add (cpid,
-            (GChildWatchFunc)_on_child_down_cb, session);
-    session->priv->cpid = cpid;
-    session->priv->is_sessiond_up = TRUE;
+    session = _spawn_sessiond (config, &stream);
+    if (!session)
+        return NULL;
 
     /* Create dbus connection */
-    stream = tlm_pipe_stream_new (cout_fd, cin_fd, TRUE);
     session->priv->connection = g_dbus_connection_new_sync (
             G_IO_STREAM (stream), NULL, G_DBUS_CONNECTION_FLAGS_NONE, NULL,
             NULL, NULL);
@@ -533,28 +768,194 @@ tlm_session_remote_new (
         g_object_unref (session);
         return NULL;
     }
-    DBG("'%s' object exported(%p)", TLM_SESSION_OBJECTPATH, session);
+    _sessiond_connected (session, start_time);
+    return session;
+}
 
-    session->priv->signal_session_created = g_signal_connect_swapped (
-            session->priv->dbus_session_proxy, "session-created",
-            G_CALLBACK (_on_session_created_cb), session);
-    session->priv->signal_session_terminated = g_signal_connect_swapped (
-            session->priv->dbus_session_proxy, "session-terminated",
-            G_CALLBACK(_on_session_terminated_cb), session);
-    session->priv->signal_authenticated = g_signal_connect_swapped (
-            session->priv->dbus_session_proxy, "authenticated",
-            G_CALLBACK(_on_authenticated_cb), session);
-    session->priv->signal_error = g_signal_connect_swapped (
-            session->priv->dbus_session_proxy, "error",
-            G_CALLBACK(_on_error_cb), session);
+/* state of a sessiond being connected to from the main loop */
+typedef struct {
+    TlmSessionRemote *session;
+    GCancellable *cancellable;
+    TlmSessionRemoteSpawnCb callback;
+    gpointer user_data;
+    gint64 start_time;
+} TlmSessiondSpawn;
+
+static void
+_finish_spawn (
+        TlmSessiondSpawn *spawn,
+        GError *error)
+{
+    if (g_cancellable_is_cancelled (spawn->cancellable)) {
+        /* the caller is gone, do not report back */
+        g_object_unref (spawn->session);
+    } else if (error) {
+        DBG ("Failed to connect to sessiond: %s", error->message);
+        g_object_unref (spawn->session);
+        spawn->callback (NULL, spawn->user_data);
+    } else {
+        _sessiond_connected (spawn->session, spawn->start_time);
+        spawn->callback (spawn->session, spawn->user_data);
+    }
+    if (error)
+        g_error_free (error);
+    g_object_unref (spawn->cancellable);
+    g_slice_free (TlmSessiondSpawn, spawn);
+}
+
+static void
+_on_session_proxy_ready (
+        GObject *source,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    TlmSessiondSpawn *spawn = (TlmSessiondSpawn *) user_data;
+    TlmDbusSession *proxy = NULL;
+    GError *error = NULL;
+
+    proxy = tlm_dbus_session_proxy_new_finish (res, &error);
+    /* dispose expects the signals of a set proxy to be connected */
+    if (proxy && g_cancellable_is_cancelled (spawn->cancellable))
+        g_object_unref (proxy);
+    else
+        spawn->session->priv->dbus_session_proxy = proxy;
+    _finish_spawn (spawn, error);
+}
+
+static void
+_on_sessiond_connection_ready (
+        GObject *source,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    TlmSessiondSpawn *spawn = (TlmSessiondSpawn *) user_data;
+    GError *error = NULL;
+
+    spawn->session->priv->connection = g_dbus_connection_new_finish (res,
+            &error);
+    if (error || g_cancellable_is_cancelled (spawn->cancellable)) {
+        _finish_spawn (spawn, error);
+        return;
+    }
+
+    tlm_dbus_session_proxy_new (
+            spawn->session->priv->connection,
+            G_DBUS_PROXY_FLAGS_NONE,
+            NULL,
+            TLM_SESSION_OBJECTPATH,
+            spawn->cancellable,
+            _on_session_proxy_ready,
+            spawn);
+}
+
+/* Starts sessiond like tlm_session_remote_spawn() but connects to it from
+ * the main loop. Returns FALSE if sessiond could not be started, otherwise
+ * callback gets the connected session, or NULL, unless cancellable has been
+ * cancelled by then. */
+gboolean
+tlm_session_remote_spawn_async (
+        TlmConfig *config,
+        GCancellable *cancellable,
+        TlmSessionRemoteSpawnCb callback,
+        gpointer user_data)
+{
+    TlmSessiondSpawn *spawn = NULL;
+    TlmPipeStream *stream = NULL;
+    gint64 start_time = g_get_monotonic_time ();
+
+    g_return_val_if_fail (cancellable && callback, FALSE);
+
+    spawn = g_slice_new0 (TlmSessiondSpawn);
+    spawn->session = _spawn_sessiond (config, &stream);
+    if (!spawn->session) {
+        g_slice_free (TlmSessiondSpawn, spawn);
+        return FALSE;
+    }
+    spawn->cancellable = g_object_ref (cancellable);
+    spawn->callback = callback;
+    spawn->user_data = user_data;
+    spawn->start_time = start_time;
+
+    g_dbus_connection_new (G_IO_STREAM (stream), NULL,
+            G_DBUS_CONNECTION_FLAGS_NONE, NULL, cancellable,
+            _on_sessiond_connection_ready, spawn);
+    g_object_unref (stream);
+    return TRUE;
+}
+
+void
+tlm_session_remote_setup (
+        TlmSessionRemote *session,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username)
+{
+    g_return_if_fail (session && TLM_IS_SESSION_REMOTE (session));
 
     g_object_set (G_OBJECT (session), "seatid", seat_id, "service", service,
             "username", username, NULL);
+}
 
-    session->priv->can_emit_signal = TRUE;
+void
+tlm_session_remote_set_request_time (
+        TlmSessionRemote *session,
+        gint64 request_time)
+{
+    g_return_if_fail (session && TLM_IS_SESSION_REMOTE (session));
+
+    session->priv->timeline.stamps[TLM_LOGIN_PHASE_QUEUED] = request_time;
+}
+
+gboolean
+tlm_session_remote_is_alive (
+        TlmSessionRemote *session)
+{
+    g_return_val_if_fail (session && TLM_IS_SESSION_REMOTE (session), FALSE);
+
+    return session->priv->child != NULL &&
+           session->priv->child->last_sig == 0 &&
+           session->priv->dbus_session_proxy != NULL;
+}
+
+gboolean
+tlm_session_remote_is_terminating (
+        TlmSessionRemote *session)
+{
+    g_return_val_if_fail (session && TLM_IS_SESSION_REMOTE (session), FALSE);
+
+    return session->priv->child != NULL &&
+           session->priv->child->last_sig != 0;
+}
+
+TlmSessionRemote *
+tlm_session_remote_new (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username)
+{
+    TlmSessionRemote *session = tlm_session_remote_spawn (config);
+
+    if (session)
+        tlm_session_remote_setup (session, seat_id, service, username);
     return session;
 }
 
+gboolean
+tlm_session_remote_drain_detached (
+        GMainLoop *loop)
+{
+    g_return_val_if_fail (loop != NULL, FALSE);
+
+    if (detached_children == 0)
+        return FALSE;
+
+    DBG ("waiting for %u detached sessiond process(es)", detached_children);
+    if (drain_loop) g_main_loop_unref (drain_loop);
+    drain_loop = g_main_loop_ref (loop);
+    return TRUE;
+}
+
 gboolean
 tlm_session_remote_terminate (
         TlmSessionRemote *self)
@@ -562,22 +963,43 @@ tlm_session_remote_terminate (
     g_return_val_if_fail (self && TLM_IS_SESSION_REMOTE(self), FALSE);
     TlmSessionRemotePrivate *priv = TLM_SESSION_REMOTE_PRIV(self);
 
-    if (!priv->is_sessiond_up) {
+    if (!priv->child) {
         WARN ("sessiond is not running");
         return FALSE;
     }
 
-    DBG ("Terminate child session process");
-    if (kill (priv->cpid, SIGHUP) < 0)
-        WARN ("kill(%u, SIGHUP): %s", priv->cpid, strerror(errno));
-    priv->last_sig = SIGHUP;
-    priv->timer_id = g_timeout_add_seconds (
-            tlm_config_get_uint (priv->config, TLM_CONFIG_GENERAL,
-                    TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT, 3),
-            _terminate_timeout, self);
+    _terminate_sessiond_child (priv->child);
     return TRUE;
 }
 
+/* adds the phases stamped here to the ones reported by sessiond */
+static GVariant *
+_merge_timeline (
+        TlmSessionRemote *self,
+        GVariant *sessioninfo)
+{
+    TlmLoginTimeline timeline = self->priv->timeline;
+    GVariantBuilder builder;
+    GVariantIter iter;
+    const gchar *key;
+    GVariant *value;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_iter_init (&iter, sessioninfo);
+    while (g_variant_iter_next (&iter, "{&sv}", &key, &value)) {
+        if (g_strcmp0 (key, "timeline") == 0)
+            tlm_login_timeline_merge_variant (&timeline, value);
+        else
+            g_variant_builder_add (&builder, "{sv}", key, value);
+        g_variant_unref (value);
+    }
+    g_variant_builder_add (&builder, "{sv}", "timeline",
+            tlm_login_timeline_to_variant (&timeline));
+
+    g_variant_unref (sessioninfo);
+    return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
 static void
 _session_info_async_cb (
         GObject *object,
@@ -596,6 +1018,7 @@ _session_info_async_cb (
         g_signal_emit (self, signals[SIG_SESSION_ERROR],  0, error);
         g_error_free (error);
     } else {
+        sessioninfo = _merge_timeline (self, sessioninfo);
         g_signal_emit (self, signals[SIG_SESSION_INFO], 0,
                     sessioninfo);
     }
@@ -609,7 +1032,7 @@ tlm_session_remote_get_info (
     g_return_val_if_fail (self && TLM_IS_SESSION_REMOTE(self), FALSE);
     TlmSessionRemotePrivate *priv = TLM_SESSION_REMOTE_PRIV(self);
 
-    if (!priv->is_sessiond_up) {
+    if (!priv->child) {
         WARN ("sessiond is not running");
         return FALSE;
     }
@@ -27,6 +27,7 @@
 #define __TLM_SESSION_REMOTE_H_
 
 #include <glib.h>
+#include <gio/gio.h>
 #include "common/tlm-config.h"
 
 G_BEGIN_DECLS
@@ -72,12 +73,61 @@ tlm_session_remote_new (
         const gchar *service,
         const gchar *username);
 
+TlmSessionRemote *
+tlm_session_remote_spawn (
+        TlmConfig *config);
+
+typedef void (*TlmSessionRemoteSpawnCb) (
+        TlmSessionRemote *session,
+        gpointer user_data);
+
+gboolean
+tlm_session_remote_spawn_async (
+        TlmConfig *config,
+        GCancellable *cancellable,
+        TlmSessionRemoteSpawnCb callback,
+        gpointer user_data);
+
+void
+tlm_session_remote_setup (
+        TlmSessionRemote *session,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username);
+
+void
+tlm_session_remote_set_request_time (
+        TlmSessionRemote *session,
+        gint64 request_time);
+
+gboolean
+tlm_session_remote_is_alive (
+        TlmSessionRemote *session);
+
+gboolean
+tlm_session_remote_is_terminating (
+        TlmSessionRemote *session);
+
 void
 tlm_session_remote_create (
     TlmSessionRemote *session,
     const gchar *password,
     GHashTable *environment);
 
+void
+tlm_session_remote_authenticate (
+    TlmSessionRemote *session,
+    const gchar *password,
+    GHashTable *environment);
+
+void
+tlm_session_remote_open (
+    TlmSessionRemote *session);
+
+gboolean
+tlm_session_remote_drain_detached (
+        GMainLoop *loop);
+
 gboolean
 tlm_session_remote_terminate (
         TlmSessionRemote *session);
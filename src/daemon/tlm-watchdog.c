@@ -0,0 +1,262 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+/* Detects main loop dispatches that take longer than a threshold. The poll
+ * function of the main context is wrapped so that the time between poll
+ * returning and the next poll is known; a watchdog thread warns while a
+ * dispatch is still running past the threshold, and the main loop reports
+ * its total duration when it gets back to poll. The thread sleeps until the
+ * deadline of the running dispatch, and without a timeout while the main
+ * loop polls or once the dispatch has been reported. Code known to block
+ * marks itself with tlm_watchdog_mark() so that the report names it and its
+ * seat; dispatches nobody marked are reported as unknown.
+ *
+ * Nested iterations of the watched context end the measurement of the
+ * dispatch they run in. */
+
+#include <string.h>
+
+#include "tlm-watchdog.h"
+#include "tlm-metrics.h"
+#include "common/tlm-log.h"
+
+#define TLM_WATCHDOG_NAME_SIZE 64
+
+static GMainContext *_context = NULL;
+static GPollFunc _poll_func = NULL;     /* the wrapped poll function */
+static GThread *_thread = NULL;
+static gint _running = 0;
+
+/* shared with the watchdog thread */
+static GMutex _lock;
+static GCond _cond;
+static gboolean _stopping = FALSE;
+static gint64 _threshold = 0;           /* usec */
+static gint64 _dispatch_start = 0;      /* 0 while polling */
+static gboolean _reported = FALSE;
+static gboolean _waiting = FALSE;       /* thread waits for a dispatch */
+static const gchar *_what = NULL;
+static gchar _source[TLM_WATCHDOG_NAME_SIZE];
+static gchar _seat[TLM_WATCHDOG_NAME_SIZE];
+
+/* called with _lock held */
+static const gchar *
+_get_callback (void)
+{
+    if (_what)
+        return _what;
+    return _source[0] ? _source : "unknown";
+}
+
+/* called with _lock held, returns a newly allocated description */
+static gchar *
+_describe (void)
+{
+    return g_strdup_printf ("%s%s%s", _get_callback (),
+            _seat[0] ? " on " : "", _seat);
+}
+
+static gpointer
+_watchdog_thread (gpointer data)
+{
+    gint64 now, elapsed;
+    gchar *where;
+
+    g_mutex_lock (&_lock);
+    while (!_stopping) {
+        if (!_dispatch_start || _reported) {
+            /* armed again by the next dispatch */
+            _waiting = TRUE;
+            g_cond_wait (&_cond, &_lock);
+            _waiting = FALSE;
+            continue;
+        }
+        now = g_get_monotonic_time ();
+        elapsed = now - _dispatch_start;
+        if (elapsed < _threshold) {
+            g_cond_wait_until (&_cond, &_lock, _dispatch_start + _threshold);
+            continue;
+        }
+        _reported = TRUE;
+        where = _describe ();
+        g_mutex_unlock (&_lock);
+        WARN ("main loop blocked for %" G_GINT64_FORMAT " ms so far in %s",
+              elapsed / 1000, where);
+        g_free (where);
+        g_mutex_lock (&_lock);
+    }
+    g_mutex_unlock (&_lock);
+
+    return NULL;
+}
+
+static gint
+_watchdog_poll (
+        GPollFD *ufds,
+        guint nfds,
+        gint timeout)
+{
+    gint64 now = g_get_monotonic_time ();
+    gint64 elapsed = 0;
+    gchar *where = NULL;
+    gchar *callback = NULL;
+    gint ret;
+
+    g_mutex_lock (&_lock);
+    if (_dispatch_start && now - _dispatch_start >= _threshold) {
+        elapsed = now - _dispatch_start;
+        where = _describe ();
+        callback = g_strdup (_get_callback ());
+    }
+    _dispatch_start = 0;
+    _reported = FALSE;
+    _what = NULL;
+    _source[0] = _seat[0] = '\0';
+    g_mutex_unlock (&_lock);
+
+    if (where) {
+        WARN ("main loop stalled for %" G_GINT64_FORMAT " ms in %s",
+              elapsed / 1000, where);
+        tlm_metrics_add (TLM_METRIC_MAINLOOP_STALLS, "callback", callback, 1);
+        tlm_metrics_observe (TLM_METRIC_MAINLOOP_STALL, NULL, NULL, elapsed);
+        g_free (where);
+        g_free (callback);
+    }
+
+    ret = _poll_func (ufds, nfds, timeout);
+
+    g_mutex_lock (&_lock);
+    _dispatch_start = g_get_monotonic_time ();
+    if (_waiting)
+        g_cond_signal (&_cond);
+    g_mutex_unlock (&_lock);
+
+    return ret;
+}
+
+/**
+ * tlm_watchdog_start:
+ * @context: (allow-none): the main context to watch, %NULL for the default
+ * @threshold_ms: dispatch duration reported as a stall, 0 to stop watching
+ *
+ * Starts watching the dispatches of @context, or changes the threshold when
+ * already started. Must be called from the thread running @context.
+ */
+void
+tlm_watchdog_start (
+        GMainContext *context,
+        guint threshold_ms)
+{
+    GError *error = NULL;
+
+    if (!threshold_ms) {
+        tlm_watchdog_stop ();
+        return;
+    }
+
+    g_mutex_lock (&_lock);
+    _threshold = (gint64) threshold_ms * 1000;
+    g_cond_signal (&_cond);
+    g_mutex_unlock (&_lock);
+
+    if (_thread)
+        return;
+
+    _stopping = FALSE;
+    _thread = g_thread_try_new ("tlm-watchdog", _watchdog_thread, NULL,
+            &error);
+    if (!_thread) {
+        WARN ("Failed to start main loop watchdog: %s",
+              error ? error->message : "");
+        g_clear_error (&error);
+        return;
+    }
+
+    _context = g_main_context_ref (context ? context :
+            g_main_context_default ());
+    _poll_func = g_main_context_get_poll_func (_context);
+    g_main_context_set_poll_func (_context, _watchdog_poll);
+    g_atomic_int_set (&_running, 1);
+    DBG ("main loop watchdog started, threshold %u ms", threshold_ms);
+}
+
+/**
+ * tlm_watchdog_stop:
+ *
+ * Stops watching the main context, if started.
+ */
+void
+tlm_watchdog_stop (void)
+{
+    if (!_thread)
+        return;
+
+    g_atomic_int_set (&_running, 0);
+    g_main_context_set_poll_func (_context, _poll_func);
+    g_main_context_unref (_context);
+    _context = NULL;
+    _poll_func = NULL;
+
+    g_mutex_lock (&_lock);
+    _stopping = TRUE;
+    _dispatch_start = 0;
+    g_cond_signal (&_cond);
+    g_mutex_unlock (&_lock);
+
+    g_thread_join (_thread);
+    _thread = NULL;
+    DBG ("main loop watchdog stopped");
+}
+
+/**
+ * tlm_watchdog_mark:
+ * @what: (transfer none): static string naming the running code
+ * @seat_id: (allow-none): the seat the code runs for, %NULL keeps the seat
+ * of an earlier mark in the same dispatch
+ *
+ * Names the code running in the main loop for the rest of the current
+ * dispatch, used in stall reports. Does nothing unless the watchdog runs.
+ */
+void
+tlm_watchdog_mark (
+        const gchar *what,
+        const gchar *seat_id)
+{
+    GSource *source;
+    const gchar *source_name = NULL;
+
+    if (!g_atomic_int_get (&_running))
+        return;
+
+    source = g_main_current_source ();
+    if (source)
+        source_name = g_source_get_name (source);
+
+    g_mutex_lock (&_lock);
+    _what = what;
+    g_strlcpy (_source, source_name ? source_name : "", sizeof (_source));
+    if (seat_id)
+        g_strlcpy (_seat, seat_id, sizeof (_seat));
+    g_mutex_unlock (&_lock);
+}
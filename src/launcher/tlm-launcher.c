@@ -46,6 +46,7 @@ typedef struct {
   FILE *fp;
   guint socket_watcher;
   TlmProcessManager *proc_manager;
+  gboolean is_stopping;
 } TlmLauncher;
 
 static void _tlm_launcher_process (TlmLauncher *l);
@@ -57,6 +58,17 @@ _handle_quit_signal (gpointer user_data)
 
     g_return_val_if_fail (l != NULL, G_SOURCE_CONTINUE);
     DBG ("Received quit signal");
+    /* stop the launched processes and quit once all of them have been
+     * reaped; a second quit signal does not wait for them */
+    if (l->proc_manager && !l->is_stopping) {
+        l->is_stopping = TRUE;
+        if (tlm_process_manager_stop_all_processes (l->proc_manager)) {
+            g_signal_connect_swapped (l->proc_manager,
+                    "all-processes-stopped", G_CALLBACK (g_main_loop_quit),
+                    l->loop);
+            return G_SOURCE_CONTINUE;
+        }
+    }
     if (l->proc_manager) {
         g_object_unref (l->proc_manager);
         l->proc_manager = NULL;
@@ -88,6 +100,7 @@ _tlm_launcher_init (TlmLauncher *l)
   l->fp = NULL;
   l->socket_watcher = 0;
   l->proc_manager = 0;
+  l->is_stopping = FALSE;
   _install_sighandlers (l);
 }
 
@@ -38,6 +38,9 @@
 #include "tlm-process-manager.h"
 #include "common/tlm-log.h"
 #include "common/tlm-utils.h"
+#include "common/tlm-process-watch.h"
+#include "common/tlm-spawn.h"
+#include "common/tlm-trace.h"
 #include "common/dbus/tlm-dbus-server-interface.h"
 #include "common/dbus/tlm-dbus-server-p2p.h"
 #include "common/dbus/tlm-dbus-utils.h"
@@ -58,7 +61,7 @@ struct ProcessObject
     gchar *args;
     int last_sig;
     guint timer_id;
-    guint watch_id;
+    TlmProcessWatch *watch;
     gboolean is_leader;
 };
 
@@ -80,6 +83,7 @@ static GParamSpec *pspecs[N_PROPERTIES];
 
 enum {
 	SIG_PROCESS_STOPPED,
+	SIG_ALL_PROCESSES_STOPPED,
 
     SIG_MAX
 };
@@ -110,9 +114,9 @@ _destroy_process_obj (
 	if (obj) {
 		g_free (obj->path);
 		g_free (obj->args);
-		if (obj->watch_id) {
-			g_source_remove (obj->watch_id);
-			obj->watch_id = 0;
+		if (obj->watch) {
+			tlm_process_watch_free (obj->watch);
+			obj->watch = NULL;
 		}
 		if (obj->timer_id > 0) {
 			g_source_remove (obj->timer_id);
@@ -132,7 +136,7 @@ _stop_process_timeout (gpointer user_data)
         case SIGTERM:
             DBG ("process %u didn't respond to SIGTERM, sending SIGKILL",
                  obj->pid);
-            if (killpg (obj->pid, SIGKILL))
+            if (!tlm_process_watch_signal_group (obj->watch, SIGKILL))
                 WARN ("killpg(%u, SIGKILL): %s", obj->pid, strerror(errno));
             obj->last_sig = SIGKILL;
             return G_SOURCE_CONTINUE;
@@ -154,13 +158,18 @@ _stop_process (
 {
     DBG ("Stop process with pid %d", obj->pid);
 
-    if (kill (obj->pid, 0) != 0) {
+    if (obj->last_sig) {
+        DBG ("process %d is already being stopped", obj->pid);
+        return;
+    }
+
+    if (!tlm_process_watch_is_alive (obj->watch)) {
         DBG ("no launcher process is running");
         obj->timer_id = 0;
         return;
     }
 
-    if (killpg (obj->pid, SIGTERM) < 0)
+    if (!tlm_process_watch_signal_group (obj->watch, SIGTERM))
         WARN ("killpg(%u, SIGTERM): %s", obj->pid, strerror(errno));
     obj->last_sig = SIGTERM;
     obj->timer_id = g_timeout_add_seconds (
@@ -169,34 +178,24 @@ _stop_process (
             		_stop_process_timeout, obj);
 }
 
-static void
-_stop_process_blocking (
-        gpointer proc_obj,
+static guint
+_stop_all_processes (
         TlmProcessManager *self)
 {
-	struct ProcessObject *obj = proc_obj;
-	_stop_process (obj, self);
-	while (obj->timer_id != 0)
-	      g_main_context_iteration(NULL, TRUE);
-}
+    GHashTableIter iter;
+    gpointer key;
+    struct ProcessObject *value = NULL;
 
-static void
-_stop_all_processes_blocking (
-        TlmProcessManager *self)
-{
-    if (self->priv->launched_processes) {
-        GHashTableIter iter;
-        pid_t key;
-        struct ProcessObject *value = NULL;
-        g_hash_table_iter_init (&iter, self->priv->launched_processes);
-        while (g_hash_table_iter_next (&iter,
-                (gpointer)&key,
-                (gpointer)&value)) {
-            _stop_process_blocking (value, self);
-        }
-        g_hash_table_unref (self->priv->launched_processes);
-        self->priv->launched_processes = NULL;
-    }
+    if (!self->priv->launched_processes)
+        return 0;
+
+    /* processes are removed from the table by _on_process_down_cb once they
+     * have been reaped */
+    g_hash_table_iter_init (&iter, self->priv->launched_processes);
+    while (g_hash_table_iter_next (&iter, &key, (gpointer)&value))
+        _stop_process (value, self);
+
+    return g_hash_table_size (self->priv->launched_processes);
 }
 
 static void
@@ -228,7 +227,14 @@ tlm_process_manager_dispose (GObject *object)
 {
     TlmProcessManager *self = TLM_PROCESS_MANAGER(object);
 
-    _stop_all_processes_blocking (self);
+    /* whatever is still running has been signalled at this point but is
+     * no longer supervised */
+    if (_stop_all_processes (self) > 0)
+        WARN ("disposing with processes still running");
+    if (self->priv->launched_processes) {
+        g_hash_table_unref (self->priv->launched_processes);
+        self->priv->launched_processes = NULL;
+    }
     _stop_dbus_server (self);
 
     g_clear_object (&self->priv->config);
@@ -298,9 +304,9 @@ _on_process_down_cb (
     guint obj_pid = 0;
     gboolean is_leader = FALSE;
 
-    g_spawn_close_pid (pid);
-
     TlmProcessManager *self = TLM_PROCESS_MANAGER (data);
+    TLM_TRACE2 (launcher__exit, g_getenv ("XDG_SEAT"),
+            g_getenv ("XDG_SESSION_ID"), getuid (), pid, status);
     if (WIFEXITED(status)) {
         DBG ("process with pid (%d) exited status %d", pid,
                WEXITSTATUS(status));
@@ -314,19 +320,20 @@ _on_process_down_cb (
 
     struct ProcessObject *obj = g_hash_table_lookup (
                 self->priv->launched_processes, GUINT_TO_POINTER (pid));
-    is_leader = obj->is_leader;
+    if (obj)
+        is_leader = obj->is_leader;
     g_hash_table_remove (self->priv->launched_processes,
     		GUINT_TO_POINTER (pid));
     g_signal_emit (self, signals[SIG_PROCESS_STOPPED], 0, pid);
 
     if (is_leader) {
         DBG ("leader gone down.. bring down all the other processes");
-        _stop_all_processes_blocking (self);
+        _stop_all_processes (self);
     }
 
-    if (!self->priv->launched_processes ||
-        g_hash_table_size (self->priv->launched_processes) == 0) {
+    if (g_hash_table_size (self->priv->launched_processes) == 0) {
         DBG("All childs dead, going down...");
+        g_signal_emit (self, signals[SIG_ALL_PROCESSES_STOPPED], 0);
         kill (0, SIGINT);
     }
 }
@@ -341,57 +348,45 @@ tlm_process_manager_launch_process (
 {
     gchar **args = NULL;
     gchar **args_iter = NULL;
+    GPid child_pid = 0;
     gint i;
 
     DBG ("start process with path %s", command);
     g_return_val_if_fail (self && TLM_IS_PROCESS_MANAGER(self), FALSE);
 
-    pid_t child_pid = fork ();
-    if (child_pid) {
-        DBG ("setup watch for the new process with pid %u", child_pid);
-    	struct ProcessObject *obj = g_malloc0 (sizeof (struct ProcessObject));
-    	obj->pid = child_pid;
-        setpgid(child_pid, 0);
-        obj->is_leader = is_leader;
-    	g_hash_table_insert (self->priv->launched_processes,
-    			GUINT_TO_POINTER (child_pid), obj);
-        if (procid) *procid = obj->pid;
-    	obj->watch_id = g_child_watch_add (child_pid,
-    			(GChildWatchFunc)_on_process_down_cb, self);
-    	return TRUE;
+    args = tlm_utils_split_command_line (command);
+    if (!args || !args[0]) {
+        if (error)
+            *error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_INVALID_INPUT,
+                "Invalid command");
+        g_strfreev (args);
+        return FALSE;
     }
 
-    if (signal (SIGTERM, SIG_DFL) == SIG_ERR)
-        WARN ("failed to reset SIGTERM: %s", strerror (errno));
-    if (signal (SIGINT, SIG_DFL) == SIG_ERR)
-        WARN ("failed to reset SIGINT: %s", strerror (errno));
-    if (signal (SIGPIPE, SIG_DFL) == SIG_ERR)
-        WARN ("failed to reset SIGPIPE: %s", strerror (errno));
-    if (signal (SIGHUP, SIG_DFL) == SIG_ERR)
-        WARN ("failed to reset SIGHUP: %s", strerror (errno));
-
-    sigset_t unmask;
-    if (sigemptyset (&unmask) ||
-        sigaddset (&unmask, SIGTERM) ||
-        sigaddset (&unmask, SIGINT) ||
-        sigaddset (&unmask, SIGPIPE) ||
-        sigaddset (&unmask, SIGHUP))
-        WARN ("failed to set up signal mask");
-    if (sigprocmask (SIG_UNBLOCK, &unmask, NULL))
-        WARN ("failed to unblock signals: %s", strerror (errno));
-
-    DBG ("start new process: cmd %s", command);
-    args = tlm_utils_split_command_line (command);
     args_iter = args; i = 0;
     while (args_iter && *args_iter) {
         DBG ("\targv[%d]: %s", i, *args_iter);
         args_iter++; i++;
     }
-    execvp (args[0], args);
-    WARN("exec failed: %s", strerror (errno));
-    /* we reach here only in case of error */
+
+    if (!tlm_spawn_async (args, TRUE, &child_pid, error)) {
+        g_strfreev (args);
+        return FALSE;
+    }
+    TLM_TRACE2 (launcher__spawn, g_getenv ("XDG_SEAT"),
+            g_getenv ("XDG_SESSION_ID"), getuid (), child_pid, args[0]);
     g_strfreev (args);
-    exit (0);
+
+    DBG ("setup watch for the new process with pid %u", child_pid);
+    struct ProcessObject *obj = g_malloc0 (sizeof (struct ProcessObject));
+    obj->pid = child_pid;
+    obj->is_leader = is_leader;
+    g_hash_table_insert (self->priv->launched_processes,
+            GUINT_TO_POINTER (child_pid), obj);
+    if (procid) *procid = obj->pid;
+    obj->watch = tlm_process_watch_new (child_pid,
+            _on_process_down_cb, self);
+    return TRUE;
 }
 
 gboolean
@@ -416,6 +411,15 @@ tlm_process_manager_stop_process (
     return TRUE;
 }
 
+gboolean
+tlm_process_manager_stop_all_processes (
+        TlmProcessManager *self)
+{
+    g_return_val_if_fail (self && TLM_IS_PROCESS_MANAGER(self), FALSE);
+
+    return _stop_all_processes (self) > 0;
+}
+
 gboolean
 tlm_process_manager_list_processes (
         TlmProcessManager *self)
@@ -499,6 +503,12 @@ tlm_process_manager_class_init (TlmProcessManagerClass *klass)
                                 0, NULL, NULL, NULL, G_TYPE_NONE,
                                 1, G_TYPE_UINT);
 
+    signals[SIG_ALL_PROCESSES_STOPPED] = g_signal_new (
+                                "all-processes-stopped",
+                                TLM_TYPE_PROCESS_MANAGER,
+    							G_SIGNAL_RUN_LAST,
+                                0, NULL, NULL, NULL, G_TYPE_NONE,
+                                0, G_TYPE_NONE);
 }
 
 static void
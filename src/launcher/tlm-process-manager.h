@@ -79,6 +79,10 @@ tlm_process_manager_stop_process (
         guint procid,
         GError **error);
 
+gboolean
+tlm_process_manager_stop_all_processes (
+        TlmProcessManager *self);
+
 gboolean
 tlm_process_manager_list_processes (
         TlmProcessManager *self);
@@ -30,6 +30,7 @@
 #include <glib.h>
 
 #include "tlm-account-plugin-default.h"
+#include "tlm-home-pool.h"
 #include "tlm-log.h"
 
 /**
@@ -39,8 +40,9 @@
  * #TlmAccountPluginDefault provides a default implementation of user account
  * operations:
  * - setting up guest account is performed by running 'useradd'
- * - cleaning up guest account is performed by running 'rm -rf' on the account's
- * home directory
+ * - cleaning up guest account replaces the account's home directory with an
+ * empty one, or with a copy of #TLM_HOME_POOL_TEMPLATE prepared in advance,
+ * and deletes the old contents in a background thread
  * - check the account validity is done using getpwnam().
  *
  * It is recommended to use a GUM plugin instead: see #TlmAccountPluginGumd.
@@ -68,6 +70,7 @@ struct _TlmAccountPluginDefault
 {
     GObject parent;
     GHashTable *config;
+    TlmHomePool *home_pool;
 };
 
 
@@ -85,17 +88,37 @@ _setup_guest_account (TlmAccountPlugin *plugin, const gchar *user_name)
 
     g_free (command);
 
+    if (res != -1 && TLM_ACCOUNT_PLUGIN_DEFAULT(plugin)->home_pool) {
+        struct passwd *pwd_entry = getpwnam (user_name);
+        if (pwd_entry && pwd_entry->pw_dir)
+            tlm_home_pool_prepare (
+                    TLM_ACCOUNT_PLUGIN_DEFAULT(plugin)->home_pool,
+                    pwd_entry->pw_dir, pwd_entry->pw_uid, pwd_entry->pw_gid);
+    }
+
     return res != -1;
 }
 
+static void
+_home_cleanup_done (const gchar *home_dir,
+                    gboolean success,
+                    gpointer user_data)
+{
+    (void) user_data;
+
+    if (success)
+        DBG("old contents of '%s' deleted", home_dir);
+    else
+        WARN("failed to delete old contents of '%s'", home_dir);
+}
+
 static gboolean
 _cleanup_guest_user (TlmAccountPlugin *plugin,
                      const gchar *user_name,
                      gboolean delete)
 {
+    TlmAccountPluginDefault *self = NULL;
     struct passwd *pwd_entry = NULL;
-    char *command = NULL;
-    int res;
 
     (void) delete;
 
@@ -103,6 +126,8 @@ _cleanup_guest_user (TlmAccountPlugin *plugin,
     g_return_val_if_fail (TLM_IS_ACCOUNT_PLUGIN_DEFAULT(plugin), FALSE);
     g_return_val_if_fail (user_name && user_name[0], FALSE);
 
+    self = TLM_ACCOUNT_PLUGIN_DEFAULT(plugin);
+
     /* clear error */
     errno = 0;
 
@@ -119,13 +144,14 @@ _cleanup_guest_user (TlmAccountPlugin *plugin,
         return FALSE;
     }
 
-    command = g_strdup_printf ("rm -rf %s/*", pwd_entry->pw_dir);
-
-    res = system (command);
+    if (self->home_pool)
+        return tlm_home_pool_swap (self->home_pool, pwd_entry->pw_dir,
+                                   pwd_entry->pw_uid, pwd_entry->pw_gid,
+                                   _home_cleanup_done, NULL);
 
-    g_free (command);
-
-    return res != -1;
+    /* the home is empty on return, the old tree goes away in the background */
+    return tlm_home_cleanup_start (pwd_entry->pw_dir, _home_cleanup_done,
+                                   NULL);
 }
 
 static gboolean
@@ -170,6 +196,7 @@ _plugin_finalize (GObject *self)
 {
     TlmAccountPluginDefault *plugin = TLM_ACCOUNT_PLUGIN_DEFAULT(self);
 
+    if (plugin->home_pool) tlm_home_pool_free (plugin->home_pool);
     if (plugin->config) g_hash_table_unref (plugin->config);
 
     G_OBJECT_CLASS (tlm_account_plugin_default_parent_class)->finalize(self);
@@ -188,6 +215,7 @@ _plugin_set_property (GObject      *object,
             gpointer p = g_value_get_boxed (value);
             if (p)
                 self->config = g_hash_table_ref ((GHashTable *)p);
+            self->home_pool = tlm_home_pool_new_from_config (self->config);
             break;
         }
         default:
@@ -44,6 +44,10 @@
  * operations that is utiziling gumd daemon API to perform them:
  * <ulink url="https://github.com/01org/gumd">
  * https://github.com/01org/gumd</ulink>.
+ *
+ * When #TLM_HOME_POOL_TEMPLATE is set in the plugin's group, guest homes
+ * are replaced with copies of the template prepared in the background
+ * instead of being deleted and recreated by gumd at cleanup.
  */
 
 /**
@@ -86,6 +90,19 @@ _setup_guest_account (
         return FALSE;
     }
 
+    if (TLM_ACCOUNT_PLUGIN_GUMD(plugin)->home_pool) {
+        uid_t uid = 0;
+        gid_t gid = 0;
+        gchar *home_dir = NULL;
+
+        g_object_get (G_OBJECT (guser), "uid", &uid, "gid", &gid, "homedir",
+                &home_dir, NULL);
+        if (home_dir)
+            tlm_home_pool_prepare (TLM_ACCOUNT_PLUGIN_GUMD(plugin)->home_pool,
+                    home_dir, uid, gid);
+        g_free (home_dir);
+    }
+
     g_object_unref (guser);
 
     return TRUE;
@@ -118,6 +135,12 @@ _cleanup_guest_user (
     g_object_get (G_OBJECT (guser), "uid", &uid, "gid", &gid, "homedir",
             &home_dir, NULL);
 
+    if (TLM_ACCOUNT_PLUGIN_GUMD(plugin)->home_pool) {
+        ret = tlm_home_pool_swap (TLM_ACCOUNT_PLUGIN_GUMD(plugin)->home_pool,
+                home_dir, uid, gid, NULL, NULL);
+        goto _finished;
+    }
+
     if (!gum_file_delete_home_dir (home_dir, &error)) {
         goto _finished;
     }
@@ -176,6 +199,7 @@ _plugin_finalize (GObject *self)
 {
     TlmAccountPluginGumd *plugin = TLM_ACCOUNT_PLUGIN_GUMD(self);
 
+    if (plugin->home_pool) tlm_home_pool_free (plugin->home_pool);
     if (plugin->config) g_hash_table_unref (plugin->config);
 
     G_OBJECT_CLASS (tlm_account_plugin_gumd_parent_class)->finalize(self);
@@ -194,6 +218,7 @@ _plugin_set_property (GObject      *object,
             gpointer p = g_value_get_boxed (value);
             if (p)
                 self->config = g_hash_table_ref ((GHashTable *)p);
+            self->home_pool = tlm_home_pool_new_from_config (self->config);
             break;
         }
         default:
@@ -28,6 +28,7 @@
 
 #include <glib.h>
 #include "tlm-account-plugin.h"
+#include "tlm-home-pool.h"
 
 G_BEGIN_DECLS
 
@@ -50,6 +51,7 @@ struct _TlmAccountPluginGumd
 {
     GObject parent;
     GHashTable *config;
+    TlmHomePool *home_pool;
 };
 
 struct _TlmAccountPluginGumdClass
@@ -39,6 +39,7 @@
 
 static TlmSessionDaemon *_daemon = NULL;
 static guint _sig_source_id[2];
+static gboolean _is_terminating = FALSE;
 
 static void
 _on_daemon_closed (gpointer data, GObject *server)
@@ -55,6 +56,19 @@ _handle_quit_signal (gpointer user_data)
 
     g_return_val_if_fail (ml != NULL, FALSE);
     DBG ("Received quit signal");
+    /* let the user session go down first and quit once it has been
+     * reaped or could not be terminated; a second quit signal does not
+     * wait for it */
+    if (_daemon && !_is_terminating &&
+        tlm_session_daemon_has_session (_daemon)) {
+        _is_terminating = TRUE;
+        g_signal_connect_swapped (_daemon, "session-terminated",
+                G_CALLBACK (g_main_loop_quit), ml);
+        g_signal_connect_swapped (_daemon, "session-error",
+                G_CALLBACK (g_main_loop_quit), ml);
+        tlm_session_daemon_terminate_session (_daemon);
+        return G_SOURCE_CONTINUE;
+    }
     if (ml) g_main_loop_quit (ml);
 
     return FALSE;
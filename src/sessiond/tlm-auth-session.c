@@ -42,6 +42,7 @@
 #include "common/tlm-log.h"
 #include "common/tlm-utils.h"
 #include "common/tlm-error.h"
+#include "common/tlm-trace.h"
 
 G_DEFINE_TYPE (TlmAuthSession, tlm_auth_session, G_TYPE_OBJECT);
 
@@ -55,6 +56,7 @@ enum {
     PROP_USERNAME,
     PROP_PASSWORD,
     PROP_TTYNAME,
+    PROP_SEAT,
     N_PROPERTIES
 };
 static GParamSpec *pspecs[N_PROPERTIES];
@@ -65,7 +67,9 @@ struct _TlmAuthSessionPrivate
     gchar *username;
     gchar *password;
     gchar *tty_name;
+    gchar *seat_id;
     gchar *session_id; /* logind session path */
+    uid_t uid; /* for the probes, -1 until the user is known */
     pam_handle_t *pam_handle;
 };
 
@@ -80,6 +84,8 @@ _auth_session_stop (TlmAuthSession *auth_session)
     TlmAuthSessionPrivate *priv = TLM_AUTH_SESSION_PRIV (auth_session);
 
     g_return_if_fail (priv->pam_handle);
+    TLM_TRACE1 (pam__enter, priv->seat_id, priv->session_id, priv->uid,
+            "close");
     res = pam_setcred (priv->pam_handle, PAM_DELETE_CRED);
     if (res != PAM_SUCCESS) {
         WARN ("Failed to remove credentials from pam session: %s",
@@ -88,6 +94,8 @@ _auth_session_stop (TlmAuthSession *auth_session)
 
     res = pam_end (priv->pam_handle,
                    pam_close_session (priv->pam_handle, 0));
+    TLM_TRACE2 (pam__exit, priv->seat_id, priv->session_id, priv->uid,
+            "close", res);
     if (res != PAM_SUCCESS) {
         WARN ("Failed to end pam session: %s",
             pam_strerror (priv->pam_handle, res));
@@ -118,6 +126,7 @@ tlm_auth_session_finalize (GObject *self)
     g_clear_string (&priv->username);
     g_clear_string (&priv->password);
     g_clear_string (&priv->tty_name);
+    g_clear_string (&priv->seat_id);
     g_clear_string (&priv->session_id);
 
     G_OBJECT_CLASS (tlm_auth_session_parent_class)->finalize (self);
@@ -145,6 +154,9 @@ _auth_session_set_property (GObject *obj,
         case PROP_TTYNAME:
             priv->tty_name = g_value_dup_string (value);
             break;
+        case PROP_SEAT:
+            priv->seat_id = g_value_dup_string (value);
+            break;
 
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, property_id, pspec);
@@ -173,6 +185,9 @@ _auth_session_get_property (GObject *obj,
         case PROP_TTYNAME:
             g_value_set_string (value, priv->tty_name);
             break;
+        case PROP_SEAT:
+            g_value_set_string (value, priv->seat_id);
+            break;
 
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, property_id, pspec);
@@ -219,6 +234,13 @@ tlm_auth_session_class_init (TlmAuthSessionClass *klass)
                              NULL,
                              G_PARAM_READWRITE|
                              G_PARAM_CONSTRUCT_ONLY|G_PARAM_STATIC_STRINGS);
+    pspecs[PROP_SEAT] =
+        g_param_spec_string ("seat",
+                             "seat",
+                             "Seat id",
+                             NULL,
+                             G_PARAM_READWRITE|
+                             G_PARAM_CONSTRUCT_ONLY|G_PARAM_STATIC_STRINGS);
 
     g_object_class_install_properties (g_klass, N_PROPERTIES, pspecs);
 }
@@ -229,6 +251,7 @@ tlm_auth_session_init (TlmAuthSession *auth_session)
     TlmAuthSessionPrivate *priv = TLM_AUTH_SESSION_PRIV (auth_session);
 
     priv->service = priv->username = NULL;
+    priv->uid = (uid_t) -1;
 
     auth_session->priv = priv;
 }
@@ -359,7 +382,11 @@ tlm_auth_session_authenticate (TlmAuthSession *auth_session, GError **error)
     pam_get_item (priv->pam_handle, PAM_USER, (const void **)&p_uname);
     DBG ("PAM service : '%s', PAM username : '%s'", p_service, p_uname);
     DBG ("starting pam authentication for user '%s'", priv->username);
-    if((res = pam_authenticate (priv->pam_handle, PAM_SILENT)) != PAM_SUCCESS) {
+    TLM_TRACE1 (pam__enter, priv->seat_id, NULL, priv->uid, "authenticate");
+    res = pam_authenticate (priv->pam_handle, PAM_SILENT);
+    TLM_TRACE2 (pam__exit, priv->seat_id, NULL, priv->uid,
+            "authenticate", res);
+    if (res != PAM_SUCCESS) {
         WARN ("PAM authentication failure: %s",
               pam_strerror (priv->pam_handle, res));
         if (error)
@@ -368,6 +395,9 @@ tlm_auth_session_authenticate (TlmAuthSession *auth_session, GError **error)
                     pam_strerror (priv->pam_handle, res));
         return FALSE;
     }
+    /* PAM modules may have created the account */
+    if (priv->uid == (uid_t) -1)
+        priv->uid = tlm_user_get_uid (priv->username);
 
     return TRUE;
 }
@@ -391,21 +421,30 @@ tlm_auth_session_open (TlmAuthSession *auth_session, GError **error)
         return FALSE;
     }*/
 
+    TLM_TRACE1 (pam__enter, priv->seat_id, NULL, priv->uid, "setcred");
     res = pam_setcred (priv->pam_handle, PAM_ESTABLISH_CRED);
+    TLM_TRACE2 (pam__exit, priv->seat_id, NULL, priv->uid, "setcred", res);
     if (res != PAM_SUCCESS) {
         WARN ("Failed to establish pam credentials: %s",
                 pam_strerror (priv->pam_handle, res));
         return FALSE;
     }
 
+    TLM_TRACE1 (pam__enter, priv->seat_id, NULL, priv->uid, "open_session");
     res = pam_open_session (priv->pam_handle, 0);
+    TLM_TRACE2 (pam__exit, priv->seat_id, NULL, priv->uid,
+            "open_session", res);
     if (res != PAM_SUCCESS) {
         WARN ("Failed to open pam session: %s",
                 pam_strerror (priv->pam_handle, res));
         return FALSE;
     }
 
+    TLM_TRACE1 (pam__enter, priv->seat_id, NULL, priv->uid,
+            "reinitialize_cred");
     res = pam_setcred (priv->pam_handle, PAM_REINITIALIZE_CRED);
+    TLM_TRACE2 (pam__exit, priv->seat_id, NULL, priv->uid,
+            "reinitialize_cred", res);
     if (res != PAM_SUCCESS) {
         WARN ("Failed to reinitialize pam credentials: %s",
                 pam_strerror (priv->pam_handle, res));
@@ -422,7 +461,8 @@ TlmAuthSession *
 tlm_auth_session_new (const gchar *service,
                       const gchar *username,
                       const gchar *password,
-                      const gchar *tty_name)
+                      const gchar *tty_name,
+                      const gchar *seat_id)
 {
     int res;
     TlmAuthSession *auth_session = TLM_AUTH_SESSION (
@@ -431,14 +471,20 @@ tlm_auth_session_new (const gchar *service,
                       "username", username,
                       "password", password,
                       "ttyname", tty_name,
+                      "seat", seat_id,
                       NULL));
     TlmAuthSessionPrivate *priv = TLM_AUTH_SESSION_PRIV (auth_session);
 
+    if (priv->username)
+        priv->uid = tlm_user_get_uid (priv->username);
+
     struct pam_conv conv = { _auth_session_pam_conversation_cb,
                              auth_session };
     DBG ("loading pam for service '%s'", priv->service);
+    TLM_TRACE1 (pam__enter, priv->seat_id, NULL, priv->uid, "start");
     res = pam_start (priv->service, priv->username,
                      &conv, &priv->pam_handle);
+    TLM_TRACE2 (pam__exit, priv->seat_id, NULL, priv->uid, "start", res);
     if (res != PAM_SUCCESS) {
         WARN ("pam initialization failed: %s", pam_strerror (NULL, res));
         g_object_unref (auth_session);
@@ -63,7 +63,8 @@ TlmAuthSession *
 tlm_auth_session_new (const gchar *service,
                       const gchar *username,
                       const gchar *password,
-                      const gchar *tty_name);
+                      const gchar *tty_name,
+                      const gchar *seat_id);
 
 gboolean
 tlm_auth_session_putenv (TlmAuthSession *auth_session,
@@ -0,0 +1,271 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/vfs.h>
+#include <sys/inotify.h>
+#include <glib-unix.h>
+
+#include "tlm-session-cgroup.h"
+#include "common/tlm-log.h"
+
+#ifndef CGROUP2_SUPER_MAGIC
+#define CGROUP2_SUPER_MAGIC 0x63677270
+#endif
+
+/* A cgroup v2 directory holding all processes of one user session, created
+ * below a directory delegated to tlm. Writing to cgroup.kill SIGKILLs the
+ * whole subtree in one go, including processes which left the session's
+ * process group, and cgroup.events reports when the last one is gone. */
+struct _TlmSessionCgroup
+{
+    gchar *path;
+    gchar *procs_path;
+    gchar *kill_path;
+    gchar *events_path;
+    gint inotify_fd;
+    guint events_watch_id;
+    TlmSessionCgroupEmptyCb empty_cb;
+    gpointer empty_cb_data;
+};
+
+static gboolean
+_write_file (const gchar *path, const gchar *value)
+{
+    ssize_t len = strlen (value);
+    ssize_t ret;
+    int fd;
+
+    /* also used in the forked session child, stick to plain syscalls */
+    fd = open (path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return FALSE;
+    ret = write (fd, value, len);
+    close (fd);
+
+    return ret == len;
+}
+
+TlmSessionCgroup *
+tlm_session_cgroup_new (
+        const gchar *root,
+        const gchar *name)
+{
+    TlmSessionCgroup *cgroup = NULL;
+    struct statfs sfs;
+
+    g_return_val_if_fail (name != NULL, NULL);
+
+    if (!root || !*root)
+        return NULL;
+
+    if (statfs (root, &sfs) < 0) {
+        WARN ("statfs(%s): %s", root, strerror (errno));
+        return NULL;
+    }
+    if (sfs.f_type != CGROUP2_SUPER_MAGIC) {
+        WARN ("%s is not a cgroup v2 directory", root);
+        return NULL;
+    }
+
+    cgroup = g_slice_new0 (TlmSessionCgroup);
+    cgroup->inotify_fd = -1;
+    cgroup->path = g_build_filename (root, name, NULL);
+    cgroup->procs_path = g_build_filename (cgroup->path, "cgroup.procs", NULL);
+    cgroup->kill_path = g_build_filename (cgroup->path, "cgroup.kill", NULL);
+    cgroup->events_path = g_build_filename (cgroup->path, "cgroup.events",
+            NULL);
+
+    if (mkdir (cgroup->path, 0755) < 0 && errno != EEXIST) {
+        WARN ("mkdir(%s): %s", cgroup->path, strerror (errno));
+        goto fail;
+    }
+
+    if (access (cgroup->kill_path, W_OK) < 0) {
+        WARN ("cgroup.kill is not available in %s", cgroup->path);
+        rmdir (cgroup->path);
+        goto fail;
+    }
+
+    DBG ("session cgroup %s", cgroup->path);
+    return cgroup;
+
+fail:
+    g_free (cgroup->path);
+    g_free (cgroup->procs_path);
+    g_free (cgroup->kill_path);
+    g_free (cgroup->events_path);
+    g_slice_free (TlmSessionCgroup, cgroup);
+    return NULL;
+}
+
+void
+tlm_session_cgroup_free (
+        TlmSessionCgroup *cgroup)
+{
+    if (!cgroup)
+        return;
+
+    if (cgroup->events_watch_id) {
+        g_source_remove (cgroup->events_watch_id);
+        cgroup->events_watch_id = 0;
+    }
+    if (cgroup->inotify_fd >= 0) {
+        close (cgroup->inotify_fd);
+        cgroup->inotify_fd = -1;
+    }
+
+    if (rmdir (cgroup->path) < 0 && errno != ENOENT)
+        WARN ("rmdir(%s): %s", cgroup->path, strerror (errno));
+
+    g_free (cgroup->path);
+    g_free (cgroup->procs_path);
+    g_free (cgroup->kill_path);
+    g_free (cgroup->events_path);
+    g_slice_free (TlmSessionCgroup, cgroup);
+}
+
+const gchar *
+tlm_session_cgroup_get_path (
+        TlmSessionCgroup *cgroup)
+{
+    g_return_val_if_fail (cgroup != NULL, NULL);
+
+    return cgroup->path;
+}
+
+gboolean
+tlm_session_cgroup_attach_self (
+        TlmSessionCgroup *cgroup)
+{
+    g_return_val_if_fail (cgroup != NULL, FALSE);
+
+    return _write_file (cgroup->procs_path, "0");
+}
+
+gboolean
+tlm_session_cgroup_is_populated (
+        TlmSessionCgroup *cgroup)
+{
+    gchar *contents = NULL;
+    gchar *line = NULL;
+    gboolean populated = FALSE;
+
+    g_return_val_if_fail (cgroup != NULL, FALSE);
+
+    if (!g_file_get_contents (cgroup->events_path, &contents, NULL, NULL))
+        return FALSE;
+
+    line = strstr (contents, "populated ");
+    if (line)
+        populated = line[strlen ("populated ")] == '1';
+    g_free (contents);
+
+    return populated;
+}
+
+gboolean
+tlm_session_cgroup_kill (
+        TlmSessionCgroup *cgroup)
+{
+    g_return_val_if_fail (cgroup != NULL, FALSE);
+
+    DBG ("killing %s", cgroup->path);
+    if (!_write_file (cgroup->kill_path, "1")) {
+        WARN ("write(%s): %s", cgroup->kill_path, strerror (errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean
+_on_cgroup_events_changed (
+        gint fd,
+        GIOCondition condition,
+        gpointer user_data)
+{
+    TlmSessionCgroup *cgroup = (TlmSessionCgroup *) user_data;
+    gchar buf[sizeof (struct inotify_event) + NAME_MAX + 1];
+
+    while (read (fd, buf, sizeof (buf)) > 0)
+        ;
+
+    if (tlm_session_cgroup_is_populated (cgroup))
+        return G_SOURCE_CONTINUE;
+
+    DBG ("%s is empty", cgroup->path);
+    cgroup->events_watch_id = 0;
+    if (cgroup->empty_cb)
+        cgroup->empty_cb (cgroup->empty_cb_data);
+    return G_SOURCE_REMOVE;
+}
+
+/* Returns FALSE when the cgroup is already empty, in which case the callback
+ * is never invoked. */
+gboolean
+tlm_session_cgroup_watch_empty (
+        TlmSessionCgroup *cgroup,
+        TlmSessionCgroupEmptyCb callback,
+        gpointer user_data)
+{
+    g_return_val_if_fail (cgroup != NULL, FALSE);
+
+    cgroup->empty_cb = callback;
+    cgroup->empty_cb_data = user_data;
+
+    if (cgroup->inotify_fd < 0) {
+        cgroup->inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+        if (cgroup->inotify_fd < 0) {
+            WARN ("inotify_init1(): %s", strerror (errno));
+            return FALSE;
+        }
+        if (inotify_add_watch (cgroup->inotify_fd, cgroup->events_path,
+                               IN_MODIFY) < 0) {
+            WARN ("inotify_add_watch(%s): %s", cgroup->events_path,
+                  strerror (errno));
+            close (cgroup->inotify_fd);
+            cgroup->inotify_fd = -1;
+            return FALSE;
+        }
+    }
+
+    if (!cgroup->events_watch_id)
+        cgroup->events_watch_id = g_unix_fd_add_full (G_PRIORITY_DEFAULT,
+                cgroup->inotify_fd, G_IO_IN, _on_cgroup_events_changed,
+                cgroup, NULL);
+
+    /* check only after the watch is in place to not miss the transition */
+    if (!tlm_session_cgroup_is_populated (cgroup)) {
+        g_source_remove (cgroup->events_watch_id);
+        cgroup->events_watch_id = 0;
+        return FALSE;
+    }
+
+    return TRUE;
+}
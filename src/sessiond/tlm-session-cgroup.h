@@ -0,0 +1,68 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TLM_SESSION_CGROUP_H
+#define _TLM_SESSION_CGROUP_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TlmSessionCgroup TlmSessionCgroup;
+
+typedef void (*TlmSessionCgroupEmptyCb) (gpointer user_data);
+
+TlmSessionCgroup *
+tlm_session_cgroup_new (
+        const gchar *root,
+        const gchar *name);
+
+void
+tlm_session_cgroup_free (
+        TlmSessionCgroup *cgroup);
+
+const gchar *
+tlm_session_cgroup_get_path (
+        TlmSessionCgroup *cgroup);
+
+gboolean
+tlm_session_cgroup_attach_self (
+        TlmSessionCgroup *cgroup);
+
+gboolean
+tlm_session_cgroup_is_populated (
+        TlmSessionCgroup *cgroup);
+
+gboolean
+tlm_session_cgroup_kill (
+        TlmSessionCgroup *cgroup);
+
+gboolean
+tlm_session_cgroup_watch_empty (
+        TlmSessionCgroup *cgroup,
+        TlmSessionCgroupEmptyCb callback,
+        gpointer user_data);
+
+G_END_DECLS
+
+#endif /* _TLM_SESSION_CGROUP_H */
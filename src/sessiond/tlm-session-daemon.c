@@ -41,6 +41,14 @@ struct _TlmSessionDaemonPrivate
 
 G_DEFINE_TYPE (TlmSessionDaemon, tlm_session_daemon, G_TYPE_OBJECT)
 
+enum {
+    SIG_SESSION_TERMINATED,
+    SIG_SESSION_ERROR,
+    SIG_MAX
+};
+
+static guint signals[SIG_MAX];
+
 
 #define TLM_SESSION_DAEMON_GET_PRIV(obj) \
     G_TYPE_INSTANCE_GET_PRIVATE ((obj), TLM_TYPE_SESSION_DAEMON,\
@@ -88,6 +96,13 @@ tlm_session_daemon_class_init (
     object_class->dispose = _dispose;
     object_class->finalize = _finalize;
 
+    signals[SIG_SESSION_TERMINATED] = g_signal_new ("session-terminated",
+            TLM_TYPE_SESSION_DAEMON, G_SIGNAL_RUN_LAST,
+            0, NULL, NULL, NULL, G_TYPE_NONE, 0, G_TYPE_NONE);
+
+    signals[SIG_SESSION_ERROR] = g_signal_new ("session-error",
+            TLM_TYPE_SESSION_DAEMON, G_SIGNAL_RUN_LAST,
+            0, NULL, NULL, NULL, G_TYPE_NONE, 0, G_TYPE_NONE);
 }
 
 static void
@@ -154,6 +169,52 @@ _handle_session_create_from_dbus (
     return TRUE;
 }
 
+static gboolean
+_handle_session_authenticate_from_dbus (
+        TlmSessionDaemon *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *password,
+        GVariant *environment,
+        gpointer user_data)
+{
+    g_return_val_if_fail (self && TLM_IS_SESSION_DAEMON (self), FALSE);
+    gchar *seatid = NULL;
+    gchar *service = NULL;
+    gchar *username = NULL;
+    GHashTable *data = NULL;
+
+    tlm_dbus_session_complete_session_authenticate (
+            self->priv->dbus_session, invocation);
+
+    data = tlm_dbus_utils_hash_table_from_variant (environment);
+    g_object_get (self->priv->dbus_session, "seatid", &seatid,
+            "username", &username, "service", &service, NULL);
+
+    tlm_session_authenticate (self->priv->session, seatid, service, username,
+            password, data);
+
+    g_hash_table_unref (data);
+    g_free (seatid);
+    g_free (service);
+    g_free (username);
+    return TRUE;
+}
+
+static gboolean
+_handle_session_open_from_dbus (
+        TlmSessionDaemon *self,
+        GDBusMethodInvocation *invocation,
+        gpointer user_data)
+{
+    g_return_val_if_fail (self && TLM_IS_SESSION_DAEMON (self), FALSE);
+
+    tlm_dbus_session_complete_session_open (self->priv->dbus_session,
+            invocation);
+
+    tlm_session_open (self->priv->session);
+    return TRUE;
+}
+
 static gboolean
 _handle_session_terminate_from_dbus (
         TlmSessionDaemon *self,
@@ -206,6 +267,7 @@ _handle_session_terminated_from_session (
     g_return_if_fail (self && TLM_IS_SESSION_DAEMON (self));
 
     tlm_dbus_session_emit_session_terminated (self->priv->dbus_session);
+    g_signal_emit (self, signals[SIG_SESSION_TERMINATED], 0);
 }
 
 static void
@@ -218,6 +280,17 @@ _handle_authenticated_from_session (
     tlm_dbus_session_emit_authenticated (self->priv->dbus_session);
 }
 
+static void
+_handle_login_timeline_from_session (
+        TlmSessionDaemon *self,
+        GVariant *timeline,
+        gpointer user_data)
+{
+    g_return_if_fail (self && TLM_IS_SESSION_DAEMON (self));
+
+    tlm_dbus_session_emit_login_timeline (self->priv->dbus_session, timeline);
+}
+
 static void
 _handle_error_from_session (
         TlmSessionDaemon *self,
@@ -232,6 +305,7 @@ _handle_error_from_session (
     g_free (data_str);
 
     tlm_dbus_session_emit_error (self->priv->dbus_session, error);
+    g_signal_emit (self, signals[SIG_SESSION_ERROR], 0);
 }
 
 TlmSessionDaemon *
@@ -268,6 +342,12 @@ tlm_session_daemon_new (
     g_signal_connect_swapped (daemon->priv->dbus_session,
             "handle-session-create", G_CALLBACK (
                 _handle_session_create_from_dbus), daemon);
+    g_signal_connect_swapped (daemon->priv->dbus_session,
+            "handle-session-authenticate", G_CALLBACK (
+                _handle_session_authenticate_from_dbus), daemon);
+    g_signal_connect_swapped (daemon->priv->dbus_session,
+            "handle-session-open", G_CALLBACK (
+                _handle_session_open_from_dbus), daemon);
     g_signal_connect_swapped (daemon->priv->dbus_session,
             "handle-session-terminate", G_CALLBACK(
                 _handle_session_terminate_from_dbus), daemon);
@@ -282,6 +362,8 @@ tlm_session_daemon_new (
             G_CALLBACK(_handle_session_terminated_from_session), daemon);
     g_signal_connect_swapped (daemon->priv->session, "authenticated",
             G_CALLBACK(_handle_authenticated_from_session), daemon);
+    g_signal_connect_swapped (daemon->priv->session, "login-timeline",
+            G_CALLBACK(_handle_login_timeline_from_session), daemon);
     g_signal_connect_swapped (daemon->priv->session, "session-error",
             G_CALLBACK(_handle_error_from_session), daemon);
 
@@ -304,3 +386,21 @@ tlm_session_daemon_new (
 
     return daemon;
 }
+
+void
+tlm_session_daemon_terminate_session (
+        TlmSessionDaemon *self)
+{
+    g_return_if_fail (self && TLM_IS_SESSION_DAEMON (self));
+
+    tlm_session_terminate (self->priv->session);
+}
+
+gboolean
+tlm_session_daemon_has_session (
+        TlmSessionDaemon *self)
+{
+    g_return_val_if_fail (self && TLM_IS_SESSION_DAEMON (self), FALSE);
+
+    return tlm_session_is_running (self->priv->session);
+}
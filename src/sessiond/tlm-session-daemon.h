@@ -67,4 +67,12 @@ tlm_session_daemon_new (
         gint in_fd,
         gint out_fd);
 
+void
+tlm_session_daemon_terminate_session (
+        TlmSessionDaemon *self);
+
+gboolean
+tlm_session_daemon_has_session (
+        TlmSessionDaemon *self);
+
 #endif /* __TLM_SESSION_DAEMON_H_ */
@@ -45,15 +45,25 @@
 #include <linux/kd.h>
 
 #include <glib.h>
+#include <glib-unix.h>
 #include <glib/gstdio.h>
 
 #include "tlm-session.h"
 #include "tlm-auth-session.h"
+#include "tlm-session-cgroup.h"
 #include "common/tlm-log.h"
+#include "common/tlm-process-watch.h"
+#include "common/tlm-spawn.h"
 #include "common/tlm-utils.h"
 #include "common/tlm-error.h"
 #include "common/tlm-config-general.h"
 #include "common/tlm-config-seat.h"
+#include "common/tlm-config-image.h"
+#include "common/tlm-seat-config.h"
+#include "common/tlm-login-timeline.h"
+#include "common/tlm-trace.h"
+
+#define TLM_LAUNCHER_NAME "tlm-launcher"
 
 G_DEFINE_TYPE (TlmSession, tlm_session, G_TYPE_OBJECT);
 
@@ -76,6 +86,7 @@ enum {
     SIG_SESSION_TERMINATED,
     SIG_AUTHENTICATED,
     SIG_SESSION_ERROR,
+    SIG_LOGIN_TIMELINE,
     SIG_MAX
 };
 static guint signals[SIG_MAX];
@@ -83,6 +94,7 @@ static guint signals[SIG_MAX];
 struct _TlmSessionPrivate
 {
     TlmConfig *config;
+    TlmSeatConfig *seat_config;
     pid_t child_pid;
     gchar *tty_dev;
     uid_t tty_uid;
@@ -92,11 +104,13 @@ struct _TlmSessionPrivate
     gchar *seat_id;
     gchar *service;
     gchar *username;
+    uid_t uid; /* of the user, once the session is executed */
     GHashTable *env_hash;
     TlmAuthSession *auth_session;
     int last_sig;
     guint timer_id;
-    guint child_watch_id;
+    TlmProcessWatch *child_watch;
+    TlmSessionCgroup *cgroup;
     gchar *sessionid;
     gchar *xdg_runtime_dir;
     gboolean setup_runtime_dir;
@@ -104,6 +118,9 @@ struct _TlmSessionPrivate
     gboolean is_child_up;
     gboolean session_pause;
     int kb_mode;
+    TlmLoginTimeline timeline;
+    int exec_fd;
+    guint exec_watch_id;
 };
 
 static void
@@ -114,10 +131,21 @@ tlm_session_dispose (GObject *self)
     DBG("disposing session: %s", priv->service);
     priv->can_emit_signal = FALSE;
 
-    tlm_session_terminate (session);
-    while (priv->is_child_up)
-        g_main_context_iteration(NULL, TRUE);
+    /* graceful termination goes through tlm_session_terminate(), nothing
+     * waits for the session here anymore */
+    if (priv->cgroup) {
+        tlm_session_cgroup_kill (priv->cgroup);
+    } else if (priv->is_child_up) {
+        WARN ("session child %u still running, killing it", priv->child_pid);
+        if (!tlm_process_watch_signal_group (priv->child_watch, SIGKILL))
+            WARN ("killpg(%u, SIGKILL): %s",
+                  priv->child_pid,
+                  strerror(errno));
+    }
+    _clear_session (session);
+    tlm_utils_flush_utmp ();
 
+    g_clear_pointer (&session->priv->seat_config, tlm_seat_config_unref);
     g_clear_object (&session->priv->config);
 
     G_OBJECT_CLASS (tlm_session_parent_class)->dispose (self);
@@ -258,6 +286,10 @@ tlm_session_class_init (TlmSessionClass *klass)
                                 0, NULL, NULL, NULL, G_TYPE_NONE,
                                 1, G_TYPE_ERROR);
 
+    signals[SIG_LOGIN_TIMELINE] = g_signal_new ("login-timeline",
+                                TLM_TYPE_SESSION, G_SIGNAL_RUN_LAST,
+                                0, NULL, NULL, NULL, G_TYPE_NONE,
+                                1, G_TYPE_VARIANT);
 }
 
 static void
@@ -270,11 +302,19 @@ tlm_session_init (TlmSession *session)
     priv->env_hash = NULL;
     priv->auth_session = NULL;
     priv->sessionid = NULL;
-    priv->child_watch_id = 0;
+    priv->child_watch = NULL;
+    priv->cgroup = NULL;
     priv->is_child_up = FALSE;
     priv->can_emit_signal = TRUE;
     priv->config = tlm_config_new ();
     priv->kb_mode = -1;
+    priv->exec_fd = -1;
+    priv->uid = (uid_t) -1;
+
+    /* resolve the utmp host now, nothing on the login path may wait for
+     * the resolver */
+    tlm_utils_init_utmp (tlm_config_get_string (priv->config,
+            TLM_CONFIG_GENERAL, TLM_CONFIG_GENERAL_UTMP_HOST_ADDRESS));
 
     session->priv = priv;
 }
@@ -419,10 +459,9 @@ reset_exit:
 }
 
 static gboolean
-_set_environment (TlmSessionPrivate *priv)
+_set_environment (TlmSessionPrivate *priv, const TlmUserInfo *user_info)
 {
 	gchar **envlist = tlm_auth_session_get_envlist(priv->auth_session);
-	const gchar *home_dir = NULL, *shell = NULL;
 
     if (envlist) {
         gchar **env = 0;
@@ -434,32 +473,19 @@ _set_environment (TlmSessionPrivate *priv)
         g_free (envlist);
     }
 
-    const gchar *path = tlm_config_get_string (priv->config,
-                                               TLM_CONFIG_GENERAL,
-                                               TLM_CONFIG_GENERAL_SESSION_PATH);
-    if (!path)
-        path = "/usr/local/bin:/usr/bin:/bin";
-    _setenv_to_session ("PATH", path, priv);
+    _setenv_to_session ("PATH", priv->seat_config->session_path, priv);
 
     _setenv_to_session ("USER", priv->username, priv);
     _setenv_to_session ("LOGNAME", priv->username, priv);
-    home_dir = tlm_user_get_home_dir (priv->username);
-    if (home_dir) _setenv_to_session ("HOME", home_dir, priv);
-    shell = tlm_user_get_shell (priv->username);
-    if (shell) _setenv_to_session ("SHELL", shell, priv);
-
-    if (!tlm_config_has_key (priv->config,
-                             TLM_CONFIG_GENERAL,
-                             TLM_CONFIG_GENERAL_NSEATS))
+    if (user_info->home_dir)
+        _setenv_to_session ("HOME", user_info->home_dir, priv);
+    if (user_info->shell)
+        _setenv_to_session ("SHELL", user_info->shell, priv);
+
+    if (!priv->seat_config->has_nseats)
         _setenv_to_session ("XDG_SEAT", priv->seat_id, priv);
 
-    const gchar *xdg_data_dirs =
-        tlm_config_get_string (priv->config,
-                               TLM_CONFIG_GENERAL,
-                               TLM_CONFIG_GENERAL_DATA_DIRS);
-    if (!xdg_data_dirs)
-        xdg_data_dirs = "/usr/share:/usr/local/share";
-    _setenv_to_session ("XDG_DATA_DIRS", xdg_data_dirs, priv);
+    _setenv_to_session ("XDG_DATA_DIRS", priv->seat_config->data_dirs, priv);
 
     if (priv->xdg_runtime_dir)
         _setenv_to_session ("XDG_RUNTIME_DIR", priv->xdg_runtime_dir, priv);
@@ -487,9 +513,25 @@ _clear_session (TlmSession *session)
         priv->timer_id = 0;
     }
 
-    if (priv->child_watch_id) {
-        g_source_remove (priv->child_watch_id);
-        priv->child_watch_id = 0;
+    if (priv->exec_watch_id) {
+        g_source_remove (priv->exec_watch_id);
+        priv->exec_watch_id = 0;
+    }
+    if (priv->exec_fd >= 0) {
+        close (priv->exec_fd);
+        priv->exec_fd = -1;
+    }
+
+    priv->last_sig = 0;
+
+    if (priv->child_watch) {
+        tlm_process_watch_free (priv->child_watch);
+        priv->child_watch = NULL;
+    }
+
+    if (priv->cgroup) {
+        tlm_session_cgroup_free (priv->cgroup);
+        priv->cgroup = NULL;
     }
 
     if (priv->auth_session)
@@ -506,14 +548,44 @@ _clear_session (TlmSession *session)
     g_clear_string (&priv->xdg_runtime_dir);
 }
 
+static void
+_finish_session (TlmSession *session)
+{
+    _clear_session (session);
+    if (session->priv->can_emit_signal)
+        g_signal_emit (session, signals[SIG_SESSION_TERMINATED], 0);
+}
+
+static void
+_on_session_cgroup_empty (gpointer user_data)
+{
+    TlmSession *session = TLM_SESSION (user_data);
+
+    if (session->priv->is_child_up)
+        return;
+    _finish_session (session);
+}
+
+static guint
+_get_cgroup_kill_timeout (TlmSessionPrivate *priv)
+{
+    if (tlm_config_has_key (priv->config, TLM_CONFIG_GENERAL,
+                            TLM_CONFIG_GENERAL_CGROUP_KILL_TIMEOUT))
+        return tlm_config_get_uint (priv->config, TLM_CONFIG_GENERAL,
+                                    TLM_CONFIG_GENERAL_CGROUP_KILL_TIMEOUT, 0);
+    return tlm_config_get_uint (priv->config, TLM_CONFIG_GENERAL,
+                                TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT, 3) * 1000;
+}
+
+static gboolean
+_terminate_timeout (gpointer user_data);
+
 static void
 _on_child_down_cb (
         GPid  pid,
         gint  status,
         gpointer data)
 {
-    g_spawn_close_pid (pid);
-
     TlmSession *session = TLM_SESSION (data);
 
     DBG ("Sessiond(%p) with pid (%d) closed with status %d", session, pid,
@@ -521,47 +593,89 @@ _on_child_down_cb (
 
     session->priv->child_pid = 0;
     session->priv->is_child_up = FALSE;
-    _clear_session (session);
-    if (session->priv->can_emit_signal)
-        g_signal_emit (session, signals[SIG_SESSION_TERMINATED], 0);
+
+    /* processes which left the session's process group are still around in
+     * its cgroup, take them down before closing the session */
+    if (session->priv->cgroup &&
+        tlm_session_cgroup_watch_empty (session->priv->cgroup,
+                                        _on_session_cgroup_empty, session)) {
+        DBG ("session leader gone, killing the rest of the session");
+        tlm_session_cgroup_kill (session->priv->cgroup);
+        session->priv->last_sig = SIGKILL;
+        if (!session->priv->timer_id)
+            session->priv->timer_id = g_timeout_add (
+                    _get_cgroup_kill_timeout (session->priv),
+                    _terminate_timeout, session);
+        return;
+    }
+
+    _finish_session (session);
 }
 
-static gchar *
-_build_session_command (const gchar *template, const gchar *session_id)
+static void
+_emit_login_timeline (TlmSession *session)
 {
-    const char *pptr;
-    gchar *out;
-    GString *str;
-
-    pptr = template;
-    str = g_string_sized_new (strlen(template) + strlen(session_id));
-    while (*pptr != '\0') {
-        if (*pptr == '%') {
-            pptr++;
-            switch (*pptr) {
-                case 's':
-                    g_string_append (str, session_id);
-                    break;
-                default:
-                    ;
-            }
-        } else {
-            g_string_append_c (str, *pptr);
-        }
-        pptr++;
-    }
-    out = g_string_free (str, FALSE);
-    return out;
+    GVariant *timeline;
+
+    if (!session->priv->can_emit_signal)
+        return;
+
+    timeline = g_variant_ref_sink (tlm_login_timeline_to_variant (
+            &session->priv->timeline));
+    g_signal_emit (session, signals[SIG_LOGIN_TIMELINE], 0, timeline);
+    g_variant_unref (timeline);
+}
+
+static gboolean
+_on_exec_stamp_cb (
+        gint fd,
+        GIOCondition condition,
+        gpointer user_data)
+{
+    TlmSession *session = TLM_SESSION (user_data);
+    TlmSessionPrivate *priv = session->priv;
+    gint64 exec_time = 0;
+
+    /* nothing is written if the child died before exec */
+    if (read (fd, &exec_time, sizeof (exec_time)) == sizeof (exec_time))
+        priv->timeline.stamps[TLM_LOGIN_PHASE_EXEC] = exec_time;
+
+    close (fd);
+    priv->exec_fd = -1;
+    priv->exec_watch_id = 0;
+    _emit_login_timeline (session);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_setup_session_cgroup (TlmSessionPrivate *priv)
+{
+    const gchar *root;
+    gchar *name;
+
+    root = tlm_config_get_string (priv->config, TLM_CONFIG_GENERAL,
+                                  TLM_CONFIG_GENERAL_SESSION_CGROUP);
+    if (!root || priv->cgroup)
+        return;
+
+    /* one session per sessiond */
+    name = g_strdup_printf ("session-%d", getpid ());
+    priv->cgroup = tlm_session_cgroup_new (root, name);
+    g_free (name);
+    if (!priv->cgroup)
+        WARN ("session cgroup not available, using process group");
 }
 
 static void
 _exec_user_session (
-		TlmSession *session)
+		TlmSession *session,
+		TlmUserInfo *user_info)
 {
     int tty_fd = -1;
+    int exec_pipe[2] = { -1, -1 };
     gint i;
-    guint rtdir_perm = 0700;
-    const gchar *rtdir_perm_str;
+    guint rtdir_perm;
     const char *home;
     const char *shell = NULL;
     const char *env_shell = NULL;
@@ -571,32 +685,12 @@ _exec_user_session (
     TlmSessionPrivate *priv = session->priv;
 
     priv = session->priv;
-    if (!priv->username)
-        priv->username = g_strdup (tlm_auth_session_get_username (
-                priv->auth_session));
     DBG ("session ID : %s", priv->sessionid);
 
-    if (tlm_config_has_key (priv->config,
-                            priv->seat_id,
-                            TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR)) {
-        priv->setup_runtime_dir = tlm_config_get_boolean (priv->config,
-                                           priv->seat_id,
-                                           TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR,
-                                           FALSE);
-    } else {
-        priv->setup_runtime_dir = tlm_config_get_boolean (priv->config,
-                                           TLM_CONFIG_GENERAL,
-                                           TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR,
-                                           FALSE);
-    }
-    rtdir_perm_str = tlm_config_get_string (priv->config,
-                                            priv->seat_id,
-                                            TLM_CONFIG_GENERAL_RUNTIME_MODE);
-    if (!rtdir_perm_str)
-        rtdir_perm_str = tlm_config_get_string (priv->config,
-                                               TLM_CONFIG_GENERAL,
-                                               TLM_CONFIG_GENERAL_RUNTIME_MODE);
-    uid_str = g_strdup_printf ("%u", tlm_user_get_uid (priv->username));
+    priv->setup_runtime_dir = priv->seat_config->setup_runtime_dir;
+    rtdir_perm = priv->seat_config->runtime_mode;
+    priv->uid = user_info->uid;
+    uid_str = g_strdup_printf ("%u", priv->uid);
     priv->xdg_runtime_dir = g_build_filename ("/run/user",
                                               uid_str,
                                               NULL);
@@ -605,51 +699,57 @@ _exec_user_session (
         tlm_utils_delete_dir (priv->xdg_runtime_dir);
         if (g_mkdir_with_parents ("/run/user", 0755))
             WARN ("g_mkdir_with_parents(\"/run/user\") failed");
-        if (rtdir_perm_str)
-            sscanf(rtdir_perm_str, "%o", &rtdir_perm);
         DBG ("setting up XDG_RUNTIME_DIR=%s mode=%o",
              priv->xdg_runtime_dir, rtdir_perm);
         if (g_mkdir (priv->xdg_runtime_dir, rtdir_perm))
             WARN ("g_mkdir(\"%s\") failed", priv->xdg_runtime_dir);
-        if (chown (priv->xdg_runtime_dir,
-               tlm_user_get_uid (priv->username),
-               tlm_user_get_gid (priv->username)))
+        if (chown (priv->xdg_runtime_dir, priv->uid, user_info->gid))
             WARN ("chown(\"%s\"): %s", priv->xdg_runtime_dir, strerror(errno));
         if (chmod (priv->xdg_runtime_dir, rtdir_perm))
             WARN ("chmod(\"%s\"): %s", priv->xdg_runtime_dir, strerror(errno));
     } else {
         DBG ("not setting up XDG_RUNTIME_DIR");
     }
+    tlm_login_timeline_mark (&priv->timeline, TLM_LOGIN_PHASE_RUNTIME_DIR);
 
-    gboolean setup_terminal;
-    if (tlm_config_has_key (priv->config,
-                            priv->seat_id,
-                            TLM_CONFIG_GENERAL_SETUP_TERMINAL)) {
-        setup_terminal = tlm_config_get_boolean (priv->config,
-                                                 priv->seat_id,
-                                                 TLM_CONFIG_GENERAL_SETUP_TERMINAL,
-                                                 FALSE);
-    } else {
-        setup_terminal = tlm_config_get_boolean (priv->config,
-                                                 TLM_CONFIG_GENERAL,
-                                                 TLM_CONFIG_GENERAL_SETUP_TERMINAL,
-                                                 FALSE);
-    }
-    if (setup_terminal) {
+    if (priv->seat_config->setup_terminal) {
         tty_fd = _prepare_terminal (priv);
         if (tty_fd < 0) {
             WARN ("Failed to prepare terminal");
             return;
         }
+        tlm_login_timeline_mark (&priv->timeline, TLM_LOGIN_PHASE_TERMINAL);
+    }
+
+    _setup_session_cgroup (priv);
+
+    /* the child reports when it execs the session through a pipe closed on
+     * exec */
+    if (!g_unix_open_pipe (exec_pipe, FD_CLOEXEC, NULL)) {
+        WARN ("Failed to create exec pipe: %s", strerror (errno));
+        exec_pipe[0] = exec_pipe[1] = -1;
     }
 
     priv->child_pid = fork ();
     if (priv->child_pid) {
+        tlm_login_timeline_mark (&priv->timeline, TLM_LOGIN_PHASE_FORK);
+        TLM_TRACE1 (session__fork, priv->seat_id, priv->sessionid, priv->uid,
+                priv->child_pid);
         if (tty_fd >= 0)
             close (tty_fd);
+        if (exec_pipe[0] >= 0) {
+            close (exec_pipe[1]);
+            priv->exec_fd = exec_pipe[0];
+            priv->exec_watch_id = g_unix_fd_add (priv->exec_fd,
+                    G_IO_IN | G_IO_HUP | G_IO_ERR, _on_exec_stamp_cb,
+                    session);
+        } else {
+            _emit_login_timeline (session);
+        }
         DBG ("establish handler for the child pid %u", priv->child_pid);
-        session->priv->child_watch_id = g_child_watch_add (priv->child_pid,
-                    (GChildWatchFunc)_on_child_down_cb, session);
+        DBG ("user database lookups: %u", tlm_user_info_get_nss_calls ());
+        session->priv->child_watch = tlm_process_watch_new (priv->child_pid,
+                    _on_child_down_cb, session);
         session->priv->is_child_up = TRUE;
         return;
     }
@@ -657,20 +757,13 @@ _exec_user_session (
     /* ==================================
      * this is child process here onwards
      * ================================== */
-    gint open_max;
-    gint fd;
 
-    //close all open descriptors other than stdin, stdout, stderr
-    open_max = sysconf (_SC_OPEN_MAX);
-    for (fd = 3; fd < open_max; fd++) {
-        if (fcntl (fd, F_SETFD, FD_CLOEXEC) < -1) {
-            WARN ("Failed to close desriptor '%d', error: %s",
-                fd, strerror(errno));
-        }
-    }
+    if (priv->cgroup && !tlm_session_cgroup_attach_self (priv->cgroup))
+        WARN ("Failed to move session into %s: %s",
+              tlm_session_cgroup_get_path (priv->cgroup), strerror (errno));
 
-    uid_t target_uid = tlm_user_get_uid (priv->username);
-    gid_t target_gid = tlm_user_get_gid (priv->username);
+    //close all open descriptors other than stdin, stdout, stderr
+    tlm_spawn_set_cloexec_from (3);
 
     /*if (getppid() == 1) {
         if (setsid () == (pid_t) -1)
@@ -685,28 +778,34 @@ _exec_user_session (
         WARN ("setsid() failed: %s", strerror (errno));
     DBG ("new pgid=%u", getpgrp());
 
-    if (setup_terminal) {
+    if (priv->seat_config->setup_terminal) {
         /* usually terminal settings are handled by PAM */
         _setup_terminal (priv, tty_fd);
     }
 
-    if (initgroups (priv->username, target_gid))
-        WARN ("initgroups() failed: %s", strerror(errno));
-    if (setregid (target_gid, target_gid))
+    /* group list was resolved with the user, no need for initgroups() to
+     * scan the group database again */
+    if (setgroups (user_info->n_groups, user_info->groups))
+        WARN ("setgroups() failed: %s", strerror(errno));
+    if (setregid (user_info->gid, user_info->gid))
         WARN ("setregid() failed: %s", strerror(errno));
-    if (setreuid (target_uid, target_uid))
+    if (setreuid (user_info->uid, user_info->uid))
         WARN ("setreuid() failed: %s", strerror(errno));
 
+#   ifdef ENABLE_DEBUG
     int grouplist_len = NGROUPS_MAX;
     gid_t grouplist[NGROUPS_MAX];
     grouplist_len = getgroups (grouplist_len, grouplist);
     DBG ("group membership:");
-    for (i = 0; i < grouplist_len; i++)
-        DBG ("\t%s", getgrgid (grouplist[i])->gr_name);
+    for (i = 0; i < grouplist_len; i++) {
+        struct group *gr = getgrgid (grouplist[i]);
+        DBG ("\t%s", gr ? gr->gr_name : "(unknown)");
+    }
+#   endif
 
     DBG (" state:\n\truid=%d, euid=%d, rgid=%d, egid=%d (%s)",
          getuid(), geteuid(), getgid(), getegid(), priv->username);
-    _set_environment (priv);
+    _set_environment (priv, user_info);
     umask(0077);
 
     home = getenv("HOME");
@@ -716,16 +815,11 @@ _exec_user_session (
             WARN ("Failed to change directroy : %s", strerror (errno));
     } else WARN ("Could not get home directory");
 
-    shell = tlm_config_get_string (priv->config,
-                                   priv->seat_id,
-                                   TLM_CONFIG_GENERAL_SESSION_CMD);
-    if (!shell)
-        shell = tlm_config_get_string (priv->config,
-                                       TLM_CONFIG_GENERAL,
-                                       TLM_CONFIG_GENERAL_SESSION_CMD);
+    shell = priv->seat_config->session_cmd;
     if (shell) {
         /* add sessionid if needed */
-        gchar *cmd = _build_session_command (shell, priv->sessionid);
+        gchar *cmd = tlm_utils_build_session_command (shell,
+                priv->sessionid);
         args = tlm_utils_split_command_line (cmd);
         g_free (cmd);
     }
@@ -743,6 +837,18 @@ _exec_user_session (
         }
     }
 
+    /* only tlm-launcher maps the configuration image, any other session
+     * gets neither the descriptor nor the variable pointing to it */
+    const gchar *config_fd = getenv (TLM_CONFIG_IMAGE_FD_ENV);
+    if (config_fd) {
+        gchar *program = g_path_get_basename (args[0]);
+        if (g_strcmp0 (program, TLM_LAUNCHER_NAME) == 0)
+            fcntl (atoi (config_fd), F_SETFD, 0);
+        else
+            unsetenv (TLM_CONFIG_IMAGE_FD_ENV);
+        g_free (program);
+    }
+
     if (signal (SIGTERM, SIG_DFL) == SIG_ERR)
         WARN ("failed to reset SIGTERM: %s", strerror (errno));
     if (signal (SIGINT, SIG_DFL) == SIG_ERR)
@@ -768,6 +874,14 @@ _exec_user_session (
         DBG ("\targv[%d]: %s", i, *args_iter);
         args_iter++; i++;
     }
+    if (exec_pipe[1] >= 0) {
+        gint64 exec_time = g_get_monotonic_time ();
+        if (write (exec_pipe[1], &exec_time, sizeof (exec_time)) !=
+                sizeof (exec_time))
+            DBG ("failed to report exec time: %s", strerror (errno));
+    }
+    TLM_TRACE1 (session__exec, priv->seat_id, priv->sessionid, user_info->uid,
+            args[0]);
     execvp (args[0], args);
     /* we reach here only in case of error */
     g_strfreev (args);
@@ -783,10 +897,10 @@ tlm_session_new ()
 }
 
 gboolean
-tlm_session_start (TlmSession *session,
-                   const gchar *seat_id, const gchar *service,
-                   const gchar *username, const gchar *password,
-                   GHashTable *environment)
+tlm_session_authenticate (TlmSession *session,
+                          const gchar *seat_id, const gchar *service,
+                          const gchar *username, const gchar *password,
+                          GHashTable *environment)
 {
 	GError *error = NULL;
 	g_return_val_if_fail (session && TLM_IS_SESSION(session), FALSE);
@@ -803,18 +917,28 @@ tlm_session_start (TlmSession *session,
         return FALSE;
     }
 
+    if (priv->auth_session) {
+        error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_ALREADY_EXISTS,
+                "PAM session is already authenticated");
+        g_signal_emit (session, signals[SIG_SESSION_ERROR], 0, error);
+        g_error_free (error);
+        return FALSE;
+    }
+
+    tlm_login_timeline_reset (&priv->timeline);
     g_object_set (G_OBJECT (session), "seat", seat_id, "service", service,
             "username", username, "environment", environment, NULL);
 
-    priv->vtnr = tlm_config_get_uint (priv->config,
-                                      priv->seat_id,
-                                      TLM_CONFIG_SEAT_VTNR,
-                                      0);
+    tlm_seat_config_unref (priv->seat_config);
+    priv->seat_config = tlm_config_get_seat_config (priv->config,
+                                                    priv->seat_id);
+    priv->vtnr = priv->seat_config->vtnr;
     gchar *tty_name = priv->vtnr > 0 ?
         g_strdup_printf ("tty%u", priv->vtnr) : NULL;
     priv->auth_session = tlm_auth_session_new (priv->service, priv->username,
-            password, tty_name);
+            password, tty_name, priv->seat_id);
     g_free (tty_name);
+    tlm_login_timeline_mark (&priv->timeline, TLM_LOGIN_PHASE_PAM_START);
 
     if (!priv->auth_session) {
         error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_CREATION_FAILURE,
@@ -824,16 +948,8 @@ tlm_session_start (TlmSession *session,
         return FALSE;
     }
 
-    session_type = tlm_config_get_string (priv->config,
-                                          priv->seat_id,
-                                          TLM_CONFIG_GENERAL_SESSION_TYPE);
-    if (!session_type)
-        session_type = tlm_config_get_string (priv->config,
-                                              TLM_CONFIG_GENERAL,
-                                              TLM_CONFIG_GENERAL_SESSION_TYPE);
-    if (!tlm_config_has_key (priv->config,
-                             TLM_CONFIG_GENERAL,
-                             TLM_CONFIG_GENERAL_NSEATS))
+    session_type = priv->seat_config->session_type;
+    if (!priv->seat_config->has_nseats)
         tlm_auth_session_putenv (priv->auth_session,
                                  "XDG_SEAT",
                                  priv->seat_id);
@@ -869,7 +985,28 @@ tlm_session_start (TlmSession *session,
         g_error_free (error);
         return FALSE;
     }
+    tlm_login_timeline_mark (&priv->timeline,
+                             TLM_LOGIN_PHASE_PAM_AUTHENTICATE);
     g_signal_emit (session, signals[SIG_AUTHENTICATED], 0);
+    return TRUE;
+}
+
+gboolean
+tlm_session_open (TlmSession *session)
+{
+    GError *error = NULL;
+    TlmUserInfo *user_info = NULL;
+    g_return_val_if_fail (session && TLM_IS_SESSION(session), FALSE);
+    TlmSessionPrivate *priv = TLM_SESSION_PRIV(session);
+
+    if (!priv->auth_session || priv->sessionid) {
+        error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_CREATION_FAILURE,
+                "Unable to open PAM sesssion as it is not authenticated "
+                "or already opened");
+        g_signal_emit (session, signals[SIG_SESSION_ERROR], 0, error);
+        g_error_free (error);
+        return FALSE;
+    }
 
     if (!tlm_auth_session_open (priv->auth_session, &error)) {
         if (!error) {
@@ -880,50 +1017,91 @@ tlm_session_start (TlmSession *session,
         g_error_free (error);
         return FALSE;
     }
+    tlm_login_timeline_mark (&priv->timeline,
+                             TLM_LOGIN_PHASE_PAM_OPEN_SESSION);
     priv->sessionid = g_strdup (tlm_auth_session_get_sessionid (
             priv->auth_session));
-    tlm_utils_log_utmp_entry (priv->username);
 
-    priv->session_pause =  tlm_config_get_boolean (priv->config,
-                                             TLM_CONFIG_GENERAL,
-                                             TLM_CONFIG_GENERAL_PAUSE_SESSION,
-                                             FALSE);
+    priv->session_pause = priv->seat_config->pause_session;
     if (!priv->session_pause) {
-        _exec_user_session (session);
+        if (!priv->username)
+            priv->username = g_strdup (tlm_auth_session_get_username (
+                    priv->auth_session));
+        /* resolved here, the forked child must not go to NSS while another
+         * thread may hold a lock */
+        user_info = tlm_user_info_lookup (priv->username);
+        if (!user_info) {
+            error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_CREATION_FAILURE,
+                    "Unable to look up user '%s'", priv->username);
+            g_signal_emit (session, signals[SIG_SESSION_ERROR], 0, error);
+            g_error_free (error);
+            return FALSE;
+        }
+        _exec_user_session (session, user_info);
+        tlm_user_info_unref (user_info);
+        tlm_utils_log_utmp_entry (priv->username);
         g_signal_emit (session, signals[SIG_SESSION_CREATED], 0,
                        priv->sessionid ? priv->sessionid : "");
     } else {
+        tlm_utils_log_utmp_entry (priv->username);
         g_signal_emit (session, signals[SIG_SESSION_CREATED], 0,
                        priv->sessionid ? priv->sessionid : "");
+        _emit_login_timeline (session);
         pause ();
         exit (0);
     }
     return TRUE;
 }
 
+gboolean
+tlm_session_start (TlmSession *session,
+                   const gchar *seat_id, const gchar *service,
+                   const gchar *username, const gchar *password,
+                   GHashTable *environment)
+{
+    if (!tlm_session_authenticate (session, seat_id, service, username,
+                password, environment))
+        return FALSE;
+
+    return tlm_session_open (session);
+}
+
 static gboolean
 _terminate_timeout (gpointer user_data)
 {
     TlmSession *session = TLM_SESSION(user_data);
     TlmSessionPrivate *priv = TLM_SESSION_PRIV(session);
 
+    if (priv->cgroup && priv->last_sig != SIGKILL) {
+        DBG ("session didn't go down in time, killing its cgroup");
+        TLM_TRACE2 (session__signal, priv->seat_id, priv->sessionid, priv->uid,
+                priv->child_pid, SIGKILL);
+        tlm_session_cgroup_kill (priv->cgroup);
+        priv->last_sig = SIGKILL;
+        return G_SOURCE_CONTINUE;
+    }
+
     switch (priv->last_sig)
     {
         case SIGHUP:
             DBG ("child %u didn't respond to SIGHUP, sending SIGTERM",
                  priv->child_pid);
-            if (killpg (getpgid (priv->child_pid), SIGTERM))
+            TLM_TRACE2 (session__signal, priv->seat_id, priv->sessionid,
+                    priv->uid, priv->child_pid, SIGTERM);
+            if (!tlm_process_watch_signal_group (priv->child_watch, SIGTERM))
                 WARN ("killpg(%u, SIGTERM): %s",
-                      getpgid (priv->child_pid),
+                      priv->child_pid,
                       strerror(errno));
             priv->last_sig = SIGTERM;
             return G_SOURCE_CONTINUE;
         case SIGTERM:
             DBG ("child %u didn't respond to SIGTERM, sending SIGKILL",
                  priv->child_pid);
-            if (killpg (getpgid (priv->child_pid), SIGKILL))
+            TLM_TRACE2 (session__signal, priv->seat_id, priv->sessionid,
+                    priv->uid, priv->child_pid, SIGKILL);
+            if (!tlm_process_watch_signal_group (priv->child_watch, SIGKILL))
                 WARN ("killpg(%u, SIGKILL): %s",
-                      getpgid (priv->child_pid),
+                      priv->child_pid,
                       strerror(errno));
             priv->last_sig = SIGKILL;
             return G_SOURCE_CONTINUE;
@@ -931,6 +1109,8 @@ _terminate_timeout (gpointer user_data)
             DBG ("child %u didn't respond to SIGKILL, process is stuck in kernel",
                  priv->child_pid);
             priv->timer_id = 0;
+            /* give up on it */
+            priv->is_child_up = FALSE;
             _clear_session (session);
             if (session->priv->can_emit_signal) {
                 GError *error = TLM_GET_ERROR_FOR_ID (
@@ -957,6 +1137,11 @@ tlm_session_terminate (TlmSession *session)
 
     DBG ("Session Terminate");
 
+    if (!priv->is_child_up && priv->last_sig) {
+        DBG ("waiting for the rest of the session to go down");
+        return;
+    }
+
     if (!priv->is_child_up) {
         DBG ("no child process is running - closing pam session");
         _clear_session (session);
@@ -965,16 +1150,36 @@ tlm_session_terminate (TlmSession *session)
         return;
     }
 
-    if (killpg (getpgid (priv->child_pid), SIGHUP) < 0)
+    if (priv->last_sig) {
+        DBG ("session is already terminating");
+        return;
+    }
+
+    TLM_TRACE2 (session__signal, priv->seat_id, priv->sessionid, priv->uid,
+            priv->child_pid, SIGHUP);
+    if (!tlm_process_watch_signal_group (priv->child_watch, SIGHUP))
         WARN ("kill(%u, SIGHUP): %s",
-              getpgid (priv->child_pid),
+              priv->child_pid,
               strerror(errno));
     priv->last_sig = SIGHUP;
-    priv->timer_id = g_timeout_add_seconds (
-            tlm_config_get_uint (priv->config, TLM_CONFIG_GENERAL,
-                    TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT, 3),
-            _terminate_timeout,
-            session);
+    if (priv->cgroup)
+        priv->timer_id = g_timeout_add (_get_cgroup_kill_timeout (priv),
+                _terminate_timeout, session);
+    else
+        priv->timer_id = g_timeout_add_seconds (
+                tlm_config_get_uint (priv->config, TLM_CONFIG_GENERAL,
+                        TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT, 3),
+                _terminate_timeout,
+                session);
+}
+
+gboolean
+tlm_session_is_running (TlmSession *session)
+{
+    g_return_val_if_fail (session && TLM_IS_SESSION(session), FALSE);
+
+    /* a terminating session is running until it has been closed */
+    return session->priv->is_child_up || session->priv->last_sig != 0;
 }
 
 GVariant *
@@ -989,6 +1194,8 @@ tlm_session_get_info (TlmSession *session)
             g_variant_new_uint32 (tlm_user_get_uid (session->priv->username)));
     g_variant_builder_add (&builder, "{sv}", "sessionid",
             g_variant_new_string (session->priv->sessionid));
+    g_variant_builder_add (&builder, "{sv}", "timeline",
+            tlm_login_timeline_to_variant (&session->priv->timeline));
 
     info = g_variant_builder_end (&builder);
     return info;
@@ -69,9 +69,22 @@ tlm_session_start (TlmSession *session,
                    const gchar *seat_id, const gchar *service,
                    const gchar *username, const gchar *password,
                    GHashTable *environment);
+
+gboolean
+tlm_session_authenticate (TlmSession *session,
+                          const gchar *seat_id, const gchar *service,
+                          const gchar *username, const gchar *password,
+                          GHashTable *environment);
+
+gboolean
+tlm_session_open (TlmSession *session);
+
 void
 tlm_session_terminate (TlmSession *session);
 
+gboolean
+tlm_session_is_running (TlmSession *session);
+
 GVariant *
 tlm_session_get_info (TlmSession *session);
 
@@ -38,258 +38,571 @@
 #include "common/tlm-config-general.h"
 #include "common/tlm-config-seat.h"
 
-int main (int argc, char *argv[])
+/* one add/change/remove operation, from the command line or a batch line */
+typedef struct {
+    gchar *command;
+    gchar *session_cmd;
+    gchar *sname;
+    gchar *username;
+    gchar *session_type;
+    gchar *pam_defserv;
+    gchar *pam_serv;
+    gchar *watchx;
+    gchar *rtimemode;
+    int autologin;
+    int pause;
+    int setupterm;
+    int active;
+    int nwatch;
+    int vtnr;
+    int rtimedir;
+    guint line;
+} SeatConfOp;
+
+static SeatConfOp *
+_op_new (guint line)
 {
-    int retval = -1;
-    int lockfd;
-    int autologin = -1;
-    int pause = -1;
-    int setupterm = -1;
-    int active = -1;
-    int nwatch = -1;
-    int vtnr = -1;
-    int rtimedir = -1;
-    gint nseats;
-    gint seatx;
-    gchar *cf = NULL;
-    gchar *sname = NULL;
-    gchar *username = NULL;
-    gchar *session_type = NULL;
-    gchar *pam_defserv = NULL;
-    gchar *pam_serv = NULL;
-    gchar *watchx = NULL;
-    gchar *rtimemode = NULL;
-    GKeyFile *kf;
-    GError *error = NULL;
-    GOptionContext *opts;
-    GOptionEntry main_entries[] = {
-        { "config-file", 'c',
-          0, G_OPTION_ARG_FILENAME, &cf,
-          "configuration file name",
-          NULL },
+    SeatConfOp *op = g_new0 (SeatConfOp, 1);
+
+    op->autologin = op->pause = op->setupterm = op->active = -1;
+    op->nwatch = op->vtnr = op->rtimedir = -1;
+    op->line = line;
+    return op;
+}
+
+static void
+_op_free (SeatConfOp *op)
+{
+    g_free (op->command);
+    g_free (op->session_cmd);
+    g_free (op->sname);
+    g_free (op->username);
+    g_free (op->session_type);
+    g_free (op->pam_defserv);
+    g_free (op->pam_serv);
+    g_free (op->watchx);
+    g_free (op->rtimemode);
+    g_free (op);
+}
+
+static GOptionGroup *
+_op_option_group (SeatConfOp *op)
+{
+    GOptionGroup *group;
+    GOptionEntry entries[] = {
         { "seat", 's',
-          0, G_OPTION_ARG_STRING, &sname,
+          0, G_OPTION_ARG_STRING, &op->sname,
           "seat id",
           NULL },
         { "username", 'u',
-          0, G_OPTION_ARG_STRING, &username,
+          0, G_OPTION_ARG_STRING, &op->username,
           "default user name",
           NULL },
         { "autologin", 'a',
-          0, G_OPTION_ARG_INT, &autologin,
+          0, G_OPTION_ARG_INT, &op->autologin,
           "autologin enable/disable",
           NULL },
         { "pause", 'p',
-          0, G_OPTION_ARG_INT, &pause,
+          0, G_OPTION_ARG_INT, &op->pause,
           "pause session enable/disable",
           NULL },
         { "setupterm", 't',
-          0, G_OPTION_ARG_INT, &setupterm,
+          0, G_OPTION_ARG_INT, &op->setupterm,
           "setup terminal enable/disable",
           NULL },
         { "sessiontype", 'd',
-          0, G_OPTION_ARG_STRING, &session_type,
+          0, G_OPTION_ARG_STRING, &op->session_type,
           "session type: can be one of 'unspecified', 'tty', 'x11', 'wayland' \
           or 'mir'",
           NULL },
         { "active", 'e',
-          0, G_OPTION_ARG_INT, &active,
+          0, G_OPTION_ARG_INT, &op->active,
           "seat activation enable/disable",
           NULL },
         { "pamdefserv", 'f',
-          0, G_OPTION_ARG_STRING, &pam_defserv,
+          0, G_OPTION_ARG_STRING, &op->pam_defserv,
           "pam service file for default user",
           NULL },
         { "pamserv", 'g',
-          0, G_OPTION_ARG_STRING, &pam_serv,
+          0, G_OPTION_ARG_STRING, &op->pam_serv,
           "pam service",
           NULL },
         { "nwatch", 'h',
-          0, G_OPTION_ARG_INT, &nwatch,
+          0, G_OPTION_ARG_INT, &op->nwatch,
           "number of seat-ready watch items",
           NULL },
         { "watchx", 'i',
-          0, G_OPTION_ARG_STRING, &watchx,
+          0, G_OPTION_ARG_STRING, &op->watchx,
           "seat-ready watch item",
           NULL },
         { "vtnr", 'j',
-          0, G_OPTION_ARG_INT, &vtnr,
+          0, G_OPTION_ARG_INT, &op->vtnr,
           "virtual terminal number for seat",
           NULL },
         { "rtimedir", 'k',
-          0, G_OPTION_ARG_INT, &rtimedir,
+          0, G_OPTION_ARG_INT, &op->rtimedir,
           "setup XDG_RUNTIME_DIR for the user - enable/disable",
           NULL },
         { "rtimemode", 'm',
-          0, G_OPTION_ARG_STRING, &rtimemode,
+          0, G_OPTION_ARG_STRING, &op->rtimemode,
           "access mode for the XDG_RUNTIME_DIR",
           NULL },
         { NULL }
     };
 
-    opts = g_option_context_new ("<add|change|remove> [command]");
-    g_option_context_add_main_entries (opts, main_entries, NULL);
-    g_option_context_parse (opts, &argc, &argv, NULL);
-    g_option_context_free (opts);
+    group = g_option_group_new ("seat", "Seat options", "Seat options",
+                                NULL, NULL);
+    g_option_group_add_entries (group, entries);
+    return group;
+}
+
+/* takes the command and the session command from what the options left */
+static gboolean
+_op_set_args (SeatConfOp *op, int argc, char *argv[], GError **error)
+{
     if (argc < 2) {
-        printf ("%s [options] <add|change|remove> [command]\n", argv[0]);
-        return -1;
+        g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                             "no command given");
+        return FALSE;
     }
-    if (!cf)
-        cf = g_build_filename (TLM_SYSCONF_DIR, "tlm.conf", NULL);
-    lockfd = open (cf, O_RDWR);
-    if (lockfd < 0)
-        g_critical ("open(%s): %s", cf, strerror (errno));
-    if (lockf (lockfd, F_LOCK, 0))
-        g_critical ("lockf(): %s", strerror (errno));
-    kf = g_key_file_new ();
-    if (!g_key_file_load_from_file (kf, cf,
-                                    G_KEY_FILE_KEEP_COMMENTS, &error)) {
-        g_warning ("failed to load config file: %s", error->message);
-        goto err_exit;
+    op->command = g_strdup (argv[1]);
+    if (argc >= 3)
+        op->session_cmd = g_strdup (argv[2]);
+    return TRUE;
+}
+
+/* a batch line has the same syntax as the command line, without the
+ * program name */
+static SeatConfOp *
+_op_parse_line (const gchar *line, guint line_nr, GError **error)
+{
+    SeatConfOp *op = NULL;
+    GOptionContext *opts;
+    gchar **line_argv = NULL;
+    gchar **args = NULL;
+    gchar **argv = NULL;
+    gint line_argc = 0;
+    int argc;
+    gboolean ok;
+
+    if (!g_shell_parse_argv (line, &line_argc, &line_argv, error))
+        return NULL;
+
+    argc = line_argc + 1;
+    args = g_new0 (gchar *, argc + 1);
+    args[0] = g_strdup ("tlm-seatconf");
+    memcpy (args + 1, line_argv, line_argc * sizeof (gchar *));
+    g_free (line_argv);
+    /* parsing drops the options from argv, args keeps the strings */
+    argv = g_new0 (gchar *, argc + 1);
+    memcpy (argv, args, argc * sizeof (gchar *));
+
+    op = _op_new (line_nr);
+    opts = g_option_context_new (NULL);
+    g_option_context_set_help_enabled (opts, FALSE);
+    g_option_context_set_main_group (opts, _op_option_group (op));
+    ok = g_option_context_parse (opts, &argc, &argv, error) &&
+        _op_set_args (op, argc, argv, error);
+    g_option_context_free (opts);
+    g_free (argv);
+    g_strfreev (args);
+
+    if (!ok) {
+        _op_free (op);
+        return NULL;
     }
-    nseats = g_key_file_get_integer (kf,
-                                     TLM_CONFIG_GENERAL,
-                                     TLM_CONFIG_GENERAL_NSEATS,
-                                     NULL);
+    return op;
+}
 
-    if (g_strcmp0 (argv[1], "add") == 0) {
-        seatx = nseats;
-        nseats++;
-        sname = g_strdup_printf ("seat%d", seatx);
-        puts (sname);
+static gboolean
+_read_batch (const gchar *batch, GPtrArray *ops)
+{
+    GIOChannel *channel;
+    GError *error = NULL;
+    gchar *line = NULL;
+    guint line_nr = 0;
+    gboolean ok = TRUE;
+
+    if (g_strcmp0 (batch, "-") == 0)
+        channel = g_io_channel_unix_new (STDIN_FILENO);
+    else
+        channel = g_io_channel_new_file (batch, "r", &error);
+    if (!channel) {
+        g_warning ("failed to open batch file: %s", error->message);
+        g_error_free (error);
+        return FALSE;
     }
-    else if (g_strcmp0 (argv[1], "change") == 0) {
-        if (!sname) {
-            g_warning ("no seat specified");
-            goto err_exit;
+
+    while (g_io_channel_read_line (channel, &line, NULL, NULL, &error) ==
+           G_IO_STATUS_NORMAL) {
+        SeatConfOp *op;
+
+        line_nr++;
+        g_strstrip (line);
+        if (line[0] == '\0' || line[0] == '#') {
+            g_free (line);
+            continue;
         }
-        if (!g_key_file_has_group (kf, sname)) {
-            g_warning ("given seat doesn't exist");
-            goto err_exit;
+
+        op = _op_parse_line (line, line_nr, &error);
+        if (op) {
+            g_ptr_array_add (ops, op);
+        } else {
+            printf ("%u: failed: %s\n", line_nr, error->message);
+            g_clear_error (&error);
+            ok = FALSE;
         }
+        g_free (line);
+    }
+    if (error) {
+        g_warning ("failed to read batch file: %s", error->message);
+        g_error_free (error);
+        ok = FALSE;
+    }
+
+    g_io_channel_unref (channel);
+    return ok;
+}
+
+static gboolean
+_op_apply (SeatConfOp *op, GKeyFile *kf, gint *nseats, GError **error)
+{
+    if (g_strcmp0 (op->command, "add") == 0) {
+        g_free (op->sname);
+        op->sname = g_strdup_printf ("seat%d", *nseats);
+        (*nseats)++;
     }
-    else if (g_strcmp0 (argv[1], "remove") == 0) {
-        if (!sname) {
-            g_warning ("no seat specified");
-            goto err_exit;
+    else if (g_strcmp0 (op->command, "change") == 0 ||
+             g_strcmp0 (op->command, "remove") == 0) {
+        if (!op->sname) {
+            g_set_error_literal (error, G_OPTION_ERROR,
+                                 G_OPTION_ERROR_BAD_VALUE,
+                                 "no seat specified");
+            return FALSE;
         }
-        if (!g_key_file_has_group (kf, sname)) {
-            g_warning ("given seat doesn't exist");
-            goto err_exit;
+        if (!g_key_file_has_group (kf, op->sname)) {
+            g_set_error (error, G_KEY_FILE_ERROR,
+                         G_KEY_FILE_ERROR_GROUP_NOT_FOUND,
+                         "given seat doesn't exist: %s", op->sname);
+            return FALSE;
+        }
+        if (g_strcmp0 (op->command, "remove") == 0) {
+            g_key_file_remove_key (kf,
+                                   op->sname,
+                                   TLM_CONFIG_GENERAL_SESSION_CMD,
+                                   NULL);
+            op->autologin = 0;
+            op->pause = 1;
         }
-        g_key_file_remove_key (kf,
-                               sname,
-                               TLM_CONFIG_GENERAL_SESSION_CMD,
-                               NULL);
-        autologin = 0;
-        pause = 1;
+    }
+    else {
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                     "unknown command: %s", op->command);
+        return FALSE;
     }
 
-    if (argc >= 3) {
+    if (op->session_cmd) {
         g_key_file_set_string (kf,
-                               sname,
+                               op->sname,
                                TLM_CONFIG_GENERAL_SESSION_CMD,
-                               argv[2]);
+                               op->session_cmd);
     }
-    if (username) {
+    if (op->username) {
         g_key_file_set_string (kf,
-                               sname,
+                               op->sname,
                                TLM_CONFIG_GENERAL_DEFAULT_USER,
-                               username);
+                               op->username);
     }
-    if (autologin >= 0) {
+    if (op->autologin >= 0) {
         g_key_file_set_integer (kf,
-                                sname,
+                                op->sname,
                                 TLM_CONFIG_GENERAL_AUTO_LOGIN,
-                                autologin);
+                                op->autologin);
     }
-    if (pause >= 0) {
+    if (op->pause >= 0) {
         g_key_file_set_integer (kf,
-                                sname,
+                                op->sname,
                                 TLM_CONFIG_GENERAL_PAUSE_SESSION,
-                                pause);
+                                op->pause);
     }
-    if (setupterm >= 0) {
+    if (op->setupterm >= 0) {
         g_key_file_set_integer (kf,
-                                sname,
+                                op->sname,
                                 TLM_CONFIG_GENERAL_SETUP_TERMINAL,
-                                setupterm);
+                                op->setupterm);
     }
-    if (pam_serv) {
+    if (op->pam_serv) {
         g_key_file_set_string (kf,
-                               sname,
+                               op->sname,
                                TLM_CONFIG_GENERAL_PAM_SERVICE,
-                               pam_serv);
+                               op->pam_serv);
     }
-    if (pam_defserv) {
+    if (op->pam_defserv) {
         g_key_file_set_string (kf,
-                               sname,
+                               op->sname,
                                TLM_CONFIG_GENERAL_DEFAULT_PAM_SERVICE,
-                               pam_defserv);
+                               op->pam_defserv);
     }
-    if (active >= 0) {
+    if (op->active >= 0) {
         g_key_file_set_integer (kf,
-                                sname,
+                                op->sname,
                                 TLM_CONFIG_SEAT_ACTIVE,
-                                active);
+                                op->active);
     }
-    if (session_type) {
+    if (op->session_type) {
         g_key_file_set_string (kf,
-                               sname,
+                               op->sname,
                                TLM_CONFIG_GENERAL_SESSION_TYPE,
-                               session_type);
+                               op->session_type);
     }
-    if (nwatch >= 0) {
+    if (op->nwatch >= 0) {
         g_key_file_set_integer (kf,
-                                sname,
+                                op->sname,
                                 TLM_CONFIG_SEAT_NWATCH,
-                                nwatch);
+                                op->nwatch);
     }
-    if (watchx) {
+    if (op->watchx) {
         g_key_file_set_string (kf,
-                               sname,
+                               op->sname,
                                TLM_CONFIG_SEAT_WATCHX,
-                               watchx);
+                               op->watchx);
     }
-    if (vtnr >= 0) {
+    if (op->vtnr >= 0) {
         g_key_file_set_integer (kf,
-                                sname,
+                                op->sname,
                                 TLM_CONFIG_SEAT_VTNR,
-                                vtnr);
+                                op->vtnr);
     }
-    if (rtimedir >= 0) {
+    if (op->rtimedir >= 0) {
         g_key_file_set_integer (kf,
-                                sname,
+                                op->sname,
                                 TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR,
-                                rtimedir);
+                                op->rtimedir);
     }
-    if (rtimemode) {
+    if (op->rtimemode) {
         g_key_file_set_string (kf,
-                               sname,
+                               op->sname,
                                TLM_CONFIG_GENERAL_RUNTIME_MODE,
-                               rtimemode);
+                               op->rtimemode);
     }
+
+    return TRUE;
+}
+
+static int
+_lock_config (const gchar *cf)
+{
+    struct stat fd_stat, path_stat;
+    int lockfd;
+
+    for (;;) {
+        lockfd = open (cf, O_RDWR | O_CLOEXEC);
+        if (lockfd < 0) {
+            g_warning ("open(%s): %s", cf, strerror (errno));
+            return -1;
+        }
+        if (lockf (lockfd, F_LOCK, 0)) {
+            g_warning ("lockf(): %s", strerror (errno));
+            close (lockfd);
+            return -1;
+        }
+        /* the previous holder may have replaced the file while we waited */
+        if (fstat (lockfd, &fd_stat) == 0 && stat (cf, &path_stat) == 0 &&
+            fd_stat.st_dev == path_stat.st_dev &&
+            fd_stat.st_ino == path_stat.st_ino)
+            return lockfd;
+        close (lockfd);
+    }
+}
+
+/* writes a temporary file next to the original and renames it over, so
+ * readers never see a partially written configuration */
+static gboolean
+_save_config (GKeyFile *kf, const gchar *cf, int lockfd, GError **error)
+{
+    struct stat st;
+    gchar *data = NULL;
+    gchar *tmp_path = NULL;
+    gsize len = 0, written = 0;
+    int tmpfd = -1;
+    int saved_errno;
+
+    data = g_key_file_to_data (kf, &len, error);
+    if (!data)
+        return FALSE;
+    if (fstat (lockfd, &st))
+        goto io_error;
+
+    tmp_path = g_strdup_printf ("%s.XXXXXX", cf);
+    tmpfd = g_mkstemp_full (tmp_path, O_WRONLY | O_CLOEXEC, st.st_mode & 0777);
+    if (tmpfd < 0)
+        goto io_error;
+    if (fchown (tmpfd, st.st_uid, st.st_gid)) {}
+    if (fchmod (tmpfd, st.st_mode & 07777))
+        goto io_error;
+
+    while (written < len) {
+        ssize_t ret = write (tmpfd, data + written, len - written);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            goto io_error;
+        }
+        written += ret;
+    }
+    if (fsync (tmpfd) || close (tmpfd)) {
+        tmpfd = -1;
+        goto io_error;
+    }
+    tmpfd = -1;
+    if (rename (tmp_path, cf))
+        goto io_error;
+
+    g_free (tmp_path);
+    g_free (data);
+    return TRUE;
+
+io_error:
+    saved_errno = errno;
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                 "%s", strerror (saved_errno));
+    if (tmpfd >= 0)
+        close (tmpfd);
+    if (tmp_path)
+        unlink (tmp_path);
+    g_free (tmp_path);
+    g_free (data);
+    return FALSE;
+}
+
+int main (int argc, char *argv[])
+{
+    int retval = -1;
+    int lockfd = -1;
+    gint nseats;
+    guint i;
+    gboolean ok;
+    gchar *cf = NULL;
+    gchar *batch = NULL;
+    GPtrArray *ops;
+    SeatConfOp *cmdline_op;
+    GKeyFile *kf = NULL;
+    GString *results = NULL;
+    GError *error = NULL;
+    GOptionContext *opts;
+    GOptionEntry main_entries[] = {
+        { "config-file", 'c',
+          0, G_OPTION_ARG_FILENAME, &cf,
+          "configuration file name",
+          NULL },
+        { "batch", 'b',
+          0, G_OPTION_ARG_FILENAME, &batch,
+          "read operations from file, one per line, '-' for stdin",
+          NULL },
+        { NULL }
+    };
+
+    ops = g_ptr_array_new_with_free_func ((GDestroyNotify) _op_free);
+    cmdline_op = _op_new (0);
+
+    opts = g_option_context_new ("<add|change|remove> [command]");
+    g_option_context_set_summary (opts,
+            "With --batch, each line of the file holds the seat options, "
+            "the command and\nthe session command of one operation. All "
+            "operations are applied together,\nor none of them if any "
+            "fails. Results are printed once the configuration is saved.");
+    g_option_context_set_main_group (opts, _op_option_group (cmdline_op));
+    g_option_context_add_main_entries (opts, main_entries, NULL);
+    ok = g_option_context_parse (opts, &argc, &argv, &error);
+    g_option_context_free (opts);
+    if (!ok) {
+        g_warning ("%s", error->message);
+        g_error_free (error);
+        _op_free (cmdline_op);
+        goto out;
+    }
+
+    if (batch) {
+        _op_free (cmdline_op);
+        if (!_read_batch (batch, ops))
+            goto out;
+    } else {
+        if (!_op_set_args (cmdline_op, argc, argv, NULL)) {
+            printf ("%s [options] <add|change|remove> [command]\n", argv[0]);
+            _op_free (cmdline_op);
+            goto out;
+        }
+        g_ptr_array_add (ops, cmdline_op);
+    }
+
+    if (!cf)
+        cf = g_build_filename (TLM_SYSCONF_DIR, "tlm.conf", NULL);
+    lockfd = _lock_config (cf);
+    if (lockfd < 0)
+        goto out;
+
+    kf = g_key_file_new ();
+    if (!g_key_file_load_from_file (kf, cf,
+                                    G_KEY_FILE_KEEP_COMMENTS, &error)) {
+        g_warning ("failed to load config file: %s", error->message);
+        g_error_free (error);
+        goto unlock;
+    }
+    nseats = g_key_file_get_integer (kf,
+                                     TLM_CONFIG_GENERAL,
+                                     TLM_CONFIG_GENERAL_NSEATS,
+                                     NULL);
+
+    /* results are only reported once the configuration is on disk */
+    results = g_string_new (NULL);
+    ok = TRUE;
+    for (i = 0; i < ops->len; i++) {
+        SeatConfOp *op = g_ptr_array_index (ops, i);
+
+        if (!_op_apply (op, kf, &nseats, &error)) {
+            if (batch)
+                printf ("%u: failed: %s\n", op->line, error->message);
+            else
+                g_warning ("%s", error->message);
+            g_clear_error (&error);
+            ok = FALSE;
+            continue;
+        }
+        if (batch)
+            g_string_append_printf (results, "%u: ok %s\n",
+                                    op->line, op->sname);
+        else if (g_strcmp0 (op->command, "add") == 0)
+            g_string_append_printf (results, "%s\n", op->sname);
+    }
+    if (!ok) {
+        if (batch)
+            g_warning ("some operations failed, configuration not saved");
+        goto unlock;
+    }
+
     g_key_file_set_integer (kf,
                             TLM_CONFIG_GENERAL,
                             TLM_CONFIG_GENERAL_NSEATS,
                             nseats);
-    if (!g_key_file_save_to_file (kf, cf, &error))
+    if (!_save_config (kf, cf, lockfd, &error)) {
         g_warning ("failed to save config file: %s", error->message);
+        g_error_free (error);
+        goto unlock;
+    }
+    fputs (results->str, stdout);
     retval = 0;
 
-err_exit:
-    g_free (sname);
-    g_free (cf);
-    g_free (session_type);
-    g_free (pam_defserv);
-    g_free (pam_serv);
-    g_free (watchx);
-    g_free (rtimemode);
-    g_key_file_free (kf);
+unlock:
     if (!lockf (lockfd, F_ULOCK, 0)) {}
     close (lockfd);
 
+out:
+    g_free (cf);
+    g_free (batch);
+    g_ptr_array_unref (ops);
+    if (kf)
+        g_key_file_free (kf);
+    if (results)
+        g_string_free (results, TRUE);
+
     return retval;
 }
-
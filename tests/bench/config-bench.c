@@ -0,0 +1,189 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Compares reading the per-login configuration values through the string
+ * based TlmConfig getters, with the seat group to General fallback the
+ * daemons used to do, against getting a compiled TlmSeatConfig snapshot and
+ * reading its fields, and against building a fresh snapshot. */
+
+#include <stdio.h>
+#include <glib.h>
+
+#include "common/tlm-config.h"
+#include "common/tlm-config-general.h"
+#include "common/tlm-config-seat.h"
+#include "common/tlm-seat-config.h"
+
+#define SEAT_ID "seat0"
+
+static gint iterations = 100000;
+static volatile guint sink;
+
+static GOptionEntry entries[] = {
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+      "Lookups per method (default 100000)", "N" },
+    { NULL }
+};
+
+typedef void (*LookupFunc) (TlmConfig *config);
+
+static gboolean
+_get_boolean (TlmConfig *config, const gchar *key, gboolean retval)
+{
+    const gchar *group = tlm_config_has_key (config, SEAT_ID, key) ?
+        SEAT_ID : TLM_CONFIG_GENERAL;
+    return tlm_config_get_boolean (config, group, key, retval);
+}
+
+static const gchar *
+_get_string (TlmConfig *config, const gchar *key)
+{
+    const gchar *value = tlm_config_get_string (config, SEAT_ID, key);
+    if (!value)
+        value = tlm_config_get_string (config, TLM_CONFIG_GENERAL, key);
+    return value;
+}
+
+/* the values one login used to look up */
+static void
+_lookup_strings (TlmConfig *config)
+{
+    guint mode = 0700;
+    const gchar *str;
+
+    sink += _get_boolean (config, TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR, FALSE);
+    str = _get_string (config, TLM_CONFIG_GENERAL_RUNTIME_MODE);
+    if (str)
+        sscanf (str, "%o", &mode);
+    sink += mode;
+    sink += _get_boolean (config, TLM_CONFIG_GENERAL_SETUP_TERMINAL, FALSE);
+    sink += GPOINTER_TO_UINT (_get_string (config,
+                TLM_CONFIG_GENERAL_SESSION_CMD));
+    sink += GPOINTER_TO_UINT (_get_string (config,
+                TLM_CONFIG_GENERAL_SESSION_TYPE));
+    sink += GPOINTER_TO_UINT (_get_string (config,
+                TLM_CONFIG_GENERAL_PAM_SERVICE));
+    sink += tlm_config_get_uint (config, SEAT_ID, TLM_CONFIG_SEAT_VTNR, 0);
+    sink += tlm_config_has_key (config, TLM_CONFIG_GENERAL,
+                                TLM_CONFIG_GENERAL_NSEATS);
+    sink += GPOINTER_TO_UINT (tlm_config_get_string (config,
+                TLM_CONFIG_GENERAL, TLM_CONFIG_GENERAL_SESSION_PATH));
+    sink += GPOINTER_TO_UINT (tlm_config_get_string (config,
+                TLM_CONFIG_GENERAL, TLM_CONFIG_GENERAL_DATA_DIRS));
+    sink += tlm_config_get_boolean (config, TLM_CONFIG_GENERAL,
+                                    TLM_CONFIG_GENERAL_PAUSE_SESSION, FALSE);
+}
+
+static void
+_read_fields (TlmSeatConfig *seat_config)
+{
+    sink += seat_config->setup_runtime_dir;
+    sink += seat_config->runtime_mode;
+    sink += seat_config->setup_terminal;
+    sink += GPOINTER_TO_UINT (seat_config->session_cmd);
+    sink += GPOINTER_TO_UINT (seat_config->session_type);
+    sink += GPOINTER_TO_UINT (seat_config->pam_service);
+    sink += seat_config->vtnr;
+    sink += seat_config->has_nseats;
+    sink += GPOINTER_TO_UINT (seat_config->session_path);
+    sink += GPOINTER_TO_UINT (seat_config->data_dirs);
+    sink += seat_config->pause_session;
+}
+
+static void
+_lookup_snapshot (TlmConfig *config)
+{
+    TlmSeatConfig *seat_config = tlm_config_get_seat_config (config, SEAT_ID);
+
+    _read_fields (seat_config);
+    tlm_seat_config_unref (seat_config);
+}
+
+static void
+_compile_snapshot (TlmConfig *config)
+{
+    TlmSeatConfig *seat_config = tlm_seat_config_new (config, SEAT_ID);
+
+    _read_fields (seat_config);
+    tlm_seat_config_unref (seat_config);
+}
+
+static void
+_run (const gchar *name, LookupFunc func, TlmConfig *config)
+{
+    gint64 start;
+    gint i;
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < iterations; i++)
+        func (config);
+
+    printf ("%-28s %8.1f ns per login\n", name,
+            (g_get_monotonic_time () - start) * 1000.0 / iterations);
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    TlmConfig *config;
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+
+    context = g_option_context_new ("- tlm configuration lookup benchmark");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        fprintf (stderr, "%s\n", error->message);
+        g_error_free (error);
+        g_option_context_free (context);
+        return 1;
+    }
+    g_option_context_free (context);
+
+    if (iterations <= 0)
+        iterations = 1;
+
+    config = tlm_config_new ();
+    tlm_config_set_boolean (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SETUP_TERMINAL, FALSE);
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SESSION_CMD, "weston --log=/tmp/weston.log");
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SESSION_TYPE, "wayland");
+    tlm_config_set_boolean (config, SEAT_ID,
+            TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR, TRUE);
+    tlm_config_set_string (config, SEAT_ID,
+            TLM_CONFIG_GENERAL_RUNTIME_MODE, "0700");
+    tlm_config_set_uint (config, SEAT_ID, TLM_CONFIG_SEAT_VTNR, 1);
+
+    printf ("%d iterations\n", iterations);
+    _run ("string lookups", _lookup_strings, config);
+    _run ("cached TlmSeatConfig", _lookup_snapshot, config);
+    _run ("compiled TlmSeatConfig", _compile_snapshot, config);
+
+    g_object_unref (config);
+    return 0;
+}
@@ -0,0 +1,412 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Microbenchmarks of the helpers every login goes through. Each one runs
+ * --repeats times; the median and the fastest run are reported in ns per
+ * call together with the heap allocations per call, as JSON for tracking
+ * over time.
+ *
+ * Allocations are counted by wrapping the glibc malloc entry points, run
+ * with G_SLICE=always-malloc on GLib versions that still have a slice
+ * allocator so GSlice allocations are counted too. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "common/tlm-config.h"
+#include "common/tlm-config-general.h"
+#include "common/tlm-config-seat.h"
+#include "common/tlm-utils.h"
+#include "common/dbus/tlm-dbus-utils.h"
+
+#define SEAT_ID "seat1"
+
+static gint iterations = 100000;
+static gint repeats = 5;
+static gchar *filter = NULL;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+      "Calls per run (default 100000)", "N" },
+    { "repeats", 'r', 0, G_OPTION_ARG_INT, &repeats,
+      "Runs per benchmark (default 5)", "N" },
+    { "filter", 'p', 0, G_OPTION_ARG_STRING, &filter,
+      "Only run benchmarks whose name contains this", "TEXT" },
+    { "output", 'f', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the results to a file instead of stdout", "PATH" },
+    { NULL }
+};
+
+/* allocation counting */
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static gboolean counting = FALSE;
+static guint64 allocations = 0;
+
+void *
+malloc (size_t size)
+{
+    if (counting)
+        allocations++;
+    return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+    if (counting)
+        allocations++;
+    return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+    if (counting)
+        allocations++;
+    return __libc_realloc (ptr, size);
+}
+
+/* timing, benchmarks stop the timer around their per call setup */
+
+typedef struct {
+    gint64 elapsed;
+    gint64 started;
+    guint64 allocations;
+    guint64 allocations_started;
+} MicroTimer;
+
+static void
+_timer_start (MicroTimer *timer)
+{
+    timer->allocations_started = allocations;
+    counting = TRUE;
+    timer->started = g_get_monotonic_time ();
+}
+
+static void
+_timer_stop (MicroTimer *timer)
+{
+    timer->elapsed += g_get_monotonic_time () - timer->started;
+    counting = FALSE;
+    timer->allocations += allocations - timer->allocations_started;
+}
+
+typedef struct {
+    const gchar *name;
+    void (*run) (MicroTimer *timer, gint n);
+    gint divisor; /* for benchmarks much slower than a lookup */
+} MicroBench;
+
+static TlmConfig *config = NULL;
+static GHashTable *environment = NULL;
+static GVariant *environment_variant = NULL;
+static gchar *tree_root = NULL;
+static volatile guintptr sink;
+
+static void
+_bench_config_fallback (MicroTimer *timer, gint n)
+{
+    gint i;
+
+    _timer_start (timer);
+    for (i = 0; i < n; i++) {
+        const gchar *group = tlm_config_has_key (config, SEAT_ID,
+                TLM_CONFIG_GENERAL_SESSION_CMD) ? SEAT_ID : TLM_CONFIG_GENERAL;
+        sink += GPOINTER_TO_SIZE (tlm_config_get_string (config, group,
+                    TLM_CONFIG_GENERAL_SESSION_CMD));
+        sink += tlm_config_get_boolean (config, TLM_CONFIG_GENERAL,
+                TLM_CONFIG_GENERAL_SETUP_TERMINAL, FALSE);
+        sink += tlm_config_get_uint (config, SEAT_ID, TLM_CONFIG_SEAT_VTNR, 0);
+    }
+    _timer_stop (timer);
+}
+
+static void
+_bench_split_command_line (MicroTimer *timer, gint n)
+{
+    gint i;
+
+    _timer_start (timer);
+    for (i = 0; i < n; i++) {
+        gchar **argv = tlm_utils_split_command_line (
+                "weston --log='/tmp/weston log' --idle-time=0 \"--x=a b\"");
+        sink += GPOINTER_TO_SIZE (argv);
+        g_strfreev (argv);
+    }
+    _timer_stop (timer);
+}
+
+static void
+_bench_build_session_command (MicroTimer *timer, gint n)
+{
+    gint i;
+
+    _timer_start (timer);
+    for (i = 0; i < n; i++) {
+        gchar *cmd = tlm_utils_build_session_command (
+                "weston --log=/tmp/weston-%s.log", "c4");
+        sink += GPOINTER_TO_SIZE (cmd);
+        g_free (cmd);
+    }
+    _timer_stop (timer);
+}
+
+static void
+_bench_build_user_name (MicroTimer *timer, gint n)
+{
+    gint i;
+
+    _timer_start (timer);
+    for (i = 0; i < n; i++) {
+        gchar *name = tlm_utils_build_user_name ("guest%S-%I", SEAT_ID);
+        sink += GPOINTER_TO_SIZE (name);
+        g_free (name);
+    }
+    _timer_stop (timer);
+}
+
+static void
+_bench_hash_table_to_variant (MicroTimer *timer, gint n)
+{
+    gint i;
+
+    _timer_start (timer);
+    for (i = 0; i < n; i++) {
+        GVariant *variant = g_variant_ref_sink (
+                tlm_dbus_utils_hash_table_to_variant (environment));
+        sink += GPOINTER_TO_SIZE (variant);
+        g_variant_unref (variant);
+    }
+    _timer_stop (timer);
+}
+
+static void
+_bench_hash_table_from_variant (MicroTimer *timer, gint n)
+{
+    gint i;
+
+    _timer_start (timer);
+    for (i = 0; i < n; i++) {
+        GHashTable *table = tlm_dbus_utils_hash_table_from_variant (
+                environment_variant);
+        sink += g_hash_table_size (table);
+        g_hash_table_unref (table);
+    }
+    _timer_stop (timer);
+}
+
+static void
+_bench_create_request (MicroTimer *timer, gint n)
+{
+    gint i;
+
+    _timer_start (timer);
+    for (i = 0; i < n; i++) {
+        TlmDbusRequest *request = tlm_dbus_utils_create_request (NULL, NULL,
+                TLM_DBUS_REQUEST_TYPE_LOGIN_USER, SEAT_ID, "user", "secret",
+                NULL, environment_variant);
+        sink += GPOINTER_TO_SIZE (request);
+        tlm_dbus_utils_dispose_request (request);
+    }
+    _timer_stop (timer);
+}
+
+/* a home directory like tree: 4 levels of 4 directories with 4 files */
+static void
+_make_tree (const gchar *path, guint depth)
+{
+    guint i;
+
+    g_mkdir (path, 0700);
+    for (i = 0; i < 4; i++) {
+        gchar *child = g_strdup_printf ("%s/f%u", path, i);
+
+        g_file_set_contents (child, "x", 1, NULL);
+        g_free (child);
+        if (depth) {
+            child = g_strdup_printf ("%s/d%u", path, i);
+            _make_tree (child, depth - 1);
+            g_free (child);
+        }
+    }
+}
+
+static void
+_bench_delete_dir (MicroTimer *timer, gint n)
+{
+    gint i;
+
+    for (i = 0; i < n; i++) {
+        _make_tree (tree_root, 3);
+        _timer_start (timer);
+        sink += tlm_utils_delete_dir (tree_root);
+        _timer_stop (timer);
+    }
+}
+
+static const MicroBench benchmarks[] = {
+    { "config_get_fallback", _bench_config_fallback, 1 },
+    { "split_command_line", _bench_split_command_line, 1 },
+    { "build_session_command", _bench_build_session_command, 1 },
+    { "build_user_name", _bench_build_user_name, 1 },
+    { "hash_table_to_variant", _bench_hash_table_to_variant, 1 },
+    { "hash_table_from_variant", _bench_hash_table_from_variant, 1 },
+    { "create_request", _bench_create_request, 1 },
+    { "delete_dir", _bench_delete_dir, 1000 },
+};
+
+static gint
+_compare_double (gconstpointer a, gconstpointer b)
+{
+    gdouble da = *(const gdouble *) a;
+    gdouble db = *(const gdouble *) b;
+
+    return da < db ? -1 : da > db;
+}
+
+static void
+_setup (void)
+{
+    gchar *key;
+    guint i;
+
+    config = tlm_config_new ();
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SESSION_CMD, "weston");
+    tlm_config_set_boolean (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SETUP_TERMINAL, FALSE);
+    tlm_config_set_uint (config, SEAT_ID, TLM_CONFIG_SEAT_VTNR, 2);
+
+    /* about what pam_env and a display manager put in a login */
+    environment = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         g_free);
+    for (i = 0; i < 16; i++) {
+        key = g_strdup_printf ("VARIABLE_%u", i);
+        g_hash_table_insert (environment, key,
+                g_strdup_printf ("/usr/local/share/value/%u", i));
+    }
+    environment_variant = g_variant_ref_sink (
+            tlm_dbus_utils_hash_table_to_variant (environment));
+
+    tree_root = g_build_filename (g_get_tmp_dir (), "tlm-microbench-XXXXXX",
+                                  NULL);
+    if (!g_mkdtemp (tree_root))
+        fprintf (stderr, "mkdtemp: %s\n", g_strerror (errno));
+    g_rmdir (tree_root);
+}
+
+static void
+_teardown (void)
+{
+    tlm_utils_delete_dir (tree_root);
+    g_free (tree_root);
+    g_variant_unref (environment_variant);
+    g_hash_table_unref (environment);
+    g_object_unref (config);
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    FILE *out = stdout;
+    gdouble *ns_per_op;
+    gboolean first = TRUE;
+    guint b;
+    gint r;
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+
+    context = g_option_context_new ("- tlm helper microbenchmarks");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        fprintf (stderr, "%s\n", error->message);
+        g_error_free (error);
+        g_option_context_free (context);
+        return 1;
+    }
+    g_option_context_free (context);
+
+    if (iterations <= 0)
+        iterations = 1;
+    if (repeats <= 0)
+        repeats = 1;
+    if (output && !(out = fopen (output, "w"))) {
+        fprintf (stderr, "cannot open %s: %s\n", output, g_strerror (errno));
+        return 1;
+    }
+
+    _setup ();
+    ns_per_op = g_new (gdouble, repeats);
+
+    fprintf (out, "{\n  \"iterations\": %d,\n  \"repeats\": %d,\n"
+             "  \"benchmarks\": [", iterations, repeats);
+    for (b = 0; b < G_N_ELEMENTS (benchmarks); b++) {
+        const MicroBench *bench = &benchmarks[b];
+        gint n = MAX (iterations / bench->divisor, 1);
+        guint64 allocs = 0;
+
+        if (filter && !strstr (bench->name, filter))
+            continue;
+
+        /* warm up caches and lazily initialized GLib state */
+        {
+            MicroTimer timer = { 0 };
+            bench->run (&timer, MAX (n / 10, 1));
+        }
+        for (r = 0; r < repeats; r++) {
+            MicroTimer timer = { 0 };
+
+            bench->run (&timer, n);
+            ns_per_op[r] = timer.elapsed * 1000.0 / n;
+            allocs = timer.allocations;
+        }
+        qsort (ns_per_op, repeats, sizeof (gdouble), _compare_double);
+
+        fprintf (out, "%s\n    { \"name\": \"%s\", \"calls\": %d, "
+                 "\"ns_per_op\": %.1f, \"min_ns_per_op\": %.1f, "
+                 "\"allocs_per_op\": %.2f }", first ? "" : ",", bench->name,
+                 n, ns_per_op[repeats / 2], ns_per_op[0],
+                 (gdouble) allocs / n);
+        first = FALSE;
+    }
+    fprintf (out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        fclose (out);
+    g_free (ns_per_op);
+    _teardown ();
+    return 0;
+}
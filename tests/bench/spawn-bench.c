@@ -0,0 +1,156 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Compares the latency of the old fork() + per-descriptor fcntl() loop with
+ * fork() + tlm_spawn_set_cloexec_from() and with tlm_spawn_async(). Raise
+ * the descriptor limit (ulimit -n) and the heap size to see the effect of
+ * each. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <glib.h>
+
+#include "common/tlm-spawn.h"
+
+static gint iterations = 200;
+static gint heap_mb = 0;
+static gchar *command = "/bin/true";
+
+static GOptionEntry entries[] = {
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+      "Spawns per method (default 200)", "N" },
+    { "heap", 'm', 0, G_OPTION_ARG_INT, &heap_mb,
+      "Touch this many MiB of heap before spawning", "MB" },
+    { "command", 'c', 0, G_OPTION_ARG_STRING, &command,
+      "Command to spawn (default /bin/true)", "PATH" },
+    { NULL }
+};
+
+typedef pid_t (*SpawnFunc) (gchar **argv);
+
+static pid_t
+_spawn_fork_loop (gchar **argv)
+{
+    pid_t pid = fork ();
+    if (pid == 0) {
+        long open_max = sysconf (_SC_OPEN_MAX);
+        long fd;
+        for (fd = 3; fd < open_max; fd++)
+            fcntl (fd, F_SETFD, FD_CLOEXEC);
+        execv (argv[0], argv);
+        _exit (127);
+    }
+    return pid;
+}
+
+static pid_t
+_spawn_fork_cloexec (gchar **argv)
+{
+    pid_t pid = fork ();
+    if (pid == 0) {
+        tlm_spawn_set_cloexec_from (3);
+        execv (argv[0], argv);
+        _exit (127);
+    }
+    return pid;
+}
+
+static pid_t
+_spawn_posix (gchar **argv)
+{
+    GPid pid = 0;
+
+    if (!tlm_spawn_async (argv, TRUE, &pid, NULL))
+        return -1;
+    return pid;
+}
+
+static void
+_run (const gchar *name, SpawnFunc func, gchar **argv)
+{
+    gint64 total = 0, worst = 0;
+    gint i;
+
+    for (i = 0; i < iterations; i++) {
+        gint64 start = g_get_monotonic_time ();
+        gint64 elapsed;
+        int status;
+        pid_t pid = func (argv);
+
+        if (pid < 0) {
+            fprintf (stderr, "%s: spawn failed: %s\n", name, strerror (errno));
+            return;
+        }
+        waitpid (pid, &status, 0);
+        elapsed = g_get_monotonic_time () - start;
+        total += elapsed;
+        if (elapsed > worst)
+            worst = elapsed;
+    }
+
+    printf ("%-24s avg %8.1f us  max %8" G_GINT64_FORMAT " us\n", name,
+            (double) total / iterations, worst);
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    gchar *spawn_argv[] = { NULL, NULL };
+    gchar *heap = NULL;
+
+    context = g_option_context_new ("- tlm spawn latency benchmark");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        fprintf (stderr, "%s\n", error->message);
+        g_error_free (error);
+        g_option_context_free (context);
+        return 1;
+    }
+    g_option_context_free (context);
+
+    if (iterations <= 0)
+        iterations = 1;
+
+    if (heap_mb > 0) {
+        heap = g_malloc ((gsize) heap_mb << 20);
+        memset (heap, 1, (gsize) heap_mb << 20);
+    }
+
+    printf ("descriptor limit %ld, heap %d MiB, %d iterations of %s\n",
+            sysconf (_SC_OPEN_MAX), heap_mb, iterations, command);
+
+    spawn_argv[0] = command;
+    _run ("fork + fcntl loop", _spawn_fork_loop, spawn_argv);
+    _run ("fork + close_range", _spawn_fork_cloexec, spawn_argv);
+    _run ("posix_spawn", _spawn_posix, spawn_argv);
+
+    g_free (heap);
+    return 0;
+}
@@ -0,0 +1,819 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Login storm load generator. Starts tlm with NSEATS virtual seats and the
+ * stub PAM service of pam-tlm-bench.c in a private mount namespace, runs
+ * loginUser, switchUser and logoutUser cycles on all seats at once through
+ * the root socket and prints the throughput and latency percentiles of
+ * each operation as JSON.
+ *
+ * With --replay it sends the requests of a trace recorded with
+ * REQUEST_TRACE instead, at their recorded pace or --speed times faster,
+ * all as the one --user, and reports the recorded latencies next to the
+ * replayed ones.
+ *
+ * Runs as root, or as a normal user where unprivileged user namespaces are
+ * allowed. In a user namespace tlm runs as its root and cannot change to
+ * the session user; that is logged and the session still starts. Neither
+ * logind nor the system bus is needed. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "common/dbus/tlm-dbus.h"
+#include "common/dbus/tlm-dbus-login-gen.h"
+#include "common/dbus/tlm-dbus-utils.h"
+#include "common/tlm-utils.h"
+#include "daemon/tlm-request-trace.h"
+
+#define TLM_BENCH_SERVICE   "tlm-bench"
+#define TLM_BENCH_PASSWORD  "bench"
+#define TLM_BENCH_TIMEOUT   10 /* seconds to wait for tlm */
+
+static gint n_seats = 0;
+static gint n_cycles = 20;
+static gboolean with_switch = FALSE;
+static gint auth_delay = 0;
+static gint session_delay = 0;
+static gchar *username = NULL;
+static gchar *daemon_path = NULL;
+static gchar *bin_dir = NULL;
+static gchar *pam_module = NULL;
+static gchar *output = NULL;
+static gint max_p99 = 0;
+static gchar *replay = NULL;
+static gdouble speed = 1.0;
+
+static GOptionEntry entries[] = {
+    { "seats", 's', 0, G_OPTION_ARG_INT, &n_seats,
+      "Virtual seats driven at once (default 4, or the seats of the "
+      "replayed trace)", "N" },
+    { "cycles", 'n', 0, G_OPTION_ARG_INT, &n_cycles,
+      "Login and logout cycles per seat (default 20)", "N" },
+    { "switch", 'w', 0, G_OPTION_ARG_NONE, &with_switch,
+      "Switch user between login and logout", NULL },
+    { "auth-delay", 'a', 0, G_OPTION_ARG_INT, &auth_delay,
+      "Latency of PAM authentication (default 0)", "MS" },
+    { "session-delay", 'o', 0, G_OPTION_ARG_INT, &session_delay,
+      "Latency of PAM open session (default 0)", "MS" },
+    { "user", 'u', 0, G_OPTION_ARG_STRING, &username,
+      "User to log in (default the current user)", "NAME" },
+    { "daemon", 'd', 0, G_OPTION_ARG_FILENAME, &daemon_path,
+      "tlm executable", "PATH" },
+    { "bin-dir", 'b', 0, G_OPTION_ARG_FILENAME, &bin_dir,
+      "Directory of tlm-sessiond", "DIR" },
+    { "pam-module", 'p', 0, G_OPTION_ARG_FILENAME, &pam_module,
+      "Path of pam_tlm_bench.so", "PATH" },
+    { "output", 'f', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the results to a file instead of stdout", "PATH" },
+    { "max-p99", 'm', 0, G_OPTION_ARG_INT, &max_p99,
+      "Fail when the p99 latency of an operation exceeds this", "MS" },
+    { "replay", 'r', 0, G_OPTION_ARG_FILENAME, &replay,
+      "Send the requests of a REQUEST_TRACE instead of cycles", "TRACE" },
+    { "speed", 'x', 0, G_OPTION_ARG_DOUBLE, &speed,
+      "Replay speed, 2 sends the requests twice as fast (default 1)", "X" },
+    { NULL }
+};
+
+typedef enum {
+    BENCH_OP_LOGIN,
+    BENCH_OP_SWITCH,
+    BENCH_OP_LOGOUT,
+    BENCH_N_OPS
+} BenchOp;
+
+static const gchar *op_names[BENCH_N_OPS] = { "login", "switch", "logout" };
+
+typedef struct {
+    GArray *latencies; /* gint64, usec */
+    guint errors;
+} BenchStats;
+
+typedef struct {
+    gchar *seat_id;
+    gint cycle;
+    BenchOp op;
+    gint64 start;
+} BenchSeat;
+
+static BenchStats stats[BENCH_N_OPS];
+static TlmDbusLogin *login_object = NULL;
+static GMainLoop *main_loop = NULL;
+static gint running_seats = 0;
+
+static gboolean
+_write_proc (const gchar *path, const gchar *contents)
+{
+    gssize len = strlen (contents);
+    int fd = open (path, O_WRONLY | O_CLOEXEC);
+    gboolean ret;
+
+    if (fd < 0)
+        return FALSE;
+    ret = write (fd, contents, len) == len;
+    close (fd);
+    return ret;
+}
+
+/* tlm and tlm-sessiond inherit the namespace, so PAM finds the stub
+ * service and tlm gets a socket directory of its own */
+static gboolean
+_enter_namespace (const gchar *pam_dir)
+{
+    uid_t uid = getuid ();
+    gid_t gid = getgid ();
+    gchar *map, *run_dir;
+    gboolean ret = TRUE;
+
+    if (unshare (CLONE_NEWNS | (uid ? CLONE_NEWUSER : 0)) < 0) {
+        fprintf (stderr, "unshare: %s\n", strerror (errno));
+        return FALSE;
+    }
+
+    if (uid) {
+        map = g_strdup_printf ("0 %u 1", uid);
+        ret = _write_proc ("/proc/self/uid_map", map);
+        g_free (map);
+        map = g_strdup_printf ("0 %u 1", gid);
+        ret = ret && _write_proc ("/proc/self/setgroups", "deny") &&
+            _write_proc ("/proc/self/gid_map", map);
+        g_free (map);
+        if (!ret) {
+            fprintf (stderr, "failed to map ids: %s\n", strerror (errno));
+            return FALSE;
+        }
+    }
+
+    /* tlm removes and recreates its socket directory, so the tmpfs goes
+     * on the parent */
+    run_dir = g_path_get_dirname (TLM_DBUS_SOCKET_PATH);
+    if (mount (NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) < 0 ||
+        mount ("tmpfs", run_dir, "tmpfs", 0, "mode=0755") < 0 ||
+        mount (pam_dir, "/etc/pam.d", NULL, MS_BIND, NULL) < 0) {
+        fprintf (stderr, "mount: %s\n", strerror (errno));
+        ret = FALSE;
+    }
+    g_free (run_dir);
+
+    return ret;
+}
+
+static gboolean
+_write_setup (const gchar *work_dir, const gchar *pam_dir)
+{
+    gchar *path, *contents;
+    gboolean ret;
+
+    contents = g_strdup_printf (
+            "auth     required %s delay=%d\n"
+            "account  required %s\n"
+            "password required %s\n"
+            "session  required %s delay=%d\n",
+            pam_module, auth_delay, pam_module, pam_module,
+            pam_module, session_delay);
+    path = g_build_filename (pam_dir, TLM_BENCH_SERVICE, NULL);
+    ret = g_mkdir (pam_dir, 0755) == 0 &&
+        g_file_set_contents (path, contents, -1, NULL);
+    g_free (path);
+    g_free (contents);
+    if (!ret)
+        return FALSE;
+
+    contents = g_strdup_printf (
+            "[General]\n"
+            "NSEATS=%d\n"
+            "AUTO_LOGIN=0\n"
+            "PREPARE_DEFAULT=0\n"
+            "THROTTLE_RELOGIN=0\n"
+            "PAM_SERVICE=" TLM_BENCH_SERVICE "\n"
+            "DEFAULT_PAM_SERVICE=" TLM_BENCH_SERVICE "\n"
+            "SESSION_CMD=/bin/sleep 86400\n"
+            "SETUP_TERMINAL=0\n"
+            "SETUP_RUNTIME_DIR=0\n",
+            n_seats);
+    path = g_build_filename (work_dir, "tlm.conf", NULL);
+    ret = g_file_set_contents (path, contents, -1, NULL);
+    g_free (path);
+    g_free (contents);
+
+    return ret;
+}
+
+static GPid
+_start_daemon (const gchar *work_dir)
+{
+    gchar *argv[] = { daemon_path, NULL };
+    gchar **envp = g_get_environ ();
+    gchar *conf = g_build_filename (work_dir, "tlm.conf", NULL);
+    GError *error = NULL;
+    GPid pid = 0;
+
+    envp = g_environ_setenv (envp, "TLM_CONF_FILE", conf, TRUE);
+    envp = g_environ_setenv (envp, "TLM_BIN_DIR", bin_dir, TRUE);
+    /* no account or authentication plugins */
+    envp = g_environ_setenv (envp, "TLM_PLUGINS_DIR", work_dir, TRUE);
+    if (!g_spawn_async (NULL, argv, envp, G_SPAWN_DO_NOT_REAP_CHILD, NULL,
+                NULL, &pid, &error)) {
+        fprintf (stderr, "failed to start %s: %s\n", daemon_path,
+                 error->message);
+        g_error_free (error);
+    }
+    g_strfreev (envp);
+    g_free (conf);
+
+    return pid;
+}
+
+static void
+_stop_daemon (GPid pid)
+{
+    gint i;
+
+    kill (pid, SIGTERM);
+    for (i = 0; i < TLM_BENCH_TIMEOUT * 10; i++) {
+        if (waitpid (pid, NULL, WNOHANG) == pid)
+            return;
+        g_usleep (G_USEC_PER_SEC / 10);
+    }
+    fprintf (stderr, "tlm did not stop, killing it\n");
+    kill (pid, SIGKILL);
+    waitpid (pid, NULL, 0);
+}
+
+static GDBusConnection *
+_connect (GPid pid)
+{
+    gint64 deadline = g_get_monotonic_time () +
+        TLM_BENCH_TIMEOUT * G_USEC_PER_SEC;
+    GDBusConnection *connection;
+    GError *error = NULL;
+
+    while (TRUE) {
+        connection = g_dbus_connection_new_for_address_sync (
+                TLM_DBUS_ROOT_SOCKET_ADDRESS,
+                G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, NULL, NULL,
+                &error);
+        if (connection)
+            return connection;
+        if (waitpid (pid, NULL, WNOHANG) == pid) {
+            fprintf (stderr, "tlm exited during startup\n");
+            break;
+        }
+        if (g_get_monotonic_time () > deadline) {
+            fprintf (stderr, "cannot connect to tlm: %s\n", error->message);
+            break;
+        }
+        g_clear_error (&error);
+        g_usleep (G_USEC_PER_SEC / 20);
+    }
+    g_clear_error (&error);
+
+    return NULL;
+}
+
+static GVariant *
+_environment (void)
+{
+    return g_variant_new_array (G_VARIANT_TYPE ("{ss}"), NULL, 0);
+}
+
+static void
+_call (BenchOp op, const gchar *seat_id, GAsyncReadyCallback callback,
+       gpointer user_data)
+{
+    switch (op) {
+        case BENCH_OP_LOGIN:
+            tlm_dbus_login_call_login_user (login_object, seat_id,
+                    username, TLM_BENCH_PASSWORD, _environment (), NULL,
+                    callback, user_data);
+            break;
+        case BENCH_OP_SWITCH:
+            tlm_dbus_login_call_switch_user (login_object, seat_id,
+                    username, TLM_BENCH_PASSWORD, _environment (), NULL,
+                    callback, user_data);
+            break;
+        default:
+            tlm_dbus_login_call_logout_user (login_object, seat_id, "",
+                    NULL, callback, user_data);
+            break;
+    }
+}
+
+/* adds the latency or the error of a finished call to the stats */
+static gboolean
+_finish (BenchOp op, const gchar *seat_id, gint64 start, GAsyncResult *res)
+{
+    gint64 elapsed = g_get_monotonic_time () - start;
+    GError *error = NULL;
+    gchar *sessionid = NULL;
+    gboolean ok;
+
+    switch (op) {
+        case BENCH_OP_LOGIN:
+            ok = tlm_dbus_login_call_login_user_finish (login_object,
+                    &sessionid, res, &error);
+            break;
+        case BENCH_OP_SWITCH:
+            ok = tlm_dbus_login_call_switch_user_finish (login_object,
+                    &sessionid, res, &error);
+            break;
+        default:
+            ok = tlm_dbus_login_call_logout_user_finish (login_object, res,
+                    &error);
+            break;
+    }
+    g_free (sessionid);
+
+    if (ok) {
+        g_array_append_val (stats[op].latencies, elapsed);
+    } else {
+        stats[op].errors++;
+        fprintf (stderr, "%s: %s failed: %s\n", seat_id, op_names[op],
+                 error->message);
+        g_error_free (error);
+    }
+
+    return ok;
+}
+
+static void
+_op_done (GObject *object, GAsyncResult *res, gpointer user_data);
+
+static void
+_start_op (BenchSeat *seat)
+{
+    seat->start = g_get_monotonic_time ();
+    _call (seat->op, seat->seat_id, _op_done, seat);
+}
+
+static void
+_op_done (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+    BenchSeat *seat = (BenchSeat *) user_data;
+    gboolean ok = _finish (seat->op, seat->seat_id, seat->start, res);
+
+    /* a failed login has no session to log out */
+    if (seat->op == BENCH_OP_LOGIN && ok) {
+        seat->op = with_switch ? BENCH_OP_SWITCH : BENCH_OP_LOGOUT;
+    } else if (seat->op == BENCH_OP_SWITCH) {
+        seat->op = BENCH_OP_LOGOUT;
+    } else {
+        seat->op = BENCH_OP_LOGIN;
+        if (++seat->cycle >= n_cycles) {
+            if (--running_seats == 0)
+                g_main_loop_quit (main_loop);
+            return;
+        }
+    }
+    _start_op (seat);
+}
+
+/* replay */
+
+typedef struct {
+    BenchOp op;
+    gchar *seat_id;
+    gint64 due;     /* usec from the start of the replay */
+} ReplayRequest;
+
+typedef struct {
+    BenchOp op;
+    gchar *seat_id;
+    gint64 start;
+} ReplayCall;
+
+static GArray *replay_requests = NULL; /* ReplayRequest, by arrival */
+static BenchStats recorded[BENCH_N_OPS];
+static gdouble recorded_span = 0;   /* seconds, scaled by --speed */
+static guint replay_next = 0;
+static guint replay_pending = 0;
+static gint64 replay_start = 0;
+
+static gint
+_compare_arrival (gconstpointer a, gconstpointer b)
+{
+    guint64 aa = ((const TlmRequestTraceRecord *) a)->arrival;
+    guint64 ab = ((const TlmRequestTraceRecord *) b)->arrival;
+
+    return aa < ab ? -1 : aa > ab;
+}
+
+/* loads the login, switch and logout requests of a trace recorded with
+ * REQUEST_TRACE, with the latencies tlm recorded for them */
+static gboolean
+_load_trace (const gchar *path)
+{
+    TlmRequestTraceHeader *header;
+    TlmRequestTraceRecord *records;
+    GError *error = NULL;
+    gchar *contents = NULL;
+    gsize length = 0, n_records, i;
+    guint max_seat = 0;
+    gint op;
+
+    if (!g_file_get_contents (path, &contents, &length, &error)) {
+        fprintf (stderr, "%s\n", error->message);
+        g_error_free (error);
+        return FALSE;
+    }
+    header = (TlmRequestTraceHeader *) contents;
+    if (length < sizeof (*header) ||
+        memcmp (header->magic, TLM_REQUEST_TRACE_MAGIC,
+                sizeof (header->magic)) != 0) {
+        fprintf (stderr, "%s is not a tlm request trace\n", path);
+        g_free (contents);
+        return FALSE;
+    }
+
+    n_records = (length - sizeof (*header)) / sizeof (*records);
+    records = (TlmRequestTraceRecord *) (contents + sizeof (*header));
+    qsort (records, n_records, sizeof (*records), _compare_arrival);
+
+    for (op = 0; op < BENCH_N_OPS; op++)
+        recorded[op].latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+    replay_requests = g_array_new (FALSE, FALSE, sizeof (ReplayRequest));
+
+    for (i = 0; i < n_records; i++) {
+        ReplayRequest request;
+        gint64 latency = records[i].latency;
+        guint seat = records[i].seat;
+
+        switch (records[i].type) {
+            case TLM_DBUS_REQUEST_TYPE_LOGIN_USER:
+                request.op = BENCH_OP_LOGIN;
+                break;
+            case TLM_DBUS_REQUEST_TYPE_SWITCH_USER:
+                request.op = BENCH_OP_SWITCH;
+                break;
+            case TLM_DBUS_REQUEST_TYPE_LOGOUT_USER:
+                request.op = BENCH_OP_LOGOUT;
+                break;
+            default:
+                /* session info needs the ids of the recorded sessions */
+                continue;
+        }
+
+        if (records[i].status)
+            recorded[request.op].errors++;
+        else
+            g_array_append_val (recorded[request.op].latencies, latency);
+
+        if (seat == TLM_REQUEST_TRACE_SEAT_OTHER)
+            seat = 0;
+        if (n_seats > 0)
+            seat %= n_seats;
+        max_seat = MAX (max_seat, seat);
+        request.seat_id = g_strdup_printf ("seat%u", seat);
+        request.due = (records[i].arrival - records[0].arrival) / speed;
+        g_array_append_val (replay_requests, request);
+    }
+    if (n_records)
+        recorded_span = (records[n_records - 1].arrival - records[0].arrival) /
+            speed / G_USEC_PER_SEC;
+    if (n_seats <= 0)
+        n_seats = max_seat + 1;
+
+    g_free (contents);
+    if (!replay_requests->len) {
+        fprintf (stderr, "%s has no requests to replay\n", path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+_free_trace (void)
+{
+    guint i;
+    gint op;
+
+    if (replay_requests) {
+        for (i = 0; i < replay_requests->len; i++)
+            g_free (g_array_index (replay_requests, ReplayRequest, i).seat_id);
+        g_array_free (replay_requests, TRUE);
+        replay_requests = NULL;
+    }
+    for (op = 0; op < BENCH_N_OPS; op++) {
+        if (recorded[op].latencies)
+            g_array_free (recorded[op].latencies, TRUE);
+        recorded[op].latencies = NULL;
+    }
+}
+
+static void
+_replay_done (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+    ReplayCall *call = (ReplayCall *) user_data;
+
+    _finish (call->op, call->seat_id, call->start, res);
+    g_free (call);
+
+    if (--replay_pending == 0 && replay_next == replay_requests->len)
+        g_main_loop_quit (main_loop);
+}
+
+/* sends the requests that are due and sleeps until the next one is */
+static gboolean
+_replay_due (gpointer user_data)
+{
+    gint64 now = g_get_monotonic_time () - replay_start;
+
+    while (replay_next < replay_requests->len) {
+        ReplayRequest *request = &g_array_index (replay_requests,
+                ReplayRequest, replay_next);
+        ReplayCall *call;
+
+        if (request->due > now) {
+            g_timeout_add ((request->due - now) / 1000, _replay_due, NULL);
+            return G_SOURCE_REMOVE;
+        }
+
+        call = g_new0 (ReplayCall, 1);
+        call->op = request->op;
+        call->seat_id = request->seat_id;
+        call->start = g_get_monotonic_time ();
+        replay_pending++;
+        replay_next++;
+        _call (call->op, call->seat_id, _replay_done, call);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static gint
+_compare_latency (gconstpointer a, gconstpointer b)
+{
+    gint64 la = *(const gint64 *) a;
+    gint64 lb = *(const gint64 *) b;
+
+    return la < lb ? -1 : la > lb;
+}
+
+/* nearest rank, in ms */
+static gdouble
+_percentile (GArray *sorted, guint p)
+{
+    guint rank;
+
+    if (sorted->len == 0)
+        return 0;
+    rank = (sorted->len * p + 99) / 100;
+    return g_array_index (sorted, gint64, rank ? rank - 1 : 0) / 1000.0;
+}
+
+static gboolean
+_report_operations (FILE *out, const gchar *name, BenchStats *set,
+                    gdouble elapsed, gboolean check)
+{
+    gboolean pass = TRUE, first = TRUE;
+    gint op;
+
+    fprintf (out, "  \"%s\": {", name);
+    for (op = 0; op < BENCH_N_OPS; op++) {
+        GArray *latencies = set[op].latencies;
+        gdouble p99;
+
+        if (op == BENCH_OP_SWITCH && !with_switch && !replay)
+            continue;
+
+        g_array_sort (latencies, _compare_latency);
+        p99 = _percentile (latencies, 99);
+        fprintf (out, "%s\n    \"%s\": { \"count\": %u, \"errors\": %u, "
+                 "\"per_second\": %.2f, \"p50_ms\": %.2f, "
+                 "\"p95_ms\": %.2f, \"p99_ms\": %.2f, \"max_ms\": %.2f }",
+                 first ? "" : ",", op_names[op],
+                 latencies->len, set[op].errors,
+                 elapsed > 0 ? latencies->len / elapsed : 0,
+                 _percentile (latencies, 50), _percentile (latencies, 95),
+                 p99, _percentile (latencies, 100));
+        first = FALSE;
+
+        if (!check)
+            continue;
+        if (set[op].errors)
+            pass = FALSE;
+        if (max_p99 > 0 && p99 > max_p99) {
+            fprintf (stderr, "%s p99 %.2f ms exceeds %d ms\n", op_names[op],
+                     p99, max_p99);
+            pass = FALSE;
+        }
+    }
+    fprintf (out, "\n  }");
+
+    return pass;
+}
+
+static gboolean
+_report (FILE *out, gdouble elapsed)
+{
+    gboolean pass;
+
+    fprintf (out, "{\n  \"seats\": %d,\n", n_seats);
+    if (replay)
+        fprintf (out, "  \"replay\": \"%s\",\n  \"speed\": %.2f,\n",
+                 replay, speed);
+    else
+        fprintf (out, "  \"cycles\": %d,\n", n_cycles);
+    fprintf (out, "  \"auth_delay_ms\": %d,\n"
+             "  \"session_delay_ms\": %d,\n"
+             "  \"elapsed_s\": %.3f,\n",
+             auth_delay, session_delay, elapsed);
+
+    pass = _report_operations (out, "operations", stats, elapsed, TRUE);
+    if (replay) {
+        /* measured by tlm from queueing to completion, without the
+         * D-Bus round trip the replayed latencies include */
+        fprintf (out, ",\n");
+        _report_operations (out, "recorded", recorded, recorded_span, FALSE);
+    }
+    fprintf (out, "\n}\n");
+
+    return pass;
+}
+
+static gboolean
+_get_login_object (GDBusConnection *connection)
+{
+    GError *error = NULL;
+
+    login_object = tlm_dbus_login_proxy_new_sync (connection,
+            G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
+            TLM_LOGIN_OBJECTPATH, NULL, &error);
+    if (!login_object) {
+        fprintf (stderr, "cannot get login object: %s\n", error->message);
+        g_error_free (error);
+        return FALSE;
+    }
+    /* requests queue behind the other seats' PAM stacks */
+    g_dbus_proxy_set_default_timeout (G_DBUS_PROXY (login_object), G_MAXINT);
+
+    return TRUE;
+}
+
+static gboolean
+_run (GDBusConnection *connection, gdouble *elapsed)
+{
+    BenchSeat *seats;
+    gint64 start;
+    gint i;
+
+    if (!_get_login_object (connection))
+        return FALSE;
+
+    seats = g_new0 (BenchSeat, n_seats);
+    main_loop = g_main_loop_new (NULL, FALSE);
+    start = g_get_monotonic_time ();
+    running_seats = n_seats;
+    for (i = 0; i < n_seats; i++) {
+        seats[i].seat_id = g_strdup_printf ("seat%d", i);
+        seats[i].op = BENCH_OP_LOGIN;
+        _start_op (&seats[i]);
+    }
+    g_main_loop_run (main_loop);
+    *elapsed = (g_get_monotonic_time () - start) / (gdouble) G_USEC_PER_SEC;
+
+    for (i = 0; i < n_seats; i++)
+        g_free (seats[i].seat_id);
+    g_free (seats);
+    g_main_loop_unref (main_loop);
+    g_clear_object (&login_object);
+
+    return TRUE;
+}
+
+static gboolean
+_replay (GDBusConnection *connection, gdouble *elapsed)
+{
+    if (!_get_login_object (connection))
+        return FALSE;
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+    replay_start = g_get_monotonic_time ();
+    g_idle_add (_replay_due, NULL);
+    g_main_loop_run (main_loop);
+    *elapsed = (g_get_monotonic_time () - replay_start) /
+        (gdouble) G_USEC_PER_SEC;
+
+    g_main_loop_unref (main_loop);
+    g_clear_object (&login_object);
+
+    return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    GDBusConnection *connection;
+    gchar work_dir[] = "/tmp/tlm-bench-XXXXXX";
+    gchar *pam_dir = NULL;
+    FILE *out = stdout;
+    gdouble elapsed = 0;
+    GPid pid;
+    gint op;
+    int ret = 1;
+
+    context = g_option_context_new ("- tlm login storm benchmark");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        fprintf (stderr, "%s\n", error->message);
+        g_error_free (error);
+        g_option_context_free (context);
+        return 1;
+    }
+    g_option_context_free (context);
+
+    if (!daemon_path || !bin_dir || !pam_module) {
+        fprintf (stderr, "--daemon, --bin-dir and --pam-module are required\n");
+        return 1;
+    }
+    if (speed <= 0)
+        speed = 1.0;
+    if (replay && !_load_trace (replay)) {
+        _free_trace ();
+        return 1;
+    }
+    if (n_seats <= 0)
+        n_seats = 4;
+    if (n_cycles <= 0)
+        n_cycles = 1;
+    /* resolve before entering a user namespace, where we are root */
+    if (!username)
+        username = g_strdup (g_get_user_name ());
+
+    /* the namespace must be entered while single threaded */
+    if (!g_mkdtemp (work_dir)) {
+        fprintf (stderr, "mkdtemp: %s\n", strerror (errno));
+        return 1;
+    }
+    pam_dir = g_build_filename (work_dir, "pam.d", NULL);
+    if (!_write_setup (work_dir, pam_dir) || !_enter_namespace (pam_dir))
+        goto _cleanup;
+
+    pid = _start_daemon (work_dir);
+    if (!pid)
+        goto _cleanup;
+    connection = _connect (pid);
+    if (!connection) {
+        _stop_daemon (pid);
+        goto _cleanup;
+    }
+
+    for (op = 0; op < BENCH_N_OPS; op++)
+        stats[op].latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+    if (replay ? _replay (connection, &elapsed) :
+        _run (connection, &elapsed)) {
+        if (output && !(out = fopen (output, "w"))) {
+            fprintf (stderr, "cannot open %s: %s\n", output, strerror (errno));
+            out = stdout;
+        }
+        ret = _report (out, elapsed) ? 0 : 1;
+        if (out != stdout)
+            fclose (out);
+    }
+
+    g_object_unref (connection);
+    _stop_daemon (pid);
+    for (op = 0; op < BENCH_N_OPS; op++)
+        g_array_free (stats[op].latencies, TRUE);
+
+_cleanup:
+    tlm_utils_delete_dir (work_dir);
+    _free_trace ();
+    g_free (pam_dir);
+    g_free (username);
+    return ret;
+}
@@ -26,6 +26,9 @@
 #include <check.h>
 #include <stdlib.h>
 #include "tlm-config.h"
+#include "tlm-config-general.h"
+#include "tlm-config-seat.h"
+#include "tlm-seat-config.h"
 
 #define TLM_GROUP   "tlm-test"
 #define STR_KEY     "str_key"
@@ -116,6 +119,162 @@ START_TEST(test_config)
 }
 END_TEST
 
+START_TEST(test_seat_config)
+{
+    TlmConfig *config = NULL;
+    TlmSeatConfig *seat_config = NULL;
+    TlmSeatConfig *other_config = NULL;
+
+    config = tlm_config_new ();
+    fail_if (config == NULL, "Failed to create config object");
+
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SESSION_CMD, "general-cmd");
+    tlm_config_set_boolean (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SETUP_TERMINAL, TRUE);
+    tlm_config_set_string (config, "seat-test",
+            TLM_CONFIG_GENERAL_SESSION_CMD, "seat-cmd");
+    tlm_config_set_string (config, "seat-test",
+            TLM_CONFIG_GENERAL_RUNTIME_MODE, "0750");
+    tlm_config_set_uint (config, "seat-test", TLM_CONFIG_SEAT_VTNR, 7);
+
+    /* seat values override General ones, General is inherited */
+    seat_config = tlm_config_get_seat_config (config, "seat-test");
+    fail_if (seat_config == NULL);
+    fail_if (g_strcmp0 (seat_config->session_cmd, "seat-cmd") != 0,
+             "Wrong value : %s", seat_config->session_cmd);
+    fail_if (seat_config->setup_terminal != TRUE);
+    fail_if (seat_config->runtime_mode != 0750,
+             "Wrong mode : %o", seat_config->runtime_mode);
+    fail_if (seat_config->vtnr != 7);
+
+    /* defaults */
+    fail_if (seat_config->setup_runtime_dir != FALSE);
+    fail_if (seat_config->auto_login != TRUE);
+    fail_if (g_strcmp0 (seat_config->pam_service, "tlm-login") != 0);
+    fail_if (g_strcmp0 (seat_config->default_user, "guest") != 0);
+
+    /* snapshots are shared until the configuration changes */
+    other_config = tlm_config_get_seat_config (config, "seat-test");
+    fail_if (other_config != seat_config);
+    tlm_seat_config_unref (other_config);
+
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SESSION_TYPE, "wayland");
+    other_config = tlm_config_get_seat_config (config, "seat-test");
+    fail_if (other_config == seat_config);
+    fail_if (g_strcmp0 (other_config->session_type, "wayland") != 0);
+    fail_if (seat_config->session_type != NULL);
+
+    /* seat only keys are not inherited */
+    tlm_seat_config_unref (other_config);
+    other_config = tlm_config_get_seat_config (config, "seat-other");
+    fail_if (g_strcmp0 (other_config->session_cmd, "general-cmd") != 0);
+    fail_if (other_config->vtnr != 0);
+
+    tlm_seat_config_unref (other_config);
+    tlm_seat_config_unref (seat_config);
+    g_object_unref (config);
+}
+END_TEST
+
+START_TEST(test_config_image)
+{
+    TlmConfig *config = NULL;
+    TlmConfig *mapped = NULL;
+    GHashTable *tmp_group = NULL;
+    gchar *fd_str = NULL;
+    gint fd;
+
+    config = tlm_config_new ();
+    fail_if (config == NULL, "Failed to create config object");
+    tlm_config_set_string (config, "seat-test", STR_KEY, "seat_value");
+
+    fd = tlm_config_get_image_fd (config);
+    fail_if (fd < 0, "Failed to create config image");
+
+    /* a config object created with the descriptor maps the image */
+    fd_str = g_strdup_printf ("%d", fd);
+    g_setenv ("TLM_CONFIG_FD", fd_str, TRUE);
+    g_free (fd_str);
+    mapped = tlm_config_new ();
+    g_unsetenv ("TLM_CONFIG_FD");
+    fail_if (mapped == NULL, "Failed to create config object");
+
+    fail_if (g_strcmp0 (tlm_config_get_string (mapped, TLM_GROUP, STR_KEY),
+                        STR_VALUE) != 0);
+    fail_if (tlm_config_get_int (mapped, TLM_GROUP, INT_KEY, -1) != INT_VALUE);
+    fail_if (g_strcmp0 (tlm_config_get_string (mapped, "seat-test", STR_KEY),
+                        "seat_value") != 0);
+    fail_if (tlm_config_get_string (mapped, TLM_GROUP, "unknown") != NULL);
+    fail_if (tlm_config_has_group (mapped, "unknown"));
+
+    tmp_group = tlm_config_get_group (mapped, TLM_GROUP);
+    fail_if (tmp_group == NULL);
+    fail_if (g_hash_table_size (tmp_group) != 4);
+
+    /* changes stay local to the mapping process */
+    tlm_config_set_string (mapped, TLM_GROUP, STR_KEY, "changed");
+    fail_if (g_strcmp0 (tlm_config_get_string (mapped, TLM_GROUP, STR_KEY),
+                        "changed") != 0);
+    fail_if (g_strcmp0 (tlm_config_get_string (config, TLM_GROUP, STR_KEY),
+                        STR_VALUE) != 0);
+
+    g_object_unref (mapped);
+    g_object_unref (config);
+}
+END_TEST
+
+START_TEST(test_config_diff)
+{
+    TlmConfig *config = NULL;
+    TlmConfig *other = NULL;
+    TlmSeatConfig *seat_config = NULL;
+    TlmSeatConfig *other_config = NULL;
+    GHashTable *diff = NULL;
+    GHashTable *keys = NULL;
+
+    config = tlm_config_new ();
+    other = tlm_config_new ();
+    fail_if (config == NULL || other == NULL,
+             "Failed to create config object");
+
+    diff = tlm_config_diff (config, other);
+    fail_if (diff == NULL);
+    fail_if (g_hash_table_size (diff) != 0);
+    g_hash_table_unref (diff);
+
+    tlm_config_set_string (other, TLM_GROUP, STR_KEY, "changed");
+    tlm_config_set_uint (other, "seat-test", TLM_CONFIG_SEAT_VTNR, 2);
+    diff = tlm_config_diff (config, other);
+    fail_if (g_hash_table_size (diff) != 2,
+             "Wrong number of groups : %u", g_hash_table_size (diff));
+    keys = g_hash_table_lookup (diff, TLM_GROUP);
+    fail_if (keys == NULL || g_hash_table_size (keys) != 1);
+    fail_if (!g_hash_table_contains (keys, STR_KEY));
+    keys = g_hash_table_lookup (diff, "seat-test");
+    fail_if (keys == NULL ||
+             !g_hash_table_contains (keys, TLM_CONFIG_SEAT_VTNR));
+    g_hash_table_unref (diff);
+
+    seat_config = tlm_config_get_seat_config (config, "seat-test");
+    other_config = tlm_config_get_seat_config (other, "seat-test");
+    fail_if (tlm_seat_config_equal (seat_config, other_config));
+    tlm_seat_config_unref (other_config);
+    tlm_seat_config_unref (seat_config);
+
+    /* keys outside of the snapshot don't change it */
+    seat_config = tlm_config_get_seat_config (config, "seat-other");
+    other_config = tlm_config_get_seat_config (other, "seat-other");
+    fail_if (!tlm_seat_config_equal (seat_config, other_config));
+    tlm_seat_config_unref (other_config);
+    tlm_seat_config_unref (seat_config);
+
+    g_object_unref (other);
+    g_object_unref (config);
+}
+END_TEST
+
 int main (void)
 {
     int number_failed;
@@ -127,6 +286,9 @@ int main (void)
     TCase *tc = tcase_create ("Config");
 
     tcase_add_test (tc, test_config);
+    tcase_add_test (tc, test_seat_config);
+    tcase_add_test (tc, test_config_image);
+    tcase_add_test (tc, test_config_diff);
     suite_add_tcase (s, tc);
 
     sr = srunner_create(s);
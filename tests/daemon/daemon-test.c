@@ -32,12 +32,16 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <glib-unix.h>
+#include <glib/gstdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mount.h>
 
 #include "common/dbus/tlm-dbus.h"
 #include "common/tlm-log.h"
+#include "common/tlm-error.h"
 #include "common/tlm-config.h"
 #include "common/dbus/tlm-dbus-login-gen.h"
 #include "common/tlm-utils.h"
@@ -274,6 +278,282 @@ START_TEST (test_login_user)
 }
 END_TEST
 
+/* a seat call failing synchronously emits session-error before it returns,
+ * the daemon has to survive the request completing underneath it */
+START_TEST (test_logout_without_session)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    GDBusConnection *connection = NULL;
+    TlmDbusLogin *login_object = NULL;
+    gint i;
+
+    connection = _get_bus_connection ("seat0", &error);
+    fail_if (connection == NULL, "failed to get bus connection : %s",
+            error ? error->message : "(null)");
+
+    login_object = _get_login_object (connection, &error);
+    fail_if (login_object == NULL, "failed to get login object: %s",
+            error ? error->message : "");
+
+    for (i = 0; i < 2; i++) {
+        fail_if (tlm_dbus_login_call_logout_user_sync (login_object,
+                "seat0", "", NULL, &error) == TRUE);
+        fail_if (error == NULL);
+        fail_if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED) ||
+                 g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_NO_REPLY),
+                 "daemon did not reply: %s", error->message);
+        g_error_free (error);
+        error = NULL;
+    }
+    fail_unless (kill (daemon_pid, 0) == 0, "daemon is gone");
+
+    g_object_unref (login_object);
+    g_object_unref (connection);
+}
+END_TEST
+
+#define OVERLAP_SEATS 4
+#define OVERLAP_ROUNDS 3
+
+static gint pending_replies = 0;
+
+static void
+_on_logout_reply (
+        GObject *source,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GError **error = (GError **) user_data;
+
+    tlm_dbus_login_call_logout_user_finish (TLM_DBUS_LOGIN (source), res,
+            error);
+    if (--pending_replies == 0)
+        g_main_loop_quit (main_loop);
+}
+
+/* requests for different seats are queued independently, and requests for
+ * seats that do not exist are refused without queueing them */
+START_TEST (test_overlapping_seat_requests)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    GError *errors[OVERLAP_ROUNDS][OVERLAP_SEATS] = { { NULL } };
+    gchar *seat_ids[OVERLAP_SEATS];
+    GDBusConnection *connection = NULL;
+    TlmDbusLogin *login_object = NULL;
+    gint round, i;
+
+    /* registers the D-Bus names of the tlm errors */
+    fail_if (TLM_ERROR == 0);
+
+    connection = _get_bus_connection ("seat0", &error);
+    fail_if (connection == NULL, "failed to get bus connection : %s",
+            error ? error->message : "(null)");
+
+    login_object = _get_login_object (connection, &error);
+    fail_if (login_object == NULL, "failed to get login object: %s",
+            error ? error->message : "");
+
+    seat_ids[0] = g_strdup ("seat0");
+    for (i = 1; i < OVERLAP_SEATS; i++)
+        seat_ids[i] = g_strdup_printf ("seat-test-%d", i);
+
+    for (round = 0; round < OVERLAP_ROUNDS; round++) {
+        for (i = 0; i < OVERLAP_SEATS; i++) {
+            pending_replies++;
+            tlm_dbus_login_call_logout_user (login_object, seat_ids[i], "",
+                    NULL, _on_logout_reply, &errors[round][i]);
+        }
+    }
+    g_main_loop_run (main_loop);
+
+    for (round = 0; round < OVERLAP_ROUNDS; round++) {
+        for (i = 0; i < OVERLAP_SEATS; i++) {
+            error = errors[round][i];
+            fail_if (error == NULL);
+            fail_if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED) ||
+                     g_error_matches (error, G_DBUS_ERROR,
+                             G_DBUS_ERROR_NO_REPLY),
+                     "daemon did not reply: %s", error->message);
+            fail_unless (g_error_matches (error, TLM_ERROR,
+                    TLM_ERROR_SEAT_NOT_FOUND) == (i != 0),
+                    "unexpected error for %s: %s", seat_ids[i],
+                    error->message);
+            g_error_free (error);
+        }
+    }
+    fail_unless (kill (daemon_pid, 0) == 0, "daemon is gone");
+
+    for (i = 0; i < OVERLAP_SEATS; i++)
+        g_free (seat_ids[i]);
+    g_object_unref (login_object);
+    g_object_unref (connection);
+}
+END_TEST
+
+#define SWITCH_PAM_SERVICE "tlm-test-switch"
+
+static gchar *switch_dir = NULL;
+static GPid switch_daemon_pid = 0;
+
+/* switch user needs PAM to accept the test user, the daemon runs in a
+ * private mount namespace with a stub PAM service, like tlm-bench */
+static gboolean
+_write_switch_setup (const gchar *pam_dir)
+{
+    const gchar *pam_module = g_getenv ("TLM_TEST_PAM_MODULE");
+    gchar *path, *contents;
+    gboolean ret;
+
+    contents = g_strdup_printf (
+            "auth     required %s\n"
+            "account  required %s\n"
+            "password required %s\n"
+            "session  required %s\n",
+            pam_module, pam_module, pam_module, pam_module);
+    path = g_build_filename (pam_dir, SWITCH_PAM_SERVICE, NULL);
+    ret = g_mkdir (pam_dir, 0755) == 0 &&
+        g_file_set_contents (path, contents, -1, NULL);
+    g_free (path);
+    g_free (contents);
+    if (!ret)
+        return FALSE;
+
+    path = g_build_filename (switch_dir, "tlm.conf", NULL);
+    ret = g_file_set_contents (path,
+            "[General]\n"
+            "NSEATS=1\n"
+            "AUTO_LOGIN=0\n"
+            "PREPARE_DEFAULT=0\n"
+            "PAM_SERVICE=" SWITCH_PAM_SERVICE "\n"
+            "DEFAULT_PAM_SERVICE=" SWITCH_PAM_SERVICE "\n"
+            "SESSION_CMD=/bin/sleep 86400\n"
+            "SETUP_TERMINAL=0\n"
+            "SETUP_RUNTIME_DIR=0\n", -1, NULL);
+    g_free (path);
+
+    return ret;
+}
+
+static void
+_setup_switch_daemon (void)
+{
+    GError *error = NULL;
+    gchar *argv[2];
+    gchar **envp = NULL;
+    gchar *pam_dir, *run_dir, *conf;
+    gboolean ret;
+
+    if (geteuid () != 0 || !g_getenv ("TLM_TEST_PAM_MODULE")) {
+        DBG ("switch user tests need root and the stub PAM module");
+        return;
+    }
+
+    switch_dir = g_dir_make_tmp ("tlm-daemon-test-XXXXXX", NULL);
+    fail_if (switch_dir == NULL);
+    pam_dir = g_build_filename (switch_dir, "pam.d", NULL);
+    fail_if (!_write_switch_setup (pam_dir), "failed to write setup");
+
+    /* tlm recreates its socket directory, so the tmpfs goes on the
+     * parent */
+    run_dir = g_path_get_dirname (TLM_DBUS_SOCKET_PATH);
+    ret = unshare (CLONE_NEWNS) == 0 &&
+        mount (NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) == 0 &&
+        mount ("tmpfs", run_dir, "tmpfs", 0, "mode=0755") == 0 &&
+        mount (pam_dir, "/etc/pam.d", NULL, MS_BIND, NULL) == 0;
+    fail_if (!ret, "failed to set up mount namespace: %s", strerror (errno));
+    g_free (run_dir);
+    g_free (pam_dir);
+
+    conf = g_build_filename (switch_dir, "tlm.conf", NULL);
+    envp = g_get_environ ();
+    envp = g_environ_setenv (envp, "TLM_CONF_FILE", conf, TRUE);
+    envp = g_environ_setenv (envp, "TLM_BIN_DIR",
+            g_getenv ("TLM_SESSIOND_DIR"), TRUE);
+    /* no account or authentication plugins */
+    envp = g_environ_setenv (envp, "TLM_PLUGINS_DIR", switch_dir, TRUE);
+    argv[0] = g_build_filename (g_getenv ("TLM_BIN_DIR"), "tlm", NULL);
+    argv[1] = NULL;
+    g_spawn_async (NULL, argv, envp, G_SPAWN_DEFAULT, NULL, NULL,
+            &switch_daemon_pid, &error);
+    g_free (argv[0]);
+    g_strfreev (envp);
+    g_free (conf);
+    fail_if (error != NULL, "Failed to span daemon : %s",
+            error ? error->message : "");
+    sleep (5); /* 5 seconds */
+}
+
+static void
+_teardown_switch_daemon (void)
+{
+    gchar *command;
+
+    if (switch_daemon_pid) kill (switch_daemon_pid, SIGTERM);
+    if (!switch_dir) return;
+
+    command = g_strdup_printf ("rm -rf '%s'", switch_dir);
+    if (system (command) != 0)
+        g_warning ("failed to remove '%s'", switch_dir);
+    g_free (command);
+    g_free (switch_dir);
+    switch_dir = NULL;
+}
+
+static GVariant *
+_empty_environment (void)
+{
+    return g_variant_new_array (G_VARIANT_TYPE ("{ss}"), NULL, 0);
+}
+
+/* the prepared session has to be opened once the previous one is gone,
+ * and the switchUser request has to be answered with its session id */
+START_TEST (test_switch_user)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    GDBusConnection *connection = NULL;
+    TlmDbusLogin *login_object = NULL;
+    const gchar *username = g_get_user_name ();
+    gchar *login_sessionid = NULL;
+    gchar *switch_sessionid = NULL;
+
+    if (!switch_daemon_pid)
+        return;
+
+    connection = _get_root_socket_bus_connection (&error);
+    fail_if (connection == NULL, "failed to get bus connection : %s",
+            error ? error->message : "(null)");
+
+    login_object = _get_login_object (connection, &error);
+    fail_if (login_object == NULL, "failed to get login object: %s",
+            error ? error->message : "");
+
+    fail_unless (tlm_dbus_login_call_login_user_sync (login_object,
+            "seat0", username, "test", _empty_environment (),
+            &login_sessionid, NULL, &error),
+            "login failed: %s", error ? error->message : "");
+
+    fail_unless (tlm_dbus_login_call_switch_user_sync (login_object,
+            "seat0", username, "test", _empty_environment (),
+            &switch_sessionid, NULL, &error),
+            "switch user failed: %s", error ? error->message : "");
+    fail_if (g_strcmp0 (login_sessionid, switch_sessionid) == 0,
+            "no new session after switch user");
+
+    fail_unless (tlm_dbus_login_call_logout_user_sync (login_object,
+            "seat0", switch_sessionid, NULL, &error),
+            "logout failed: %s", error ? error->message : "");
+    fail_unless (kill (switch_daemon_pid, 0) == 0, "daemon is gone");
+
+    g_free (login_sessionid);
+    g_free (switch_sessionid);
+    g_object_unref (login_object);
+    g_object_unref (connection);
+}
+END_TEST
+
 Suite* daemon_suite (void)
 {
     TCase *tc = NULL;
@@ -286,6 +566,16 @@ Suite* daemon_suite (void)
     tcase_add_checked_fixture (tc, _create_mainloop, _stop_mainloop);
 
     tcase_add_test (tc, test_login_user);
+    tcase_add_test (tc, test_logout_without_session);
+    tcase_add_test (tc, test_overlapping_seat_requests);
+    suite_add_tcase (s, tc);
+
+    /* runs last, it leaves the test process in its own mount namespace */
+    tc = tcase_create ("Switch user");
+    tcase_set_timeout(tc, 30);
+    tcase_add_unchecked_fixture (tc, _setup_switch_daemon,
+            _teardown_switch_daemon);
+    tcase_add_test (tc, test_switch_user);
     suite_add_tcase (s, tc);
 
     return s;
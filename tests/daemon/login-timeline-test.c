@@ -0,0 +1,147 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+#include <check.h>
+#include <stdlib.h>
+#include <glib.h>
+
+#include "common/tlm-login-timeline.h"
+
+/* stamps of tlm-sessiond, with a phase name it does not know */
+static GVariant *
+_sessiond_stamps (void)
+{
+    GVariantBuilder builder;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sx}"));
+    g_variant_builder_add (&builder, "{sx}", "fork", (gint64) 9000);
+    g_variant_builder_add (&builder, "{sx}", "pam-start", (gint64) 3000);
+    g_variant_builder_add (&builder, "{sx}", "bogus", (gint64) 7);
+    g_variant_builder_add (&builder, "{sx}", "pam-authenticate",
+                           (gint64) 5000);
+    return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+START_TEST (test_merge)
+{
+    TlmLoginTimeline timeline;
+    GVariant *stamps, *merged;
+    GVariantIter iter;
+    const gchar *name;
+    gint64 stamp;
+    static const gchar *expected[] = {
+        "queued", "pam-start", "pam-authenticate", "fork"
+    };
+    guint i = 0;
+
+    tlm_login_timeline_reset (&timeline);
+    timeline.stamps[TLM_LOGIN_PHASE_QUEUED] = 1000;
+    timeline.stamps[TLM_LOGIN_PHASE_PAM_START] = 2000;
+
+    stamps = _sessiond_stamps ();
+    tlm_login_timeline_merge_variant (&timeline, stamps);
+    g_variant_unref (stamps);
+
+    fail_unless (timeline.stamps[TLM_LOGIN_PHASE_QUEUED] == 1000);
+    fail_unless (timeline.stamps[TLM_LOGIN_PHASE_PAM_START] == 3000,
+                 "stamp of tlm-sessiond not taken");
+    fail_unless (timeline.stamps[TLM_LOGIN_PHASE_PAM_AUTHENTICATE] == 5000);
+    fail_unless (timeline.stamps[TLM_LOGIN_PHASE_FORK] == 9000);
+    fail_unless (timeline.stamps[TLM_LOGIN_PHASE_EXEC] == 0);
+
+    /* the merged timeline is listed in phase order */
+    merged = g_variant_ref_sink (tlm_login_timeline_to_variant (&timeline));
+    g_variant_iter_init (&iter, merged);
+    while (g_variant_iter_next (&iter, "{&sx}", &name, &stamp)) {
+        fail_unless (i < G_N_ELEMENTS (expected), "extra phase %s", name);
+        fail_unless (g_strcmp0 (name, expected[i]) == 0,
+                     "phase %u is %s instead of %s", i, name, expected[i]);
+        i++;
+    }
+    fail_unless (i == G_N_ELEMENTS (expected));
+    g_variant_unref (merged);
+
+    /* anything but a{sx} is ignored */
+    stamps = g_variant_ref_sink (g_variant_new_int64 (1));
+    tlm_login_timeline_merge_variant (&timeline, stamps);
+    g_variant_unref (stamps);
+    fail_unless (timeline.stamps[TLM_LOGIN_PHASE_QUEUED] == 1000);
+}
+END_TEST
+
+START_TEST (test_to_string)
+{
+    TlmLoginTimeline timeline;
+    gchar *str;
+
+    tlm_login_timeline_reset (&timeline);
+    str = tlm_login_timeline_to_string (&timeline);
+    fail_unless (g_strcmp0 (str, "no phases: ") == 0, "got '%s'", str);
+    g_free (str);
+
+    timeline.stamps[TLM_LOGIN_PHASE_QUEUED] = 1000000;
+    /* spawned for the pool before the request */
+    timeline.stamps[TLM_LOGIN_PHASE_SESSIOND_SPAWNED] = 500000;
+    timeline.stamps[TLM_LOGIN_PHASE_PAM_START] = 1002000;
+    timeline.stamps[TLM_LOGIN_PHASE_PAM_AUTHENTICATE] = 1302000;
+    timeline.stamps[TLM_LOGIN_PHASE_EXEC] = 1312000;
+
+    str = tlm_login_timeline_to_string (&timeline);
+    fail_unless (g_strcmp0 (str,
+                "total 312.0 ms, slowest pam-authenticate 300.0 ms: "
+                "queued, sessiond-spawned pooled, pam-start 2.0 ms, "
+                "pam-authenticate 300.0 ms, exec 10.0 ms") == 0,
+                 "got '%s'", str);
+    g_free (str);
+}
+END_TEST
+
+Suite* login_timeline_suite (void)
+{
+    Suite *s = suite_create ("Login timeline");
+
+    TCase *tc = tcase_create ("Login timeline tests");
+    tcase_add_test (tc, test_merge);
+    tcase_add_test (tc, test_to_string);
+    suite_add_tcase (s, tc);
+
+    return s;
+}
+
+int main (void)
+{
+    int number_failed;
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+
+    Suite *s = login_timeline_suite ();
+    SRunner *sr = srunner_create (s);
+    srunner_run_all (sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed (sr);
+    srunner_free (sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
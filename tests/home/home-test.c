@@ -0,0 +1,430 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "tlm-home-cleanup.h"
+#include "tlm-home-pool.h"
+
+#define DEEP_TREE_DEPTH 200
+#define READY_PREFIX ".home.tlm-ready-"
+
+static gchar *tmp_dir = NULL;
+
+static void
+_create_tmp_dir (void)
+{
+    tmp_dir = g_dir_make_tmp ("tlm-home-test-XXXXXX", NULL);
+    fail_if (tmp_dir == NULL);
+}
+
+static void
+_remove_tmp_dir (void)
+{
+    gchar *command = g_strdup_printf ("rm -rf '%s'", tmp_dir);
+    if (system (command) != 0)
+        g_warning ("failed to remove '%s'", tmp_dir);
+    g_free (command);
+    g_free (tmp_dir);
+    tmp_dir = NULL;
+}
+
+static gchar *
+_path (const gchar *name)
+{
+    return g_build_filename (tmp_dir, name, NULL);
+}
+
+static void
+_mkdir (const gchar *name, mode_t mode)
+{
+    gchar *path = _path (name);
+    fail_if (g_mkdir (path, mode) != 0, "mkdir %s: %s", path,
+             strerror (errno));
+    g_free (path);
+}
+
+static void
+_write (const gchar *name)
+{
+    gchar *path = _path (name);
+    fail_if (!g_file_set_contents (path, name, -1, NULL));
+    g_free (path);
+}
+
+static void
+_symlink (const gchar *target, const gchar *name)
+{
+    gchar *path = _path (name);
+    fail_if (symlink (target, path) != 0);
+    g_free (path);
+}
+
+static gboolean
+_exists (const gchar *name)
+{
+    gchar *path = _path (name);
+    struct stat st;
+    gboolean res = lstat (path, &st) == 0;
+    g_free (path);
+    return res;
+}
+
+static guint
+_count_entries (const gchar *name, const gchar *prefix)
+{
+    gchar *path = _path (name);
+    GDir *dir = g_dir_open (path, 0, NULL);
+    const gchar *entry;
+    guint count = 0;
+
+    fail_if (dir == NULL);
+    while ((entry = g_dir_read_name (dir)) != NULL)
+        if (!prefix || g_str_has_prefix (entry, prefix)) count++;
+    g_dir_close (dir);
+    g_free (path);
+    return count;
+}
+
+static gchar *
+_find_entry (const gchar *prefix)
+{
+    GDir *dir = g_dir_open (tmp_dir, 0, NULL);
+    const gchar *entry;
+    gchar *found = NULL;
+
+    fail_if (dir == NULL);
+    while (!found && (entry = g_dir_read_name (dir)) != NULL)
+        if (g_str_has_prefix (entry, prefix)) found = g_strdup (entry);
+    g_dir_close (dir);
+    return found;
+}
+
+static void
+_drain_main_context (void)
+{
+    /* workers attach their completion right after renaming */
+    g_usleep (50000);
+    while (g_main_context_iteration (NULL, FALSE));
+}
+
+/* waits for @count ready homes, and @gone to be deleted if set */
+static void
+_wait_for_ready (guint count, const gchar *gone)
+{
+    gint i;
+
+    for (i = 0; i < 1000; i++) {
+        while (g_main_context_iteration (NULL, FALSE));
+        if (_count_entries (".", READY_PREFIX) == count &&
+            (!gone || !_exists (gone)))
+            break;
+        g_usleep (10000);
+    }
+    fail_unless (_count_entries (".", READY_PREFIX) == count);
+    _drain_main_context ();
+}
+
+static void
+_create_template (void)
+{
+    _mkdir ("template", 0755);
+    _write ("template/.bashrc");
+    _mkdir ("template/.config", 0755);
+    _mkdir ("template/.config/app", 0755);
+    _write ("template/.config/app/settings");
+    _mkdir ("template/private", 0750);
+    _symlink (".bashrc", "template/link");
+    _mkdir ("home", 0700);
+    _write ("home/junk");
+}
+
+START_TEST (test_delete_tree)
+{
+    gchar *path;
+
+    _mkdir ("outside", 0700);
+    _write ("outside/keep");
+    _mkdir ("tree", 0700);
+    _write ("tree/.dotfile");
+    _mkdir ("tree/.config", 0700);
+    _write ("tree/.config/settings");
+    _mkdir ("tree/a", 0700);
+    _mkdir ("tree/a/b", 0700);
+    _mkdir ("tree/a/b/c", 0500);
+    _mkdir ("tree/a/empty", 0700);
+    _write ("tree/a/b/file");
+    _symlink ("../outside", "tree/dirlink");
+    _symlink ("../../outside/keep", "tree/a/filelink");
+    path = _path ("outside");
+    _symlink (path, "tree/a/b/abslink");
+    g_free (path);
+
+    path = _path ("tree");
+    fail_unless (tlm_home_cleanup_delete_tree (path));
+    g_free (path);
+
+    fail_if (_exists ("tree"));
+    fail_unless (_exists ("outside/keep"));
+    fail_unless (_count_entries ("outside", NULL) == 1);
+}
+END_TEST
+
+START_TEST (test_delete_deep_tree)
+{
+    struct rlimit limit, low;
+    gchar *path;
+    gint fd, next, i;
+
+    path = _path ("deep");
+    fail_if (g_mkdir (path, 0700) != 0);
+    fd = open (path, O_RDONLY | O_DIRECTORY);
+    for (i = 0; i < DEEP_TREE_DEPTH; i++) {
+        fail_if (mkdirat (fd, "d", 0700) != 0);
+        next = openat (fd, "d", O_RDONLY | O_DIRECTORY);
+        if (i % 10 == 0)
+            close (openat (fd, ".f", O_WRONLY | O_CREAT, 0600));
+        close (fd);
+        fail_if (next < 0);
+        fd = next;
+    }
+    close (fd);
+
+    /* far fewer descriptors than levels */
+    fail_if (getrlimit (RLIMIT_NOFILE, &limit) != 0);
+    low = limit;
+    low.rlim_cur = 32;
+    fail_if (setrlimit (RLIMIT_NOFILE, &low) != 0);
+
+    fail_unless (tlm_home_cleanup_delete_tree (path));
+    fail_if (_exists ("deep"));
+
+    setrlimit (RLIMIT_NOFILE, &limit);
+    g_free (path);
+}
+END_TEST
+
+static void
+_cleanup_done (const gchar *home_dir, gboolean success, gpointer user_data)
+{
+    GMainLoop *loop = (GMainLoop *) user_data;
+
+    fail_unless (success);
+    g_main_loop_quit (loop);
+}
+
+START_TEST (test_cleanup_start)
+{
+    GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+    struct stat st;
+    gchar *path;
+
+    _mkdir ("home", 0751);
+    _write ("home/.profile");
+    _mkdir ("home/.cache", 0700);
+    _write ("home/.cache/blob");
+    _write ("home/document");
+
+    path = _path ("home");
+    fail_unless (tlm_home_cleanup_start (path, _cleanup_done, loop));
+
+    /* the home is usable right away */
+    fail_if (stat (path, &st) != 0);
+    fail_unless (S_ISDIR (st.st_mode));
+    fail_unless ((st.st_mode & 07777) == 0751);
+    fail_unless (st.st_uid == getuid ());
+    fail_unless (_count_entries ("home", NULL) == 0);
+
+    g_main_loop_run (loop);
+    fail_unless (_count_entries (".", ".home.") == 0);
+
+    g_free (path);
+    g_main_loop_unref (loop);
+}
+END_TEST
+
+START_TEST (test_pool_swap)
+{
+    GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+    TlmHomePool *pool;
+    gchar *template_dir, *home_dir, *path;
+    gchar target[64];
+    ssize_t len;
+    struct stat st;
+
+    _create_template ();
+    template_dir = _path ("template");
+    home_dir = _path ("home");
+
+    pool = tlm_home_pool_new (template_dir, 1);
+    fail_if (pool == NULL);
+    tlm_home_pool_prepare (pool, home_dir, getuid (), getgid ());
+    _wait_for_ready (1, NULL);
+
+    fail_unless (tlm_home_pool_swap (pool, home_dir, getuid (), getgid (),
+                                     _cleanup_done, loop));
+
+    /* the template is in place when swap returns */
+    fail_if (_exists ("home/junk"));
+    fail_unless (_exists ("home/.bashrc"));
+    fail_unless (_exists ("home/.config/app/settings"));
+    path = _path ("home/link");
+    len = readlink (path, target, sizeof (target) - 1);
+    fail_unless (len == strlen (".bashrc"));
+    target[len] = '\0';
+    fail_unless (g_strcmp0 (target, ".bashrc") == 0);
+    g_free (path);
+    path = _path ("home/private");
+    fail_if (stat (path, &st) != 0);
+    fail_unless ((st.st_mode & 07777) == 0750);
+    g_free (path);
+    path = _path ("home");
+    fail_if (stat (path, &st) != 0);
+    fail_unless ((st.st_mode & 07777) == 0700);
+    g_free (path);
+
+    g_main_loop_run (loop);
+
+    /* and refilled in the background */
+    _wait_for_ready (1, NULL);
+
+    tlm_home_pool_free (pool);
+    _drain_main_context ();
+    g_free (home_dir);
+    g_free (template_dir);
+    g_main_loop_unref (loop);
+}
+END_TEST
+
+START_TEST (test_pool_nothing_ready)
+{
+    GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+    TlmHomePool *pool;
+    gchar *template_dir, *home_dir;
+
+    _create_template ();
+    template_dir = _path ("template");
+    home_dir = _path ("home");
+
+    pool = tlm_home_pool_new (template_dir, 1);
+    fail_if (pool == NULL);
+
+    /* nothing is copied on the caller's thread, the home is emptied */
+    fail_unless (tlm_home_pool_swap (pool, home_dir, getuid (), getgid (),
+                                     _cleanup_done, loop));
+    fail_unless (_count_entries ("home", NULL) == 0);
+    g_main_loop_run (loop);
+
+    _wait_for_ready (1, NULL);
+    fail_unless (tlm_home_pool_swap (pool, home_dir, getuid (), getgid (),
+                                     _cleanup_done, loop));
+    fail_unless (_exists ("home/.bashrc"));
+    g_main_loop_run (loop);
+
+    tlm_home_pool_free (pool);
+    _drain_main_context ();
+    g_free (home_dir);
+    g_free (template_dir);
+    g_main_loop_unref (loop);
+}
+END_TEST
+
+START_TEST (test_pool_template_changed)
+{
+    GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+    TlmHomePool *pool;
+    gchar *template_dir, *home_dir, *stale;
+
+    _create_template ();
+    template_dir = _path ("template");
+    home_dir = _path ("home");
+
+    pool = tlm_home_pool_new (template_dir, 1);
+    fail_if (pool == NULL);
+    tlm_home_pool_prepare (pool, home_dir, getuid (), getgid ());
+    _wait_for_ready (1, NULL);
+    tlm_home_pool_free (pool);
+    _drain_main_context ();
+    stale = _find_entry (READY_PREFIX);
+    fail_if (stale == NULL);
+
+    _write ("template/new-file");
+
+    /* the home left by the previous pool is not swapped in */
+    pool = tlm_home_pool_new (template_dir, 1);
+    fail_if (pool == NULL);
+    fail_unless (tlm_home_pool_swap (pool, home_dir, getuid (), getgid (),
+                                     _cleanup_done, loop));
+    fail_unless (_count_entries ("home", NULL) == 0);
+    g_main_loop_run (loop);
+
+    _wait_for_ready (1, stale);
+    fail_unless (tlm_home_pool_swap (pool, home_dir, getuid (), getgid (),
+                                     _cleanup_done, loop));
+    fail_unless (_exists ("home/new-file"));
+    g_main_loop_run (loop);
+
+    tlm_home_pool_free (pool);
+    _drain_main_context ();
+    g_free (stale);
+    g_free (home_dir);
+    g_free (template_dir);
+    g_main_loop_unref (loop);
+}
+END_TEST
+
+int main (void)
+{
+    int number_failed;
+    SRunner *sr = NULL;
+    Suite *s = suite_create ("tlm home tests");
+    TCase *tc = tcase_create ("Home");
+
+    tcase_set_timeout (tc, 30);
+    tcase_add_checked_fixture (tc, _create_tmp_dir, _remove_tmp_dir);
+    tcase_add_test (tc, test_delete_tree);
+    tcase_add_test (tc, test_delete_deep_tree);
+    tcase_add_test (tc, test_cleanup_start);
+    tcase_add_test (tc, test_pool_swap);
+    tcase_add_test (tc, test_pool_nothing_ready);
+    tcase_add_test (tc, test_pool_template_changed);
+    suite_add_tcase (s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? 0 : -1;
+}
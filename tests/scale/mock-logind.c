@@ -0,0 +1,294 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Stand-in for systemd-logind, for tests on a private bus. Owns
+ * org.freedesktop.login1 and implements the part of the Manager interface
+ * tlm uses: ListSeats and the SeatNew and SeatRemoved signals. It starts
+ * with --seats seats, prints "ready" once it owns the name and runs the
+ * hotplug --script on SIGUSR1, printing the resulting seat count after the
+ * last step.
+ *
+ * The script is a comma separated list of steps:
+ *   add:N      add N seats
+ *   remove:N   remove the N most recently added seats
+ *   flap:N     add a seat and remove it again, N times
+ *   wait:MS    pause
+ *
+ * Seats are named seat0, seat1, ... in the order they are added. Runs
+ * until terminated. */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib-unix.h>
+#include <gio/gio.h>
+
+#define LOGIND_BUS_NAME         "org.freedesktop.login1"
+#define LOGIND_OBJECT_PATH      "/org/freedesktop/login1"
+#define LOGIND_MANAGER_IFACE    "org.freedesktop.login1.Manager"
+#define LOGIND_SEAT_PATH        LOGIND_OBJECT_PATH "/seat/"
+
+static const gchar introspection_xml[] =
+    "<node>"
+    "  <interface name='" LOGIND_MANAGER_IFACE "'>"
+    "    <method name='ListSeats'>"
+    "      <arg name='seats' type='a(so)' direction='out'/>"
+    "    </method>"
+    "    <signal name='SeatNew'>"
+    "      <arg name='seat_id' type='s'/>"
+    "      <arg name='object_path' type='o'/>"
+    "    </signal>"
+    "    <signal name='SeatRemoved'>"
+    "      <arg name='seat_id' type='s'/>"
+    "      <arg name='object_path' type='o'/>"
+    "    </signal>"
+    "  </interface>"
+    "</node>";
+
+static gint n_seats = 1;
+static gchar *script = NULL;
+
+static GOptionEntry entries[] = {
+    { "seats", 's', 0, G_OPTION_ARG_INT, &n_seats,
+      "Seats present at startup (default 1)", "N" },
+    { "script", 'c', 0, G_OPTION_ARG_STRING, &script,
+      "Hotplug steps run on SIGUSR1", "STEPS" },
+    { NULL }
+};
+
+typedef struct {
+    GDBusConnection *connection;
+    GMainLoop *loop;
+    guint next_seat;   /* index of the next seat to add */
+    guint n_present;   /* seats present, always the last ones added */
+    gchar **steps;
+    guint step;
+    guint flaps_left;
+} MockLogind;
+
+static void
+_emit (MockLogind *mock, const gchar *signal_name, guint index)
+{
+    gchar *id = g_strdup_printf ("seat%u", index);
+    gchar *path = g_strdup_printf (LOGIND_SEAT_PATH "seat%u", index);
+    GError *error = NULL;
+
+    if (!g_dbus_connection_emit_signal (mock->connection, NULL,
+                LOGIND_OBJECT_PATH, LOGIND_MANAGER_IFACE, signal_name,
+                g_variant_new ("(so)", id, path), &error)) {
+        g_printerr ("failed to emit %s: %s\n", signal_name, error->message);
+        g_error_free (error);
+    }
+    g_free (id);
+    g_free (path);
+}
+
+static void
+_add_seats (MockLogind *mock, guint count)
+{
+    while (count--) {
+        _emit (mock, "SeatNew", mock->next_seat++);
+        mock->n_present++;
+    }
+}
+
+static void
+_remove_seats (MockLogind *mock, guint count)
+{
+    while (count-- && mock->n_present) {
+        _emit (mock, "SeatRemoved", --mock->next_seat);
+        mock->n_present--;
+    }
+}
+
+static gboolean
+_run_script (gpointer user_data)
+{
+    MockLogind *mock = (MockLogind *) user_data;
+    const gchar *step;
+    guint value;
+
+    /* one flap per iteration, so tlm sees the signals interleaved with
+     * its own work instead of as one burst */
+    if (mock->flaps_left) {
+        _add_seats (mock, 1);
+        _remove_seats (mock, 1);
+        mock->flaps_left--;
+        return G_SOURCE_CONTINUE;
+    }
+
+    while (mock->steps && (step = mock->steps[mock->step])) {
+        const gchar *arg = strchr (step, ':');
+
+        mock->step++;
+        value = arg ? (guint) strtoul (arg + 1, NULL, 10) : 0;
+        if (g_str_has_prefix (step, "add:")) {
+            _add_seats (mock, value);
+        } else if (g_str_has_prefix (step, "remove:")) {
+            _remove_seats (mock, value);
+        } else if (g_str_has_prefix (step, "flap:")) {
+            mock->flaps_left = value;
+            g_idle_add (_run_script, mock);
+            return G_SOURCE_REMOVE;
+        } else if (g_str_has_prefix (step, "wait:")) {
+            g_timeout_add (value, _run_script, mock);
+            return G_SOURCE_REMOVE;
+        } else {
+            g_printerr ("unknown step '%s'\n", step);
+        }
+    }
+
+    g_dbus_connection_flush_sync (mock->connection, NULL, NULL);
+    printf ("seats %u\n", mock->n_present);
+    fflush (stdout);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_handle_method_call (GDBusConnection *connection,
+                     const gchar *sender,
+                     const gchar *object_path,
+                     const gchar *interface_name,
+                     const gchar *method_name,
+                     GVariant *parameters,
+                     GDBusMethodInvocation *invocation,
+                     gpointer user_data)
+{
+    MockLogind *mock = (MockLogind *) user_data;
+    GVariantBuilder builder;
+    guint i;
+
+    if (g_strcmp0 (method_name, "ListSeats") != 0) {
+        g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                G_DBUS_ERROR_UNKNOWN_METHOD, "%s is not mocked", method_name);
+        return;
+    }
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(so)"));
+    for (i = mock->next_seat - mock->n_present; i < mock->next_seat; i++) {
+        gchar *id = g_strdup_printf ("seat%u", i);
+        gchar *path = g_strdup_printf (LOGIND_SEAT_PATH "seat%u", i);
+
+        g_variant_builder_add (&builder, "(so)", id, path);
+        g_free (id);
+        g_free (path);
+    }
+    g_dbus_method_invocation_return_value (invocation,
+            g_variant_new ("(a(so))", &builder));
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+    _handle_method_call, NULL, NULL
+};
+
+static void
+_on_name_acquired (GDBusConnection *connection,
+                   const gchar *name,
+                   gpointer user_data)
+{
+    printf ("ready\n");
+    fflush (stdout);
+}
+
+static void
+_on_name_lost (GDBusConnection *connection,
+               const gchar *name,
+               gpointer user_data)
+{
+    MockLogind *mock = (MockLogind *) user_data;
+
+    g_printerr ("cannot own %s\n", name);
+    g_main_loop_quit (mock->loop);
+}
+
+static gboolean
+_on_sigusr1 (gpointer user_data)
+{
+    MockLogind *mock = (MockLogind *) user_data;
+
+    mock->step = mock->flaps_left = 0;
+    g_idle_add (_run_script, mock);
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+_on_sigterm (gpointer user_data)
+{
+    g_main_loop_quit (((MockLogind *) user_data)->loop);
+    return G_SOURCE_REMOVE;
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    GDBusNodeInfo *node_info;
+    MockLogind mock = { 0 };
+    guint owner_id;
+
+    context = g_option_context_new ("- logind stand-in for tests");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        fprintf (stderr, "%s\n", error->message);
+        g_error_free (error);
+        g_option_context_free (context);
+        return 1;
+    }
+    g_option_context_free (context);
+
+    mock.connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+    if (!mock.connection) {
+        fprintf (stderr, "cannot connect to the system bus: %s\n",
+                 error->message);
+        g_error_free (error);
+        return 1;
+    }
+
+    node_info = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+    g_dbus_connection_register_object (mock.connection, LOGIND_OBJECT_PATH,
+            node_info->interfaces[0], &interface_vtable, &mock, NULL, NULL);
+
+    mock.loop = g_main_loop_new (NULL, FALSE);
+    mock.next_seat = mock.n_present = n_seats > 0 ? n_seats : 0;
+    if (script)
+        mock.steps = g_strsplit (script, ",", -1);
+
+    owner_id = g_bus_own_name_on_connection (mock.connection,
+            LOGIND_BUS_NAME, G_BUS_NAME_OWNER_FLAGS_NONE, _on_name_acquired,
+            _on_name_lost, &mock, NULL);
+    g_unix_signal_add (SIGUSR1, _on_sigusr1, &mock);
+    g_unix_signal_add (SIGTERM, _on_sigterm, &mock);
+
+    g_main_loop_run (mock.loop);
+
+    g_bus_unown_name (owner_id);
+    g_main_loop_unref (mock.loop);
+    g_strfreev (mock.steps);
+    g_dbus_node_info_unref (node_info);
+    g_object_unref (mock.connection);
+    g_free (script);
+    return 0;
+}
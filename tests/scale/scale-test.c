@@ -0,0 +1,654 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Seat scale test. For every seat count it starts a private system bus,
+ * mock-logind with that many seats and tlm on top, and measures:
+ *   - startup: time from starting tlm until it holds all seats
+ *   - settle: time until tlm follows the mock's hotplug script
+ *   - RSS and open fds of tlm, per seat over a run without seats
+ * tlm is asked for its seat count through getMetrics on the root socket.
+ *
+ * Results are printed as JSON and compared against a baseline key file;
+ * a value more than --tolerance percent over its baseline fails the test.
+ * --update-baseline writes the measured values instead. Like tlm-bench it
+ * runs as root or in an unprivileged user namespace. */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "common/dbus/tlm-dbus.h"
+#include "common/dbus/tlm-dbus-login-gen.h"
+#include "common/tlm-utils.h"
+
+#define SCALE_TIMEOUT       60 /* seconds for tlm to reach a seat count */
+#define SCALE_POLL          10 /* ms between getMetrics calls */
+#define SCALE_SETTLED       10 /* equal polls for the seat count to settle */
+#define SCALE_MIN_DELTA_MS  20 /* timing noise ignored by the comparison */
+
+static gchar *counts = NULL;
+static gchar *script = NULL;
+static gchar *daemon_path = NULL;
+static gchar *mock_path = NULL;
+static gchar *bus_daemon = NULL;
+static gchar *baseline = NULL;
+static gboolean update_baseline = FALSE;
+static gint tolerance = 25;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+    { "counts", 'c', 0, G_OPTION_ARG_STRING, &counts,
+      "Comma separated seat counts (default 1,10,100,500,1000)", "LIST" },
+    { "script", 's', 0, G_OPTION_ARG_STRING, &script,
+      "mock-logind hotplug script (default flap:100,add:10,remove:10)",
+      "STEPS" },
+    { "daemon", 'd', 0, G_OPTION_ARG_FILENAME, &daemon_path,
+      "tlm executable", "PATH" },
+    { "mock", 'm', 0, G_OPTION_ARG_FILENAME, &mock_path,
+      "mock-logind executable", "PATH" },
+    { "dbus-daemon", 'b', 0, G_OPTION_ARG_FILENAME, &bus_daemon,
+      "dbus-daemon executable (default from PATH)", "PATH" },
+    { "baseline", 'B', 0, G_OPTION_ARG_FILENAME, &baseline,
+      "Baseline key file", "PATH" },
+    { "update-baseline", 'u', 0, G_OPTION_ARG_NONE, &update_baseline,
+      "Write the results to the baseline instead of comparing", NULL },
+    { "tolerance", 't', 0, G_OPTION_ARG_INT, &tolerance,
+      "Allowed regression over the baseline (default 25)", "PERCENT" },
+    { "output", 'f', 0, G_OPTION_ARG_FILENAME, &output,
+      "Write the results to a file instead of stdout", "PATH" },
+    { NULL }
+};
+
+typedef struct {
+    guint seats;
+    gint64 startup_ms;
+    gint64 settle_ms;
+    gint64 rss_kb;
+    gint64 fds;
+    gdouble rss_per_seat_kb;
+    gdouble fds_per_seat;
+} ScaleResult;
+
+typedef struct {
+    GPid pid;
+    FILE *out; /* stdout of the process, or NULL */
+} ScaleChild;
+
+static gchar *work_dir = NULL;
+static gchar *bus_address = NULL;
+
+static gboolean
+_write_proc (const gchar *path, const gchar *contents)
+{
+    gssize len = strlen (contents);
+    int fd = open (path, O_WRONLY | O_CLOEXEC);
+    gboolean ret;
+
+    if (fd < 0)
+        return FALSE;
+    ret = write (fd, contents, len) == len;
+    close (fd);
+    return ret;
+}
+
+/* gives tlm a socket directory of its own */
+static gboolean
+_enter_namespace (void)
+{
+    uid_t uid = getuid ();
+    gid_t gid = getgid ();
+    gchar *map, *run_dir;
+    gboolean ret = TRUE;
+
+    if (unshare (CLONE_NEWNS | (uid ? CLONE_NEWUSER : 0)) < 0) {
+        fprintf (stderr, "unshare: %s\n", strerror (errno));
+        return FALSE;
+    }
+
+    if (uid) {
+        map = g_strdup_printf ("0 %u 1", uid);
+        ret = _write_proc ("/proc/self/uid_map", map);
+        g_free (map);
+        map = g_strdup_printf ("0 %u 1", gid);
+        ret = ret && _write_proc ("/proc/self/setgroups", "deny") &&
+            _write_proc ("/proc/self/gid_map", map);
+        g_free (map);
+        if (!ret) {
+            fprintf (stderr, "failed to map ids: %s\n", strerror (errno));
+            return FALSE;
+        }
+    }
+
+    run_dir = g_path_get_dirname (TLM_DBUS_SOCKET_PATH);
+    if (mount (NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) < 0 ||
+        mount ("tmpfs", run_dir, "tmpfs", 0, "mode=0755") < 0) {
+        fprintf (stderr, "mount: %s\n", strerror (errno));
+        ret = FALSE;
+    }
+    g_free (run_dir);
+
+    return ret;
+}
+
+static gboolean
+_write_setup (void)
+{
+    gchar *path, *contents;
+    gboolean ret;
+
+    /* a system bus that lets everyone own and call anything */
+    contents = g_strdup_printf (
+            "<busconfig>\n"
+            "  <type>system</type>\n"
+            "  <listen>unix:path=%s/system_bus_socket</listen>\n"
+            "  <auth>EXTERNAL</auth>\n"
+            "  <policy context=\"default\">\n"
+            "    <allow user=\"*\"/>\n"
+            "    <allow own=\"*\"/>\n"
+            "    <allow send_destination=\"*\"/>\n"
+            "    <allow receive_sender=\"*\"/>\n"
+            "  </policy>\n"
+            "</busconfig>\n", work_dir);
+    path = g_build_filename (work_dir, "bus.conf", NULL);
+    ret = g_file_set_contents (path, contents, -1, NULL);
+    g_free (path);
+    g_free (contents);
+    if (!ret)
+        return FALSE;
+    bus_address = g_strdup_printf ("unix:path=%s/system_bus_socket",
+                                   work_dir);
+
+    path = g_build_filename (work_dir, "tlm.conf", NULL);
+    ret = g_file_set_contents (path,
+            "[General]\n"
+            "AUTO_LOGIN=0\n"
+            "PREPARE_DEFAULT=0\n", -1, NULL);
+    g_free (path);
+
+    return ret;
+}
+
+static gboolean
+_spawn (gchar **argv, gboolean with_output, ScaleChild *child)
+{
+    gchar **envp = g_get_environ ();
+    gchar *conf = g_build_filename (work_dir, "tlm.conf", NULL);
+    GError *error = NULL;
+    gint out_fd = -1;
+    gboolean ret;
+
+    envp = g_environ_setenv (envp, "DBUS_SYSTEM_BUS_ADDRESS", bus_address,
+                             TRUE);
+    envp = g_environ_setenv (envp, "TLM_CONF_FILE", conf, TRUE);
+    envp = g_environ_setenv (envp, "TLM_PLUGINS_DIR", work_dir, TRUE);
+    ret = g_spawn_async_with_pipes (NULL, argv, envp,
+            G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH, NULL, NULL,
+            &child->pid, NULL, with_output ? &out_fd : NULL, NULL, &error);
+    if (!ret) {
+        fprintf (stderr, "failed to start %s: %s\n", argv[0],
+                 error->message);
+        g_error_free (error);
+    }
+    child->out = out_fd >= 0 ? fdopen (out_fd, "r") : NULL;
+    g_strfreev (envp);
+    g_free (conf);
+
+    return ret;
+}
+
+static void
+_stop (ScaleChild *child)
+{
+    gint i;
+
+    if (!child->pid)
+        return;
+    kill (child->pid, SIGTERM);
+    for (i = 0; i < 100; i++) {
+        if (waitpid (child->pid, NULL, WNOHANG) == child->pid)
+            break;
+        g_usleep (G_USEC_PER_SEC / 10);
+    }
+    if (i == 100) {
+        kill (child->pid, SIGKILL);
+        waitpid (child->pid, NULL, 0);
+    }
+    if (child->out)
+        fclose (child->out);
+    child->pid = 0;
+    child->out = NULL;
+}
+
+/* waits for a line starting with prefix, returns the rest of it */
+static gchar *
+_read_line (ScaleChild *child, const gchar *prefix)
+{
+    gchar line[256];
+
+    while (child->out && fgets (line, sizeof (line), child->out)) {
+        if (g_str_has_prefix (line, prefix))
+            return g_strstrip (g_strdup (line + strlen (prefix)));
+    }
+    return NULL;
+}
+
+static gboolean
+_wait_for_bus (void)
+{
+    GDBusConnection *connection;
+    gint i;
+
+    for (i = 0; i < SCALE_TIMEOUT * 1000 / SCALE_POLL; i++) {
+        connection = g_dbus_connection_new_for_address_sync (bus_address,
+                G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION, NULL, NULL,
+                NULL);
+        if (connection) {
+            g_object_unref (connection);
+            return TRUE;
+        }
+        g_usleep (SCALE_POLL * 1000);
+    }
+    fprintf (stderr, "private bus did not come up\n");
+    return FALSE;
+}
+
+static TlmDbusLogin *
+_connect_tlm (GPid pid)
+{
+    GDBusConnection *connection = NULL;
+    TlmDbusLogin *login_object = NULL;
+    gint i;
+
+    for (i = 0; i < SCALE_TIMEOUT * 1000 / SCALE_POLL && !connection; i++) {
+        if (waitpid (pid, NULL, WNOHANG) == pid) {
+            fprintf (stderr, "tlm exited during startup\n");
+            return NULL;
+        }
+        connection = g_dbus_connection_new_for_address_sync (
+                TLM_DBUS_ROOT_SOCKET_ADDRESS,
+                G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, NULL, NULL,
+                NULL);
+        if (!connection)
+            g_usleep (SCALE_POLL * 1000);
+    }
+    if (!connection) {
+        fprintf (stderr, "cannot connect to tlm\n");
+        return NULL;
+    }
+
+    login_object = tlm_dbus_login_proxy_new_sync (connection,
+            G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
+            TLM_LOGIN_OBJECTPATH, NULL, NULL);
+    g_object_unref (connection);
+
+    return login_object;
+}
+
+static gint64
+_get_seats (TlmDbusLogin *login_object)
+{
+    gchar *metrics = NULL, *line;
+    gint64 seats = -1;
+
+    if (!tlm_dbus_login_call_get_metrics_sync (login_object, &metrics, NULL,
+                NULL))
+        return -1;
+
+    /* the gauge is only there once a seat was created */
+    seats = 0;
+    line = strstr (metrics, "\ntlm_seats ");
+    if (line)
+        seats = g_ascii_strtoll (line + strlen ("\ntlm_seats "), NULL, 10);
+    g_free (metrics);
+
+    return seats;
+}
+
+/* returns the time in ms when tlm first held the expected seats and kept
+ * holding them for SCALE_SETTLED polls, or -1 */
+static gint64
+_wait_for_seats (TlmDbusLogin *login_object, gint64 expected, gint64 start)
+{
+    gint64 deadline = start + SCALE_TIMEOUT * G_USEC_PER_SEC;
+    gint64 reached = 0;
+    guint stable = 0;
+
+    while (g_get_monotonic_time () < deadline) {
+        gint64 seats = _get_seats (login_object);
+
+        if (seats < 0)
+            return -1;
+        if (seats == expected) {
+            if (!reached)
+                reached = g_get_monotonic_time ();
+            if (++stable >= SCALE_SETTLED)
+                return (reached - start) / 1000;
+        } else {
+            reached = 0;
+            stable = 0;
+        }
+        g_usleep (SCALE_POLL * 1000);
+    }
+    fprintf (stderr, "tlm did not reach %" G_GINT64_FORMAT " seats\n",
+             expected);
+    return -1;
+}
+
+static void
+_sample_process (GPid pid, ScaleResult *result)
+{
+    gchar *path, *status = NULL, *line;
+    GDir *dir;
+
+    path = g_strdup_printf ("/proc/%d/status", pid);
+    if (g_file_get_contents (path, &status, NULL, NULL) &&
+        (line = strstr (status, "VmRSS:")))
+        result->rss_kb = g_ascii_strtoll (line + strlen ("VmRSS:"), NULL, 10);
+    g_free (status);
+    g_free (path);
+
+    path = g_strdup_printf ("/proc/%d/fd", pid);
+    dir = g_dir_open (path, 0, NULL);
+    if (dir) {
+        while (g_dir_read_name (dir))
+            result->fds++;
+        g_dir_close (dir);
+    }
+    g_free (path);
+}
+
+static gboolean
+_run (guint seats, ScaleResult *result)
+{
+    ScaleChild bus = { 0 }, mock = { 0 }, tlm = { 0 };
+    gchar *config = g_build_filename (work_dir, "bus.conf", NULL);
+    gchar *config_arg = g_strconcat ("--config-file=", config, NULL);
+    gchar *seats_arg = g_strdup_printf ("--seats=%u", seats);
+    gchar *script_arg = g_strconcat ("--script=", script, NULL);
+    gchar *bus_argv[] = { bus_daemon, config_arg, "--nofork", NULL };
+    gchar *mock_argv[] = { mock_path, seats_arg, script_arg, NULL };
+    gchar *tlm_argv[] = { daemon_path, NULL };
+    TlmDbusLogin *login_object = NULL;
+    gchar *ready = NULL, *final_seats = NULL;
+    gint64 start;
+    gboolean ret = FALSE;
+
+    memset (result, 0, sizeof (*result));
+    result->seats = seats;
+
+    if (!_spawn (bus_argv, FALSE, &bus) || !_wait_for_bus ())
+        goto _out;
+    if (!_spawn (mock_argv, TRUE, &mock) ||
+        !(ready = _read_line (&mock, "ready"))) {
+        fprintf (stderr, "mock-logind did not start\n");
+        goto _out;
+    }
+
+    start = g_get_monotonic_time ();
+    if (!_spawn (tlm_argv, FALSE, &tlm) ||
+        !(login_object = _connect_tlm (tlm.pid)))
+        goto _out;
+    result->startup_ms = _wait_for_seats (login_object, seats, start);
+    if (result->startup_ms < 0)
+        goto _out;
+    _sample_process (tlm.pid, result);
+
+    if (seats) {
+        start = g_get_monotonic_time ();
+        kill (mock.pid, SIGUSR1);
+        final_seats = _read_line (&mock, "seats ");
+        if (!final_seats) {
+            fprintf (stderr, "mock-logind did not finish its script\n");
+            goto _out;
+        }
+        result->settle_ms = _wait_for_seats (login_object,
+                g_ascii_strtoll (final_seats, NULL, 10), start);
+        if (result->settle_ms < 0)
+            goto _out;
+    }
+    ret = TRUE;
+
+_out:
+    g_clear_object (&login_object);
+    _stop (&tlm);
+    _stop (&mock);
+    _stop (&bus);
+    g_unlink (g_strrstr (bus_address, "=") + 1);
+    g_free (ready);
+    g_free (final_seats);
+    g_free (config);
+    g_free (config_arg);
+    g_free (seats_arg);
+    g_free (script_arg);
+
+    return ret;
+}
+
+typedef struct {
+    const gchar *key;
+    gsize offset;
+    gboolean is_time;
+} ScaleValue;
+
+static const ScaleValue values[] = {
+    { "startup_ms", G_STRUCT_OFFSET (ScaleResult, startup_ms), TRUE },
+    { "settle_ms", G_STRUCT_OFFSET (ScaleResult, settle_ms), TRUE },
+    { "rss_per_seat_kb", G_STRUCT_OFFSET (ScaleResult, rss_per_seat_kb),
+      FALSE },
+    { "fds_per_seat", G_STRUCT_OFFSET (ScaleResult, fds_per_seat), FALSE },
+};
+
+static gdouble
+_get_value (const ScaleResult *result, const ScaleValue *value)
+{
+    if (value->is_time)
+        return G_STRUCT_MEMBER (gint64, result, value->offset);
+    return G_STRUCT_MEMBER (gdouble, result, value->offset);
+}
+
+static gboolean
+_compare (GKeyFile *key_file, const ScaleResult *result)
+{
+    gchar *group = g_strdup_printf ("seats-%u", result->seats);
+    gboolean pass = TRUE;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (values); i++) {
+        gdouble measured = _get_value (result, &values[i]);
+        gdouble expected, limit;
+        GError *error = NULL;
+
+        expected = g_key_file_get_double (key_file, group, values[i].key,
+                                          &error);
+        if (error) {
+            g_error_free (error);
+            continue;
+        }
+        limit = expected * (100 + tolerance) / 100;
+        if (values[i].is_time && limit < expected + SCALE_MIN_DELTA_MS)
+            limit = expected + SCALE_MIN_DELTA_MS;
+        if (measured > limit) {
+            fprintf (stderr, "%u seats: %s %.2f regressed over baseline "
+                     "%.2f\n", result->seats, values[i].key, measured,
+                     expected);
+            pass = FALSE;
+        }
+    }
+    g_free (group);
+
+    return pass;
+}
+
+static void
+_store (GKeyFile *key_file, const ScaleResult *result)
+{
+    gchar *group = g_strdup_printf ("seats-%u", result->seats);
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (values); i++)
+        g_key_file_set_double (key_file, group, values[i].key,
+                               _get_value (result, &values[i]));
+    g_free (group);
+}
+
+static void
+_report (FILE *out, GArray *results)
+{
+    guint i;
+
+    fprintf (out, "{\n  \"script\": \"%s\",\n  \"runs\": [", script);
+    for (i = 0; i < results->len; i++) {
+        ScaleResult *r = &g_array_index (results, ScaleResult, i);
+
+        fprintf (out, "%s\n    { \"seats\": %u, \"startup_ms\": %"
+                 G_GINT64_FORMAT ", \"settle_ms\": %" G_GINT64_FORMAT
+                 ", \"rss_kb\": %" G_GINT64_FORMAT ", \"fds\": %"
+                 G_GINT64_FORMAT ", \"rss_per_seat_kb\": %.2f"
+                 ", \"fds_per_seat\": %.2f }",
+                 i ? "," : "", r->seats, r->startup_ms, r->settle_ms,
+                 r->rss_kb, r->fds, r->rss_per_seat_kb, r->fds_per_seat);
+    }
+    fprintf (out, "\n  ]\n}\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    GArray *results;
+    GKeyFile *key_file;
+    ScaleResult reference;
+    gchar work_template[] = "/tmp/tlm-scale-XXXXXX";
+    gchar **count_list = NULL;
+    FILE *out = stdout;
+    gboolean pass = TRUE;
+    guint i;
+    int ret = 1;
+
+    context = g_option_context_new ("- tlm seat scale test");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        fprintf (stderr, "%s\n", error->message);
+        g_error_free (error);
+        g_option_context_free (context);
+        return 1;
+    }
+    g_option_context_free (context);
+
+    if (!daemon_path || !mock_path) {
+        fprintf (stderr, "--daemon and --mock are required\n");
+        return 1;
+    }
+    if (!counts)
+        counts = g_strdup ("1,10,100,500,1000");
+    if (!script)
+        script = g_strdup ("flap:100,add:10,remove:10");
+    if (!bus_daemon)
+        bus_daemon = g_strdup ("dbus-daemon");
+
+    if (!(work_dir = g_mkdtemp (work_template))) {
+        fprintf (stderr, "mkdtemp: %s\n", strerror (errno));
+        return 1;
+    }
+    if (!_write_setup () || !_enter_namespace ())
+        goto _cleanup;
+
+    /* what tlm costs without seats, subtracted from every run */
+    if (!_run (0, &reference))
+        goto _cleanup;
+
+    results = g_array_new (FALSE, FALSE, sizeof (ScaleResult));
+    count_list = g_strsplit (counts, ",", -1);
+    for (i = 0; count_list[i]; i++) {
+        ScaleResult result;
+        guint seats = (guint) strtoul (count_list[i], NULL, 10);
+
+        if (!seats)
+            continue;
+        if (!_run (seats, &result)) {
+            fprintf (stderr, "run with %u seats failed\n", seats);
+            pass = FALSE;
+            continue;
+        }
+        result.rss_per_seat_kb =
+            (gdouble) (result.rss_kb - reference.rss_kb) / seats;
+        result.fds_per_seat = (gdouble) (result.fds - reference.fds) / seats;
+        g_array_append_val (results, result);
+    }
+
+    if (output && !(out = fopen (output, "w"))) {
+        fprintf (stderr, "cannot open %s: %s\n", output, strerror (errno));
+        out = stdout;
+    }
+    _report (out, results);
+    if (out != stdout)
+        fclose (out);
+
+    key_file = g_key_file_new ();
+    if (update_baseline && baseline) {
+        for (i = 0; i < results->len; i++)
+            _store (key_file, &g_array_index (results, ScaleResult, i));
+        gchar *data = g_key_file_to_data (key_file, NULL, NULL);
+
+        if (!g_file_set_contents (baseline, data, -1, &error)) {
+            fprintf (stderr, "cannot write %s: %s\n", baseline,
+                     error->message);
+            g_clear_error (&error);
+            pass = FALSE;
+        }
+        g_free (data);
+    } else if (baseline &&
+               g_key_file_load_from_file (key_file, baseline,
+                                          G_KEY_FILE_NONE, NULL)) {
+        for (i = 0; i < results->len; i++)
+            pass &= _compare (key_file,
+                              &g_array_index (results, ScaleResult, i));
+    } else if (baseline) {
+        fprintf (stderr, "no baseline at %s, nothing compared\n", baseline);
+    }
+    g_key_file_free (key_file);
+    g_array_free (results, TRUE);
+    g_strfreev (count_list);
+    ret = pass ? 0 : 1;
+
+_cleanup:
+    tlm_utils_delete_dir (work_dir);
+    g_free (bus_address);
+    g_free (counts);
+    g_free (script);
+    g_free (bus_daemon);
+    return ret;
+}
@@ -0,0 +1,255 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#define TEST_CONFIG \
+    "[General]\n" \
+    "NSEATS=1\n" \
+    "\n" \
+    "[seat0]\n" \
+    "SESSION_CMD=weston\n"
+
+static gchar *tmp_dir = NULL;
+static gchar *config_path = NULL;
+
+static void
+_setup (void)
+{
+    tmp_dir = g_dir_make_tmp ("tlm-seatconf-test-XXXXXX", NULL);
+    fail_if (tmp_dir == NULL);
+    config_path = g_build_filename (tmp_dir, "tlm.conf", NULL);
+    fail_if (!g_file_set_contents (config_path, TEST_CONFIG, -1, NULL));
+}
+
+static void
+_teardown (void)
+{
+    gchar *command;
+
+    g_chmod (tmp_dir, 0700);
+    command = g_strdup_printf ("rm -rf '%s'", tmp_dir);
+    if (system (command) != 0)
+        g_warning ("failed to remove '%s'", tmp_dir);
+    g_free (command);
+    g_free (config_path);
+    config_path = NULL;
+    g_free (tmp_dir);
+    tmp_dir = NULL;
+}
+
+/* runs tlm-seatconf in batch mode on the given lines, returns its exit
+ * status and stdout */
+static gint
+_run_batch (const gchar *lines, gchar **out)
+{
+    gchar *batch_path = g_build_filename (tmp_dir, "batch", NULL);
+    gchar *seatconf = g_build_filename (g_getenv ("TLM_BIN_DIR"),
+                                        "tlm-seatconf", NULL);
+    gchar *argv[] = { seatconf, "-c", config_path, "-b", batch_path, NULL };
+    GError *error = NULL;
+    gint status = -1;
+
+    fail_if (!g_file_set_contents (batch_path, lines, -1, NULL));
+    fail_if (!g_spawn_sync (NULL, argv, NULL, G_SPAWN_STDERR_TO_DEV_NULL,
+                            NULL, NULL, out, NULL, &status, &error),
+             "failed to run %s: %s", seatconf, error ? error->message : "");
+
+    g_free (seatconf);
+    g_free (batch_path);
+    return status;
+}
+
+static gboolean
+_succeeded (gint status)
+{
+    return WIFEXITED (status) && WEXITSTATUS (status) == 0;
+}
+
+static gchar *
+_read_config (void)
+{
+    gchar *contents = NULL;
+
+    fail_if (!g_file_get_contents (config_path, &contents, NULL, NULL));
+    return contents;
+}
+
+static GKeyFile *
+_load_config (void)
+{
+    GKeyFile *kf = g_key_file_new ();
+
+    fail_if (!g_key_file_load_from_file (kf, config_path, 0, NULL));
+    return kf;
+}
+
+START_TEST (test_batch_apply)
+{
+    GKeyFile *kf;
+    gchar *out = NULL;
+    gchar *value;
+    gint status;
+
+    status = _run_batch ("# comment\n"
+                         "\n"
+                         "add 'weston --tty=2'\n"
+                         "-s seat0 -a 1 -u guest change\n"
+                         "-u other add\n", &out);
+    fail_unless (_succeeded (status), "tlm-seatconf failed");
+    fail_unless (g_strcmp0 (out, "3: ok seat1\n"
+                                 "4: ok seat0\n"
+                                 "5: ok seat2\n") == 0,
+                 "unexpected output: %s", out);
+
+    kf = _load_config ();
+    fail_unless (g_key_file_get_integer (kf, "General", "NSEATS", NULL) == 3);
+    value = g_key_file_get_string (kf, "seat1", "SESSION_CMD", NULL);
+    fail_unless (g_strcmp0 (value, "weston --tty=2") == 0);
+    g_free (value);
+    value = g_key_file_get_string (kf, "seat0", "DEFAULT_USER", NULL);
+    fail_unless (g_strcmp0 (value, "guest") == 0);
+    g_free (value);
+    fail_unless (g_key_file_get_integer (kf, "seat0", "AUTO_LOGIN", NULL) == 1);
+    value = g_key_file_get_string (kf, "seat2", "DEFAULT_USER", NULL);
+    fail_unless (g_strcmp0 (value, "other") == 0);
+    g_free (value);
+    g_key_file_free (kf);
+    g_free (out);
+}
+END_TEST
+
+START_TEST (test_batch_remove)
+{
+    GKeyFile *kf;
+    gchar *out = NULL;
+
+    fail_unless (_succeeded (_run_batch ("-s seat0 remove\n", &out)));
+    fail_unless (g_strcmp0 (out, "1: ok seat0\n") == 0,
+                 "unexpected output: %s", out);
+
+    kf = _load_config ();
+    fail_if (g_key_file_has_key (kf, "seat0", "SESSION_CMD", NULL));
+    fail_unless (g_key_file_get_integer (kf, "seat0", "AUTO_LOGIN", NULL) == 0);
+    fail_unless (g_key_file_get_integer (kf, "seat0", "PAUSE_SESSION",
+                                         NULL) == 1);
+    g_key_file_free (kf);
+    g_free (out);
+}
+END_TEST
+
+START_TEST (test_batch_parse_error)
+{
+    gchar *out = NULL;
+    gchar *contents;
+
+    fail_if (_succeeded (_run_batch ("add weston\n"
+                                     "-a notanumber change\n"
+                                     "add 'unterminated\n", &out)));
+    fail_if (strstr (out, ": ok") != NULL, "unexpected output: %s", out);
+    fail_unless (strstr (out, "2: failed") != NULL,
+                 "unexpected output: %s", out);
+    fail_unless (strstr (out, "3: failed") != NULL,
+                 "unexpected output: %s", out);
+
+    contents = _read_config ();
+    fail_unless (g_strcmp0 (contents, TEST_CONFIG) == 0);
+    g_free (contents);
+    g_free (out);
+}
+END_TEST
+
+START_TEST (test_batch_apply_error)
+{
+    gchar *out = NULL;
+    gchar *contents;
+
+    fail_if (_succeeded (_run_batch ("add weston\n"
+                                     "-s seat7 change\n"
+                                     "change\n"
+                                     "rename\n", &out)));
+    fail_unless (g_strcmp0 (out, "2: failed: given seat doesn't exist: seat7\n"
+                                 "3: failed: no seat specified\n"
+                                 "4: failed: unknown command: rename\n") == 0,
+                 "unexpected output: %s", out);
+
+    contents = _read_config ();
+    fail_unless (g_strcmp0 (contents, TEST_CONFIG) == 0);
+    g_free (contents);
+    g_free (out);
+}
+END_TEST
+
+START_TEST (test_batch_save_error)
+{
+    gchar *out = NULL;
+    gchar *contents;
+
+    /* the directory permissions do not stop root from writing */
+    if (geteuid () == 0)
+        return;
+
+    fail_if (g_chmod (tmp_dir, 0500) != 0, "chmod: %s", strerror (errno));
+    fail_if (_succeeded (_run_batch ("add weston\n", &out)));
+    fail_if (strstr (out, ": ok") != NULL, "unexpected output: %s", out);
+    g_chmod (tmp_dir, 0700);
+
+    contents = _read_config ();
+    fail_unless (g_strcmp0 (contents, TEST_CONFIG) == 0);
+    g_free (contents);
+    g_free (out);
+}
+END_TEST
+
+int main (void)
+{
+    int number_failed;
+    SRunner *sr = NULL;
+    Suite *s = suite_create ("tlm seatconf tests");
+    TCase *tc = tcase_create ("Seatconf");
+
+    tcase_add_checked_fixture (tc, _setup, _teardown);
+    tcase_add_test (tc, test_batch_apply);
+    tcase_add_test (tc, test_batch_remove);
+    tcase_add_test (tc, test_batch_parse_error);
+    tcase_add_test (tc, test_batch_apply_error);
+    tcase_add_test (tc, test_batch_save_error);
+    suite_add_tcase (s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? 0 : -1;
+}